@@ -60,9 +60,10 @@ let package = Package(
         .target(name: "SubstrateCExtras", dependencies: vulkanDependencies, exclude: ["CMakeLists.txt"]),
         .target(name: "Substrate",
                 dependencies: ["SubstrateUtilities", "SubstrateCExtras", .product(name: "Atomics", package: "swift-atomics"), .product(name: "SPIRV-Cross", package: "SPIRV-Cross"), .product(name: "OrderedCollections", package: "swift-collections")] + vulkanDependencies,
-                path: "Sources/Substrate", exclude: ["CMakeLists.txt", "MetalBackend/CMakeLists.txt", "VulkanBackend/CMakeLists.txt"]),
+                path: "Sources/Substrate", exclude: ["CMakeLists.txt", "MetalBackend/CMakeLists.txt", "VulkanBackend/CMakeLists.txt", "HeadlessBackend/CMakeLists.txt"]),
         .target(name: "SubstrateUtilities", dependencies: [.product(name: "Atomics", package: "swift-atomics")], exclude: ["CMakeLists.txt"]),
         .testTarget(name: "SubstrateUtilitiesTests", dependencies: ["SubstrateUtilities"]),
+        .testTarget(name: "SubstrateTests", dependencies: ["Substrate", "SubstrateUtilities"]),
         
         // ShaderTool
         .target(name: "SPIRVCrossExtras",
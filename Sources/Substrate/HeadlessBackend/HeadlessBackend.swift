@@ -0,0 +1,529 @@
+//
+//  HeadlessBackend.swift
+//  Substrate
+//
+
+import SubstrateUtilities
+import Foundation
+
+struct HeadlessFence {
+    /// The index of the command encoder that signals the fence.
+    let index: Int
+}
+
+enum HeadlessCompactedResourceCommandType {
+    case memoryBarrier(resources: UnsafeMutableBufferPointer<Resource>, afterStages: RenderStages, beforeStages: RenderStages)
+    case useResources(UnsafeMutableBufferPointer<Resource>, usage: ResourceUsageType, stages: RenderStages)
+    case updateFence(HeadlessFence, afterStages: RenderStages)
+    case waitForFence(HeadlessFence, beforeStages: RenderStages)
+}
+
+struct HeadlessUseResourceKey: Hashable {
+    var usage: ResourceUsageType
+    var stages: RenderStages
+}
+
+/// A render backend that runs all of the CPU-side work of a RenderGraph (pass culling, dependency
+/// resolution, resource command generation, transient allocation and argument buffer encoding) but,
+/// rather than submitting to a GPU, records the backend commands it generates into memory.
+/// Command buffers complete asynchronously: each queue completes its committed command buffers in submission order
+/// on its own serial dispatch queue, so completion handlers never run on the committing thread.
+final class HeadlessBackend : SpecificRenderBackend {
+    typealias BufferReference = HeadlessBufferReference
+    typealias TextureReference = HeadlessTextureReference
+    typealias ArgumentBufferReference = HeadlessBufferReference
+    typealias ArgumentBufferArrayReference = HeadlessBufferReference
+    typealias SamplerReference = SamplerDescriptor
+
+    typealias TransientResourceRegistry = HeadlessTransientResourceRegistry
+    typealias PersistentResourceRegistry = HeadlessPersistentResourceRegistry
+
+    typealias CommandBuffer = HeadlessCommandBuffer
+    typealias RenderTargetDescriptor = HeadlessRenderTargetDescriptor
+    typealias Event = Queue
+    typealias BackendQueue = HeadlessCommandQueue
+
+    typealias CompactedResourceCommandType = HeadlessCompactedResourceCommandType
+    // Dependencies track their resources, as in the Vulkan backend, so that cross-queue layout transitions can be recorded.
+    typealias InterEncoderDependencyType = FineDependency
+
+    let resourceRegistry : HeadlessPersistentResourceRegistry
+
+    /// The maximum number of committed command buffers to retain; zero disables recording.
+    let maxRecordedCommandBuffers : Int
+    /// Whether compute passes that allow it are recorded into separate command buffers as if submitted to an async compute queue.
+    let supportsAsyncCompute : Bool
+    /// Whether indirect draws can use a non-zero `baseInstance`, which determines whether such draws can be batched.
+    let supportsIndirectFirstInstance : Bool
+    private var recordingLock = SpinLock()
+    private var _recordedCommandBuffers = [HeadlessCommandBufferRecording]()
+    
+    private var pipelineCompilationLock = SpinLock()
+    private var _pipelineCompilationMode = PipelineCompilationMode.synchronous
+    private var compiledRenderPipelines = Set<RenderPipelineDescriptor>()
+    private var pendingRenderPipelines = Set<RenderPipelineDescriptor>()
+    private var pendingPipelinesCompiledHandlers = [() -> Void]()
+
+    var activeContext : RenderGraphContextImpl<HeadlessBackend>? = nil
+
+    var queueSyncEvents = [Queue?](repeating: nil, count: QueueRegistry.maxQueues)
+
+    let renderPipelineReflection = HeadlessPipelineReflection(stages: [.vertex, .fragment])
+    let computePipelineReflection = HeadlessPipelineReflection(stages: .compute)
+
+    public init(maxRecordedCommandBuffers: Int = 16, supportsAsyncCompute: Bool = false, supportsIndirectFirstInstance: Bool = true) {
+        self.resourceRegistry = HeadlessPersistentResourceRegistry()
+        self.maxRecordedCommandBuffers = maxRecordedCommandBuffers
+        self.supportsAsyncCompute = supportsAsyncCompute
+        self.supportsIndirectFirstInstance = supportsIndirectFirstInstance
+    }
+
+    deinit {
+        self.recordingLock.deinit()
+        self.pipelineCompilationLock.deinit()
+    }
+
+    public var api : RenderAPI {
+        return .headless
+    }
+
+    public var renderDevice: Any {
+        return self
+    }
+
+    // MARK: - Recording
+
+    func appendRecording(_ recording: HeadlessCommandBufferRecording) {
+        self.recordingLock.withLock {
+            if self._recordedCommandBuffers.count >= self.maxRecordedCommandBuffers {
+                self._recordedCommandBuffers.removeFirst(self._recordedCommandBuffers.count - self.maxRecordedCommandBuffers + 1)
+            }
+            self._recordedCommandBuffers.append(recording)
+        }
+    }
+
+    var recordedCommandBuffers: [HeadlessCommandBufferRecording] {
+        return self.recordingLock.withLock { self._recordedCommandBuffers }
+    }
+
+    func clearRecordedCommandBuffers() {
+        self.recordingLock.withLock { self._recordedCommandBuffers.removeAll() }
+    }
+
+    // MARK: - Pipeline compilation
+    
+    /// Emulates the Vulkan backend's asynchronous pipeline compilation, so that deferred draws can be tested.
+    /// Render pipelines that are first drawn with while compilation is asynchronous finish compiling when the
+    /// command buffer that first drew with them is committed.
+    var pipelineCompilationMode: PipelineCompilationMode {
+        get {
+            return self.pipelineCompilationLock.withLock { self._pipelineCompilationMode }
+        }
+        set {
+            self.pipelineCompilationLock.withLock { self._pipelineCompilationMode = newValue }
+        }
+    }
+    
+    /// Returns the pipeline to draw with for `descriptor`, and whether the draw has been deferred because the pipeline is being compiled.
+    /// As in the Vulkan backend, a deferred draw uses the descriptor's `fallbackDescriptor`, or should be skipped if the returned pipeline is `nil`.
+    func renderPipelineForDraw(_ descriptor: RenderPipelineDescriptor) -> (pipeline: RenderPipelineDescriptor?, isDeferred: Bool) {
+        return self.pipelineCompilationLock.withLock {
+            if self._pipelineCompilationMode == .synchronous || self.compiledRenderPipelines.contains(descriptor) {
+                self.compiledRenderPipelines.insert(descriptor)
+                return (descriptor, false)
+            }
+            self.pendingRenderPipelines.insert(descriptor)
+            
+            // Fallback pipelines are compiled synchronously.
+            guard let fallbackDescriptor = descriptor.fallbackDescriptor else { return (nil, true) }
+            self.compiledRenderPipelines.insert(fallbackDescriptor)
+            return (fallbackDescriptor, true)
+        }
+    }
+    
+    /// Finishes compiling the pending render pipelines, then calls the handlers waiting for them.
+    func compilePendingPipelines() {
+        let handlers = self.pipelineCompilationLock.withLock { () -> [() -> Void] in
+            self.compiledRenderPipelines.formUnion(self.pendingRenderPipelines)
+            self.pendingRenderPipelines.removeAll()
+            defer { self.pendingPipelinesCompiledHandlers.removeAll() }
+            return self.pendingPipelinesCompiledHandlers
+        }
+        handlers.forEach { $0() }
+    }
+    
+    func notifyWhenPendingPipelinesCompiled(_ handler: @escaping () -> Void) {
+        let hasPendingPipelines = self.pipelineCompilationLock.withLock { () -> Bool in
+            if self.pendingRenderPipelines.isEmpty {
+                return false
+            }
+            self.pendingPipelinesCompiledHandlers.append(handler)
+            return true
+        }
+        if !hasPendingPipelines {
+            handler()
+        }
+    }
+
+    // MARK: - RenderBackendProtocol
+
+    func setActiveContext(_ context: RenderGraphContextImpl<HeadlessBackend>?) {
+        assert(self.activeContext == nil || context == nil)
+        self.activeContext = context
+    }
+
+    @usableFromInline func materialisePersistentTexture(_ texture: Texture) -> Bool {
+        return resourceRegistry.accessLock.withWriteLock {
+            return self.resourceRegistry.allocateTexture(texture) != nil
+        }
+    }
+
+    @usableFromInline func registerWindowTexture(texture: Texture, context: Any) {
+        self.resourceRegistry.registerWindowTexture(texture: texture, context: context)
+    }
+
+    @usableFromInline func materialisePersistentBuffer(_ buffer: Buffer) -> Bool {
+        return resourceRegistry.accessLock.withWriteLock {
+            return self.resourceRegistry.allocateBuffer(buffer) != nil
+        }
+    }
+
+    @usableFromInline func materialiseHeap(_ heap: Heap) -> Bool {
+        return true
+    }
+
+    @usableFromInline func replaceBackingResource(for buffer: Buffer, with: Any?) -> Any? {
+        self.resourceRegistry.accessLock.withWriteLock {
+            let oldValue = self.resourceRegistry[buffer]?._buffer.takeUnretainedValue()
+            self.resourceRegistry.bufferReferences[buffer] = (with as! HeadlessBuffer?).map { HeadlessBufferReference(buffer: Unmanaged<HeadlessBuffer>.passRetained($0), offset: 0) }
+            return oldValue
+        }
+    }
+
+    @usableFromInline func replaceBackingResource(for texture: Texture, with: Any?) -> Any? {
+        self.resourceRegistry.accessLock.withWriteLock {
+            let oldValue = self.resourceRegistry[texture]?._texture.takeUnretainedValue()
+            self.resourceRegistry.textureReferences[texture] = (with as! HeadlessTexture?).map { HeadlessTextureReference(texture: Unmanaged<HeadlessTexture>.passRetained($0)) }
+            return oldValue
+        }
+    }
+
+    @usableFromInline func replaceBackingResource(for heap: Heap, with: Any?) -> Any? {
+        return nil
+    }
+
+    @usableFromInline func updateLabel(on resource: Resource) {
+        self.resourceRegistry.accessLock.withReadLock {
+            if let buffer = Buffer(resource) {
+                self.resourceRegistry[buffer]?.buffer.label = buffer.label
+            } else if let texture = Texture(resource) {
+                self.resourceRegistry[texture]?.texture.label = texture.label
+            }
+        }
+    }
+
+    @usableFromInline func updatePurgeableState(for resource: Resource, to newState: ResourcePurgeableState?) -> ResourcePurgeableState {
+        return .nonDiscardable
+    }
+
+    @usableFromInline func sizeAndAlignment(for buffer: BufferDescriptor) -> (size: Int, alignment: Int) {
+        return (buffer.length.roundedUpToMultiple(of: 256), 256)
+    }
+
+    @usableFromInline func sizeAndAlignment(for texture: TextureDescriptor) -> (size: Int, alignment: Int) {
+        var size = 0.0
+        var width = texture.width, height = texture.height, depth = texture.depth
+        for _ in 0..<texture.mipmapLevelCount {
+            size += Double(width * height * depth) * texture.pixelFormat.bytesPerPixel
+            width = max(width >> 1, 1)
+            height = max(height >> 1, 1)
+            depth = max(depth >> 1, 1)
+        }
+        let totalSize = Int(size.rounded(.up)) * texture.arrayLength * texture.sampleCount
+        return (totalSize.roundedUpToMultiple(of: 4096), 4096)
+    }
+
+    @usableFromInline func usedSize(for heap: Heap) -> Int {
+        return 0
+    }
+
+    @usableFromInline func currentAllocatedSize(for heap: Heap) -> Int {
+        return heap.size
+    }
+
+    @usableFromInline func maxAvailableSize(forAlignment alignment: Int, in heap: Heap) -> Int {
+        return heap.size
+    }
+
+    @usableFromInline func dispose(texture: Texture) {
+        self.resourceRegistry.disposeTexture(texture)
+    }
+
+    @usableFromInline func dispose(buffer: Buffer) {
+        self.resourceRegistry.disposeBuffer(buffer)
+    }
+
+    @usableFromInline func dispose(argumentBuffer: ArgumentBuffer) {
+        self.resourceRegistry.disposeArgumentBuffer(argumentBuffer)
+    }
+
+    @usableFromInline func dispose(argumentBufferArray: ArgumentBufferArray) {
+        self.resourceRegistry.disposeArgumentBufferArray(argumentBufferArray)
+    }
+
+    @usableFromInline func dispose(heap: Heap) {
+
+    }
+
+    public func supportsPixelFormat(_ pixelFormat: PixelFormat, usage: TextureUsage) -> Bool {
+        return true
+    }
+
+    public var hasUnifiedMemory: Bool {
+        return true
+    }
+
+    public var supportsMemorylessAttachments: Bool {
+        return false
+    }
+
+    @usableFromInline func bufferContents(for buffer: Buffer, range: Range<Int>) -> UnsafeMutableRawPointer {
+        let bufferReference = self.activeContext?.resourceMap.bufferForCPUAccess(buffer) ?? resourceRegistry.accessLock.withReadLock { resourceRegistry[buffer]! }
+        guard let contents = bufferReference.buffer.contents else {
+            fatalError("Buffer \(buffer) is not CPU-accessible.")
+        }
+        return contents + bufferReference.offset + range.lowerBound
+    }
+
+    @usableFromInline func buffer(_ buffer: Buffer, didModifyRange range: Range<Int>) {
+        // All CPU-accessible memory is coherent.
+    }
+
+    @usableFromInline func registerExternalResource(_ resource: Resource, backingResource: Any) {
+        self.resourceRegistry.importExternalResource(resource, backingResource: backingResource)
+    }
+
+    public func backingResource(_ resource: Resource) -> Any? {
+        return resourceRegistry.accessLock.withReadLock {
+            if let buffer = Buffer(resource) {
+                return resourceRegistry[buffer]?.buffer
+            } else if let texture = Texture(resource) {
+                return resourceRegistry[texture]?.texture
+            }
+            return nil
+        }
+    }
+
+    // Textures have no backing memory, so reads return zeroes and writes are discarded.
+
+    @usableFromInline func copyTextureBytes(from texture: Texture, to bytes: UnsafeMutableRawPointer, bytesPerRow: Int, region: Region, mipmapLevel: Int) {
+        assert(texture.flags.contains(.persistent) || self.activeContext != nil, "GPU memory for a transient texture may not be accessed outside of a RenderGraph RenderPass.")
+        bytes.initializeMemory(as: UInt8.self, repeating: 0, count: bytesPerRow * region.size.height * region.size.depth)
+    }
+
+    @usableFromInline func replaceTextureRegion(texture: Texture, region: Region, mipmapLevel: Int, withBytes bytes: UnsafeRawPointer, bytesPerRow: Int) {
+        assert(texture.flags.contains(.persistent) || self.activeContext != nil, "GPU memory for a transient texture may not be accessed outside of a RenderGraph RenderPass.")
+    }
+
+    @usableFromInline func replaceTextureRegion(texture: Texture, region: Region, mipmapLevel: Int, slice: Int, withBytes bytes: UnsafeRawPointer, bytesPerRow: Int, bytesPerImage: Int) {
+        assert(texture.flags.contains(.persistent) || self.activeContext != nil, "GPU memory for a transient texture may not be accessed outside of a RenderGraph RenderPass.")
+    }
+
+    @usableFromInline
+    func renderPipelineReflection(descriptor: RenderPipelineDescriptor, renderTarget: Substrate.RenderTargetDescriptor) -> PipelineReflection? {
+        return self.renderPipelineReflection
+    }
+
+    @usableFromInline
+    func computePipelineReflection(descriptor: ComputePipelineDescriptor) -> PipelineReflection? {
+        return self.computePipelineReflection
+    }
+
+    @usableFromInline var pushConstantPath: ResourceBindingPath {
+        return ResourceBindingPath(headlessArgumentBufferIndex: nil, index: Int(UInt32.max))
+    }
+
+    @usableFromInline func argumentBufferPath(at index: Int, stages: RenderStages) -> ResourceBindingPath {
+        return ResourceBindingPath(headlessArgumentBufferIndex: nil, index: index, isArgumentBuffer: true)
+    }
+
+    // MARK: - SpecificRenderBackend conformance
+
+    static var requiresResourceResidencyTracking: Bool {
+        // Track residency as Metal does so that useResource generation is exercised.
+        return true
+    }
+
+    var requiresEmulatedInputAttachments: Bool {
+        return false
+    }
+
+    static func encodeArguments(from argumentBuffer: ArgumentBuffer, into storage: UnsafeMutableRawPointer, resourceMap: FrameResourceMap<HeadlessBackend>) {
+        let entries = storage.assumingMemoryBound(to: UInt64.self)
+        for (i, (bindingPath, binding)) in argumentBuffer.bindings.enumerated() {
+            let address: UInt64
+            switch binding {
+            case .texture(let texture):
+                guard let reference = resourceMap[texture] else { continue }
+                address = UInt64(UInt(bitPattern: reference._texture.toOpaque()))
+            case .buffer(let buffer, let offset):
+                guard let reference = resourceMap[buffer] else { continue }
+                address = UInt64(UInt(bitPattern: reference._buffer.toOpaque())) &+ UInt64(reference.offset + offset)
+            case .sampler(let descriptor):
+                address = UInt64(truncatingIfNeeded: resourceMap[descriptor].hashValue)
+            case .bytes(let offset, let length):
+                address = UInt64(offset) << 32 | UInt64(length)
+            }
+            entries[2 * i] = bindingPath.value
+            entries[2 * i + 1] = address
+        }
+    }
+
+    static func fillArgumentBuffer(_ argumentBuffer: ArgumentBuffer, storage: HeadlessBufferReference, firstUseCommandIndex: Int, resourceMap: FrameResourceMap<HeadlessBackend>) {
+        if argumentBuffer.stateFlags.contains(.initialised) { return }
+
+        let destPointer = storage.buffer.contents! + storage.offset
+        destPointer.initializeMemory(as: UInt8.self, repeating: 0, count: HeadlessBackend.encodedLength(for: argumentBuffer))
+        HeadlessBackend.encodeArguments(from: argumentBuffer, into: destPointer, resourceMap: resourceMap)
+
+        argumentBuffer.markAsInitialised()
+    }
+
+    static func fillArgumentBufferArray(_ argumentBufferArray: ArgumentBufferArray, storage: HeadlessBufferReference, firstUseCommandIndex: Int, resourceMap: FrameResourceMap<HeadlessBackend>) {
+        let elementLength = HeadlessBackend.encodedElementLength(for: argumentBufferArray)
+
+        for (i, argumentBuffer) in argumentBufferArray._bindings.enumerated() {
+            guard let argumentBuffer = argumentBuffer else { continue }
+            if argumentBuffer.stateFlags.contains(.initialised) { continue }
+
+            HeadlessBackend.encodeArguments(from: argumentBuffer, into: storage.buffer.contents! + storage.offset + i * elementLength, resourceMap: resourceMap)
+        }
+    }
+
+    func makeQueue(renderGraphQueue: Queue) -> HeadlessCommandQueue {
+        return HeadlessCommandQueue(backend: self, queue: renderGraphQueue)
+    }
+
+    func makeSyncEvent(for queue: Queue) -> Queue {
+        self.queueSyncEvents[Int(queue.index)] = queue
+        return queue
+    }
+
+    func syncEvent(for queue: Queue) -> Queue? {
+        return self.queueSyncEvents[Int(queue.index)]
+    }
+
+    func freeSyncEvent(for queue: Queue) {
+        assert(self.queueSyncEvents[Int(queue.index)] != nil)
+        self.queueSyncEvents[Int(queue.index)] = nil
+    }
+
+    func makeTransientRegistry(index: Int, inflightFrameCount: Int, queue: Queue) -> HeadlessTransientResourceRegistry {
+        return HeadlessTransientResourceRegistry(queue: queue, transientRegistryIndex: index, persistentRegistry: self.resourceRegistry)
+    }
+
+    func generateFenceCommands(frameCommandInfo: FrameCommandInfo<HeadlessBackend>, commandGenerator: ResourceCommandGenerator<HeadlessBackend>, compactedResourceCommands: inout [CompactedResourceCommand<HeadlessCompactedResourceCommandType>]) {
+        let dependencies = commandGenerator.commandEncoderDependencies
+
+        let commandEncoderCount = frameCommandInfo.commandEncoders.count
+        let reductionMatrix = dependencies.transitiveReduction(hasDependency: { $0 != nil })
+
+        let allocator = ThreadLocalTagAllocator(tag: .renderGraphResourceCommandArrayTag)
+
+        for sourceIndex in (0..<commandEncoderCount) { // sourceIndex always points to the producing pass.
+            let dependentRange = min(sourceIndex + 1, commandEncoderCount)..<commandEncoderCount
+            
+            // Fences can't be used across queues; those dependencies are instead handled by waiting on the source command buffer.
+            let queueFamilyIndex = frameCommandInfo.commandEncoders[sourceIndex].queueFamilyIndex
+            let hasFenceDependency = { (dependentIndex: Int) -> Bool in
+                return reductionMatrix.dependency(from: dependentIndex, on: sourceIndex) && frameCommandInfo.commandEncoders[dependentIndex].queueFamilyIndex == queueFamilyIndex
+            }
+
+            // As in the Vulkan backend, the dependent command buffer's wait on the source command buffer makes the source's writes available,
+            // but any textures still need their layout transitions on the consuming queue. These only need to wait for the top of the pipe,
+            // which is recorded as a barrier with no source stages.
+            for dependentIndex in dependentRange where reductionMatrix.dependency(from: dependentIndex, on: sourceIndex) && !hasFenceDependency(dependentIndex) {
+                let dependency = dependencies.dependency(from: dependentIndex, on: sourceIndex)!
+                var textures = [Resource]()
+                for (resource, _, _) in dependency.resources where resource.type == .texture && !textures.contains(resource) {
+                    textures.append(resource)
+                }
+                if textures.isEmpty { continue }
+
+                let memory = allocator.allocate(capacity: textures.count) as UnsafeMutablePointer<Resource>
+                memory.initialize(from: textures, count: textures.count)
+                compactedResourceCommands.append(CompactedResourceCommand<HeadlessCompactedResourceCommandType>(command: .memoryBarrier(resources: UnsafeMutableBufferPointer(start: memory, count: textures.count), afterStages: [], beforeStages: dependency.wait.stages), index: dependency.wait.index, order: .before))
+            }
+
+            var signalStages : RenderStages = []
+            var signalIndex = -1
+            for dependentIndex in dependentRange where hasFenceDependency(dependentIndex) {
+                let dependency = dependencies.dependency(from: dependentIndex, on: sourceIndex)!
+                signalStages.formUnion(dependency.signal.stages)
+                signalIndex = max(signalIndex, dependency.signal.index)
+            }
+
+            if signalIndex < 0 { continue }
+
+            let fence = HeadlessFence(index: sourceIndex)
+            compactedResourceCommands.append(CompactedResourceCommand<HeadlessCompactedResourceCommandType>(command: .updateFence(fence, afterStages: signalStages), index: signalIndex, order: .after))
+
+            for dependentIndex in dependentRange where hasFenceDependency(dependentIndex) {
+                let dependency = dependencies.dependency(from: dependentIndex, on: sourceIndex)!
+                compactedResourceCommands.append(CompactedResourceCommand<HeadlessCompactedResourceCommandType>(command: .waitForFence(fence, beforeStages: dependency.wait.stages), index: dependency.wait.index, order: .before))
+            }
+        }
+    }
+
+    func compactResourceCommands(queue: Queue, resourceMap: FrameResourceMap<HeadlessBackend>, commandInfo: FrameCommandInfo<HeadlessBackend>, commandGenerator: ResourceCommandGenerator<HeadlessBackend>, into compactedResourceCommands: inout [CompactedResourceCommand<HeadlessCompactedResourceCommandType>]) {
+        guard !commandGenerator.commands.isEmpty else { return }
+        assert(compactedResourceCommands.isEmpty)
+
+        self.generateFenceCommands(frameCommandInfo: commandInfo, commandGenerator: commandGenerator, compactedResourceCommands: &compactedResourceCommands)
+
+        let allocator = ThreadLocalTagAllocator(tag: .renderGraphResourceCommandArrayTag)
+
+        let makeBuffer: ([Resource]) -> UnsafeMutableBufferPointer<Resource> = { resources in
+            let memory = allocator.allocate(capacity: resources.count) as UnsafeMutablePointer<Resource>
+            memory.initialize(from: resources, count: resources.count)
+            return UnsafeMutableBufferPointer(start: memory, count: resources.count)
+        }
+
+        var barrierResources: [Resource] = []
+        var barrierAfterStages: RenderStages = []
+        var barrierBeforeStages: RenderStages = []
+
+        commandGenerator.compactResourceCommands(commandInfo: commandInfo, into: &compactedResourceCommands,
+            useResourceKey: { resource, usage, stages in
+                return (key: HeadlessUseResourceKey(usage: usage, stages: stages), residentKey: resource, element: resource)
+            },
+            makeUseResourcesCommand: { key, resources in
+                return .useResources(makeBuffer(resources), usage: key.usage, stages: key.stages)
+            },
+            addToBarrier: { resource, _, afterStages, _, beforeStages in
+                barrierResources.append(resource)
+                barrierAfterStages.formUnion(afterStages)
+                barrierBeforeStages.formUnion(beforeStages)
+            },
+            makeBarrierCommand: {
+                let command = HeadlessCompactedResourceCommandType.memoryBarrier(resources: makeBuffer(barrierResources), afterStages: barrierAfterStages, beforeStages: barrierBeforeStages)
+                barrierResources.removeAll(keepingCapacity: true)
+                barrierAfterStages = []
+                barrierBeforeStages = []
+                return command
+            })
+    }
+}
+
+extension RenderBackend {
+    /// The most recently committed command buffers recorded by the `.headless` backend, oldest first.
+    /// Empty if a different backend is active.
+    public static var headlessRecordedCommandBuffers: [HeadlessCommandBufferRecording] {
+        return (_backend as? HeadlessBackend)?.recordedCommandBuffers ?? []
+    }
+
+    /// Discards the command buffers recorded by the `.headless` backend.
+    public static func clearHeadlessRecordedCommandBuffers() {
+        (_backend as? HeadlessBackend)?.clearRecordedCommandBuffers()
+    }
+}
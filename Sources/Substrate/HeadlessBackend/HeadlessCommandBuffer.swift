@@ -0,0 +1,318 @@
+//
+//  HeadlessCommandBuffer.swift
+//  Substrate
+//
+
+import SubstrateUtilities
+import Dispatch
+
+public enum HeadlessEncoderType {
+    case draw
+    case compute
+    case blit
+    case external
+
+    init?(_ type: RenderPassType) {
+        switch type {
+        case .draw:
+            self = .draw
+        case .compute:
+            self = .compute
+        case .blit:
+            self = .blit
+        case .external:
+            self = .external
+        case .cpu:
+            return nil
+        }
+    }
+}
+
+/// A command that the headless backend would have submitted to the GPU.
+public enum HeadlessBackendCommand {
+    case waitForQueue(index: Int, value: UInt64)
+    case signalQueue(index: Int, value: UInt64)
+    /// Signals the async compute queue's timeline with `value` once the command buffer completes.
+    case signalAsyncComputeQueue(value: UInt64)
+    /// Waits for the frame's command buffer at `commandBufferIndex`, which was submitted to a different queue family,
+    /// to signal `value` on its queue's timeline.
+    case waitForCommandBuffer(commandBufferIndex: Int, queueFamilyIndex: Int, value: UInt64)
+
+    case beginEncoder(name: String, type: HeadlessEncoderType)
+    case endEncoder
+    case beginPass(name: String)
+
+    /// A RenderGraph command, identified by its index within the frame and its case name.
+    case command(index: Int, name: StaticString)
+    /// A draw whose render pipeline was still being compiled, which was drawn with the pipeline's fallback or skipped if it has none.
+    case deferredDraw(index: Int, usesFallback: Bool)
+
+    case memoryBarrier(resources: [Resource], afterStages: RenderStages, beforeStages: RenderStages)
+    case useResources([Resource], usage: ResourceUsageType, stages: RenderStages)
+    case updateFence(index: Int, afterStages: RenderStages)
+    case waitForFence(index: Int, beforeStages: RenderStages)
+
+    case presentSwapchains(count: Int)
+}
+
+/// The commands recorded into a single headless command buffer.
+public struct HeadlessCommandBufferRecording {
+    public let queueIndex: Int
+    public let frameIndex: UInt64
+    /// The index of the command buffer within its frame.
+    public let commandBufferIndex: Int
+    /// Zero for the main queue, or one for the async compute queue.
+    public let queueFamilyIndex: Int
+    public internal(set) var commands: [HeadlessBackendCommand] = []
+}
+
+final class HeadlessCommandQueue: BackendQueue {
+    typealias Backend = HeadlessBackend
+
+    let backend: HeadlessBackend
+    let queue: Queue
+
+    /// Command buffers complete in submission order on this queue, standing in for the GPU timeline.
+    let completionQueue: DispatchQueue
+    /// The last value signalled by a command buffer on the async compute queue, standing in for its timeline semaphore.
+    private var asyncComputeSignalValue: UInt64 = 0
+
+    init(backend: HeadlessBackend, queue: Queue) {
+        self.backend = backend
+        self.queue = queue
+        self.completionQueue = DispatchQueue(label: "Headless Command Queue \(queue.index)")
+    }
+
+    func makeCommandBuffer(commandInfo: FrameCommandInfo<Backend>, resourceMap: FrameResourceMap<Backend>, compactedResourceCommands: [CompactedResourceCommand<Backend.CompactedResourceCommandType>]) -> HeadlessCommandBuffer {
+        return self.makeCommandBuffer(commandInfo: commandInfo, resourceMap: resourceMap, compactedResourceCommands: compactedResourceCommands, commandBufferIndex: 0)
+    }
+
+    func makeCommandBuffer(commandInfo: FrameCommandInfo<Backend>, resourceMap: FrameResourceMap<Backend>, compactedResourceCommands: [CompactedResourceCommand<Backend.CompactedResourceCommandType>], commandBufferIndex: Int) -> HeadlessCommandBuffer {
+        let commandBuffer = HeadlessCommandBuffer(backend: self.backend, queue: self, commandInfo: commandInfo, resourceMap: resourceMap, compactedResourceCommands: compactedResourceCommands, commandBufferIndex: commandBufferIndex)
+        
+        // As in the Vulkan backend, command buffers on the async compute queue signal their own timeline when they're created,
+        // since they don't signal the render graph queue's sync event.
+        if commandBuffer.recording.queueFamilyIndex == CommandEncoderInfo<HeadlessRenderTargetDescriptor>.asyncComputeQueueFamilyIndex {
+            self.asyncComputeSignalValue += 1
+            commandBuffer.signalAsyncComputeQueue(value: self.asyncComputeSignalValue)
+        }
+        return commandBuffer
+    }
+}
+
+final class HeadlessCommandBuffer: BackendCommandBuffer {
+    typealias Backend = HeadlessBackend
+
+    let backend: HeadlessBackend
+    let queue: HeadlessCommandQueue
+    let commandInfo: FrameCommandInfo<HeadlessBackend>
+    let resourceMap: FrameResourceMap<HeadlessBackend>
+    let compactedResourceCommands: [CompactedResourceCommand<HeadlessCompactedResourceCommandType>]
+
+    let isRecording: Bool
+    var recording: HeadlessCommandBufferRecording
+
+    /// The value this command buffer signals on its queue's timeline, which command buffers on other queues wait for.
+    private(set) var signalValue: UInt64 = 0
+    
+    /// The render pipeline set in the encoder that's being encoded.
+    private var renderPipelineDescriptor: RenderPipelineDescriptor? = nil
+    private(set) var deferredDrawCount = 0
+
+    private(set) var gpuStartTime: Double = 0.0
+    private(set) var gpuEndTime: Double = 0.0
+
+    init(backend: HeadlessBackend,
+         queue: HeadlessCommandQueue,
+         commandInfo: FrameCommandInfo<HeadlessBackend>,
+         resourceMap: FrameResourceMap<HeadlessBackend>,
+         compactedResourceCommands: [CompactedResourceCommand<HeadlessCompactedResourceCommandType>],
+         commandBufferIndex: Int) {
+        self.backend = backend
+        self.queue = queue
+        self.commandInfo = commandInfo
+        self.resourceMap = resourceMap
+        self.compactedResourceCommands = compactedResourceCommands
+        self.isRecording = backend.maxRecordedCommandBuffers > 0
+        self.recording = HeadlessCommandBufferRecording(queueIndex: Int(queue.queue.index), frameIndex: commandInfo.globalFrameIndex,
+                                                        commandBufferIndex: commandBufferIndex, queueFamilyIndex: commandInfo.commandBufferCount > 0 ? commandInfo.queueFamilyIndex(commandBufferIndex: commandBufferIndex) : 0)
+    }
+
+    @inline(__always)
+    func record(_ command: @autoclosure () -> HeadlessBackendCommand) {
+        if self.isRecording {
+            self.recording.commands.append(command())
+        }
+    }
+
+    func encodeCommands(encoderIndex: Int) {
+        let encoderInfo = self.commandInfo.commandEncoders[encoderIndex]
+        guard let encoderType = HeadlessEncoderType(encoderInfo.type) else { return }
+
+        self.record(.beginEncoder(name: encoderInfo.name, type: encoderType))
+        self.renderPipelineDescriptor = nil
+
+        for passRecord in self.commandInfo.passes[encoderInfo.passRange] {
+            self.executePass(passRecord)
+        }
+
+        self.record(.endEncoder)
+    }
+
+    func executePass(_ pass: RenderPassRecord) {
+        self.record(.beginPass(name: pass.name))
+
+        var resourceCommandIndex = self.compactedResourceCommands.binarySearch { $0.index < pass.commandRange!.lowerBound }
+
+        for (i, command) in zip(pass.commandRange!, pass.commands) {
+            self.checkResourceCommands(resourceCommandIndex: &resourceCommandIndex, phase: .before, commandIndex: i)
+            switch command {
+            case .setRenderPipelineDescriptor(let descriptor):
+                self.renderPipelineDescriptor = descriptor.takeUnretainedValue().value
+                self.record(.command(index: i, name: command.name))
+            case .drawPrimitives, .drawPrimitivesIndirect, .drawIndexedPrimitives, .drawIndexedPrimitivesIndirect:
+                self.recordDraw(index: i, name: command.name)
+            default:
+                self.record(.command(index: i, name: command.name))
+            }
+            self.checkResourceCommands(resourceCommandIndex: &resourceCommandIndex, phase: .after, commandIndex: i)
+        }
+    }
+
+    func recordDraw(index: Int, name: StaticString) {
+        guard let descriptor = self.renderPipelineDescriptor else {
+            self.record(.command(index: index, name: name))
+            return
+        }
+        
+        let (pipeline, isDeferred) = self.backend.renderPipelineForDraw(descriptor)
+        if isDeferred {
+            self.deferredDrawCount += 1
+            self.record(.deferredDraw(index: index, usesFallback: pipeline != nil))
+        } else {
+            self.record(.command(index: index, name: name))
+        }
+    }
+
+    func checkResourceCommands(resourceCommandIndex: inout Int, phase: PerformOrder, commandIndex: Int) {
+        while resourceCommandIndex < self.compactedResourceCommands.count, commandIndex == self.compactedResourceCommands[resourceCommandIndex].index, phase == self.compactedResourceCommands[resourceCommandIndex].order {
+            defer { resourceCommandIndex += 1 }
+
+            switch self.compactedResourceCommands[resourceCommandIndex].command {
+            case .memoryBarrier(let resources, let afterStages, let beforeStages):
+                self.record(.memoryBarrier(resources: Array(resources), afterStages: afterStages, beforeStages: beforeStages))
+
+            case .useResources(let resources, let usage, let stages):
+                self.record(.useResources(Array(resources), usage: usage, stages: stages))
+
+            case .updateFence(let fence, let afterStages):
+                self.record(.updateFence(index: fence.index, afterStages: afterStages))
+
+            case .waitForFence(let fence, let beforeStages):
+                self.record(.waitForFence(index: fence.index, beforeStages: beforeStages))
+            }
+        }
+    }
+
+    func waitForEvent(_ event: Queue, value: UInt64) {
+        self.record(.waitForQueue(index: Int(event.index), value: value))
+    }
+
+    func signalEvent(_ event: Queue, value: UInt64) {
+        self.signalValue = value
+        self.record(.signalQueue(index: Int(event.index), value: value))
+    }
+
+    func signalAsyncComputeQueue(value: UInt64) {
+        self.signalValue = value
+        self.record(.signalAsyncComputeQueue(value: value))
+    }
+
+    func waitForCommandBuffer(_ commandBuffer: HeadlessCommandBuffer) {
+        self.record(.waitForCommandBuffer(commandBufferIndex: commandBuffer.recording.commandBufferIndex, queueFamilyIndex: commandBuffer.recording.queueFamilyIndex, value: commandBuffer.signalValue))
+    }
+
+    func presentSwapchains(resourceRegistry: HeadlessTransientResourceRegistry) {
+        if resourceRegistry.frameWindowTextureCount > 0 {
+            self.record(.presentSwapchains(count: resourceRegistry.frameWindowTextureCount))
+        }
+        // because we reset the list after each command buffer submission.
+        resourceRegistry.clearWindowTextures()
+    }
+
+    func commit(onCompletion: @escaping (HeadlessCommandBuffer) -> Void) {
+        self.gpuStartTime = Double(DispatchTime.now().uptimeNanoseconds) * 1e-9
+
+        if self.isRecording {
+            self.backend.appendRecording(self.recording)
+        }
+        self.backend.compilePendingPipelines()
+
+        self.queue.completionQueue.async {
+            self.gpuEndTime = Double(DispatchTime.now().uptimeNanoseconds) * 1e-9
+            onCompletion(self)
+        }
+    }
+
+    var error: Error? {
+        return nil
+    }
+}
+
+extension RenderGraphCommand {
+    /// The name of the command's case, which is safe to retain after the frame's command memory has been freed.
+    var name: StaticString {
+        switch self {
+        case .setLabel: return "setLabel"
+        case .pushDebugGroup: return "pushDebugGroup"
+        case .popDebugGroup: return "popDebugGroup"
+        case .insertDebugSignpost: return "insertDebugSignpost"
+        case .setBytes: return "setBytes"
+        case .setBuffer: return "setBuffer"
+        case .setBufferOffset: return "setBufferOffset"
+        case .setTexture: return "setTexture"
+        case .setSamplerState: return "setSamplerState"
+        case .setArgumentBuffer: return "setArgumentBuffer"
+        case .setArgumentBufferArray: return "setArgumentBufferArray"
+        case .clearRenderTargets: return "clearRenderTargets"
+        case .setVertexBuffer: return "setVertexBuffer"
+        case .setVertexBufferOffset: return "setVertexBufferOffset"
+        case .setRenderPipelineDescriptor: return "setRenderPipelineDescriptor"
+        case .drawPrimitives: return "drawPrimitives"
+        case .drawPrimitivesIndirect: return "drawPrimitivesIndirect"
+        case .drawIndexedPrimitives: return "drawIndexedPrimitives"
+        case .drawIndexedPrimitivesIndirect: return "drawIndexedPrimitivesIndirect"
+        case .setViewport: return "setViewport"
+        case .setFrontFacing: return "setFrontFacing"
+        case .setCullMode: return "setCullMode"
+        case .setTriangleFillMode: return "setTriangleFillMode"
+        case .setDepthStencilDescriptor: return "setDepthStencilDescriptor"
+        case .setScissorRect: return "setScissorRect"
+        case .setDepthClipMode: return "setDepthClipMode"
+        case .setDepthBias: return "setDepthBias"
+        case .setStencilReferenceValue: return "setStencilReferenceValue"
+        case .setStencilReferenceValues: return "setStencilReferenceValues"
+        case .dispatchThreads: return "dispatchThreads"
+        case .dispatchThreadgroups: return "dispatchThreadgroups"
+        case .dispatchThreadgroupsIndirect: return "dispatchThreadgroupsIndirect"
+        case .setComputePipelineDescriptor: return "setComputePipelineDescriptor"
+        case .setStageInRegion: return "setStageInRegion"
+        case .setThreadgroupMemoryLength: return "setThreadgroupMemoryLength"
+        case .copyBufferToTexture: return "copyBufferToTexture"
+        case .copyBufferToBuffer: return "copyBufferToBuffer"
+        case .copyTextureToBuffer: return "copyTextureToBuffer"
+        case .copyTextureToTexture: return "copyTextureToTexture"
+        case .blitTextureToTexture: return "blitTextureToTexture"
+        case .fillBuffer: return "fillBuffer"
+        case .generateMipmaps: return "generateMipmaps"
+        case .synchroniseTexture: return "synchroniseTexture"
+        case .synchroniseTextureSlice: return "synchroniseTextureSlice"
+        case .synchroniseBuffer: return "synchroniseBuffer"
+        case .encodeExternalCommand: return "encodeExternalCommand"
+        #if canImport(MetalPerformanceShaders)
+        case .encodeRayIntersection: return "encodeRayIntersection"
+        case .encodeRayIntersectionRayCountBuffer: return "encodeRayIntersectionRayCountBuffer"
+        #endif
+        }
+    }
+}
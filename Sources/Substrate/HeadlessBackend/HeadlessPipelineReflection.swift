@@ -0,0 +1,89 @@
+//
+//  HeadlessPipelineReflection.swift
+//  Substrate
+//
+
+import SubstrateUtilities
+
+// The headless backend has no shader reflection data, so binding paths are synthesised from argument names.
+// Layout: [isArgumentBuffer: bit 62][argumentBufferIndex + 1: bits 32..<48][index: bits 0..<32]
+extension ResourceBindingPath {
+    static let headlessArgumentBufferFlag: UInt64 = 1 << 62
+
+    init(headlessArgumentBufferIndex argumentBufferIndex: Int?, index: Int, isArgumentBuffer: Bool = false) {
+        var value = UInt64(UInt32(truncatingIfNeeded: index))
+        if let argumentBufferIndex = argumentBufferIndex {
+            value |= UInt64(UInt16(truncatingIfNeeded: argumentBufferIndex + 1)) << 32
+        }
+        if isArgumentBuffer {
+            value |= ResourceBindingPath.headlessArgumentBufferFlag
+        }
+        self.init(value: value)
+    }
+
+    var headlessIndex: Int {
+        return Int(truncatingIfNeeded: UInt32(truncatingIfNeeded: self.value))
+    }
+
+    var headlessArgumentBufferIndex: Int? {
+        let storedIndex = Int((self.value >> 32) & 0xFFFF)
+        return storedIndex == 0 ? nil : storedIndex - 1
+    }
+
+    var isHeadlessArgumentBuffer: Bool {
+        return self.value & ResourceBindingPath.headlessArgumentBufferFlag != 0
+    }
+}
+
+/// A reflection object that considers every argument active for every stage of the pipeline.
+/// Resources are conservatively treated as read-write so that the RenderGraph generates the same
+/// hazard tracking work that a pipeline writing to every bound resource would.
+final class HeadlessPipelineReflection: PipelineReflection {
+    static let argumentEncoder = UnsafeRawPointer(UnsafeMutableRawPointer.allocate(byteCount: 1, alignment: 1))
+
+    let stages: RenderStages
+
+    init(stages: RenderStages) {
+        self.stages = stages
+    }
+
+    /// A stable 32-bit FNV-1a hash so that synthesised binding paths are consistent between runs.
+    static func index(forArgumentName name: String) -> Int {
+        var hash: UInt32 = 2166136261
+        for byte in name.utf8 {
+            hash = (hash ^ UInt32(byte)) &* 16777619
+        }
+        return Int(hash >> 1) // Leave room for array indices.
+    }
+
+    func bindingPath(argumentBuffer: ArgumentBuffer, argumentName: String, arrayIndex: Int) -> ResourceBindingPath? {
+        return ResourceBindingPath(headlessArgumentBufferIndex: nil, index: HeadlessPipelineReflection.index(forArgumentName: argumentName) &+ arrayIndex, isArgumentBuffer: true)
+    }
+
+    func bindingPath(argumentName: String, arrayIndex: Int, argumentBufferPath: ResourceBindingPath?) -> ResourceBindingPath? {
+        return ResourceBindingPath(headlessArgumentBufferIndex: argumentBufferPath?.headlessIndex, index: HeadlessPipelineReflection.index(forArgumentName: argumentName) &+ arrayIndex)
+    }
+
+    func bindingPath(pathInOriginalArgumentBuffer: ResourceBindingPath, newArgumentBufferPath: ResourceBindingPath) -> ResourceBindingPath {
+        return ResourceBindingPath(headlessArgumentBufferIndex: newArgumentBufferPath.headlessIndex, index: pathInOriginalArgumentBuffer.headlessIndex)
+    }
+
+    func argumentReflection(at path: ResourceBindingPath) -> ArgumentReflection? {
+        if path.isHeadlessArgumentBuffer {
+            return ArgumentReflection(type: .buffer, bindingPath: path, usageType: .read, activeStages: self.stages, activeRange: .fullResource)
+        }
+        return ArgumentReflection(type: .buffer, bindingPath: path, usageType: .readWrite, activeStages: self.stages, activeRange: .fullResource)
+    }
+
+    var hasArgumentTypeInformation: Bool {
+        return false
+    }
+
+    func argumentBufferEncoder(at path: ResourceBindingPath, currentEncoder: UnsafeRawPointer?) -> UnsafeRawPointer? {
+        return HeadlessPipelineReflection.argumentEncoder
+    }
+
+    var threadExecutionWidth: Int {
+        return 32
+    }
+}
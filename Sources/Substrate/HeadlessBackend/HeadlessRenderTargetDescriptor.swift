@@ -0,0 +1,107 @@
+//
+//  HeadlessRenderTargetDescriptor.swift
+//  Substrate
+//
+
+final class HeadlessRenderTargetDescriptor: BackendRenderTargetDescriptor {
+    var descriptor : RenderTargetDescriptor
+    var renderPasses = [DrawRenderPass]()
+
+    init(renderPass: DrawRenderPass) {
+        self.descriptor = renderPass.renderTargetDescriptorForActiveAttachments
+        self.renderPasses.append(renderPass)
+    }
+
+    convenience init(renderPass: RenderPassRecord) {
+        self.init(renderPass: renderPass.pass as! DrawRenderPass)
+    }
+
+    func tryUpdateDescriptor<D : RenderTargetAttachmentDescriptor>(_ desc: inout D?, with new: D?, clearOperation: ClearOperation) -> Bool {
+        guard let descriptor = desc else {
+            desc = new
+            return true
+        }
+
+        guard let new = new else {
+            return true
+        }
+
+        if clearOperation.isClear {
+            // If descriptor was not nil, it must've already had and been using this attachment,
+            // so we can't overwrite its load action.
+            return false
+        }
+
+        return  descriptor.texture     == new.texture &&
+                descriptor.level       == new.level &&
+                descriptor.slice       == new.slice &&
+                descriptor.depthPlane  == new.depthPlane
+    }
+
+    func tryMerge(withPass pass: DrawRenderPass) -> Bool {
+        if pass.renderTargetDescriptor.size != self.descriptor.size {
+            return false // The render targets must be the same size.
+        }
+
+        let passDescriptor = pass.renderTargetDescriptorForActiveAttachments
+
+        var newDescriptor = descriptor
+        newDescriptor.colorAttachments.append(contentsOf: repeatElement(nil, count: max(passDescriptor.colorAttachments.count - descriptor.colorAttachments.count, 0)))
+
+        for i in 0..<min(newDescriptor.colorAttachments.count, passDescriptor.colorAttachments.count) {
+            if !self.tryUpdateDescriptor(&newDescriptor.colorAttachments[i], with: passDescriptor.colorAttachments[i], clearOperation: pass.colorClearOperation(attachmentIndex: i)) {
+                return false
+            }
+        }
+
+        if !self.tryUpdateDescriptor(&newDescriptor.depthAttachment, with: passDescriptor.depthAttachment, clearOperation: pass.depthClearOperation) {
+            return false
+        }
+
+        if !self.tryUpdateDescriptor(&newDescriptor.stencilAttachment, with: passDescriptor.stencilAttachment, clearOperation: pass.stencilClearOperation) {
+            return false
+        }
+
+        if newDescriptor.visibilityResultBuffer != nil && passDescriptor.visibilityResultBuffer != newDescriptor.visibilityResultBuffer {
+            return false
+        } else {
+            newDescriptor.visibilityResultBuffer = passDescriptor.visibilityResultBuffer
+        }
+
+        newDescriptor.renderTargetArrayLength = max(newDescriptor.renderTargetArrayLength, passDescriptor.renderTargetArrayLength)
+
+        self.descriptor = newDescriptor
+        self.renderPasses.append(pass)
+
+        return true
+    }
+
+    func descriptorMergedWithPass(_ pass: RenderPassRecord, storedTextures: inout [Texture]) -> HeadlessRenderTargetDescriptor {
+        let drawPass = pass.pass as! DrawRenderPass
+        if self.tryMerge(withPass: drawPass) {
+            return self
+        } else {
+            self.finalise(storedTextures: &storedTextures)
+            return HeadlessRenderTargetDescriptor(renderPass: drawPass)
+        }
+    }
+
+    func finalise(storedTextures: inout [Texture]) {
+        // There's no tile memory to avoid storing to, so conservatively treat every attachment as stored.
+        for attachment in self.descriptor.colorAttachments {
+            guard let attachment = attachment else { continue }
+            storedTextures.append(attachment.texture)
+            if let resolveTexture = attachment.resolveTexture {
+                storedTextures.append(resolveTexture)
+            }
+        }
+
+        if let depthAttachment = self.descriptor.depthAttachment {
+            storedTextures.append(depthAttachment.texture)
+        }
+
+        if let stencilAttachment = self.descriptor.stencilAttachment {
+            storedTextures.append(stencilAttachment.texture)
+        }
+    }
+}
@@ -0,0 +1,522 @@
+//
+//  HeadlessResourceRegistry.swift
+//  Substrate
+//
+
+import SubstrateUtilities
+import Foundation
+
+/// The CPU-side stand-in for a GPU buffer. Only buffers that the CPU can access have backing memory.
+final class HeadlessBuffer {
+    let length: Int
+    let contents: UnsafeMutableRawPointer?
+    var label: String?
+
+    init(length: Int, isCPUAccessible: Bool) {
+        self.length = length
+        if isCPUAccessible {
+            self.contents = .allocate(byteCount: max(length, 1), alignment: 256)
+        } else {
+            self.contents = nil
+        }
+    }
+
+    deinit {
+        self.contents?.deallocate()
+    }
+}
+
+/// The CPU-side stand-in for a GPU texture. Textures have no backing memory in the headless backend.
+final class HeadlessTexture {
+    let descriptor: TextureDescriptor
+    var label: String?
+
+    init(descriptor: TextureDescriptor) {
+        self.descriptor = descriptor
+    }
+}
+
+// Must be a POD type and trivially copyable/movable
+struct HeadlessBufferReference {
+    let _buffer: Unmanaged<HeadlessBuffer>
+    let offset: Int
+
+    var buffer: HeadlessBuffer {
+        return self._buffer.takeUnretainedValue()
+    }
+
+    init(buffer: Unmanaged<HeadlessBuffer>, offset: Int) {
+        self._buffer = buffer
+        self.offset = offset
+    }
+}
+
+// Must be a POD type and trivially copyable/movable
+struct HeadlessTextureReference {
+    let _texture: Unmanaged<HeadlessTexture>
+
+    var texture: HeadlessTexture {
+        return self._texture.takeUnretainedValue()
+    }
+
+    init(texture: Unmanaged<HeadlessTexture>) {
+        self._texture = texture
+    }
+}
+
+extension HeadlessBackend {
+    /// Each binding in an argument buffer is encoded as a (binding path, resource address) pair.
+    static var argumentBufferBindingStride: Int {
+        return 2 * MemoryLayout<UInt64>.stride
+    }
+
+    static func encodedLength(for argumentBuffer: ArgumentBuffer) -> Int {
+        return max(argumentBuffer.bindings.count, 1) * HeadlessBackend.argumentBufferBindingStride
+    }
+
+    static func encodedElementLength(for argumentBufferArray: ArgumentBufferArray) -> Int {
+        return argumentBufferArray._bindings.lazy.compactMap { $0.map { HeadlessBackend.encodedLength(for: $0) } }.max() ?? HeadlessBackend.argumentBufferBindingStride
+    }
+}
+
+final class HeadlessPersistentResourceRegistry: BackendPersistentResourceRegistry {
+    typealias Backend = HeadlessBackend
+
+    var accessLock = ReaderWriterLock()
+
+    var textureReferences = PersistentResourceMap<Texture, HeadlessTextureReference>()
+    var bufferReferences = PersistentResourceMap<Buffer, HeadlessBufferReference>()
+    var argumentBufferReferences = PersistentResourceMap<ArgumentBuffer, HeadlessBufferReference>()
+    var argumentBufferArrayReferences = PersistentResourceMap<ArgumentBufferArray, HeadlessBufferReference>()
+
+    var windowTextures = Set<Texture>()
+
+    init() {
+        self.prepareFrame()
+    }
+
+    deinit {
+        self.textureReferences.deinit()
+        self.bufferReferences.deinit()
+        self.argumentBufferReferences.deinit()
+        self.argumentBufferArrayReferences.deinit()
+    }
+
+    func prepareFrame() {
+
+    }
+
+    func registerWindowTexture(texture: Texture, context: Any) {
+        self.windowTextures.insert(texture)
+    }
+
+    @discardableResult
+    func allocateTexture(_ texture: Texture) -> HeadlessTextureReference? {
+        precondition(texture._usesPersistentRegistry)
+
+        let headlessTexture = HeadlessTexture(descriptor: texture.descriptor)
+        headlessTexture.label = texture.label
+
+        let reference = HeadlessTextureReference(texture: Unmanaged.passRetained(headlessTexture))
+        assert(self.textureReferences[texture] == nil)
+        self.textureReferences[texture] = reference
+
+        return reference
+    }
+
+    @discardableResult
+    func allocateBuffer(_ buffer: Buffer) -> HeadlessBufferReference? {
+        precondition(buffer._usesPersistentRegistry)
+
+        let headlessBuffer = HeadlessBuffer(length: buffer.descriptor.length, isCPUAccessible: buffer.descriptor.storageMode != .private)
+        headlessBuffer.label = buffer.label
+
+        let reference = HeadlessBufferReference(buffer: Unmanaged.passRetained(headlessBuffer), offset: 0)
+        assert(self.bufferReferences[buffer] == nil)
+        self.bufferReferences[buffer] = reference
+
+        return reference
+    }
+
+    @discardableResult
+    func allocateArgumentBufferIfNeeded(_ argumentBuffer: ArgumentBuffer) -> HeadlessBufferReference {
+        if let baseArray = argumentBuffer.sourceArray {
+            _ = self.allocateArgumentBufferArrayIfNeeded(baseArray)
+            return self.argumentBufferReferences[argumentBuffer]!
+        }
+        if let reference = self.argumentBufferReferences[argumentBuffer] {
+            return reference
+        }
+
+        let storage = HeadlessBuffer(length: HeadlessBackend.encodedLength(for: argumentBuffer), isCPUAccessible: true)
+        let reference = HeadlessBufferReference(buffer: Unmanaged.passRetained(storage), offset: 0)
+        self.argumentBufferReferences[argumentBuffer] = reference
+
+        return reference
+    }
+
+    @discardableResult
+    func allocateArgumentBufferArrayIfNeeded(_ argumentBufferArray: ArgumentBufferArray) -> HeadlessBufferReference {
+        if let reference = self.argumentBufferArrayReferences[argumentBufferArray] {
+            return reference
+        }
+
+        let elementLength = HeadlessBackend.encodedElementLength(for: argumentBufferArray)
+        let storage = HeadlessBuffer(length: elementLength * argumentBufferArray._bindings.count, isCPUAccessible: true)
+        let reference = HeadlessBufferReference(buffer: Unmanaged.passRetained(storage), offset: 0)
+
+        for (i, argumentBuffer) in argumentBufferArray._bindings.enumerated() {
+            guard let argumentBuffer = argumentBuffer else { continue }
+            self.argumentBufferReferences[argumentBuffer] = HeadlessBufferReference(buffer: reference._buffer, offset: i * elementLength)
+        }
+
+        self.argumentBufferArrayReferences[argumentBufferArray] = reference
+
+        return reference
+    }
+
+    func importExternalResource(_ resource: Resource, backingResource: Any) {
+        if let texture = Texture(resource) {
+            self.textureReferences[texture] = HeadlessTextureReference(texture: Unmanaged.passRetained(backingResource as! HeadlessTexture))
+        } else if let buffer = Buffer(resource) {
+            self.bufferReferences[buffer] = HeadlessBufferReference(buffer: Unmanaged.passRetained(backingResource as! HeadlessBuffer), offset: 0)
+        }
+    }
+
+    subscript(texture: Texture) -> HeadlessTextureReference? {
+        return self.textureReferences[texture]
+    }
+
+    subscript(buffer: Buffer) -> HeadlessBufferReference? {
+        return self.bufferReferences[buffer]
+    }
+
+    subscript(argumentBuffer: ArgumentBuffer) -> HeadlessBufferReference? {
+        return self.argumentBufferReferences[argumentBuffer]
+    }
+
+    subscript(argumentBufferArray: ArgumentBufferArray) -> HeadlessBufferReference? {
+        return self.argumentBufferArrayReferences[argumentBufferArray]
+    }
+
+    subscript(descriptor: SamplerDescriptor) -> SamplerDescriptor {
+        return descriptor
+    }
+
+    func prepareMultiframeBuffer(_ buffer: Buffer, frameIndex: UInt64) {
+        // No-op for the headless backend.
+    }
+
+    func prepareMultiframeTexture(_ texture: Texture, frameIndex: UInt64) {
+        // No-op for the headless backend.
+    }
+
+    func disposeTexture(_ texture: Texture) {
+        if let reference = self.textureReferences.removeValue(forKey: texture) {
+            CommandEndActionManager.manager.enqueue(action: .release(Unmanaged.fromOpaque(reference._texture.toOpaque())))
+        }
+    }
+
+    func disposeBuffer(_ buffer: Buffer) {
+        if let reference = self.bufferReferences.removeValue(forKey: buffer) {
+            CommandEndActionManager.manager.enqueue(action: .release(Unmanaged.fromOpaque(reference._buffer.toOpaque())))
+        }
+    }
+
+    func disposeArgumentBuffer(_ buffer: ArgumentBuffer) {
+        if let reference = self.argumentBufferReferences.removeValue(forKey: buffer) {
+            assert(buffer.sourceArray == nil, "Persistent argument buffers from an argument buffer array should not be disposed individually.")
+            CommandEndActionManager.manager.enqueue(action: .release(Unmanaged.fromOpaque(reference._buffer.toOpaque())))
+        }
+    }
+
+    func disposeArgumentBufferArray(_ buffer: ArgumentBufferArray) {
+        if let reference = self.argumentBufferArrayReferences.removeValue(forKey: buffer) {
+            CommandEndActionManager.manager.enqueue(action: .release(Unmanaged.fromOpaque(reference._buffer.toOpaque())))
+        }
+    }
+
+    func cycleFrames() {
+
+    }
+}
+
+final class HeadlessTransientResourceRegistry: BackendTransientResourceRegistry {
+    typealias Backend = HeadlessBackend
+
+    let queue: Queue
+    let persistentRegistry: HeadlessPersistentResourceRegistry
+    var accessLock = SpinLock()
+
+    private var textureReferences: TransientResourceMap<Texture, HeadlessTextureReference>
+    private var bufferReferences: TransientResourceMap<Buffer, HeadlessBufferReference>
+    private var argumentBufferReferences: TransientResourceMap<ArgumentBuffer, HeadlessBufferReference>
+    private var argumentBufferArrayReferences: TransientResourceMap<ArgumentBufferArray, HeadlessBufferReference>
+
+    var textureWaitEvents: TransientResourceMap<Texture, ContextWaitEvent>
+    var bufferWaitEvents: TransientResourceMap<Buffer, ContextWaitEvent>
+    var argumentBufferWaitEvents: TransientResourceMap<ArgumentBuffer, ContextWaitEvent>
+    var argumentBufferArrayWaitEvents: TransientResourceMap<ArgumentBufferArray, ContextWaitEvent>
+    var historyBufferResourceWaitEvents = [Resource : ContextWaitEvent]() // since history buffers use the persistent (rather than transient) resource maps.
+
+    /// Argument buffer storage is only valid for a single frame, and is released once the frame's command buffers complete.
+    private var frameArgumentBufferStorage = [Unmanaged<HeadlessBuffer>]()
+
+    /// The number of window textures retrieved this frame that have not yet been presented.
+    private(set) var frameWindowTextureCount = 0
+
+    init(queue: Queue, transientRegistryIndex: Int, persistentRegistry: HeadlessPersistentResourceRegistry) {
+        self.queue = queue
+        self.persistentRegistry = persistentRegistry
+
+        self.textureReferences = .init(transientRegistryIndex: transientRegistryIndex)
+        self.bufferReferences = .init(transientRegistryIndex: transientRegistryIndex)
+        self.argumentBufferReferences = .init(transientRegistryIndex: transientRegistryIndex)
+        self.argumentBufferArrayReferences = .init(transientRegistryIndex: transientRegistryIndex)
+
+        self.textureWaitEvents = .init(transientRegistryIndex: transientRegistryIndex)
+        self.bufferWaitEvents = .init(transientRegistryIndex: transientRegistryIndex)
+        self.argumentBufferWaitEvents = .init(transientRegistryIndex: transientRegistryIndex)
+        self.argumentBufferArrayWaitEvents = .init(transientRegistryIndex: transientRegistryIndex)
+
+        self.prepareFrame()
+    }
+
+    deinit {
+        self.textureReferences.deinit()
+        self.bufferReferences.deinit()
+        self.argumentBufferReferences.deinit()
+        self.argumentBufferArrayReferences.deinit()
+
+        self.textureWaitEvents.deinit()
+        self.bufferWaitEvents.deinit()
+        self.argumentBufferWaitEvents.deinit()
+        self.argumentBufferArrayWaitEvents.deinit()
+    }
+
+    func prepareFrame() {
+        self.textureReferences.prepareFrame()
+        self.bufferReferences.prepareFrame()
+        self.argumentBufferReferences.prepareFrame()
+        self.argumentBufferArrayReferences.prepareFrame()
+
+        self.textureWaitEvents.prepareFrame()
+        self.bufferWaitEvents.prepareFrame()
+        self.argumentBufferWaitEvents.prepareFrame()
+        self.argumentBufferArrayWaitEvents.prepareFrame()
+    }
+
+    static func isAliasingCandidate(resource: Resource) -> Bool {
+        // The headless backend has no heaps, so nothing is ever aliased.
+        return false
+    }
+
+    @discardableResult
+    func allocateTexture(_ texture: Texture) -> HeadlessTextureReference {
+        let headlessTexture = HeadlessTexture(descriptor: texture.descriptor)
+        headlessTexture.label = texture.label
+        let reference = HeadlessTextureReference(texture: Unmanaged.passRetained(headlessTexture))
+
+        if texture._usesPersistentRegistry {
+            precondition(texture.flags.contains(.historyBuffer))
+            self.persistentRegistry.textureReferences[texture] = reference
+            self.historyBufferResourceWaitEvents[Resource(texture)] = ContextWaitEvent()
+        } else {
+            precondition(self.textureReferences[texture] == nil)
+            self.textureReferences[texture] = reference
+            self.textureWaitEvents[texture] = ContextWaitEvent()
+        }
+
+        return reference
+    }
+
+    @discardableResult
+    func allocateTextureIfNeeded(_ texture: Texture, forceGPUPrivate: Bool, frameStoredTextures: [Texture]) -> HeadlessTextureReference {
+        if let reference = self.textureReferences[texture] {
+            return reference
+        }
+        if texture.flags.contains(.windowHandle) {
+            return try! self.allocateWindowHandleTexture(texture)
+        }
+        return self.allocateTexture(texture)
+    }
+
+    @discardableResult
+    func allocateWindowHandleTexture(_ texture: Texture) throws -> HeadlessTextureReference {
+        precondition(texture.flags.contains(.windowHandle))
+
+        if let reference = self.textureReferences[texture] {
+            return reference
+        }
+
+        let reference = HeadlessTextureReference(texture: Unmanaged.passRetained(HeadlessTexture(descriptor: texture.descriptor)))
+        self.textureReferences[texture] = reference
+        self.frameWindowTextureCount += 1
+        return reference
+    }
+
+    @discardableResult
+    func allocateTextureView(_ texture: Texture, resourceMap: FrameResourceMap<HeadlessBackend>) -> HeadlessTextureReference {
+        assert(texture.flags.intersection([.persistent, .windowHandle, .externalOwnership]) == [])
+
+        let reference = HeadlessTextureReference(texture: Unmanaged.passRetained(HeadlessTexture(descriptor: texture.descriptor)))
+        assert(self.textureReferences[texture] == nil)
+        self.textureReferences[texture] = reference
+        return reference
+    }
+
+    @discardableResult
+    func allocateBuffer(_ buffer: Buffer, forceGPUPrivate: Bool) -> HeadlessBufferReference {
+        let isCPUAccessible = !forceGPUPrivate && buffer.descriptor.storageMode != .private
+        let headlessBuffer = HeadlessBuffer(length: buffer.descriptor.length, isCPUAccessible: isCPUAccessible)
+        headlessBuffer.label = buffer.label
+        let reference = HeadlessBufferReference(buffer: Unmanaged.passRetained(headlessBuffer), offset: 0)
+
+        if buffer._usesPersistentRegistry {
+            precondition(buffer.flags.contains(.historyBuffer))
+            self.persistentRegistry.bufferReferences[buffer] = reference
+            self.historyBufferResourceWaitEvents[Resource(buffer)] = ContextWaitEvent()
+        } else {
+            precondition(self.bufferReferences[buffer] == nil)
+            self.bufferReferences[buffer] = reference
+            self.bufferWaitEvents[buffer] = ContextWaitEvent()
+        }
+
+        return reference
+    }
+
+    @discardableResult
+    func allocateBufferIfNeeded(_ buffer: Buffer, forceGPUPrivate: Bool) -> HeadlessBufferReference {
+        if let reference = self.bufferReferences[buffer] {
+            return reference
+        }
+        return self.allocateBuffer(buffer, forceGPUPrivate: forceGPUPrivate)
+    }
+
+    @discardableResult
+    func allocateArgumentBufferIfNeeded(_ argumentBuffer: ArgumentBuffer) -> HeadlessBufferReference {
+        if let baseArray = argumentBuffer.sourceArray {
+            _ = self.allocateArgumentBufferArrayIfNeeded(baseArray)
+            return self.argumentBufferReferences[argumentBuffer]!
+        }
+        if let reference = self.argumentBufferReferences[argumentBuffer] {
+            return reference
+        }
+
+        let storage = HeadlessBuffer(length: HeadlessBackend.encodedLength(for: argumentBuffer), isCPUAccessible: true)
+        let reference = HeadlessBufferReference(buffer: Unmanaged.passRetained(storage), offset: 0)
+        self.frameArgumentBufferStorage.append(reference._buffer)
+
+        self.argumentBufferReferences[argumentBuffer] = reference
+        self.argumentBufferWaitEvents[argumentBuffer] = ContextWaitEvent()
+
+        return reference
+    }
+
+    @discardableResult
+    func allocateArgumentBufferArrayIfNeeded(_ argumentBufferArray: ArgumentBufferArray) -> HeadlessBufferReference {
+        if let reference = self.argumentBufferArrayReferences[argumentBufferArray] {
+            return reference
+        }
+
+        let elementLength = HeadlessBackend.encodedElementLength(for: argumentBufferArray)
+        let storage = HeadlessBuffer(length: elementLength * argumentBufferArray._bindings.count, isCPUAccessible: true)
+        let reference = HeadlessBufferReference(buffer: Unmanaged.passRetained(storage), offset: 0)
+        self.frameArgumentBufferStorage.append(reference._buffer)
+
+        for (i, argumentBuffer) in argumentBufferArray._bindings.enumerated() {
+            guard let argumentBuffer = argumentBuffer else { continue }
+
+            self.argumentBufferReferences[argumentBuffer] = HeadlessBufferReference(buffer: reference._buffer, offset: i * elementLength)
+            self.argumentBufferWaitEvents[argumentBuffer] = ContextWaitEvent()
+        }
+
+        self.argumentBufferArrayReferences[argumentBufferArray] = reference
+        self.argumentBufferArrayWaitEvents[argumentBufferArray] = ContextWaitEvent()
+
+        return reference
+    }
+
+    subscript(texture: Texture) -> HeadlessTextureReference? {
+        return self.textureReferences[texture]
+    }
+
+    subscript(buffer: Buffer) -> HeadlessBufferReference? {
+        return self.bufferReferences[buffer]
+    }
+
+    subscript(argumentBuffer: ArgumentBuffer) -> HeadlessBufferReference? {
+        return self.argumentBufferReferences[argumentBuffer]
+    }
+
+    subscript(argumentBufferArray: ArgumentBufferArray) -> HeadlessBufferReference? {
+        return self.argumentBufferArrayReferences[argumentBufferArray]
+    }
+
+    func withHeapAliasingFencesIfPresent(for resourceHandle: Resource.Handle, perform: (inout [FenceDependency]) -> Void) {
+        // No resources are heap-aliased, so there are never any fences.
+    }
+
+    func setDisposalFences(on resource: Resource, to fences: [FenceDependency]) {
+        assert(Self.isAliasingCandidate(resource: resource))
+    }
+
+    func disposeTexture(_ texture: Texture, waitEvent: ContextWaitEvent) {
+        // We keep the reference around until the end of the frame since allocation/disposal is all processed ahead of time.
+        let reference: HeadlessTextureReference?
+        if texture._usesPersistentRegistry {
+            precondition(texture.flags.contains(.historyBuffer))
+            reference = self.persistentRegistry.textureReferences[texture]
+            _ = reference?._texture.retain() // since the persistent registry releases its resources unconditionally on dispose.
+        } else {
+            reference = self.textureReferences[texture]
+        }
+
+        if let reference = reference {
+            CommandEndActionManager.manager.enqueue(action: .release(Unmanaged.fromOpaque(reference._texture.toOpaque())), after: waitEvent.waitValue, on: self.queue)
+        }
+    }
+
+    func disposeBuffer(_ buffer: Buffer, waitEvent: ContextWaitEvent) {
+        // We keep the reference around until the end of the frame since allocation/disposal is all processed ahead of time.
+        let reference: HeadlessBufferReference?
+        if buffer._usesPersistentRegistry {
+            precondition(buffer.flags.contains(.historyBuffer))
+            reference = self.persistentRegistry.bufferReferences[buffer]
+            _ = reference?._buffer.retain() // since the persistent registry releases its resources unconditionally on dispose.
+        } else {
+            reference = self.bufferReferences[buffer]
+        }
+
+        if let reference = reference {
+            CommandEndActionManager.manager.enqueue(action: .release(Unmanaged.fromOpaque(reference._buffer.toOpaque())), after: waitEvent.waitValue, on: self.queue)
+        }
+    }
+
+    func disposeArgumentBuffer(_ buffer: ArgumentBuffer, waitEvent: ContextWaitEvent) {
+        // Argument buffer storage is released in bulk in cycleFrames.
+    }
+
+    func disposeArgumentBufferArray(_ buffer: ArgumentBufferArray, waitEvent: ContextWaitEvent) {
+        // Argument buffer storage is released in bulk in cycleFrames.
+    }
+
+    func clearWindowTextures() {
+        self.frameWindowTextureCount = 0
+    }
+
+    func cycleFrames() {
+        // Clear all transient resources at the end of the frame.
+        self.textureReferences.removeAll()
+        self.bufferReferences.removeAll()
+        self.argumentBufferReferences.removeAll()
+        self.argumentBufferArrayReferences.removeAll()
+
+        // cycleFrames is called after the frame's command buffers have been submitted.
+        let frameCompletionValue = self.queue.lastSubmittedCommand
+        for storage in self.frameArgumentBufferStorage {
+            CommandEndActionManager.manager.enqueue(action: .release(Unmanaged.fromOpaque(storage.toOpaque())), after: frameCompletionValue, on: self.queue)
+        }
+        self.frameArgumentBufferStorage.removeAll(keepingCapacity: true)
+    }
+}
@@ -370,6 +370,11 @@ final class MetalBackend : SpecificRenderBackend {
         return !self.isAppleSiliconGPU
     }
     
+    var supportsIndirectFirstInstance: Bool {
+        // Supported by all Mac GPUs and by Apple GPUs from family 3 onwards.
+        return true
+    }
+    
     static func fillArgumentBuffer(_ argumentBuffer: ArgumentBuffer, storage: MTLBufferReference, firstUseCommandIndex: Int, resourceMap: FrameResourceMap<MetalBackend>) {
         argumentBuffer.setArguments(storage: storage, resourceMap: resourceMap)
     }
@@ -445,56 +450,10 @@ final class MetalBackend : SpecificRenderBackend {
         
         let allocator = ThreadLocalTagAllocator(tag: .renderGraphResourceCommandArrayTag)
         
-        var currentEncoderIndex = 0
-        var currentEncoder = commandInfo.commandEncoders[currentEncoderIndex]
-        
-        
-        var barrierResources: [Unmanaged<MTLResource>] = []
-        barrierResources.reserveCapacity(8) // we use memoryBarrier(resource) for up to eight resources, and memoryBarrier(scope) otherwise.
-        
-        var barrierScope: MTLBarrierScope = []
-        var barrierAfterStages: MTLRenderStages = []
-        var barrierBeforeStages: MTLRenderStages = []
-        var barrierLastIndex: Int = .max
-        
-        var encoderResidentResources = Set<MetalResidentResource>()
-        
-        var encoderUseResourceCommandIndex: Int = .max
-        var encoderUseResources = [UseResourceKey: [Unmanaged<MTLResource>]]()
-        
-        let addBarrier: (inout [CompactedResourceCommand<MetalCompactedResourceCommandType>]) -> Void = { compactedResourceCommands in
-            #if os(macOS) || targetEnvironment(macCatalyst)
-            let isRTBarrier = barrierScope.contains(.renderTargets) && !self.isAppleSiliconGPU
-            #else
-            let isRTBarrier = false
-            #endif
-            if barrierResources.count <= 8, !isRTBarrier {
-                let memory = allocator.allocate(capacity: barrierResources.count) as UnsafeMutablePointer<Unmanaged<MTLResource>>
-                memory.assign(from: barrierResources, count: barrierResources.count)
-                let bufferPointer = UnsafeMutableBufferPointer<MTLResource>(start: UnsafeMutableRawPointer(memory).assumingMemoryBound(to: MTLResource.self), count: barrierResources.count)
-                
-                compactedResourceCommands.append(.init(command: .resourceMemoryBarrier(resources: bufferPointer, afterStages: barrierAfterStages.last, beforeStages: barrierBeforeStages.first), index: barrierLastIndex, order: .before))
-            } else {
-                compactedResourceCommands.append(.init(command: .scopedMemoryBarrier(scope: barrierScope, afterStages: barrierAfterStages.last, beforeStages: barrierBeforeStages.first), index: barrierLastIndex, order: .before))
-            }
-            barrierResources.removeAll(keepingCapacity: true)
-            barrierScope = []
-            barrierAfterStages = []
-            barrierBeforeStages = []
-            barrierLastIndex = .max
-        }
-        
-        let useResources: (inout [CompactedResourceCommand<MetalCompactedResourceCommandType>]) -> Void = { compactedResourceCommands in
-            for (key, resources) in encoderUseResources where !resources.isEmpty {
-                let memory = allocator.allocate(capacity: resources.count) as UnsafeMutablePointer<Unmanaged<MTLResource>>
-                memory.assign(from: resources, count: resources.count)
-                let bufferPointer = UnsafeMutableBufferPointer<MTLResource>(start: UnsafeMutableRawPointer(memory).assumingMemoryBound(to: MTLResource.self), count: resources.count)
-                
-                compactedResourceCommands.append(.init(command: .useResources(bufferPointer, usage: key.usage, stages: key.stages), index: encoderUseResourceCommandIndex, order: .before))
-            }
-            encoderUseResourceCommandIndex = .max
-            encoderUseResources.removeAll(keepingCapacity: true)
-            encoderResidentResources.removeAll(keepingCapacity: true)
+        let makeBuffer: ([Unmanaged<MTLResource>]) -> UnsafeMutableBufferPointer<MTLResource> = { resources in
+            let memory = allocator.allocate(capacity: resources.count) as UnsafeMutablePointer<Unmanaged<MTLResource>>
+            memory.assign(from: resources, count: resources.count)
+            return UnsafeMutableBufferPointer<MTLResource>(start: UnsafeMutableRawPointer(memory).assumingMemoryBound(to: MTLResource.self), count: resources.count)
         }
         
         let getResource: (Resource) -> Unmanaged<MTLResource>? = { resource in
@@ -508,27 +467,16 @@ final class MetalBackend : SpecificRenderBackend {
             fatalError()
         }
         
-        for command in commandGenerator.commands {
-            if command.index >= barrierLastIndex { // For barriers, the barrier associated with command.index needs to happen _after_ any barriers required to happen _by_ barrierLastIndex
-                addBarrier(&compactedResourceCommands)
-            }
-            
-            while !currentEncoder.commandRange.contains(command.index) {
-                currentEncoderIndex += 1
-                currentEncoder = commandInfo.commandEncoders[currentEncoderIndex]
-                
-                useResources(&compactedResourceCommands)
-                
-                assert(barrierScope == [])
-                assert(barrierResources.isEmpty)
-            }
-            
-            // Strategy:
-            // useResource should be batched together by usage to as early as possible in the encoder.
-            // memoryBarriers should be as late as possible.
-            switch command.command {
-            case .useResource(let resource, let usage, let stages, let allowReordering):
-                guard let mtlResource = getResource(resource) else { break }
+        var barrierResources: [Unmanaged<MTLResource>] = []
+        barrierResources.reserveCapacity(8) // we use memoryBarrier(resource) for up to eight resources, and memoryBarrier(scope) otherwise.
+        
+        var barrierScope: MTLBarrierScope = []
+        var barrierAfterStages: MTLRenderStages = []
+        var barrierBeforeStages: MTLRenderStages = []
+        
+        commandGenerator.compactResourceCommands(commandInfo: commandInfo, into: &compactedResourceCommands,
+            useResourceKey: { resource, usage, stages in
+                guard let mtlResource = getResource(resource) else { return nil }
                 
                 var computedUsageType: MTLResourceUsage = []
                 if usage == .inputAttachmentRenderTarget || usage == .inputAttachment {
@@ -546,22 +494,14 @@ final class MetalBackend : SpecificRenderBackend {
                     }
                 }
                 
-                if !allowReordering {
-                    let memory = allocator.allocate(capacity: 1) as UnsafeMutablePointer<Unmanaged<MTLResource>>
-                    memory.initialize(to: mtlResource)
-                    let bufferPointer = UnsafeMutableBufferPointer<MTLResource>(start: UnsafeMutableRawPointer(memory).assumingMemoryBound(to: MTLResource.self), count: 1)
-                    compactedResourceCommands.append(.init(command: .useResources(bufferPointer, usage: computedUsageType, stages: MTLRenderStages(stages)), index: command.index, order: .before))
-                } else {
-                    let key = MetalResidentResource(resource: mtlResource, stages: MTLRenderStages(stages), usage: computedUsageType)
-                    let (inserted, _) = encoderResidentResources.insert(key)
-                    if inserted {
-                        encoderUseResources[UseResourceKey(stages: MTLRenderStages(stages), usage: computedUsageType), default: []].append(mtlResource)
-                    }
-                    encoderUseResourceCommandIndex = min(command.index, encoderUseResourceCommandIndex)
-                }
-                
-            case .memoryBarrier(let resource, let afterUsage, let afterStages, let beforeCommand, let beforeUsage, let beforeStages, _):
-                
+                return (key: UseResourceKey(stages: MTLRenderStages(stages), usage: computedUsageType),
+                        residentKey: MetalResidentResource(resource: mtlResource, stages: MTLRenderStages(stages), usage: computedUsageType),
+                        element: mtlResource)
+            },
+            makeUseResourcesCommand: { key, resources in
+                return .useResources(makeBuffer(resources), usage: key.usage, stages: key.stages)
+            },
+            addToBarrier: { resource, afterUsage, afterStages, beforeUsage, beforeStages in
                 var scope: MTLBarrierScope = []
                 
                 #if os(macOS) || targetEnvironment(macCatalyst)
@@ -591,16 +531,25 @@ final class MetalBackend : SpecificRenderBackend {
                 barrierScope.formUnion(scope)
                 barrierAfterStages.formUnion(MTLRenderStages(afterStages))
                 barrierBeforeStages.formUnion(MTLRenderStages(beforeStages))
-                barrierLastIndex = min(beforeCommand, barrierLastIndex)
-            }
-        }
-        
-        if barrierLastIndex < .max {
-            addBarrier(&compactedResourceCommands)
-        }
-        useResources(&compactedResourceCommands)
-        
-        compactedResourceCommands.sort()
+            },
+            makeBarrierCommand: {
+                #if os(macOS) || targetEnvironment(macCatalyst)
+                let isRTBarrier = barrierScope.contains(.renderTargets) && !self.isAppleSiliconGPU
+                #else
+                let isRTBarrier = false
+                #endif
+                let command: MetalCompactedResourceCommandType
+                if barrierResources.count <= 8, !isRTBarrier {
+                    command = .resourceMemoryBarrier(resources: makeBuffer(barrierResources), afterStages: barrierAfterStages.last, beforeStages: barrierBeforeStages.first)
+                } else {
+                    command = .scopedMemoryBarrier(scope: barrierScope, afterStages: barrierAfterStages.last, beforeStages: barrierBeforeStages.first)
+                }
+                barrierResources.removeAll(keepingCapacity: true)
+                barrierScope = []
+                barrierAfterStages = []
+                barrierBeforeStages = []
+                return command
+            })
     }
     
     func didCompleteCommand(_ index: UInt64, queue: Queue, context: RenderGraphContextImpl<MetalBackend>) {
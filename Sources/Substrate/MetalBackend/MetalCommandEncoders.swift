@@ -271,11 +271,30 @@ final class FGMTLThreadRenderCommandEncoder {
         case .drawPrimitives(let args):
             encoder.drawPrimitives(type: MTLPrimitiveType(args.pointee.primitiveType), vertexStart: Int(args.pointee.vertexStart), vertexCount: Int(args.pointee.vertexCount), instanceCount: Int(args.pointee.instanceCount), baseInstance: Int(args.pointee.baseInstance))
             
+        case .drawPrimitivesIndirect(let args):
+            let indirectBuffer = resourceMap[args.pointee.indirectBuffer]!
+            
+            // Metal can't read a draw count on the GPU outside of an MTLIndirectCommandBuffer, so the count is ignored and
+            // unused draws are expected to have a zero instance count.
+            for i in 0..<Int(args.pointee.drawCount) {
+                encoder.drawPrimitives(type: MTLPrimitiveType(args.pointee.primitiveType), indirectBuffer: indirectBuffer.buffer, indirectBufferOffset: Int(args.pointee.indirectBufferOffset) + indirectBuffer.offset + i * Int(args.pointee.stride))
+            }
+            
         case .drawIndexedPrimitives(let args):
             let indexBuffer = resourceMap[args.pointee.indexBuffer]!
             
             encoder.drawIndexedPrimitives(type: MTLPrimitiveType(args.pointee.primitiveType), indexCount: Int(args.pointee.indexCount), indexType: MTLIndexType(args.pointee.indexType), indexBuffer: indexBuffer.buffer, indexBufferOffset: Int(args.pointee.indexBufferOffset) + indexBuffer.offset, instanceCount: Int(args.pointee.instanceCount), baseVertex: Int(args.pointee.baseVertex), baseInstance: Int(args.pointee.baseInstance))
             
+        case .drawIndexedPrimitivesIndirect(let args):
+            let indexBuffer = resourceMap[args.pointee.indexBuffer]!
+            let indirectBuffer = resourceMap[args.pointee.indirectBuffer]!
+            
+            // Metal has no multi-draw indirect for render encoders, so issue one indirect draw per set of arguments.
+            // As for drawPrimitivesIndirect, any draw count is ignored.
+            for i in 0..<Int(args.pointee.drawCount) {
+                encoder.drawIndexedPrimitives(type: MTLPrimitiveType(args.pointee.primitiveType), indexType: MTLIndexType(args.pointee.indexType), indexBuffer: indexBuffer.buffer, indexBufferOffset: Int(args.pointee.indexBufferOffset) + indexBuffer.offset, indirectBuffer: indirectBuffer.buffer, indirectBufferOffset: Int(args.pointee.indirectBufferOffset) + indirectBuffer.offset + i * Int(args.pointee.stride))
+            }
+            
         case .setViewport(let viewportPtr):
             encoder.setViewport(MTLViewport(viewportPtr.pointee))
             
@@ -538,7 +538,7 @@ final class MetalTransientResourceRegistry: BackendTransientResourceRegistry {
         return self.frameArgumentBufferAllocator
     }
     
-    static func isAliasedHeapResource(resource: Resource) -> Bool {
+    static func isAliasingCandidate(resource: Resource) -> Bool {
         let flags = resource.flags
         let storageMode : StorageMode = resource.storageMode
         
@@ -556,23 +556,25 @@ final class MetalTransientResourceRegistry: BackendTransientResourceRegistry {
     func computeTextureUsage(_ texture: Texture, storedTextures: [Texture]) -> MTLTextureUsageProperties {
         var textureUsage : MTLTextureUsage = []
         
-        for usage in texture.usages {
-            switch usage.type {
-            case .read:
-                textureUsage.formUnion(.shaderRead)
-            case .write:
-                textureUsage.formUnion(.shaderWrite)
-            case .readWrite:
-                textureUsage.formUnion([.shaderRead, .shaderWrite])
-            case  .inputAttachmentRenderTarget:
-                textureUsage.formUnion(.renderTarget)
-                if RenderBackend.requiresEmulatedInputAttachments {
+        texture.usages.withContiguousChunks { usages in
+            for usage in usages {
+                switch usage.type {
+                case .read:
                     textureUsage.formUnion(.shaderRead)
+                case .write:
+                    textureUsage.formUnion(.shaderWrite)
+                case .readWrite:
+                    textureUsage.formUnion([.shaderRead, .shaderWrite])
+                case  .inputAttachmentRenderTarget:
+                    textureUsage.formUnion(.renderTarget)
+                    if RenderBackend.requiresEmulatedInputAttachments {
+                        textureUsage.formUnion(.shaderRead)
+                    }
+                case .readWriteRenderTarget, .writeOnlyRenderTarget, .unusedRenderTarget:
+                    textureUsage.formUnion(.renderTarget)
+                default:
+                    break
                 }
-            case .readWriteRenderTarget, .writeOnlyRenderTarget, .unusedRenderTarget:
-                textureUsage.formUnion(.renderTarget)
-            default:
-                break
             }
         }
         
@@ -841,7 +843,7 @@ final class MetalTransientResourceRegistry: BackendTransientResourceRegistry {
     }
     
     func setDisposalFences(on resource: Resource, to fences: [FenceDependency]) {
-        assert(Self.isAliasedHeapResource(resource: resource))
+        assert(Self.isAliasingCandidate(resource: resource))
         self.heapResourceDisposalFences[resource] = fences
     }
     
@@ -869,7 +871,7 @@ final class MetalTransientResourceRegistry: BackendTransientResourceRegistry {
             }
             
             var fences : [FenceDependency] = []
-            if Self.isAliasedHeapResource(resource: Resource(texture)) {
+            if self.isAliasedHeapResource(resource: Resource(texture)) {
                 fences = self.heapResourceDisposalFences[Resource(texture)] ?? []
             }
             
@@ -892,7 +894,7 @@ final class MetalTransientResourceRegistry: BackendTransientResourceRegistry {
         
         if let mtlBuffer = bufferRef {
             var fences : [FenceDependency] = []
-            if Self.isAliasedHeapResource(resource: Resource(buffer)) {
+            if self.isAliasedHeapResource(resource: Resource(buffer)) {
                 fences = self.heapResourceDisposalFences[Resource(buffer)] ?? []
             }
             
@@ -23,6 +23,8 @@ struct FenceDependency {
     var encoderIndex: Int
     var index: Int // The index of the dependency within the command stream
     var stages: RenderStages
+    /// The usage that signals or waits on the dependency, if known. Used to scope heap aliasing barriers.
+    var usage: ResourceUsage? = nil
 }
 
 // For fence tracking - support at most one dependency between each set of two render passes. Make the fence update as early as possible, and make the fence wait as late as possible.
@@ -61,6 +63,11 @@ struct FineDependency: Dependency {
     var wait : FenceDependency
     
     var resources: [(Resource, producingUsage: ResourceUsage, consumingUsage: ResourceUsage)]
+    /// Whether the consuming encoder uses memory that was previously used by a different resource in the producing encoder.
+    var isAliasingDependency: Bool = false
+    /// For aliasing dependencies, the last usages of the memory's previous occupants and the first usages of its new occupants.
+    /// Empty if any of the usages are unknown, in which case the dependency must cover all commands.
+    var aliasedUsages: [(producingUsage: ResourceUsage, consumingUsage: ResourceUsage)] = []
     
     init(resource: Resource,
          producingUsage: ResourceUsage, producingEncoder: Int, consumingUsage: ResourceUsage, consumingEncoder: Int) {
@@ -75,9 +82,11 @@ struct FineDependency: Dependency {
         self.signal = signal
         self.wait = wait
         // Heap aliasing dependency with no associated resources.
-        // TODO: check that this is correct once the Vulkan backend supports resource aliasing.
         self.resources = []
-    
+        self.isAliasingDependency = true
+        if let producingUsage = signal.usage, let consumingUsage = wait.usage {
+            self.aliasedUsages = [(producingUsage, consumingUsage)]
+        }
     }
     
     public func merged(with otherDependency: FineDependency) -> FineDependency {
@@ -90,6 +99,17 @@ struct FineDependency: Dependency {
         
         result.resources.append(contentsOf: otherDependency.resources)
         
+        if result.isAliasingDependency, otherDependency.isAliasingDependency {
+            if result.aliasedUsages.isEmpty || otherDependency.aliasedUsages.isEmpty {
+                result.aliasedUsages = [] // Unknown usages on either side widen the whole dependency.
+            } else {
+                result.aliasedUsages.append(contentsOf: otherDependency.aliasedUsages)
+            }
+        } else if otherDependency.isAliasingDependency {
+            result.aliasedUsages = otherDependency.aliasedUsages
+        }
+        result.isAliasingDependency = result.isAliasingDependency || otherDependency.isAliasingDependency
+        
         return result
     }
 }
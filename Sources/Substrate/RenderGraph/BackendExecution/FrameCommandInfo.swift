@@ -15,6 +15,9 @@ struct CommandEncoderInfo<RenderTargetDescriptor: BackendRenderTargetDescriptor>
     var commandBufferIndex: Int
     var queueFamilyIndex: Int // corresponding to the Vulkan concept of queue families; this indicates whether e.g. the encoder is executed on the main render queue vs async compute etc.
     
+    static var mainQueueFamilyIndex: Int { return 0 }
+    static var asyncComputeQueueFamilyIndex: Int { return 1 }
+    
     var passRange: Range<Int>
     var commandRange: Range<Int>
     
@@ -31,10 +34,20 @@ struct FrameCommandInfo<Backend: SpecificRenderBackend> {
     let passEncoderIndices: [Int]
     var commandEncoders: [CommandEncoderInfo<Backend.RenderTargetDescriptor>]
     
+    /// The value each command buffer's completion is signalled with on the context's queue.
+    /// Command buffers on the async compute queue don't signal the context's queue; instead, the frame's last command buffer
+    /// waits for them, and so their value is the last command buffer's value.
+    let commandBufferSignalValues: [UInt64]
+    /// For each command buffer, the command buffers on other queues that it must wait for.
+    private(set) var commandBufferQueueDependencies: [[Int]]
+    
     // storedTextures contain all textures that are stored to (i.e. textures that aren't eligible to be memoryless on iOS).
     var storedTextures: [Texture]
     
-    init(passes: [RenderPassRecord], initialCommandBufferSignalValue: UInt64) {
+    /// Whether the backend should record timestamps at the start and end of each command encoder, for `RenderGraphFrameProfile`.
+    var recordsGPUTimestamps = false
+    
+    init(passes: [RenderPassRecord], initialCommandBufferSignalValue: UInt64, supportsAsyncCompute: Bool = false) {
         self.globalFrameIndex = RenderGraph.globalSubmissionIndex
         self.passes = passes
         self.baseCommandBufferSignalValue = initialCommandBufferSignalValue
@@ -47,7 +60,6 @@ struct FrameCommandInfo<Backend: SpecificRenderBackend> {
         
         do {
             var commandEncoders = [CommandEncoderInfo<Backend.RenderTargetDescriptor>]()
-            var commandBufferIndex = 0
             
             let addEncoder = { (passRange: Range<Int>, usesWindowTexture: Bool) -> Void in
                 let name: String
@@ -57,17 +69,15 @@ struct FrameCommandInfo<Backend: SpecificRenderBackend> {
                     name = "[\(passes[passRange.first!].name)...\(passes[passRange.last!].name)] (\(passRange.count) passes)"
                 }
                 
-                let queueFamilyIndex = 0 // TODO: correctly compute this for Vulkan.
-                
-                if let previousEncoder = commandEncoders.last,
-                   previousEncoder.usesWindowTexture != usesWindowTexture || previousEncoder.queueFamilyIndex != queueFamilyIndex {
-                    commandBufferIndex += 1
+                var queueFamilyIndex = CommandEncoderInfo<Backend.RenderTargetDescriptor>.mainQueueFamilyIndex
+                if supportsAsyncCompute, passes[passRange].allSatisfy({ ($0.pass as? ComputeRenderPass)?.allowsAsyncCompute ?? false }) {
+                    queueFamilyIndex = CommandEncoderInfo<Backend.RenderTargetDescriptor>.asyncComputeQueueFamilyIndex
                 }
                 
                 commandEncoders.append(CommandEncoderInfo(name: name,
                                                           type: passes[passRange.first!].type,
                                                           renderTargetDescriptor: renderTargetDescriptors[passRange.lowerBound],
-                                                          commandBufferIndex: commandBufferIndex,
+                                                          commandBufferIndex: 0,
                                                           queueFamilyIndex: queueFamilyIndex,
                                                           passRange: passRange,
                                                           commandRange: passes[passRange.first!].commandRange!.lowerBound..<passes[passRange.last!].commandRange!.upperBound,
@@ -96,7 +106,43 @@ struct FrameCommandInfo<Backend: SpecificRenderBackend> {
                 addEncoder(encoderFirstPass..<passes.count, encoderUsesWindowTexture)
             }
             
+            // The frame's completion is tracked by its last command buffer, so async compute work must be followed by
+            // main queue work that can wait for it.
+            let lastMainQueueEncoder = commandEncoders.lastIndex(where: { $0.queueFamilyIndex == CommandEncoderInfo<Backend.RenderTargetDescriptor>.mainQueueFamilyIndex }) ?? -1
+            for i in (lastMainQueueEncoder + 1)..<commandEncoders.count {
+                commandEncoders[i].queueFamilyIndex = CommandEncoderInfo<Backend.RenderTargetDescriptor>.mainQueueFamilyIndex
+            }
+            
+            var commandBufferIndex = 0
+            var commandBufferSignalValues = [UInt64]()
+            var mainQueueCommandBufferCount = 0
+            for i in commandEncoders.indices {
+                if i > 0 {
+                    let previousEncoder = commandEncoders[i - 1]
+                    if previousEncoder.usesWindowTexture != commandEncoders[i].usesWindowTexture || previousEncoder.queueFamilyIndex != commandEncoders[i].queueFamilyIndex {
+                        commandBufferIndex += 1
+                    }
+                }
+                commandEncoders[i].commandBufferIndex = commandBufferIndex
+                
+                if commandBufferIndex == commandBufferSignalValues.count {
+                    if commandEncoders[i].queueFamilyIndex == CommandEncoderInfo<Backend.RenderTargetDescriptor>.mainQueueFamilyIndex {
+                        commandBufferSignalValues.append(initialCommandBufferSignalValue + UInt64(mainQueueCommandBufferCount))
+                        mainQueueCommandBufferCount += 1
+                    } else {
+                        commandBufferSignalValues.append(0) // Filled in below.
+                    }
+                }
+            }
+            
+            let lastSignalValue = initialCommandBufferSignalValue + UInt64(max(mainQueueCommandBufferCount, 1) - 1)
+            for i in commandEncoders.indices where commandEncoders[i].queueFamilyIndex != CommandEncoderInfo<Backend.RenderTargetDescriptor>.mainQueueFamilyIndex {
+                commandBufferSignalValues[commandEncoders[i].commandBufferIndex] = lastSignalValue
+            }
+            
             self.commandEncoders = commandEncoders
+            self.commandBufferSignalValues = commandBufferSignalValues
+            self.commandBufferQueueDependencies = [[Int]](repeating: [], count: commandBufferSignalValues.count)
             
             var passEncoderIndices = [Int](repeating: 0, count: passes.count)
             var encoderIndex = 0
@@ -132,7 +178,34 @@ struct FrameCommandInfo<Backend: SpecificRenderBackend> {
     }
     
     public func signalValue(commandBufferIndex: Int) -> UInt64 {
-        return self.baseCommandBufferSignalValue + UInt64(commandBufferIndex)
+        return self.commandBufferSignalValues[commandBufferIndex]
+    }
+    
+    public func queueFamilyIndex(commandBufferIndex: Int) -> Int {
+        return self.commandEncoders.first(where: { $0.commandBufferIndex == commandBufferIndex })!.queueFamilyIndex
+    }
+    
+    /// Computes which command buffers need to wait for command buffers on other queues, based on the dependencies between encoders.
+    mutating func computeQueueDependencies<Dependency>(encoderDependencies: DependencyTable<Dependency?>) {
+        guard self.commandEncoders.contains(where: { $0.queueFamilyIndex != CommandEncoderInfo<Backend.RenderTargetDescriptor>.mainQueueFamilyIndex }) else { return }
+        
+        for dependentIndex in self.commandEncoders.indices {
+            let dependent = self.commandEncoders[dependentIndex]
+            for sourceIndex in 0..<dependentIndex where encoderDependencies.dependency(from: dependentIndex, on: sourceIndex) != nil {
+                let source = self.commandEncoders[sourceIndex]
+                if source.queueFamilyIndex != dependent.queueFamilyIndex, !self.commandBufferQueueDependencies[dependent.commandBufferIndex].contains(source.commandBufferIndex) {
+                    self.commandBufferQueueDependencies[dependent.commandBufferIndex].append(source.commandBufferIndex)
+                }
+            }
+        }
+        
+        // The last command buffer signals the frame's completion, so it needs to wait for all async compute work.
+        let lastCommandBufferIndex = self.commandBufferCount - 1
+        for encoder in self.commandEncoders where encoder.queueFamilyIndex != CommandEncoderInfo<Backend.RenderTargetDescriptor>.mainQueueFamilyIndex {
+            if !self.commandBufferQueueDependencies[lastCommandBufferIndex].contains(encoder.commandBufferIndex) {
+                self.commandBufferQueueDependencies[lastCommandBufferIndex].append(encoder.commandBufferIndex)
+            }
+        }
     }
     
     // Generates a render target descriptor, if applicable, for each pass.
@@ -10,8 +10,14 @@ import Foundation
 import Dispatch
 
 extension TaggedHeap.Tag {
+    /// The tag for the compacted resource commands of the execution in `executionSlot`, which last until it has been submitted.
+    static func renderGraphResourceCommandArrayTag(executionSlot: Int) -> Self {
+        return 2807157891446559070 &+ Self(executionSlot)
+    }
+    
+    /// The tag for the compacted resource commands of the execution that's currently being prepared.
     static var renderGraphResourceCommandArrayTag: Self {
-        return 2807157891446559070
+        return .renderGraphResourceCommandArrayTag(executionSlot: RenderGraph.activeExecutionSlot)
     }
 }
 
@@ -64,21 +70,33 @@ final class RenderGraphContextImpl<Backend: SpecificRenderBackend>: _RenderGraph
         return FrameResourceMap<Backend>(persistentRegistry: self.backend.resourceRegistry, transientRegistry: self.resourceRegistry)
     }
 
-    func executeRenderGraph(passes: [RenderPassRecord], usedResources: Set<Resource>, dependencyTable: DependencyTable<Substrate.DependencyType>, completion: @escaping (Double) -> Void) {
+    func executeRenderGraph(passes: [RenderPassRecord], usedResources: Set<Resource>, dependencyTable: DependencyTable<Substrate.DependencyType>, profile: RenderGraphFrameProfile?, completion: @escaping (Double) -> Void) -> Int {
+        defer { self.backend.setActiveContext(nil) }
         
-        // Use separate command buffers for onscreen and offscreen work (Delivering Optimised Metal Apps and Games, WWDC 2019)
-        self.resourceRegistry?.prepareFrame()
+        guard let frameCommandInfo = self.generateFrameCommands(passes: passes, usedResources: usedResources, profile: profile, completion: completion) else { return 0 }
+        let deferredDrawCount = self.encodeAndSubmit(frameCommandInfo: frameCommandInfo, passes: passes, profile: profile, completion: completion)
+        self.endFrame(profile: profile)
+        return deferredDrawCount
+    }
+    
+    func prepareRenderGraph(passes: [RenderPassRecord], usedResources: Set<Resource>, dependencyTable: DependencyTable<Substrate.DependencyType>, profile: RenderGraphFrameProfile?, completion: @escaping (Double) -> Void) -> () -> Int {
+        // Encoding doesn't access resources from the CPU, so another RenderGraph can become active while this frame is encoded.
+        defer { self.backend.setActiveContext(nil) }
         
-        defer {
-            TaggedHeap.free(tag: .renderGraphResourceCommandArrayTag)
-            
-            self.resourceRegistry?.cycleFrames()
-            
-            self.commandGenerator.reset()
-            self.compactedResourceCommands.removeAll(keepingCapacity: true)
-            
-            self.backend.setActiveContext(nil)
+        guard let frameCommandInfo = self.generateFrameCommands(passes: passes, usedResources: usedResources, profile: profile, completion: completion) else { return { 0 } }
+        self.acquireWindowTextures(frameCommandInfo: frameCommandInfo)
+        
+        return {
+            let deferredDrawCount = self.encodeAndSubmit(frameCommandInfo: frameCommandInfo, passes: passes, profile: profile, completion: completion)
+            self.endFrame(profile: profile)
+            return deferredDrawCount
         }
+    }
+    
+    /// Returns nil if there are no passes to encode, in which case the frame has already been ended.
+    private func generateFrameCommands(passes: [RenderPassRecord], usedResources: Set<Resource>, profile: RenderGraphFrameProfile?, completion: @escaping (Double) -> Void) -> FrameCommandInfo<Backend>? {
+        // Use separate command buffers for onscreen and offscreen work (Delivering Optimised Metal Apps and Games, WWDC 2019)
+        self.resourceRegistry?.prepareFrame()
         
         if passes.isEmpty {
             if self.renderGraphQueue.lastCompletedCommand >= self.renderGraphQueue.lastSubmittedCommand {
@@ -90,20 +108,75 @@ final class RenderGraphContextImpl<Backend: SpecificRenderBackend>: _RenderGraph
                     self.enqueuedEmptyFrameCompletionHandlers.append((self.queueCommandBufferIndex, completion))
                 }
             }
-            return
+            self.endFrame(profile: profile)
+            return nil
+        }
+        
+        var frameCommandInfo = FrameCommandInfo<Backend>(passes: passes, initialCommandBufferSignalValue: self.queueCommandBufferIndex + 1, supportsAsyncCompute: backend.supportsAsyncCompute)
+        frameCommandInfo.recordsGPUTimestamps = profile != nil
+        profile.measure("Generate Resource Commands") {
+            self.commandGenerator.generateCommands(passes: passes, usedResources: usedResources, transientRegistry: self.resourceRegistry, backend: backend, frameCommandInfo: &frameCommandInfo)
+            self.commandGenerator.executePreFrameCommands(context: self, frameCommandInfo: &frameCommandInfo)
+            frameCommandInfo.computeQueueDependencies(encoderDependencies: self.commandGenerator.commandEncoderDependencies)
+            self.commandGenerator.commands.sort() // We do this here since executePreFrameCommands may have added to the commandGenerator commands.
+        }
+        profile.measure("Compact Resource Commands") {
+            backend.compactResourceCommands(queue: self.renderGraphQueue, resourceMap: self.resourceMap, commandInfo: frameCommandInfo, commandGenerator: self.commandGenerator, into: &self.compactedResourceCommands)
+        }
+        
+        profile?.updateCounters {
+            $0.resourceCommandCount = self.commandGenerator.commands.count
+            $0.compactedResourceCommandCount = self.compactedResourceCommands.count
+            $0.commandEncoderCount = frameCommandInfo.commandEncoders.count
+            $0.commandBufferCount = frameCommandInfo.commandBufferCount
+        }
+        
+        return frameCommandInfo
+    }
+    
+    private func endFrame(profile: RenderGraphFrameProfile?) {
+        // The compacted resource commands are freed along with the rest of the execution's allocations once it's been submitted.
+        if let profile = profile, let statistics = self.resourceRegistry?.takeAllocationStatistics() {
+            profile.updateCounters {
+                $0.transientBytes = statistics.transientBytes
+                $0.resourcePoolHitCount = statistics.poolHitCount
+                $0.resourcePoolMissCount = statistics.poolMissCount
+            }
         }
         
-        var frameCommandInfo = FrameCommandInfo<Backend>(passes: passes, initialCommandBufferSignalValue: self.queueCommandBufferIndex + 1)
-        self.commandGenerator.generateCommands(passes: passes, usedResources: usedResources, transientRegistry: self.resourceRegistry, backend: backend, frameCommandInfo: &frameCommandInfo)
-        self.commandGenerator.executePreFrameCommands(context: self, frameCommandInfo: &frameCommandInfo)
-        self.commandGenerator.commands.sort() // We do this here since executePreFrameCommands may have added to the commandGenerator commands.
-        backend.compactResourceCommands(queue: self.renderGraphQueue, resourceMap: self.resourceMap, commandInfo: frameCommandInfo, commandGenerator: self.commandGenerator, into: &self.compactedResourceCommands)
+        self.resourceRegistry?.cycleFrames()
+        
+        self.commandGenerator.reset()
+        self.compactedResourceCommands.removeAll(keepingCapacity: true)
+    }
+    
+    /// Retrieves the drawables for the frame's window textures on the calling thread, so that encoding doesn't need to
+    /// synchronise with the main thread when it happens asynchronously.
+    private func acquireWindowTextures(frameCommandInfo: FrameCommandInfo<Backend>) {
+        let resourceMap = self.resourceMap
+        for encoder in frameCommandInfo.commandEncoders where encoder.usesWindowTexture {
+            for pass in frameCommandInfo.passes[encoder.passRange] where pass.usesWindowTexture {
+                for resource in pass.writtenResources where resource.type == .texture && resource.flags.contains(.windowHandle) {
+                    // Failures are reported when the encoder tries to retrieve the texture.
+                    _ = try? resourceMap.renderTargetTexture(Texture(resource)!)
+                }
+            }
+        }
+    }
+    
+    /// Returns the number of draws in the frame that were deferred because their pipeline was being compiled.
+    private func encodeAndSubmit(frameCommandInfo: FrameCommandInfo<Backend>, passes: [RenderPassRecord], profile: RenderGraphFrameProfile?, completion: @escaping (Double) -> Void) -> Int {
+        let resourceMap = self.resourceMap
         
         let lastCommandBufferIndex = frameCommandInfo.commandBufferCount - 1
+        let lastWindowCommandBufferIndex = frameCommandInfo.commandEncoders.last(where: { $0.usesWindowTexture })?.commandBufferIndex
         
         var commandBuffer : Backend.CommandBuffer? = nil
+        var frameCommandBuffers = [Backend.CommandBuffer]()
+        frameCommandBuffers.reserveCapacity(frameCommandInfo.commandBufferCount)
         
         var committedCommandBufferCount = 0
+        var deferredDrawCount = 0
         
         var gpuStartTime: Double = 0.0
         
@@ -111,10 +184,36 @@ final class RenderGraphContextImpl<Backend: SpecificRenderBackend>: _RenderGraph
         
         func processCommandBuffer() {
             if let commandBuffer = commandBuffer {
-                if let transientRegistry = resourceMap.transientRegistry {
+                let submitStartTime = profile != nil ? RenderGraphFrameProfile.currentTime : 0
+                if committedCommandBufferCount == 0 {
+                    profile?.submissionTime = submitStartTime
+                }
+                deferredDrawCount += commandBuffer.deferredDrawCount
+                
+                defer {
+                    profile?.addCPUInterval(name: "Submit Command Buffer \(committedCommandBufferCount - 1)", startTime: submitStartTime, endTime: RenderGraphFrameProfile.currentTime)
+                }
+                
+                // The frame's window textures may have been acquired before encoding, so only present them once all of the encoders that use them are encoded.
+                if committedCommandBufferCount == lastWindowCommandBufferIndex, let transientRegistry = resourceMap.transientRegistry {
                     commandBuffer.presentSwapchains(resourceRegistry: transientRegistry)
                 }
                 
+                if frameCommandInfo.queueFamilyIndex(commandBufferIndex: committedCommandBufferCount) != CommandEncoderInfo<Backend.RenderTargetDescriptor>.mainQueueFamilyIndex {
+                    // Command buffers on other queues don't signal the render graph queue's sync event; the frame's last
+                    // command buffer waits for them, and its completion covers theirs.
+                    let cbIndex = committedCommandBufferCount
+                    commandBuffer.commit(onCompletion: { (commandBuffer) in
+                        if let error = commandBuffer.error {
+                            print("Error executing async compute command buffer \(cbIndex): \(error)")
+                        }
+                        profile?.addGPUIntervals(commandBuffer.encoderGPUIntervals)
+                    })
+                    frameCommandBuffers.append(commandBuffer)
+                    committedCommandBufferCount += 1
+                    return
+                }
+                
                 // Make sure that the sync event value is what we expect, so we don't update it past
                 // the signal for another buffer before that buffer has completed.
                 // We only need to do this if we haven't already waited in this command buffer for it.
@@ -140,6 +239,8 @@ final class RenderGraphContextImpl<Backend: SpecificRenderBackend>: _RenderGraph
                     
                     CommandEndActionManager.manager.didCompleteCommand(queueCBIndex, on: self.renderGraphQueue)
                     
+                    profile?.addGPUIntervals(commandBuffer.encoderGPUIntervals)
+                    
                     if cbIndex == 0 {
                         gpuStartTime = commandBuffer.gpuStartTime
                     }
@@ -164,41 +265,65 @@ final class RenderGraphContextImpl<Backend: SpecificRenderBackend>: _RenderGraph
                         }
                     }
                 })
+                frameCommandBuffers.append(commandBuffer)
                 committedCommandBufferCount += 1
                 
             }
             commandBuffer = nil
         }
         
-        var waitedEvents = QueueCommandIndices(repeating: 0)
+        // Waits on one queue don't apply to the others, so we track the waited values per queue family.
+        var waitedEvents = [QueueCommandIndices](repeating: QueueCommandIndices(repeating: 0), count: 2)
         
-        for (i, encoderInfo) in frameCommandInfo.commandEncoders.enumerated() {
-            let commandBufferIndex = encoderInfo.commandBufferIndex
+        let encodesConcurrently = Backend.CommandBuffer.supportsConcurrentEncoding
+        
+        var encoderIndex = 0
+        while encoderIndex < frameCommandInfo.commandEncoders.count {
+            let commandBufferIndex = frameCommandInfo.commandEncoders[encoderIndex].commandBufferIndex
             if commandBufferIndex != committedCommandBufferCount {
                 processCommandBuffer()
             }
             
+            let queueFamilyIndex = frameCommandInfo.commandEncoders[encoderIndex].queueFamilyIndex
+            let encodeStartTime = profile != nil ? RenderGraphFrameProfile.currentTime : 0
+            
             if commandBuffer == nil {
                 commandBuffer = self.commandQueue.makeCommandBuffer(commandInfo: frameCommandInfo,
                                                       resourceMap: resourceMap,
-                                                      compactedResourceCommands: self.compactedResourceCommands)
+                                                      compactedResourceCommands: self.compactedResourceCommands,
+                                                      commandBufferIndex: commandBufferIndex)
+                for dependency in frameCommandInfo.commandBufferQueueDependencies[commandBufferIndex] {
+                    commandBuffer!.waitForCommandBuffer(frameCommandBuffers[dependency])
+                }
             }
             
-            let waitEventValues = encoderInfo.queueCommandWaitIndices
-            for queue in QueueRegistry.allQueues {
-                if waitedEvents[Int(queue.index)] < waitEventValues[Int(queue.index)],
-                    waitEventValues[Int(queue.index)] > queue.lastCompletedCommand {
-                    if let event = backend.syncEvent(for: queue) {
-                        commandBuffer!.waitForEvent(event, value: waitEventValues[Int(queue.index)])
-                    } else {
-                        // It's not a queue known to this backend, so the best we can do is sleep and wait until the queue is completd.
-                        queue.waitForCommandCompletion(waitEventValues[Int(queue.index)])
+            let firstEncoderIndex = encoderIndex
+            while encoderIndex < frameCommandInfo.commandEncoders.count, frameCommandInfo.commandEncoders[encoderIndex].commandBufferIndex == commandBufferIndex {
+                let waitEventValues = frameCommandInfo.commandEncoders[encoderIndex].queueCommandWaitIndices
+                for queue in QueueRegistry.allQueues {
+                    if waitedEvents[queueFamilyIndex][Int(queue.index)] < waitEventValues[Int(queue.index)],
+                        waitEventValues[Int(queue.index)] > queue.lastCompletedCommand {
+                        if let event = backend.syncEvent(for: queue) {
+                            commandBuffer!.waitForEvent(event, value: waitEventValues[Int(queue.index)])
+                        } else {
+                            // It's not a queue known to this backend, so the best we can do is sleep and wait until the queue is completd.
+                            queue.waitForCommandCompletion(waitEventValues[Int(queue.index)])
+                        }
                     }
                 }
+                waitedEvents[queueFamilyIndex] = pointwiseMax(waitEventValues, waitedEvents[queueFamilyIndex])
+                
+                if !encodesConcurrently {
+                    commandBuffer!.encodeCommands(encoderIndex: encoderIndex)
+                }
+                encoderIndex += 1
             }
-            waitedEvents = pointwiseMax(waitEventValues, waitedEvents)
             
-            commandBuffer!.encodeCommands(encoderIndex: i)
+            if encodesConcurrently {
+                commandBuffer!.encodeCommands(encoderIndices: firstEncoderIndex..<encoderIndex)
+            }
+            
+            profile?.addCPUInterval(name: "Encode Command Buffer \(commandBufferIndex)", startTime: encodeStartTime, endTime: RenderGraphFrameProfile.currentTime)
         }
         
         processCommandBuffer()
@@ -206,5 +331,7 @@ final class RenderGraphContextImpl<Backend: SpecificRenderBackend>: _RenderGraph
         for passRecord in passes {
             passRecord.pass = nil // Release references to the RenderPasses.
         }
+        
+        return deferredDrawCount
     }
 }
@@ -199,32 +199,159 @@ struct FrameResourceCommand : Comparable {
     }
 }
 
-extension ChunkArray.RandomAccessView where Element == ResourceUsage {
-    func indexOfPreviousWrite(before index: Int, resource: Resource) -> Int? {
-        let usageActiveRange = index >= self.endIndex ? .fullResource : self[index].activeRange
-        for i in (0..<index).reversed() {
-            if self[i].affectsGPUBarriers, self[i].isWrite, self[i].activeRange.intersects(with: usageActiveRange, resource: resource) {
-                return i
+/// The previous write and read for each of a resource's usages, computed in a single forward pass over the usages
+/// so that generating barriers doesn't require scanning backwards through the usages for every usage.
+struct ResourceUsageHistory {
+    /// For each usage, the index of the most recent preceding write to an intersecting range, or -1.
+    private var previousWriteIndices = [Int]()
+    /// For each usage, the index of the most recent preceding read of an intersecting range, or -1.
+    private var previousReadIndices = [Int]()
+    /// The indices of the usages that read the resource, in increasing order.
+    private var readIndices = [Int]()
+    /// The index of the last write to any part of the resource.
+    private(set) var lastWriteIndex : Int? = nil
+    
+    // The writes and reads whose ranges haven't been entirely covered by a later write or read respectively.
+    // A covered access can never be the most recent access intersecting a range, since the covering access would be more recent.
+    private var writeFrontier = [Int]()
+    private var readFrontier = [Int]()
+    
+    mutating func build(usages: ChunkArray<ResourceUsage>, resource: Resource) {
+        self.previousWriteIndices.removeAll(keepingCapacity: true)
+        self.previousReadIndices.removeAll(keepingCapacity: true)
+        self.readIndices.removeAll(keepingCapacity: true)
+        self.writeFrontier.removeAll(keepingCapacity: true)
+        self.readFrontier.removeAll(keepingCapacity: true)
+        self.lastWriteIndex = nil
+        
+        for i in 0..<usages.count {
+            let usage = usages[i]
+            self.previousWriteIndices.append(ResourceUsageHistory.mostRecentAccess(in: self.writeFrontier, intersecting: usage.activeRange, usages: usages, resource: resource))
+            self.previousReadIndices.append(ResourceUsageHistory.mostRecentAccess(in: self.readFrontier, intersecting: usage.activeRange, usages: usages, resource: resource))
+            
+            guard usage.affectsGPUBarriers else { continue }
+            if usage.isWrite, ResourceUsageHistory.insert(i, into: &self.writeFrontier, usages: usages, resource: resource) {
+                self.lastWriteIndex = i
+            }
+            if usage.isRead {
+                ResourceUsageHistory.insert(i, into: &self.readFrontier, usages: usages, resource: resource)
+                self.readIndices.append(i)
             }
         }
-        return nil
     }
-
-    func indexOfPreviousRead(before index: Int, resource: Resource) -> Int? {
-        let usageActiveRange = index >= self.endIndex ? .fullResource : self[index].activeRange
-        for i in (0..<index).reversed() {
-            if self[i].affectsGPUBarriers, self[i].isRead, self[i].activeRange.intersects(with: usageActiveRange, resource: resource) {
-                return i
+    
+    private static func mostRecentAccess(in frontier: [Int], intersecting range: ActiveResourceRange, usages: ChunkArray<ResourceUsage>, resource: Resource) -> Int {
+        for i in frontier.reversed() where usages[i].activeRange.intersects(with: range, resource: resource) {
+            return i
+        }
+        return -1
+    }
+    
+    /// Returns false if the access doesn't affect any part of the resource.
+    @discardableResult
+    private static func insert(_ index: Int, into frontier: inout [Int], usages: ChunkArray<ResourceUsage>, resource: Resource) -> Bool {
+        let range = usages[index].activeRange
+        if range.isEqual(to: .inactive, resource: resource) {
+            return false
+        }
+        if range.isEqual(to: .fullResource, resource: resource) {
+            frontier.removeAll(keepingCapacity: true)
+        } else {
+            frontier.removeAll(where: { ResourceUsageHistory.range(range, covers: usages[$0].activeRange, resource: resource) })
+        }
+        frontier.append(index)
+        return true
+    }
+    
+    private static func range(_ range: ActiveResourceRange, covers other: ActiveResourceRange, resource: Resource) -> Bool {
+        switch (range, other) {
+        case (.buffer(let range), .buffer(let other)):
+            return range.lowerBound <= other.lowerBound && other.upperBound <= range.upperBound
+        default:
+            return range.isEqual(to: other, resource: resource)
+        }
+    }
+    
+    func indexOfPreviousWrite(before index: Int) -> Int? {
+        let previousWriteIndex = self.previousWriteIndices[index]
+        return previousWriteIndex >= 0 ? previousWriteIndex : nil
+    }
+    
+    func indexOfPreviousRead(before index: Int) -> Int? {
+        let previousReadIndex = self.previousReadIndices[index]
+        return previousReadIndex >= 0 ? previousReadIndex : nil
+    }
+    
+    /// The indices of the reads after `index` (or from the first usage if `index` is nil) and before `endIndex`.
+    func readIndices(after index: Int?, before endIndex: Int) -> ArraySlice<Int> {
+        let lowerBound = index.map { $0 + 1 } ?? 0
+        
+        var low = 0
+        var high = self.readIndices.count
+        while low < high {
+            let mid = (low + high) / 2
+            if self.readIndices[mid] < lowerBound {
+                low = mid + 1
+            } else {
+                high = mid
             }
         }
-        return nil
+        
+        var end = low
+        while end < self.readIndices.count, self.readIndices[end] < endIndex {
+            end += 1
+        }
+        return self.readIndices[low..<end]
+    }
+}
+
+/// The output of generating commands for a subset of a frame's resources, which is merged into the ResourceCommandGenerator
+/// once all resources have been processed. Operations on shared state (such as the transient registry) are deferred until the merge.
+final class ResourceCommandGenerationState<Backend: SpecificRenderBackend> {
+    var allocator : AllocatorType = .system
+    var usageHistory = ResourceUsageHistory()
+    
+    var commands = [FrameResourceCommand]()
+    var preFrameCommands = [PreFrameResourceCommand]()
+    var transientLifetimes = [TransientResourceLifetime]()
+    /// The inter-encoder dependencies found while processing this partition's resources, in the order they were found.
+    /// Most frames only have dependencies between a few pairs of encoders, so these are kept as a list rather than a full table.
+    var encoderDependencies = [(from: Int, on: Int, dependency: Backend.InterEncoderDependencyType)]()
+    
+    var disposalFences = [(Resource, [FenceDependency])]()
+    var historyBuffersToDispose = [Resource]()
+    var resourcesToMarkInitialised = [Resource]()
+    
+    func reset() {
+        self.allocator = .threadLocalTag(ThreadLocalTagAllocator(tag: ResourceCommandGenerator<Backend>.resourceCommandGeneratorTag))
+        self.commands.removeAll(keepingCapacity: true)
+        self.preFrameCommands.removeAll(keepingCapacity: true)
+        self.transientLifetimes.removeAll(keepingCapacity: true)
+        self.encoderDependencies.removeAll(keepingCapacity: true)
+        self.disposalFences.removeAll(keepingCapacity: true)
+        self.historyBuffersToDispose.removeAll(keepingCapacity: true)
+        self.resourcesToMarkInitialised.removeAll(keepingCapacity: true)
+    }
+    
+    func addEncoderDependency(from: Int, on: Int, _ dependency: Backend.InterEncoderDependencyType) {
+        // Consecutive usages of a resource usually produce dependencies between the same pair of encoders.
+        if let last = self.encoderDependencies.last, last.from == from, last.on == on {
+            self.encoderDependencies[self.encoderDependencies.count - 1].dependency = last.dependency.merged(with: dependency)
+        } else {
+            self.encoderDependencies.append((from, on, dependency))
+        }
     }
 }
 
 final class ResourceCommandGenerator<Backend: SpecificRenderBackend> {
     typealias Dependency = Backend.InterEncoderDependencyType
     
+    /// The minimum number of resources to process in each concurrent job.
+    var minimumResourcesPerPartition = 256
+    
     private var preFrameCommands = [PreFrameResourceCommand]()
+    private var transientLifetimes = [TransientResourceLifetime]()
+    private var partitionStates = [ResourceCommandGenerationState<Backend>]()
     var commands = [FrameResourceCommand]()
     
     var commandEncoderDependencies = DependencyTable<Dependency?>(capacity: 1, defaultValue: nil)
@@ -233,7 +360,7 @@ final class ResourceCommandGenerator<Backend: SpecificRenderBackend> {
         return UInt64(bitPattern: Int64("ResourceCommandGenerator".hashValue))
     }
     
-    func processResourceResidency(resource: Resource, frameCommandInfo: FrameCommandInfo<Backend>) {
+    func processResourceResidency(resource: Resource, frameCommandInfo: FrameCommandInfo<Backend>, state: ResourceCommandGenerationState<Backend>) {
         guard Backend.requiresResourceResidencyTracking else { return }
         
         var resourceIsRenderTarget = false
@@ -265,7 +392,7 @@ final class ResourceCommandGenerator<Backend: SpecificRenderBackend> {
                             usage.type != previousUsageType ||
                             usage.stages != previousUsageStages ||
                             usageEncoderIndex != previousEncoderIndex {
-                            self.commands.append(FrameResourceCommand(command: .useResource(resource, usage: usage.type, stages: usage.stages, allowReordering: !resourceIsRenderTarget && usageEncoderIndex != previousEncoderIndex), // Keep the useResource call as late as possible for render targets, and don't allow reordering within an encoder.
+                            state.commands.append(FrameResourceCommand(command: .useResource(resource, usage: usage.type, stages: usage.stages, allowReordering: !resourceIsRenderTarget && usageEncoderIndex != previousEncoderIndex), // Keep the useResource call as late as possible for render targets, and don't allow reordering within an encoder.
                                 index: usage.commandRange.lowerBound))
                         }
                         
@@ -277,310 +404,357 @@ final class ResourceCommandGenerator<Backend: SpecificRenderBackend> {
     }
     
     
-    func processInputAttachmentUsage(_ usage: ResourceUsage, activeRange: ActiveResourceRange) {
+    func processInputAttachmentUsage(_ usage: ResourceUsage, activeRange: ActiveResourceRange, state: ResourceCommandGenerationState<Backend>) {
         guard RenderBackend.requiresEmulatedInputAttachments else { return }
         // To simulate input attachments on desktop platforms, we need to insert a render target barrier between every draw.
         let applicableRange = usage.commandRange
         let resource = usage.resource
         
-        let commands = usage.renderPassRecord.commands!
+        let drawCommandOffsets = usage.renderPassRecord.drawCommandOffsets!
         let passCommandRange = usage.renderPassRecord.commandRange!
         var previousCommandIndex = -1
         
         let rangeInPass = applicableRange.offset(by: -passCommandRange.lowerBound)
-        for i in rangeInPass {
-            let command = commands[i]
-            if command.isDrawCommand {
-                let commandIndex = i + passCommandRange.lowerBound
-                if previousCommandIndex >= 0 {
-                    self.commands.append(FrameResourceCommand(command: .memoryBarrier(Resource(resource), afterUsage: usage.type, afterStages: usage.stages, beforeCommand: commandIndex, beforeUsage: usage.type, beforeStages: usage.stages, activeRange: activeRange), index: previousCommandIndex))
-//                            self.commands.append(FrameResourceCommand(command: .useResource(resource, usage: .read, stages: usage.stages, allowReordering: false), index: commandIndex))
-                }
-                previousCommandIndex = commandIndex
+        let firstDraw = drawCommandOffsets.binarySearch(predicate: { $0 < rangeInPass.lowerBound })
+        for i in drawCommandOffsets[firstDraw...] {
+            if i >= rangeInPass.upperBound { break }
+            
+            let commandIndex = i + passCommandRange.lowerBound
+            if previousCommandIndex >= 0 {
+                state.commands.append(FrameResourceCommand(command: .memoryBarrier(Resource(resource), afterUsage: usage.type, afterStages: usage.stages, beforeCommand: commandIndex, beforeUsage: usage.type, beforeStages: usage.stages, activeRange: activeRange), index: previousCommandIndex))
+//                        self.commands.append(FrameResourceCommand(command: .useResource(resource, usage: .read, stages: usage.stages, allowReordering: false), index: commandIndex))
             }
+            previousCommandIndex = commandIndex
         }
     }
     
-    func generateCommands(passes: [RenderPassRecord], usedResources: Set<Resource>, transientRegistry: Backend.TransientResourceRegistry?, backend: Backend, frameCommandInfo: inout FrameCommandInfo<Backend>) {
-        if passes.isEmpty {
-            return
+    private func generateCommands(for resource: Resource, state: ResourceCommandGenerationState<Backend>, backend: Backend, frameCommandInfo: FrameCommandInfo<Backend>) {
+        if resource.usages.isEmpty { return }
+        
+        self.processResourceResidency(resource: resource, frameCommandInfo: frameCommandInfo, state: state)
+        
+        let usagesArray = resource.usages
+        state.usageHistory.build(usages: usagesArray, resource: resource)
+        
+        let firstUsage = usagesArray.first!
+        
+        if resource.baseResource == nil, Backend.TransientResourceRegistry.isAliasingCandidate(resource: resource) {
+            let fenceDependency = FenceDependency(encoderIndex: frameCommandInfo.encoderIndex(for: firstUsage.renderPassRecord), index: firstUsage.commandRange.lowerBound, stages: firstUsage.stages, usage: firstUsage)
+            state.preFrameCommands.append(PreFrameResourceCommand(command: .waitForHeapAliasingFences(resource: resource, waitDependency: fenceDependency), index: firstUsage.commandRange.lowerBound, order: .before))
         }
         
-        self.commandEncoderDependencies.resizeAndClear(capacity: frameCommandInfo.commandEncoders.count, clearValue: nil)
-        let allocator = AllocatorType.threadLocalTag(ThreadLocalTagAllocator(tag: Self.resourceCommandGeneratorTag))
-        defer { TaggedHeap.free(tag: Self.resourceCommandGeneratorTag) }
+        var remainingSubresources = ActiveResourceRange.inactive
+        var remainingSubresourcesUsageIndex: Int = -1
         
-        resourceLoop: for resource in usedResources {
-            if resource.usages.isEmpty { continue }
-            
-            self.processResourceResidency(resource: resource, frameCommandInfo: frameCommandInfo)
-            
-            let usagesArray = resource.usages.makeRandomAccessView(allocator: allocator)
-            
-            let firstUsage = usagesArray.first!
-            
-            if resource.baseResource == nil, Backend.TransientResourceRegistry.isAliasedHeapResource(resource: resource) {
-                let fenceDependency = FenceDependency(encoderIndex: frameCommandInfo.encoderIndex(for: firstUsage.renderPassRecord), index: firstUsage.commandRange.lowerBound, stages: firstUsage.stages)
-                self.preFrameCommands.append(PreFrameResourceCommand(command: .waitForHeapAliasingFences(resource: resource, waitDependency: fenceDependency), index: firstUsage.commandRange.lowerBound, order: .before))
+        var activeSubresources = ActiveResourceRange.fullResource
+        var usageIndex = usagesArray.startIndex
+        var skipUntilAfterInapplicableUsage = false // When processing subresources, we skip until we encounter a usage that is incompatible with our current subresources, since every usage up until that point will have already been processed.
+        
+        while usageIndex < usagesArray.count {
+            defer {
+                usageIndex += 1
+                
+                if usageIndex == usagesArray.count, !remainingSubresources.isEqual(to: .inactive, resource: resource) {
+                    // Reset the tracked state to the remainingSubresources
+                    activeSubresources = remainingSubresources
+                    remainingSubresources = .inactive
+                    usageIndex = remainingSubresourcesUsageIndex
+                    skipUntilAfterInapplicableUsage = true
+                }
             }
             
-            var remainingSubresources = ActiveResourceRange.inactive
-            var remainingSubresourcesUsageIndex: Int = -1
-            
-            var activeSubresources = ActiveResourceRange.fullResource
-            var usageIndex = usagesArray.startIndex
-            var skipUntilAfterInapplicableUsage = false // When processing subresources, we skip until we encounter a usage that is incompatible with our current subresources, since every usage up until that point will have already been processed.
+            let usage = usagesArray[usageIndex]
+            if !usage.affectsGPUBarriers {
+                continue
+            }
             
-            while usageIndex < usagesArray.count {
-                defer {
-                    usageIndex += 1
-                    
-                    if usageIndex == usagesArray.count, !remainingSubresources.isEqual(to: .inactive, resource: resource) {
+            // Check for subresource tracking
+            if resource.type == .texture { // We only track subresources for textures.
+                if usage.activeRange.isEqual(to: .fullResource, resource: resource) {
+                    if !remainingSubresources.isEqual(to: .inactive, resource: resource) {
                         // Reset the tracked state to the remainingSubresources
                         activeSubresources = remainingSubresources
                         remainingSubresources = .inactive
-                        usageIndex = remainingSubresourcesUsageIndex
+                        
+                        usageIndex = remainingSubresourcesUsageIndex - 1 // since it will have 1 added to it in the defer statement
                         skipUntilAfterInapplicableUsage = true
-                    }
-                }
-                
-                let usage = usagesArray[usageIndex]
-                if !usage.affectsGPUBarriers {
-                    continue
-                }
-                
-                // Check for subresource tracking
-                if resource.type == .texture { // We only track subresources for textures.
-                    if usage.activeRange.isEqual(to: .fullResource, resource: resource) {
-                        if !remainingSubresources.isEqual(to: .inactive, resource: resource) {
-                            // Reset the tracked state to the remainingSubresources
-                            activeSubresources = remainingSubresources
-                            remainingSubresources = .inactive
-                            
-                            usageIndex = remainingSubresourcesUsageIndex - 1 // since it will have 1 added to it in the defer statement
-                            skipUntilAfterInapplicableUsage = true
-                            
-                            continue
-                        } else {
-                            activeSubresources = .fullResource
-                        }
+                        
+                        continue
                     } else {
-                        let activeRangeIntersection = usage.activeRange.intersection(with: activeSubresources, resource: resource, allocator: allocator)
-                        if activeRangeIntersection.isEqual(to: .inactive, resource: resource) {
-                            skipUntilAfterInapplicableUsage = false
-                            continue
-                        } else if skipUntilAfterInapplicableUsage {
-                            continue
-                        } else if !activeRangeIntersection.isEqual(to: activeSubresources, resource: resource) {
-                            if remainingSubresources.isEqual(to: .inactive, resource: resource) {
-                                remainingSubresourcesUsageIndex = usageIndex
-                            }
-                            
-                            remainingSubresources.formUnion(with: activeSubresources.subtracting(range: activeRangeIntersection, resource: resource, allocator: allocator), resource: resource, allocator: allocator)
-                            activeSubresources = activeRangeIntersection
+                        activeSubresources = .fullResource
+                    }
+                } else {
+                    let activeRangeIntersection = usage.activeRange.intersection(with: activeSubresources, resource: resource, allocator: state.allocator)
+                    if activeRangeIntersection.isEqual(to: .inactive, resource: resource) {
+                        skipUntilAfterInapplicableUsage = false
+                        continue
+                    } else if skipUntilAfterInapplicableUsage {
+                        continue
+                    } else if !activeRangeIntersection.isEqual(to: activeSubresources, resource: resource) {
+                        if remainingSubresources.isEqual(to: .inactive, resource: resource) {
+                            remainingSubresourcesUsageIndex = usageIndex
                         }
+                        
+                        remainingSubresources.formUnion(with: activeSubresources.subtracting(range: activeRangeIntersection, resource: resource, allocator: state.allocator), resource: resource, allocator: state.allocator)
+                        activeSubresources = activeRangeIntersection
                     }
                 }
+            }
+            
+            if usage.type == .inputAttachmentRenderTarget {
+                self.processInputAttachmentUsage(usage, activeRange: activeSubresources, state: state)
+            }
+            
+            let previousWriteIndex = state.usageHistory.indexOfPreviousWrite(before: usageIndex)
+            
+            if usage.isWrite {
+                assert(!resource.flags.contains(.immutableOnceInitialised) || !resource.stateFlags.contains(.initialised), "A resource with the flag .immutableOnceInitialised is being written to in \(usage) when it has already been initialised.")
                 
-                if usage.type == .inputAttachmentRenderTarget {
-                    processInputAttachmentUsage(usage, activeRange: activeSubresources)
+                // Process all the reads since the last write.
+                for previousReadIndex in state.usageHistory.readIndices(after: previousWriteIndex, before: usageIndex) {
+                    let previousRead = usagesArray[previousReadIndex]
+                    guard frameCommandInfo.encoderIndex(for: previousRead.renderPassRecord) != frameCommandInfo.encoderIndex(for: usage.renderPassRecord) else { continue }
+                    
+                    let fromEncoder = frameCommandInfo.encoderIndex(for: usage.renderPassRecord)
+                    let onEncoder = frameCommandInfo.encoderIndex(for: previousRead.renderPassRecord)
+                    let dependency = Dependency(resource: resource, producingUsage: previousRead, producingEncoder: onEncoder, consumingUsage: usage, consumingEncoder: fromEncoder)
+                    
+                    state.addEncoderDependency(from: fromEncoder, on: onEncoder, dependency)
                 }
-                
-                let previousWriteIndex = usagesArray.indexOfPreviousWrite(before: usageIndex, resource: resource)
-                
-                if usage.isWrite {
-                    assert(!resource.flags.contains(.immutableOnceInitialised) || !resource.stateFlags.contains(.initialised), "A resource with the flag .immutableOnceInitialised is being written to in \(usage) when it has already been initialised.")
+            }
+            
+            if let previousWrite = previousWriteIndex.map({ usagesArray[$0] }) {
+                if usage.isRead, usage.resource == resource, // rather than processing a texture view/base resource
+                    frameCommandInfo.encoderIndex(for: previousWrite.renderPassRecord) == frameCommandInfo.encoderIndex(for: usage.renderPassRecord),
+                    !(previousWrite.type.isRenderTarget && usage.type == .readWriteRenderTarget) {
                     
-                    // Process all the reads since the last write.
-                    for previousReadIndex in ((previousWriteIndex ?? -1) + 1)..<usageIndex {
-                        let previousRead = usagesArray[previousReadIndex]
-                        guard previousRead.affectsGPUBarriers, previousRead.isRead, frameCommandInfo.encoderIndex(for: previousRead.renderPassRecord) != frameCommandInfo.encoderIndex(for: usage.renderPassRecord) else { continue }
-                        
-                        let fromEncoder = frameCommandInfo.encoderIndex(for: usage.renderPassRecord)
-                        let onEncoder = frameCommandInfo.encoderIndex(for: previousRead.renderPassRecord)
-                        let dependency = Dependency(resource: resource, producingUsage: previousRead, producingEncoder: onEncoder, consumingUsage: usage, consumingEncoder: fromEncoder)
-                        
-                        commandEncoderDependencies.setDependency(from: fromEncoder,
-                                                                 on: onEncoder,
-                                                                 to: commandEncoderDependencies.dependency(from: fromEncoder, on: onEncoder)?.merged(with: dependency) ?? dependency)
-                    }
+                    assert(!usage.stages.isEmpty || usage.renderPassRecord.type != .draw)
+                    assert(!previousWrite.stages.isEmpty || previousWrite.renderPassRecord.type != .draw)
+                    
+                    state.commands.append(FrameResourceCommand(command: .memoryBarrier(Resource(resource), afterUsage: previousWrite.type, afterStages: previousWrite.stages, beforeCommand: usage.commandRange.lowerBound, beforeUsage: usage.type, beforeStages: usage.stages, activeRange: activeSubresources), index: previousWrite.commandRange.last!))
                 }
                 
-                if let previousWrite = previousWriteIndex.map({ usagesArray[$0] }) {
-                    if usage.isRead, usage.resource == resource, // rather than processing a texture view/base resource
-                        frameCommandInfo.encoderIndex(for: previousWrite.renderPassRecord) == frameCommandInfo.encoderIndex(for: usage.renderPassRecord),
-                        !(previousWrite.type.isRenderTarget && usage.type == .readWriteRenderTarget) {
-                        
-                        assert(!usage.stages.isEmpty || usage.renderPassRecord.type != .draw)
-                        assert(!previousWrite.stages.isEmpty || previousWrite.renderPassRecord.type != .draw)
-                        
-                        self.commands.append(FrameResourceCommand(command: .memoryBarrier(Resource(resource), afterUsage: previousWrite.type, afterStages: previousWrite.stages, beforeCommand: usage.commandRange.lowerBound, beforeUsage: usage.type, beforeStages: usage.stages, activeRange: activeSubresources), index: previousWrite.commandRange.last!))
-                    }
+                if (usage.isRead || usage.isWrite), frameCommandInfo.encoderIndex(for: previousWrite.renderPassRecord) != frameCommandInfo.encoderIndex(for: usage.renderPassRecord) {
+                    let fromEncoder = frameCommandInfo.encoderIndex(for: usage.renderPassRecord)
+                    let onEncoder = frameCommandInfo.encoderIndex(for: previousWrite.renderPassRecord)
+                    let dependency = Dependency(resource: resource, producingUsage: previousWrite, producingEncoder: onEncoder, consumingUsage: usage, consumingEncoder: fromEncoder)
                     
-                    if (usage.isRead || usage.isWrite), frameCommandInfo.encoderIndex(for: previousWrite.renderPassRecord) != frameCommandInfo.encoderIndex(for: usage.renderPassRecord) {
-                        let fromEncoder = frameCommandInfo.encoderIndex(for: usage.renderPassRecord)
-                        let onEncoder = frameCommandInfo.encoderIndex(for: previousWrite.renderPassRecord)
-                        let dependency = Dependency(resource: resource, producingUsage: previousWrite, producingEncoder: onEncoder, consumingUsage: usage, consumingEncoder: fromEncoder)
-                        
-                        commandEncoderDependencies.setDependency(from: fromEncoder,
-                                                                 on: onEncoder,
-                                                                 to: commandEncoderDependencies.dependency(from: fromEncoder, on: onEncoder)?.merged(with: dependency) ?? dependency)
-                    }
-                } else {
-                    #if canImport(Vulkan)
-                    if Backend.self == VulkanBackend.self, resource.type == .texture, !resource.flags.contains(.windowHandle),
-                       usage.resource == resource {  // rather than processing a texture view/base resource
-                        // We may need a pipeline barrier for image layout transitions or queue ownership transfers.
-                        // Put the barrier as early as possible unless it's a render target barrier, in which case put it at the time of first usage
-                        // so that it can be inserted as a subpass dependency.
+                    state.addEncoderDependency(from: fromEncoder, on: onEncoder, dependency)
+                }
+            } else {
+                #if canImport(Vulkan)
+                if Backend.self == VulkanBackend.self, resource.type == .texture, !resource.flags.contains(.windowHandle),
+                   usage.resource == resource {  // rather than processing a texture view/base resource
+                    // We may need a pipeline barrier for image layout transitions or queue ownership transfers.
+                    // Put the barrier as early as possible unless it's a render target barrier, in which case put it at the time of first usage
+                    // so that it can be inserted as a subpass dependency.
 
-                        if let previousRead = usagesArray.indexOfPreviousRead(before: usageIndex, resource: resource).map({ usagesArray[$0] }) {
-                            if previousRead.type != usage.type { // We only need to check if the usage types differ, since otherwise the layouts are guaranteed to be the same.
-                            
-                                let onEncoder = frameCommandInfo.encoderIndex(for: previousRead.renderPassRecord)
-                                let fromEncoder = frameCommandInfo.encoderIndex(for: usage.renderPassRecord)
-                                if fromEncoder == onEncoder {
-                                    self.commands.append(FrameResourceCommand(command:
-                                                                            .memoryBarrier(Resource(resource), afterUsage: previousRead.type, afterStages: previousRead.stages, beforeCommand: usage.commandRange.lowerBound, beforeUsage: usage.type, beforeStages: usage.stages, activeRange: activeSubresources),
-                                                                     index: previousRead.commandRange.upperBound))
-                                } else {
-                                    let dependency = Dependency(resource: resource, producingUsage: previousRead, producingEncoder: onEncoder, consumingUsage: usage, consumingEncoder: fromEncoder)
-                                    commandEncoderDependencies.setDependency(from: fromEncoder,
-                                                                            on: onEncoder,
-                                                                            to: commandEncoderDependencies.dependency(from: fromEncoder, on: onEncoder)?.merged(with: dependency) ?? dependency)
-                                }
-                            } 
+                    if let previousRead = state.usageHistory.indexOfPreviousRead(before: usageIndex).map({ usagesArray[$0] }) {
+                        if previousRead.type != usage.type { // We only need to check if the usage types differ, since otherwise the layouts are guaranteed to be the same.
+                        
+                            let onEncoder = frameCommandInfo.encoderIndex(for: previousRead.renderPassRecord)
+                            let fromEncoder = frameCommandInfo.encoderIndex(for: usage.renderPassRecord)
+                            if fromEncoder == onEncoder {
+                                state.commands.append(FrameResourceCommand(command:
+                                                                        .memoryBarrier(Resource(resource), afterUsage: previousRead.type, afterStages: previousRead.stages, beforeCommand: usage.commandRange.lowerBound, beforeUsage: usage.type, beforeStages: usage.stages, activeRange: activeSubresources),
+                                                                 index: previousRead.commandRange.upperBound))
+                            } else {
+                                let dependency = Dependency(resource: resource, producingUsage: previousRead, producingEncoder: onEncoder, consumingUsage: usage, consumingEncoder: fromEncoder)
+                                state.addEncoderDependency(from: fromEncoder, on: onEncoder, dependency)
+                            }
+                        } 
 
-                        } else if !usage.type.isRenderTarget { // Render target layout transitions are handled by the render pass.
-                            self.commands.append(FrameResourceCommand(command:
-                                                                    .memoryBarrier(Resource(resource), afterUsage: .frameStartLayoutTransitionCheck, afterStages: .cpuBeforeRender, beforeCommand: usage.commandRange.lowerBound, beforeUsage: usage.type, beforeStages: usage.stages, activeRange: activeSubresources),
-                                                                  index: usage.type.isRenderTarget ? usage.commandRange.lowerBound : 0))
-                        }
+                    } else if !usage.type.isRenderTarget { // Render target layout transitions are handled by the render pass.
+                        state.commands.append(FrameResourceCommand(command:
+                                                                .memoryBarrier(Resource(resource), afterUsage: .frameStartLayoutTransitionCheck, afterStages: .cpuBeforeRender, beforeCommand: usage.commandRange.lowerBound, beforeUsage: usage.type, beforeStages: usage.stages, activeRange: activeSubresources),
+                                                              index: usage.type.isRenderTarget ? usage.commandRange.lowerBound : 0))
                     }
-                    #endif
                 }
+                #endif
             }
-            
-            let lastUsage = usagesArray.last!
-            
-            defer {
-                if usagesArray.contains(where: { $0.isWrite }), resource.flags.intersection([.historyBuffer, .persistent]) != [] {
-                    resource.markAsInitialised()
-                }
+        }
+        
+        let lastUsage = usagesArray.last
+        
+        if usagesArray.contains(where: { $0.isWrite }), resource.flags.intersection([.historyBuffer, .persistent]) != [] {
+            state.resourcesToMarkInitialised.append(resource)
+        }
+        
+        let historyBufferUseFrame = resource.flags.contains(.historyBuffer) && resource.stateFlags.contains(.initialised)
+        if historyBufferUseFrame {
+            state.historyBuffersToDispose.append(resource) // This will dispose it in the RenderGraph persistent allocator, which will in turn call dispose in the resource registry at the end of the frame.
+        }
+        
+        var canBeMemoryless = false
+        
+        // We dispose at the end of a command encoder since resources can't alias against each other within a command encoder.
+        let lastCommandEncoderIndex = frameCommandInfo.encoderIndex(for: lastUsage.renderPassRecord)
+        let disposalIndex = frameCommandInfo.commandEncoders[lastCommandEncoderIndex].commandRange.last!
+        
+        // Insert commands to materialise and dispose of the resource.
+        if let argumentBuffer = ArgumentBuffer(resource) {
+            // Unlike textures and buffers, we materialise persistent argument buffers at first use rather than immediately.
+            if !historyBufferUseFrame {
+                state.preFrameCommands.append(PreFrameResourceCommand(command: .materialiseArgumentBuffer(argumentBuffer), index: firstUsage.commandRange.lowerBound, order: .before))
             }
             
-            let historyBufferUseFrame = resource.flags.contains(.historyBuffer) && resource.stateFlags.contains(.initialised)
-            if historyBufferUseFrame {
-                resource.dispose() // This will dispose it in the RenderGraph persistent allocator, which will in turn call dispose in the resource registry at the end of the frame.
+            if !resource.flags.contains(.persistent), !resource.flags.contains(.historyBuffer) || historyBufferUseFrame {
+                state.preFrameCommands.append(PreFrameResourceCommand(command: .disposeResource(resource, afterStages: lastUsage.stages), index: disposalIndex, order: .after))
             }
             
-            var canBeMemoryless = false
-            
-            // We dispose at the end of a command encoder since resources can't alias against each other within a command encoder.
-            let lastCommandEncoderIndex = frameCommandInfo.encoderIndex(for: lastUsage.renderPassRecord)
-            let disposalIndex = frameCommandInfo.commandEncoders[lastCommandEncoderIndex].commandRange.last!
-            
-            // Insert commands to materialise and dispose of the resource.
-            if let argumentBuffer = ArgumentBuffer(resource) {
-                // Unlike textures and buffers, we materialise persistent argument buffers at first use rather than immediately.
+        } else if !resource.flags.contains(.persistent) || resource.flags.contains(.windowHandle) {
+            if let buffer = Buffer(resource) {
+                
                 if !historyBufferUseFrame {
-                    self.preFrameCommands.append(PreFrameResourceCommand(command: .materialiseArgumentBuffer(argumentBuffer), index: firstUsage.commandRange.lowerBound, order: .before))
+                    state.preFrameCommands.append(PreFrameResourceCommand(command: .materialiseBuffer(buffer), index: firstUsage.commandRange.lowerBound, order: .before))
                 }
                 
-                if !resource.flags.contains(.persistent), !resource.flags.contains(.historyBuffer) || historyBufferUseFrame {
-                    self.preFrameCommands.append(PreFrameResourceCommand(command: .disposeResource(resource, afterStages: lastUsage.stages), index: disposalIndex, order: .after))
+                if !resource.flags.contains(.historyBuffer) || historyBufferUseFrame {
+                    state.preFrameCommands.append(PreFrameResourceCommand(command: .disposeResource(resource, afterStages: lastUsage.stages), index: disposalIndex, order: .after))
                 }
                 
-            } else if !resource.flags.contains(.persistent) || resource.flags.contains(.windowHandle) {
-                if let buffer = Buffer(resource) {
-                    
-                    if !historyBufferUseFrame {
-                        self.preFrameCommands.append(PreFrameResourceCommand(command: .materialiseBuffer(buffer), index: firstUsage.commandRange.lowerBound, order: .before))
-                    }
-                    
-                    if !resource.flags.contains(.historyBuffer) || historyBufferUseFrame {
-                        self.preFrameCommands.append(PreFrameResourceCommand(command: .disposeResource(resource, afterStages: lastUsage.stages), index: disposalIndex, order: .after))
-                    }
-                    
-                } else if let texture = Texture(resource) {
-                    canBeMemoryless = backend.supportsMemorylessAttachments &&
-                        (texture.flags.intersection([.persistent, .historyBuffer]) == [] || (texture.flags.contains(.persistent) && texture.descriptor.usageHint == .renderTarget))
-                        && usagesArray.allSatisfy({ $0.type.isRenderTarget })
-                        && !frameCommandInfo.storedTextures.contains(texture)
-                    
-                    if !historyBufferUseFrame {
-                        if texture.isTextureView {
-                            self.preFrameCommands.append(PreFrameResourceCommand(command: .materialiseTextureView(texture), index: firstUsage.commandRange.lowerBound, order: .before))
-                        } else {
-                            self.preFrameCommands.append(PreFrameResourceCommand(command: .materialiseTexture(texture), index: firstUsage.commandRange.lowerBound, order: .before))
-                        }
-                    }
-                    
-                    if !resource.flags.contains(.historyBuffer) || historyBufferUseFrame {
-                        self.preFrameCommands.append(PreFrameResourceCommand(command: .disposeResource(resource, afterStages: lastUsage.stages), index: disposalIndex, order: .after))
+            } else if let texture = Texture(resource) {
+                canBeMemoryless = backend.supportsMemorylessAttachments &&
+                    (texture.flags.intersection([.persistent, .historyBuffer]) == [] || (texture.flags.contains(.persistent) && texture.descriptor.usageHint == .renderTarget))
+                    && usagesArray.allSatisfy({ $0.type.isRenderTarget })
+                    && !frameCommandInfo.storedTextures.contains(texture)
+                
+                if !historyBufferUseFrame {
+                    if texture.isTextureView {
+                        state.preFrameCommands.append(PreFrameResourceCommand(command: .materialiseTextureView(texture), index: firstUsage.commandRange.lowerBound, order: .before))
+                    } else {
+                        state.preFrameCommands.append(PreFrameResourceCommand(command: .materialiseTexture(texture), index: firstUsage.commandRange.lowerBound, order: .before))
                     }
                 }
-            }
-            
-            let lastWriteIndex = usagesArray.indexOfPreviousWrite(before: usagesArray.count, resource: resource)
-            let lastWrite = lastWriteIndex.map { usagesArray[$0] }
-            
-            if resource.flags.contains(.persistent) || historyBufferUseFrame {
-                // Prepare the resource for being used this frame. For Vulkan, this means computing the image layouts.
-                if let buffer = Buffer(resource) {
-                    backend.resourceRegistry.prepareMultiframeBuffer(buffer, frameIndex: frameCommandInfo.globalFrameIndex)
-                } else if let texture = Texture(resource) {
-                    backend.resourceRegistry.prepareMultiframeTexture(texture, frameIndex: frameCommandInfo.globalFrameIndex)
-                }
                 
-                for queue in QueueRegistry.allQueues {
-                    // TODO: separate out the wait index for the first read from the first write.
-                    let waitIndex = resource[waitIndexFor: queue, accessType: lastWriteIndex != nil ? .readWrite : .read]
-                    self.preFrameCommands.append(PreFrameResourceCommand(command: .waitForCommandBuffer(index: waitIndex, queue: queue), index: firstUsage.commandRange.first!, order: .before))
+                if !resource.flags.contains(.historyBuffer) || historyBufferUseFrame {
+                    state.preFrameCommands.append(PreFrameResourceCommand(command: .disposeResource(resource, afterStages: lastUsage.stages), index: disposalIndex, order: .after))
                 }
+            }
+        }
+        
+        let lastWriteIndex = state.usageHistory.lastWriteIndex
+        let lastWrite = lastWriteIndex.map { usagesArray[$0] }
+        
+        if resource.flags.contains(.persistent) || historyBufferUseFrame {
+            // Prepare the resource for being used this frame. For Vulkan, this means computing the image layouts.
+            if let buffer = Buffer(resource) {
+                backend.resourceRegistry.prepareMultiframeBuffer(buffer, frameIndex: frameCommandInfo.globalFrameIndex)
+            } else if let texture = Texture(resource) {
+                backend.resourceRegistry.prepareMultiframeTexture(texture, frameIndex: frameCommandInfo.globalFrameIndex)
+            }
+            
+            for queue in QueueRegistry.allQueues {
+                // TODO: separate out the wait index for the first read from the first write.
+                let waitIndex = resource[waitIndexFor: queue, accessType: lastWriteIndex != nil ? .readWrite : .read]
+                state.preFrameCommands.append(PreFrameResourceCommand(command: .waitForCommandBuffer(index: waitIndex, queue: queue), index: firstUsage.commandRange.first!, order: .before))
+            }
 
-                if !resource.stateFlags.contains(.initialised) || !resource.flags.contains(.immutableOnceInitialised) {
-                    if lastUsage.isWrite {
-                        self.preFrameCommands.append(PreFrameResourceCommand(command: .updateCommandBufferWaitIndex(resource, accessType: .readWrite), index: lastUsage.commandRange.last!, order: .after))
-                    } else {
-                        if let lastWrite = lastWrite {
-                            self.preFrameCommands.append(PreFrameResourceCommand(command: .updateCommandBufferWaitIndex(resource, accessType: .readWrite), index: lastWrite.commandRange.last!, order: .after))
-                        }
-                        // Process all the reads since the last write.
-                        for readIndex in ((lastWriteIndex ?? -1) + 1)..<usagesArray.count {
-                            let read = usagesArray[readIndex]
-                            guard read.affectsGPUBarriers, read.isRead else { continue }
-                            
-                            self.preFrameCommands.append(PreFrameResourceCommand(command: .updateCommandBufferWaitIndex(resource, accessType: .write), index: read.commandRange.last!, order: .after))
-                        }
+            if !resource.stateFlags.contains(.initialised) || !resource.flags.contains(.immutableOnceInitialised) {
+                if lastUsage.isWrite {
+                    state.preFrameCommands.append(PreFrameResourceCommand(command: .updateCommandBufferWaitIndex(resource, accessType: .readWrite), index: lastUsage.commandRange.last!, order: .after))
+                } else {
+                    if let lastWrite = lastWrite {
+                        state.preFrameCommands.append(PreFrameResourceCommand(command: .updateCommandBufferWaitIndex(resource, accessType: .readWrite), index: lastWrite.commandRange.last!, order: .after))
+                    }
+                    // Process all the reads since the last write.
+                    for readIndex in state.usageHistory.readIndices(after: lastWriteIndex, before: usagesArray.count) {
+                        let read = usagesArray[readIndex]
+                        
+                        state.preFrameCommands.append(PreFrameResourceCommand(command: .updateCommandBufferWaitIndex(resource, accessType: .write), index: read.commandRange.last!, order: .after))
                     }
                 }
             }
+        }
+        
+        if Backend.TransientResourceRegistry.isAliasingCandidate(resource: resource), !canBeMemoryless {
+            // Reads need to wait for all previous writes to complete.
+            // Writes need to wait for all previous reads and writes to complete.
             
-            if Backend.TransientResourceRegistry.isAliasedHeapResource(resource: resource), !canBeMemoryless {
-                // Reads need to wait for all previous writes to complete.
-                // Writes need to wait for all previous reads and writes to complete.
-                
-                var storeFences : [FenceDependency] = []
-                
-                // We only need to wait for the write to complete if there have been no reads since the write; otherwise, we wait on the reads
-                // which in turn have a transitive dependency on the write.
-                if let lastWriteIndex = lastWriteIndex, usagesArray.index(after: lastWriteIndex) == usagesArray.endIndex {
-                    let lastWrite = lastWrite!
-                    storeFences = [FenceDependency(encoderIndex: frameCommandInfo.encoderIndex(for: lastWrite.renderPassRecord), index: lastWrite.commandRange.last!, stages: lastWrite.stages)]
-                }
-                
-                // Process all the reads since the last write.
-                for readIndex in ((lastWriteIndex ?? -1) + 1)..<usagesArray.count {
-                    let read = usagesArray[readIndex]
-                    guard read.affectsGPUBarriers, read.isRead, read.renderPassRecord.type != .external else { continue }
-                    
-                    storeFences.append(FenceDependency(encoderIndex: frameCommandInfo.encoderIndex(for: read.renderPassRecord), index: read.commandRange.last!, stages: read.stages))
-                }
+            var storeFences : [FenceDependency] = []
+            
+            // We only need to wait for the write to complete if there have been no reads since the write; otherwise, we wait on the reads
+            // which in turn have a transitive dependency on the write.
+            if let lastWriteIndex = lastWriteIndex, usagesArray.index(after: lastWriteIndex) == usagesArray.endIndex {
+                let lastWrite = lastWrite!
+                storeFences = [FenceDependency(encoderIndex: frameCommandInfo.encoderIndex(for: lastWrite.renderPassRecord), index: lastWrite.commandRange.last!, stages: lastWrite.stages, usage: lastWrite)]
+            }
+            
+            // Process all the reads since the last write.
+            for readIndex in state.usageHistory.readIndices(after: lastWriteIndex, before: usagesArray.count) {
+                let read = usagesArray[readIndex]
+                guard read.renderPassRecord.type != .external else { continue }
                 
-                transientRegistry!.setDisposalFences(on: resource, to: storeFences)
+                storeFences.append(FenceDependency(encoderIndex: frameCommandInfo.encoderIndex(for: read.renderPassRecord), index: read.commandRange.last!, stages: read.stages, usage: read))
+            }
+            
+            state.disposalFences.append((resource, storeFences))
+            
+            if resource.baseResource == nil {
+                state.transientLifetimes.append(TransientResourceLifetime(resource: resource, firstCommandIndex: firstUsage.commandRange.lowerBound, lastCommandIndex: disposalIndex))
+            }
+        }
+    }
+    
+    func generateCommands(passes: [RenderPassRecord], usedResources: Set<Resource>, transientRegistry: Backend.TransientResourceRegistry?, backend: Backend, frameCommandInfo: inout FrameCommandInfo<Backend>) {
+        if passes.isEmpty {
+            return
+        }
+        
+        self.commandEncoderDependencies.resizeAndClear(capacity: frameCommandInfo.commandEncoders.count, clearValue: nil)
+        defer { TaggedHeap.free(tag: Self.resourceCommandGeneratorTag) }
+        
+        // Each resource's usages are processed independently, so the resources are partitioned across the job manager's threads
+        // with separate outputs for each partition.
+        let resources = Array(usedResources)
+        let partitionCount = min(RenderGraph.jobManager.threadCount, (resources.count + self.minimumResourcesPerPartition - 1) / self.minimumResourcesPerPartition)
+        while self.partitionStates.count < partitionCount {
+            self.partitionStates.append(ResourceCommandGenerationState())
+        }
+        
+        let commandInfo = frameCommandInfo // The inout parameter can't be captured by the concurrent closure.
+        RenderGraph.jobManager.forEachConcurrently(count: partitionCount) { partition in
+            let state = self.partitionStates[partition]
+            state.reset()
+            
+            let resourceRange = (resources.count * partition / partitionCount)..<(resources.count * (partition + 1) / partitionCount)
+            for resource in resources[resourceRange] {
+                self.generateCommands(for: resource, state: state, backend: backend, frameCommandInfo: commandInfo)
             }
         }
+        
+        for state in self.partitionStates.prefix(partitionCount) {
+            self.merge(state, transientRegistry: transientRegistry)
+        }
+        
+        if !self.transientLifetimes.isEmpty {
+            self.transientLifetimes.sort(by: { $0.firstCommandIndex < $1.firstCommandIndex })
+            transientRegistry!.planTransientAliasing(lifetimes: self.transientLifetimes)
+            self.transientLifetimes.removeAll(keepingCapacity: true)
+        }
+    }
+    
+    private func merge(_ state: ResourceCommandGenerationState<Backend>, transientRegistry: Backend.TransientResourceRegistry?) {
+        self.commands.append(contentsOf: state.commands)
+        self.preFrameCommands.append(contentsOf: state.preFrameCommands)
+        self.transientLifetimes.append(contentsOf: state.transientLifetimes)
+        
+        for (from, on, dependency) in state.encoderDependencies {
+            self.commandEncoderDependencies.setDependency(from: from, on: on,
+                                                          to: self.commandEncoderDependencies.dependency(from: from, on: on)?.merged(with: dependency) ?? dependency)
+        }
+        
+        for (resource, fences) in state.disposalFences {
+            transientRegistry!.setDisposalFences(on: resource, to: fences)
+        }
+        
+        for resource in state.historyBuffersToDispose {
+            resource.dispose()
+        }
+        
+        for resource in state.resourcesToMarkInitialised {
+            resource.markAsInitialised()
+        }
     }
     
     func executePreFrameCommands(context: RenderGraphContextImpl<Backend>, frameCommandInfo: inout FrameCommandInfo<Backend>) {
@@ -606,4 +780,82 @@ final class ResourceCommandGenerator<Backend: SpecificRenderBackend> {
     func reset() {
         self.commands.removeAll(keepingCapacity: true)
     }
+    
+    /// Compacts `commands` for backends that declare resource residency with batched useResources calls and synchronise with
+    /// coarse memory barriers (Metal and the headless backend).
+    ///
+    /// Reorderable residency commands are hoisted to the first use in their encoder and grouped by the backend's `UseKey`, skipping
+    /// any resource that `residentKey` says is already resident in that encoder; memory barriers are merged and issued as late as possible.
+    /// `useResourceKey` returns nil for resources that don't need a command. `addToBarrier` accumulates a barrier into the backend's
+    /// pending barrier state, and `makeBarrierCommand` builds a command from that state and resets it.
+    func compactResourceCommands<UseKey: Hashable, ResidentKey: Hashable, Element>(
+        commandInfo: FrameCommandInfo<Backend>,
+        into compactedResourceCommands: inout [CompactedResourceCommand<Backend.CompactedResourceCommandType>],
+        useResourceKey: (_ resource: Resource, _ usage: ResourceUsageType, _ stages: RenderStages) -> (key: UseKey, residentKey: ResidentKey, element: Element)?,
+        makeUseResourcesCommand: (_ key: UseKey, _ elements: [Element]) -> Backend.CompactedResourceCommandType,
+        addToBarrier: (_ resource: Resource, _ afterUsage: ResourceUsageType, _ afterStages: RenderStages, _ beforeUsage: ResourceUsageType, _ beforeStages: RenderStages) -> Void,
+        makeBarrierCommand: () -> Backend.CompactedResourceCommandType) {
+        
+        var currentEncoderIndex = 0
+        var currentEncoder = commandInfo.commandEncoders[currentEncoderIndex]
+        
+        var barrierLastIndex: Int = .max
+        
+        var encoderResidentResources = Set<ResidentKey>()
+        var encoderUseResourceCommandIndex: Int = .max
+        var encoderUseResources = [UseKey: [Element]]()
+        
+        // The flushes are written out inline since local closures can't capture the non-escaping closure parameters.
+        for command in self.commands {
+            if command.index >= barrierLastIndex { // For barriers, the barrier associated with command.index needs to happen _after_ any barriers required to happen _by_ barrierLastIndex
+                compactedResourceCommands.append(.init(command: makeBarrierCommand(), index: barrierLastIndex, order: .before))
+                barrierLastIndex = .max
+            }
+            
+            while !currentEncoder.commandRange.contains(command.index) {
+                currentEncoderIndex += 1
+                currentEncoder = commandInfo.commandEncoders[currentEncoderIndex]
+                
+                for (key, elements) in encoderUseResources where !elements.isEmpty {
+                    compactedResourceCommands.append(.init(command: makeUseResourcesCommand(key, elements), index: encoderUseResourceCommandIndex, order: .before))
+                }
+                encoderUseResourceCommandIndex = .max
+                encoderUseResources.removeAll(keepingCapacity: true)
+                encoderResidentResources.removeAll(keepingCapacity: true)
+                
+                assert(barrierLastIndex == .max)
+            }
+            
+            // Strategy:
+            // useResource should be batched together by usage to as early as possible in the encoder.
+            // memoryBarriers should be as late as possible.
+            switch command.command {
+            case .useResource(let resource, let usage, let stages, let allowReordering):
+                guard let (key, residentKey, element) = useResourceKey(resource, usage, stages) else { break }
+                
+                if !allowReordering {
+                    compactedResourceCommands.append(.init(command: makeUseResourcesCommand(key, [element]), index: command.index, order: .before))
+                } else {
+                    let (inserted, _) = encoderResidentResources.insert(residentKey)
+                    if inserted {
+                        encoderUseResources[key, default: []].append(element)
+                    }
+                    encoderUseResourceCommandIndex = min(command.index, encoderUseResourceCommandIndex)
+                }
+                
+            case .memoryBarrier(let resource, let afterUsage, let afterStages, let beforeCommand, let beforeUsage, let beforeStages, _):
+                addToBarrier(resource, afterUsage, afterStages, beforeUsage, beforeStages)
+                barrierLastIndex = min(beforeCommand, barrierLastIndex)
+            }
+        }
+        
+        if barrierLastIndex < .max {
+            compactedResourceCommands.append(.init(command: makeBarrierCommand(), index: barrierLastIndex, order: .before))
+        }
+        for (key, elements) in encoderUseResources where !elements.isEmpty {
+            compactedResourceCommands.append(.init(command: makeUseResourcesCommand(key, elements), index: encoderUseResourceCommandIndex, order: .before))
+        }
+        
+        compactedResourceCommands.sort()
+    }
 }
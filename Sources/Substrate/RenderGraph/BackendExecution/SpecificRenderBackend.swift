@@ -29,6 +29,8 @@ protocol SpecificRenderBackend: _RenderBackendProtocol {
     static var requiresResourceResidencyTracking: Bool { get }
     
     var supportsMemorylessAttachments: Bool { get }
+    /// Whether compute passes that allow it can be executed on a separate asynchronous compute queue.
+    var supportsAsyncCompute: Bool { get }
     
     func makeQueue(renderGraphQueue: Queue) -> QueueImpl
     func makeSyncEvent(for queue: Queue) -> Event
@@ -51,6 +53,10 @@ extension SpecificRenderBackend {
     func didCompleteCommand(_ index: UInt64, queue: Queue, context: RenderGraphContextImpl<Self>) {
         
     }
+    
+    var supportsAsyncCompute: Bool {
+        return false
+    }
 }
 
 protocol BackendRenderTargetDescriptor: AnyObject {
@@ -67,24 +73,82 @@ protocol BackendQueue: AnyObject {
             commandInfo: FrameCommandInfo<Backend>,
              resourceMap: FrameResourceMap<Backend>,
         compactedResourceCommands: [CompactedResourceCommand<Backend.CompactedResourceCommandType>]) -> Backend.CommandBuffer
+    
+    /// Makes a command buffer for the frame's command buffer at `commandBufferIndex`, which should be submitted to the queue
+    /// for the command buffer's queue family.
+    func makeCommandBuffer(
+            commandInfo: FrameCommandInfo<Backend>,
+             resourceMap: FrameResourceMap<Backend>,
+        compactedResourceCommands: [CompactedResourceCommand<Backend.CompactedResourceCommandType>],
+        commandBufferIndex: Int) -> Backend.CommandBuffer
+}
+
+extension BackendQueue {
+    func makeCommandBuffer(
+            commandInfo: FrameCommandInfo<Backend>,
+             resourceMap: FrameResourceMap<Backend>,
+        compactedResourceCommands: [CompactedResourceCommand<Backend.CompactedResourceCommandType>],
+        commandBufferIndex: Int) -> Backend.CommandBuffer {
+        return self.makeCommandBuffer(commandInfo: commandInfo, resourceMap: resourceMap, compactedResourceCommands: compactedResourceCommands)
+    }
 }
 
 protocol BackendCommandBuffer: AnyObject {
     associatedtype Backend: SpecificRenderBackend
     
+    /// Whether the command buffer should be given all of its encoders at once through `encodeCommands(encoderIndices:)`.
+    /// The waits for every encoder in the command buffer are then registered before any of the encoders are encoded.
+    static var supportsConcurrentEncoding: Bool { get }
+    
     func encodeCommands(encoderIndex: Int)
+    /// Encodes all of the encoders that share this command buffer; called at most once per command buffer.
+    func encodeCommands(encoderIndices: Range<Int>)
     
     func waitForEvent(_ event: Backend.Event, value: UInt64)
     func signalEvent(_ event: Backend.Event, value: UInt64)
+    /// Waits for a previously committed command buffer from the same frame that was submitted to a different queue.
+    func waitForCommandBuffer(_ commandBuffer: Self)
     func presentSwapchains(resourceRegistry: Backend.TransientResourceRegistry)
     func commit(onCompletion: @escaping (Self) -> Void)
     
     var gpuStartTime: Double { get }
     var gpuEndTime: Double { get }
     
+    /// The GPU execution times of the command buffer's encoders, if `FrameCommandInfo.recordsGPUTimestamps` was set and the backend supports it.
+    /// Only valid once the command buffer has completed.
+    var encoderGPUIntervals: [RenderGraphProfileInterval] { get }
+    
+    /// The number of draws in the command buffer that were skipped or used a fallback pipeline because their pipeline was being compiled.
+    /// Only valid once the command buffer has been encoded.
+    var deferredDrawCount: Int { get }
+    
     var error: Error? { get }
 }
 
+extension BackendCommandBuffer {
+    static var supportsConcurrentEncoding: Bool {
+        return false
+    }
+    
+    func encodeCommands(encoderIndices: Range<Int>) {
+        for encoderIndex in encoderIndices {
+            self.encodeCommands(encoderIndex: encoderIndex)
+        }
+    }
+    
+    func waitForCommandBuffer(_ commandBuffer: Self) {
+        preconditionFailure("\(Self.self) doesn't support multiple queues.")
+    }
+    
+    var encoderGPUIntervals: [RenderGraphProfileInterval] {
+        return []
+    }
+    
+    var deferredDrawCount: Int {
+        return 0
+    }
+}
+
 protocol ResourceRegistry: AnyObject {
     associatedtype Backend: SpecificRenderBackend
     
@@ -100,7 +164,12 @@ protocol ResourceRegistry: AnyObject {
 }
 
 protocol BackendTransientResourceRegistry: ResourceRegistry {
-    static func isAliasedHeapResource(resource: Resource) -> Bool
+    /// Whether `resource` may be placed in memory shared with other transient resources.
+    /// Lifetimes and disposal fences are tracked for every candidate, since they're needed to decide the placement.
+    static func isAliasingCandidate(resource: Resource) -> Bool
+    /// Whether `resource` shares its memory with other transient resources in the current frame.
+    /// Only valid once `planTransientAliasing(lifetimes:)` has been called.
+    func isAliasedHeapResource(resource: Resource) -> Bool
     
     var accessLock: SpinLock { get set }
     
@@ -110,6 +179,9 @@ protocol BackendTransientResourceRegistry: ResourceRegistry {
     func allocateTextureView(_ texture: Texture, resourceMap: FrameResourceMap<Backend>) -> Backend.TextureReference
     
     func setDisposalFences(on resource: Resource, to fences: [FenceDependency])
+    /// Called once the lifetimes of all of the frame's aliased heap resources are known, before any of them are allocated.
+    /// The lifetimes are sorted by their first command index.
+    func planTransientAliasing(lifetimes: [TransientResourceLifetime])
     func disposeTexture(_ texture: Texture, waitEvent: ContextWaitEvent)
     func disposeBuffer(_ buffer: Buffer, waitEvent: ContextWaitEvent)
     func disposeArgumentBuffer(_ buffer: ArgumentBuffer, waitEvent: ContextWaitEvent)
@@ -122,11 +194,31 @@ protocol BackendTransientResourceRegistry: ResourceRegistry {
     var argumentBufferWaitEvents: TransientResourceMap<ArgumentBuffer, ContextWaitEvent>? { get }
     var argumentBufferArrayWaitEvents: TransientResourceMap<ArgumentBufferArray, ContextWaitEvent>? { get }
     var historyBufferResourceWaitEvents: [Resource : ContextWaitEvent] { get }
+    
+    /// Returns the transient allocation statistics accumulated since the last call, for `RenderGraphFrameProfile`.
+    func takeAllocationStatistics() -> TransientAllocationStatistics
+}
+
+struct TransientAllocationStatistics {
+    /// The memory backing the frame's transient resources.
+    var transientBytes = 0
+    var poolHitCount = 0
+    var poolMissCount = 0
 }
 
 extension BackendTransientResourceRegistry {
     var argumentBufferWaitEvents: TransientResourceMap<ArgumentBuffer, ContextWaitEvent>? { nil }
     var argumentBufferArrayWaitEvents: TransientResourceMap<ArgumentBufferArray, ContextWaitEvent>? { nil }
+    
+    func takeAllocationStatistics() -> TransientAllocationStatistics {
+        return TransientAllocationStatistics()
+    }
+    
+    func planTransientAliasing(lifetimes: [TransientResourceLifetime]) {}
+    
+    func isAliasedHeapResource(resource: Resource) -> Bool {
+        return Self.isAliasingCandidate(resource: resource)
+    }
 }
 
 protocol BackendPersistentResourceRegistry: ResourceRegistry {
@@ -0,0 +1,157 @@
+//
+//  TransientResourceAliasing.swift
+//  Substrate
+//
+
+import SubstrateUtilities
+
+/// The span of commands over which a transient resource's memory must remain valid.
+struct TransientResourceLifetime {
+    var resource : Resource
+    /// The index of the first command that uses the resource.
+    var firstCommandIndex : Int
+    /// The index of the command after which the resource is disposed. This is always the last command in a command encoder,
+    /// since resources can't alias against each other within a command encoder.
+    var lastCommandIndex : Int
+    
+    @inline(__always)
+    func overlaps(_ other: TransientResourceLifetime) -> Bool {
+        return self.firstCommandIndex <= other.lastCommandIndex && other.firstCommandIndex <= self.lastCommandIndex
+    }
+}
+
+struct TransientMemoryRequirements {
+    var size : Int
+    var alignment : Int
+    /// Resources can only share a memory block with other resources in the same memory class
+    /// (e.g. with the same allowed memory types and the same linear or optimal layout).
+    var memoryClass : Int
+}
+
+/// The placement of a frame's transient resources into shared memory blocks.
+struct TransientAliasingPlan {
+    struct Block {
+        var memoryClass : Int
+        var size : Int
+        var alignment : Int
+    }
+    
+    struct Placement {
+        var blockIndex : Int
+        var offset : Int
+        var size : Int
+        
+        @inline(__always)
+        func overlapsMemory(of other: Placement) -> Bool {
+            return self.blockIndex == other.blockIndex && self.offset < other.offset + other.size && other.offset < self.offset + self.size
+        }
+    }
+    
+    var blocks : [Block] = []
+    /// The placement for each lifetime passed to the planner, in the same order.
+    var placements : [Placement] = []
+    /// For each lifetime passed to the planner, the indices of the lifetimes that previously occupied some of its memory.
+    /// A resource must wait for the GPU to finish using all of its predecessors before its first use.
+    var predecessors : [[Int]] = []
+    /// For each lifetime passed to the planner, whether any other lifetime occupies some of the same memory.
+    /// Resources that don't share memory never need aliasing barriers.
+    var isShared : [Bool] = []
+    
+    /// The total size of the blocks.
+    var aliasedSize : Int {
+        return self.blocks.reduce(0, { $0 + $1.size })
+    }
+    
+    /// The memory that would be required if every resource had its own allocation.
+    var unaliasedSize : Int {
+        return self.placements.reduce(0, { $0 + $1.size })
+    }
+}
+
+enum TransientAliasingPlanner {
+    /// Packs resources into as little memory as possible such that two resources only share memory if their lifetimes don't overlap.
+    /// Resources are placed greedily in decreasing order of size at the lowest offset that doesn't conflict with any
+    /// already-placed resource in the same block that is live at the same time.
+    static func makePlan(lifetimes: [TransientResourceLifetime], requirements: [TransientMemoryRequirements]) -> TransientAliasingPlan {
+        precondition(lifetimes.count == requirements.count)
+        
+        var plan = TransientAliasingPlan()
+        plan.placements = requirements.map { TransientAliasingPlan.Placement(blockIndex: -1, offset: 0, size: $0.size) }
+        plan.predecessors = [[Int]](repeating: [], count: lifetimes.count)
+        plan.isShared = [Bool](repeating: false, count: lifetimes.count)
+        
+        var blockIndexForClass = [Int : Int]()
+        /// The indices of the lifetimes placed in each block.
+        var placedInBlock = [[Int]]()
+        
+        let placementOrder = lifetimes.indices.sorted(by: { a, b in
+            if requirements[a].size != requirements[b].size {
+                return requirements[a].size > requirements[b].size
+            }
+            return lifetimes[a].firstCommandIndex < lifetimes[b].firstCommandIndex
+        })
+        
+        var conflicts = [(offset: Int, end: Int)]()
+        
+        for i in placementOrder {
+            let requirement = requirements[i]
+            
+            let blockIndex : Int
+            if let existingIndex = blockIndexForClass[requirement.memoryClass] {
+                blockIndex = existingIndex
+            } else {
+                blockIndex = plan.blocks.count
+                blockIndexForClass[requirement.memoryClass] = blockIndex
+                plan.blocks.append(TransientAliasingPlan.Block(memoryClass: requirement.memoryClass, size: 0, alignment: 1))
+                placedInBlock.append([])
+            }
+            
+            conflicts.removeAll(keepingCapacity: true)
+            for j in placedInBlock[blockIndex] where lifetimes[i].overlaps(lifetimes[j]) {
+                conflicts.append((plan.placements[j].offset, plan.placements[j].offset + plan.placements[j].size))
+            }
+            conflicts.sort(by: { $0.offset < $1.offset })
+            
+            var offset = 0
+            for conflict in conflicts {
+                if offset + requirement.size <= conflict.offset {
+                    break // The resource fits in the gap before this conflict.
+                }
+                offset = max(offset, conflict.end.roundedUpToMultiple(of: requirement.alignment))
+            }
+            
+            plan.placements[i].blockIndex = blockIndex
+            plan.placements[i].offset = offset
+            plan.blocks[blockIndex].size = max(plan.blocks[blockIndex].size, offset + requirement.size)
+            plan.blocks[blockIndex].alignment = max(plan.blocks[blockIndex].alignment, requirement.alignment)
+            placedInBlock[blockIndex].append(i)
+        }
+        
+        // Only lifetimes in the same block that ended before a lifetime starts can be its predecessors,
+        // so sort each block by end and binary search for the candidates rather than testing every pair.
+        for var blockLifetimes in placedInBlock {
+            blockLifetimes.sort(by: { lifetimes[$0].lastCommandIndex < lifetimes[$1].lastCommandIndex })
+            
+            for i in blockLifetimes {
+                var low = 0
+                var high = blockLifetimes.count
+                while low < high {
+                    let mid = (low + high) / 2
+                    if lifetimes[blockLifetimes[mid]].lastCommandIndex < lifetimes[i].firstCommandIndex {
+                        low = mid + 1
+                    } else {
+                        high = mid
+                    }
+                }
+                
+                for j in blockLifetimes[..<low] where plan.placements[i].overlapsMemory(of: plan.placements[j]) {
+                    plan.predecessors[i].append(j)
+                    plan.isShared[i] = true
+                    plan.isShared[j] = true
+                }
+            }
+        }
+        
+        return plan
+    }
+}
@@ -148,6 +148,40 @@ public class ResourceBindingEncoder : CommandEncoder {
     @usableFromInline
     var boundUAVResources : HashSet<ResourceBindingPath>
     
+    /// The most recent state bound directly at a binding path, used to drop bindings that wouldn't change anything.
+    /// The shadow is cleared whenever the pipeline changes, since a new pipeline layout may invalidate any of its bindings.
+    @usableFromInline
+    enum BindingShadowState {
+        case buffer(Resource.Handle, offset: UInt32)
+        case texture(Resource.Handle)
+        case samplerState(UnsafePointer<RenderGraphCommand.SetSamplerStateArgs>)
+        case bytes(UnsafePointer<RenderGraphCommand.SetBytesArgs>)
+        
+        @inlinable
+        func isEquivalent(to other: BindingShadowState) -> Bool {
+            switch (self, other) {
+            case (.buffer(let buffer, let offset), .buffer(let otherBuffer, let otherOffset)):
+                return buffer == otherBuffer && offset == otherOffset
+            case (.texture(let texture), .texture(let otherTexture)):
+                return texture == otherTexture
+            case (.samplerState(let args), .samplerState(let otherArgs)):
+                return args.pointee.descriptor == otherArgs.pointee.descriptor
+            case (.bytes(let args), .bytes(let otherArgs)):
+                return BindingShadowState.bytesAreEqual(args.pointee.bytes, otherArgs.pointee.bytes, length: Int(args.pointee.length), otherLength: Int(otherArgs.pointee.length))
+            default:
+                return false
+            }
+        }
+        
+        @inlinable
+        static func bytesAreEqual(_ bytes: UnsafeRawPointer, _ otherBytes: UnsafeRawPointer, length: Int, otherLength: Int) -> Bool {
+            return length == otherLength && UnsafeRawBufferPointer(start: bytes, count: length).elementsEqual(UnsafeRawBufferPointer(start: otherBytes, count: otherLength))
+        }
+    }
+    
+    @usableFromInline
+    var boundStateShadow : HashMap<ResourceBindingPath, BindingShadowState>
+    
     // The following methods and variables are helpers for updateResourceUsages.
     // They're contained on the object rather than as local variables to minimised allocations and retain-release traffic.
     
@@ -158,6 +192,7 @@ public class ResourceBindingEncoder : CommandEncoder {
         self.boundResources.deinit()
         self.untrackedBoundResources.deinit()
         self.boundUAVResources.deinit()
+        self.boundStateShadow.deinit()
     }
     
     @usableFromInline
@@ -181,6 +216,7 @@ public class ResourceBindingEncoder : CommandEncoder {
         self.boundResources = HashMap(allocator: AllocatorType(commandRecorder.renderPassScratchAllocator))
         self.boundUAVResources = HashSet(allocator: AllocatorType(commandRecorder.renderPassScratchAllocator))
         self.untrackedBoundResources = HashMap(allocator: AllocatorType(commandRecorder.renderPassScratchAllocator))
+        self.boundStateShadow = HashMap(allocator: AllocatorType(commandRecorder.renderPassScratchAllocator))
         self.pendingArgumentBuffersByKey = ExpandingBuffer(allocator: AllocatorType(commandRecorder.renderPassScratchAllocator))
         self.pendingArgumentBuffers = ExpandingBuffer(allocator: AllocatorType(commandRecorder.renderPassScratchAllocator))
         self.resourceBindingCommands = ExpandingBuffer(allocator: AllocatorType(commandRecorder.renderPassScratchAllocator))
@@ -202,11 +238,25 @@ public class ResourceBindingEncoder : CommandEncoder {
     }
     
     public func setBytes(_ bytes: UnsafeRawPointer, length: Int, path: ResourceBindingPath) {
-        let args : RenderGraphCommand.SetBytesArgs = (path, commandRecorder.copyBytes(bytes, length: length), UInt32(length))
-        
-        let argData = commandRecorder.copyData(args)
-        
-        commandRecorder.record(.setBytes(argData))
+        if case .bytes(let previousArgs)? = self.boundStateShadow[path],
+            BindingShadowState.bytesAreEqual(previousArgs.pointee.bytes, bytes, length: Int(previousArgs.pointee.length), otherLength: length) {
+            self.commandRecorder.elidedCommandCount += 1
+            return
+        }
+        let args = commandRecorder.recordSetBytes(bytes, length: length, path: path)
+        self.boundStateShadow.insertOrAssign(key: path, value: .bytes(args))
+    }
+    
+    /// Records `state` as the state bound at `bindingPath`, returning false if it's equivalent to the state that's already bound.
+    /// Redundant bindings are counted in the command recorder's `elidedCommandCount`.
+    @usableFromInline
+    func updateShadowState(_ state: BindingShadowState, at bindingPath: ResourceBindingPath) -> Bool {
+        if let currentState = self.boundStateShadow[bindingPath], currentState.isEquivalent(to: state) {
+            self.commandRecorder.elidedCommandCount += 1
+            return false
+        }
+        self.boundStateShadow.insertOrAssign(key: bindingPath, value: state)
+        return true
     }
     
     public func setBuffer(_ buffer: Buffer?, offset: Int, key: FunctionArgumentKey) {
@@ -453,6 +503,7 @@ public class ResourceBindingEncoder : CommandEncoder {
                 let identifier : Resource.Handle
                 switch command {
                 case .setSamplerState(let args):
+                    guard self.updateShadowState(.samplerState(args), at: bindingPath) else { return nil }
                     UnsafeMutablePointer(mutating: args).pointee.bindingPath = bindingPath
                     self.commandRecorder.record(command)
                     return nil
@@ -464,35 +515,38 @@ public class ResourceBindingEncoder : CommandEncoder {
                     return nil
                     
                 case .setBytes(let args):
+                    guard self.updateShadowState(.bytes(args), at: bindingPath) else { return nil }
                     UnsafeMutablePointer(mutating: args).pointee.bindingPath = bindingPath
                     self.commandRecorder.record(command)
                     return nil
                     
                 case .setBufferOffset(let args):
-                    UnsafeMutablePointer(mutating: args).pointee.bindingPath = bindingPath
-                    self.commandRecorder.record(command)
-                    
-                    guard let setBufferArgsRaw = currentlyBound?.bindingCommand else {
+                    guard let setBufferArgsRaw = currentlyBound?.bindingCommand, currentlyBound!.resource.type == .buffer else {
                         assertionFailure("No buffer bound when setBufferOffset was called for key \(key).")
                         return currentlyBound
                     }
                     let setBufferArgs = setBufferArgsRaw.assumingMemoryBound(to: RenderGraphCommand.SetBufferArgs.self)
-                    
                     let handle = setBufferArgs.pointee.buffer
+                    
+                    guard self.updateShadowState(.buffer(handle.handle, offset: args.pointee.offset), at: bindingPath) else {
+                        return currentlyBound
+                    }
+                    
+                    UnsafeMutablePointer(mutating: args).pointee.bindingPath = bindingPath
+                    self.commandRecorder.record(command)
+                    
                     UnsafeMutablePointer(mutating: args).pointee.buffer = handle
                     setBufferArgs.pointee.hasDynamicOffset = true
                     
                     return currentlyBound
                     
                 case .setBuffer(let args):
-                    if let previousArgs = currentlyBound?.bindingCommand?.assumingMemoryBound(to: RenderGraphCommand.SetBufferArgs.self) {
-                        if previousArgs.pointee.buffer == args.pointee.buffer { // Ignore the duplicate binding.
-                            if !self.pipelineStateChanged, previousArgs.pointee.offset == args.pointee.offset {
-                                return currentlyBound
-                            } /* else {
-                             // TODO: translate duplicate setBuffer calls into setBufferOffset.
-                             }*/
-                        }
+                    // The shadow is cleared on pipeline changes, so a rebinding of the bound buffer at the same offset is redundant.
+                    let shadowState = BindingShadowState.buffer(args.pointee.buffer.handle, offset: args.pointee.offset)
+                    if currentlyBound?.resource.handle == args.pointee.buffer.handle {
+                        guard self.updateShadowState(shadowState, at: bindingPath) else { return currentlyBound }
+                    } else {
+                        self.boundStateShadow.insertOrAssign(key: bindingPath, value: shadowState)
                     }
                     
                     identifier = args.pointee.buffer.handle
@@ -501,10 +555,10 @@ public class ResourceBindingEncoder : CommandEncoder {
                     bufferOffset = Int(args.pointee.offset)
                     
                 case .setTexture(let args):
-                    if let previousArgs = currentlyBound?.bindingCommand?.assumingMemoryBound(to: RenderGraphCommand.SetTextureArgs.self) {
-                        if !self.pipelineStateChanged, previousArgs.pointee.texture == args.pointee.texture { // Ignore the duplicate binding.
-                            return currentlyBound
-                        }
+                    if currentlyBound?.resource.handle == args.pointee.texture.handle {
+                        guard self.updateShadowState(.texture(args.pointee.texture.handle), at: bindingPath) else { return currentlyBound }
+                    } else {
+                        self.boundStateShadow.insertOrAssign(key: bindingPath, value: .texture(args.pointee.texture.handle))
                     }
                     
                     identifier = args.pointee.texture.handle
@@ -574,6 +628,7 @@ public class ResourceBindingEncoder : CommandEncoder {
             }
             
             replacingBoundResourceNode(bindingPath: argumentBufferPath, resultUntrackedIfUsed: assumeConsistentUsage, perform: { currentlyBound in
+                self.boundStateShadow.removeValue(forKey: argumentBufferPath)
 
                 let argsPtr : UnsafeMutableRawPointer
                 
@@ -698,7 +753,7 @@ public class ResourceBindingEncoder : CommandEncoder {
             self.boundResources.forEachMutating { bindingPath, /* inout */ boundResource, /* inout */ deleteEntry in
                 if let reflection = pipelineReflection.argumentReflection(at: bindingPath), reflection.isActive {
                     // Mark the resource as used if it currently isn't
-                    assert(reflection.type == boundResource.resource.type || (reflection.type == .buffer && boundResource.resource.type == .argumentBuffer))
+                    assert(!pipelineReflection.hasArgumentTypeInformation || reflection.type == boundResource.resource.type || (reflection.type == .buffer && boundResource.resource.type == .argumentBuffer))
                         
                     // If the command to bind the resource hasn't yet been inserted into the command stream, insert it now.
                     if boundResource.usagePointer == nil, let bindingCommandArgs = boundResource.bindingCommand {
@@ -739,6 +794,11 @@ public class ResourceBindingEncoder : CommandEncoder {
                         bufferOffset = Int(bindingCommandArgs.assumingMemoryBound(to: RenderGraphCommand.SetBufferArgs.self).pointee.offset)
                     }
                     
+                    if let previousUsage = boundResource.usagePointer {
+                        // The binding was retained (or redundantly rebound) across the pipeline change; end its previous usage.
+                        self.usagePointersToUpdate.append(previousUsage)
+                    }
+                    
                     let node = self.commandRecorder.boundResourceUsageNode(for: boundResource.resource, encoder: self, usageType: reflection.usageType, stages: reflection.activeStages, activeRange: reflection.activeRange.offset(by: bufferOffset), inArgumentBuffer: boundResource.isInArgumentBuffer, firstCommandOffset: firstCommandOffset)
                     boundResource.usagePointer = node
                     
@@ -787,6 +847,7 @@ public class ResourceBindingEncoder : CommandEncoder {
         self.resourceBindingCommands.removeAll()
         self.pendingArgumentBuffers.removeAll()
         self.pendingArgumentBuffersByKey.removeAll()
+        self.boundStateShadow.removeAll()
         
         let endIndex = self.lastGPUCommandIndex + 1
         
@@ -913,6 +974,14 @@ public final class RenderCommandEncoder : ResourceBindingEncoder, AnyRenderComma
     var gpuCommandsStartIndexDepthStencil : Int? = nil
     
     var nonDefaultDynamicState: DrawDynamicState = []
+    
+    // The last value set for each piece of dynamic state within this encoder, or nil if it hasn't been set.
+    var currentViewport : Viewport? = nil
+    var currentScissorRect : ScissorRect? = nil
+    var currentFrontFacing : Winding? = nil
+    var currentCullMode : CullMode? = nil
+    var currentTriangleFillMode : TriangleFillMode? = nil
+    var currentDepthClipMode : DepthClipMode? = nil
 
     init(commandRecorder: RenderGraphCommandRecorder, renderPass: DrawRenderPass, passRecord: RenderPassRecord) {
         self.drawRenderPass = renderPass
@@ -1112,9 +1181,15 @@ public final class RenderCommandEncoder : ResourceBindingEncoder, AnyRenderComma
     }
     
     public func setRenderPipelineDescriptor(_ descriptor: RenderPipelineDescriptor, retainExistingBindings: Bool = true) {
+        if retainExistingBindings, descriptor == self.renderPipelineDescriptor {
+            self.commandRecorder.elidedCommandCount += 1
+            return
+        }
+        
         if !retainExistingBindings {
             self.resetAllBindings()
         }
+        self.boundStateShadow.removeAll()
         
         self.renderPipelineDescriptor = descriptor
         self.currentPipelineReflection = RenderBackend.renderPipelineReflection(descriptor: descriptor, renderTarget: self.drawRenderPass.renderTargetDescriptor)
@@ -1147,21 +1222,41 @@ public final class RenderCommandEncoder : ResourceBindingEncoder, AnyRenderComma
     }
 
     public func setViewport(_ viewport: Viewport) {
+        guard viewport != self.currentViewport else {
+            self.commandRecorder.elidedCommandCount += 1
+            return
+        }
+        self.currentViewport = viewport
         commandRecorder.record(RenderGraphCommand.setViewport, viewport)
         self.nonDefaultDynamicState.formUnion(.viewport)
     }
     
     public func setFrontFacing(_ frontFacingWinding: Winding) {
+        guard frontFacingWinding != self.currentFrontFacing else {
+            self.commandRecorder.elidedCommandCount += 1
+            return
+        }
+        self.currentFrontFacing = frontFacingWinding
         commandRecorder.record(.setFrontFacing(frontFacingWinding))
         self.nonDefaultDynamicState.formUnion(.frontFacing)
     }
     
     public func setCullMode(_ cullMode: CullMode) {
+        guard cullMode != self.currentCullMode else {
+            self.commandRecorder.elidedCommandCount += 1
+            return
+        }
+        self.currentCullMode = cullMode
         commandRecorder.record(.setCullMode(cullMode))
         self.nonDefaultDynamicState.formUnion(.cullMode)
     }
     
     public func setTriangleFillMode(_ fillMode: TriangleFillMode) {
+        guard fillMode != self.currentTriangleFillMode else {
+            self.commandRecorder.elidedCommandCount += 1
+            return
+        }
+        self.currentTriangleFillMode = fillMode
         commandRecorder.record(.setTriangleFillMode(fillMode))
         self.nonDefaultDynamicState.formUnion(.triangleFillMode)
     }
@@ -1182,6 +1277,11 @@ public final class RenderCommandEncoder : ResourceBindingEncoder, AnyRenderComma
             descriptor.backFaceStencil = .init()
         }
         
+        guard descriptor != self.depthStencilDescriptor else {
+            self.commandRecorder.elidedCommandCount += 1
+            return
+        }
+        
         self.depthStencilDescriptor = descriptor
         self.depthStencilStateChanged = true
         
@@ -1190,11 +1290,21 @@ public final class RenderCommandEncoder : ResourceBindingEncoder, AnyRenderComma
     
 //    @inlinable
     public func setScissorRect(_ rect: ScissorRect) {
+        guard rect != self.currentScissorRect else {
+            self.commandRecorder.elidedCommandCount += 1
+            return
+        }
+        self.currentScissorRect = rect
         commandRecorder.record(RenderGraphCommand.setScissorRect, rect)
         self.nonDefaultDynamicState.formUnion(.scissorRect)
     }
     
     public func setDepthClipMode(_ depthClipMode: DepthClipMode) {
+        guard depthClipMode != self.currentDepthClipMode else {
+            self.commandRecorder.elidedCommandCount += 1
+            return
+        }
+        self.currentDepthClipMode = depthClipMode
         commandRecorder.record(.setDepthClipMode(depthClipMode))
         self.nonDefaultDynamicState.formUnion(.depthClipMode)
     }
@@ -1311,6 +1421,10 @@ public final class RenderCommandEncoder : ResourceBindingEncoder, AnyRenderComma
         }
         
         super.endEncoding()
+        
+        if self.drawRenderPass.batchesIndexedDraws {
+            self.batchIndexedDraws()
+        }
     }
 }
 
@@ -1335,9 +1449,15 @@ public final class ComputeCommandEncoder : ResourceBindingEncoder {
     }
     
     public func setComputePipelineDescriptor(_ descriptor: ComputePipelineDescriptor, retainExistingBindings: Bool = true) {
+        if retainExistingBindings, descriptor == self.currentComputePipeline?.pipelineDescriptor {
+            self.commandRecorder.elidedCommandCount += 1
+            return
+        }
+        
         if !retainExistingBindings {
             self.resetAllBindings()
         }
+        self.boundStateShadow.removeAll()
         
         self.currentPipelineReflection = RenderBackend.computePipelineReflection(descriptor: descriptor)
         
@@ -106,6 +106,16 @@ enum RenderGraphCommand {
     public typealias DrawIndexedPrimitivesArgs = (primitiveType: PrimitiveType, indexCount: UInt32, indexType: IndexType, indexBuffer: Buffer, indexBufferOffset: UInt32, instanceCount: UInt32, baseVertex: Int32, baseInstance: UInt32)
     case drawIndexedPrimitives(UnsafePointer<DrawIndexedPrimitivesArgs>)
     
+    /// `drawCount` draws whose arguments are `DrawPrimitivesIndirectArguments` laid out `stride` bytes apart in `indirectBuffer`.
+    /// If `countBuffer` is non-nil, the number of draws is the `UInt32` at `countBufferOffset`, clamped to `drawCount`.
+    public typealias DrawPrimitivesIndirectArgs = (primitiveType: PrimitiveType, indirectBuffer: Buffer, indirectBufferOffset: UInt32, drawCount: UInt32, stride: UInt32, countBuffer: Buffer?, countBufferOffset: UInt32)
+    case drawPrimitivesIndirect(UnsafePointer<DrawPrimitivesIndirectArgs>)
+    
+    /// `drawCount` draws whose arguments are `DrawIndexedPrimitivesIndirectArguments` laid out `stride` bytes apart in `indirectBuffer`.
+    /// If `countBuffer` is non-nil, the number of draws is the `UInt32` at `countBufferOffset`, clamped to `drawCount`.
+    public typealias DrawIndexedPrimitivesIndirectArgs = (primitiveType: PrimitiveType, indexType: IndexType, indexBuffer: Buffer, indexBufferOffset: UInt32, indirectBuffer: Buffer, indirectBufferOffset: UInt32, drawCount: UInt32, stride: UInt32, countBuffer: Buffer?, countBufferOffset: UInt32)
+    case drawIndexedPrimitivesIndirect(UnsafePointer<DrawIndexedPrimitivesIndirectArgs>)
+    
     case setViewport(UnsafePointer<Viewport>)
     
     case setFrontFacing(Winding)
@@ -196,7 +206,7 @@ enum RenderGraphCommand {
     
     var isDrawCommand: Bool {
         switch self {
-        case .clearRenderTargets, .drawPrimitives, .drawIndexedPrimitives:
+        case .clearRenderTargets, .drawPrimitives, .drawPrimitivesIndirect, .drawIndexedPrimitives, .drawIndexedPrimitivesIndirect:
             return true
         default:
             return false
@@ -218,19 +228,21 @@ final class RenderGraphCommandRecorder {
     @usableFromInline let activeRenderGraphMask: ActiveRenderGraphMask
     @usableFromInline let renderPassScratchAllocator : ThreadLocalTagAllocator
     @usableFromInline let resourceUsageAllocator : TagAllocator.ThreadView
-    @usableFromInline var commands : ChunkArray<RenderGraphCommand> // Lifetime: RenderGraph compilation (copied to another array for the backend).
+    @usableFromInline var commands : PackedCommandStream<RenderGraphCommand> // Lifetime: RenderGraph execution. Payloads recorded through `record` are stored inline.
     @usableFromInline var dataAllocator : TagAllocator.ThreadView // Lifetime: RenderGraph execution.
     @usableFromInline let unmanagedReferences : ExpandingBuffer<Unmanaged<AnyObject>> // Lifetime: RenderGraph execution.
     @usableFromInline var readResources : HashSet<Resource>
     @usableFromInline var writtenResources : HashSet<Resource>
     
     @usableFromInline var resourceUsages = ChunkArray<(Resource, ResourceUsage)>()
+    /// The number of commands the encoders dropped because they wouldn't have changed the bound state.
+    @usableFromInline var elidedCommandCount = 0
     
     init(renderGraphTransientRegistryIndex: Int, renderGraphQueue: Queue, renderPassScratchAllocator: ThreadLocalTagAllocator, renderGraphExecutionAllocator: TagAllocator.ThreadView, resourceUsageAllocator: TagAllocator.ThreadView, unmanagedReferences: ExpandingBuffer<Unmanaged<AnyObject>>) {
         assert(_isPOD(RenderGraphCommand.self))
         self.renderGraphTransientRegistryIndex = renderGraphTransientRegistryIndex
         self.activeRenderGraphMask = 1 << renderGraphQueue.index
-        self.commands = ChunkArray() // (allocator: AllocatorType(renderGraphExecutionAllocator), initialCapacity: 64)
+        self.commands = PackedCommandStream()
         self.renderPassScratchAllocator = renderPassScratchAllocator
         self.resourceUsageAllocator = resourceUsageAllocator
         self.dataAllocator = renderGraphExecutionAllocator
@@ -253,8 +265,7 @@ final class RenderGraphCommandRecorder {
     
     @inlinable
     public func record<T>(_ commandGenerator: (UnsafePointer<T>) -> RenderGraphCommand, _ data: T) {
-        let command = commandGenerator(copyData(data))
-        self.commands.append(command, allocator: .tagThreadView(self.dataAllocator))
+        self.commands.append(commandGenerator, payload: data, allocator: .tagThreadView(self.dataAllocator))
     }
     
     @inlinable
@@ -264,16 +275,31 @@ final class RenderGraphCommandRecorder {
     
     @inlinable
     public func record(_ commandGenerator: (UnsafePointer<CChar>) -> RenderGraphCommand, _ string: String) {
-        let cStringAddress = string.withCString { label -> UnsafePointer<CChar> in
+        string.withCString { label in
             let numChars = strlen(label)
-            let destination : UnsafeMutablePointer<CChar> = self.dataAllocator.allocate(capacity: numChars + 1)
-            destination.initialize(from: label, count: numChars)
-            destination[numChars] = 0
-            return UnsafePointer(destination)
+            self.commands.append(payloadByteCount: numChars + 1, alignment: 1, allocator: .tagThreadView(self.dataAllocator)) { payload in
+                let destination = payload.bindMemory(to: CChar.self, capacity: numChars + 1)
+                destination.initialize(from: label, count: numChars)
+                destination[numChars] = 0
+                return commandGenerator(UnsafePointer(destination))
+            }
         }
-        
-        let command = commandGenerator(cStringAddress)
-        self.commands.append(command, allocator: .tagThreadView(self.dataAllocator))
+    }
+    
+    /// Records a `setBytes` command with both its arguments and the bytes stored inline.
+    @discardableResult
+    @inlinable
+    public func recordSetBytes(_ bytes: UnsafeRawPointer, length: Int, path: ResourceBindingPath) -> UnsafePointer<RenderGraphCommand.SetBytesArgs> {
+        let argsSize = MemoryLayout<RenderGraphCommand.SetBytesArgs>.stride.roundedUpToMultiple(of: 16)
+        var result : UnsafePointer<RenderGraphCommand.SetBytesArgs>! = nil
+        self.commands.append(payloadByteCount: argsSize + length, alignment: 16, allocator: .tagThreadView(self.dataAllocator)) { payload in
+            let bytesCopy = payload + argsSize
+            bytesCopy.copyMemory(from: bytes, byteCount: length)
+            let args = payload.initializeMemory(as: RenderGraphCommand.SetBytesArgs.self, repeating: (path, UnsafeRawPointer(bytesCopy), UInt32(length)), count: 1)
+            result = UnsafePointer(args)
+            return .setBytes(UnsafePointer(args))
+        }
+        return result
     }
     
     @discardableResult
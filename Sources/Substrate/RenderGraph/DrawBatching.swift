@@ -0,0 +1,176 @@
+//
+//  DrawBatching.swift
+//  Substrate
+//
+
+import SubstrateUtilities
+
+/// The arguments for a single draw within an indirect indexed draw command.
+/// The layout matches both `MTLDrawIndexedPrimitivesIndirectArguments` and `VkDrawIndexedIndirectCommand`.
+public struct DrawIndexedPrimitivesIndirectArguments {
+    public var indexCount : UInt32
+    public var instanceCount : UInt32
+    public var indexStart : UInt32
+    public var baseVertex : Int32
+    public var baseInstance : UInt32
+
+    @inlinable
+    public init(indexCount: UInt32, instanceCount: UInt32, indexStart: UInt32, baseVertex: Int32, baseInstance: UInt32) {
+        self.indexCount = indexCount
+        self.instanceCount = instanceCount
+        self.indexStart = indexStart
+        self.baseVertex = baseVertex
+        self.baseInstance = baseInstance
+    }
+}
+
+/// The number of draw calls recorded by a pass that batches its indexed draws, before and after merging.
+public struct DrawBatchingStatistics {
+    public var passName : String
+    public var drawCountBeforeBatching : Int
+    public var drawCountAfterBatching : Int
+}
+
+extension IndexType {
+    @inlinable
+    var stride : Int {
+        switch self {
+        case .uint16:
+            return 2
+        case .uint32:
+            return 4
+        }
+    }
+}
+
+extension RenderCommandEncoder {
+    /// Returns the first index of the draw within its index buffer, or nil if the draw's offset isn't a whole number of indices.
+    static func indexStart(of draw: UnsafePointer<RenderGraphCommand.DrawIndexedPrimitivesArgs>) -> UInt32? {
+        let indexStride = UInt32(draw.pointee.indexType.stride)
+        guard draw.pointee.indexBufferOffset % indexStride == 0 else { return nil }
+        return draw.pointee.indexBufferOffset / indexStride
+    }
+
+    /// Draws with a non-zero `baseInstance` can only be merged if the device supports it for indirect draws.
+    static func canMergeDraws(_ previous: UnsafePointer<RenderGraphCommand.DrawIndexedPrimitivesArgs>, _ next: UnsafePointer<RenderGraphCommand.DrawIndexedPrimitivesArgs>, supportsIndirectFirstInstance: Bool) -> Bool {
+        return previous.pointee.primitiveType == next.pointee.primitiveType &&
+            previous.pointee.indexType == next.pointee.indexType &&
+            previous.pointee.indexBuffer == next.pointee.indexBuffer &&
+            (supportsIndirectFirstInstance || (previous.pointee.baseInstance == 0 && next.pointee.baseInstance == 0)) &&
+            RenderCommandEncoder.indexStart(of: next) != nil
+    }
+
+    /// Merges runs of adjacent `drawIndexedPrimitives` commands that share a primitive type, index type and index buffer into single
+    /// `drawIndexedPrimitivesIndirect` commands, whose arguments are written to a transient indirect buffer.
+    /// Since no commands are recorded between the draws in a run, the draws are guaranteed to share all other state.
+    ///
+    /// Must be called once the pass has finished recording; the resource usages' command ranges are remapped to the new command indices.
+    func batchIndexedDraws() {
+        let commandRecorder = self.commandRecorder
+        let commandCount = commandRecorder.commands.count
+        let supportsIndirectFirstInstance = RenderBackend.supportsIndirectFirstInstance
+
+        var drawCount = 0
+        var runs = [Range<Int>]()
+        var runStart = 0
+        var previousDraw : UnsafePointer<RenderGraphCommand.DrawIndexedPrimitivesArgs>? = nil
+
+        for (i, command) in commandRecorder.commands.enumerated() {
+            switch command {
+            case .drawIndexedPrimitives(let args):
+                drawCount += 1
+                if let previous = previousDraw, RenderCommandEncoder.canMergeDraws(previous, args, supportsIndirectFirstInstance: supportsIndirectFirstInstance) {
+                    previousDraw = args
+                    continue
+                }
+                if previousDraw != nil, i - runStart > 1 {
+                    runs.append(runStart..<i)
+                }
+                runStart = i
+                previousDraw = RenderCommandEncoder.indexStart(of: args) != nil ? args : nil
+
+            case .drawPrimitives, .drawPrimitivesIndirect, .drawIndexedPrimitivesIndirect:
+                drawCount += 1
+                fallthrough
+            default:
+                if previousDraw != nil, i - runStart > 1 {
+                    runs.append(runStart..<i)
+                }
+                previousDraw = nil
+            }
+        }
+        if previousDraw != nil, commandCount - runStart > 1 {
+            runs.append(runStart..<commandCount)
+        }
+
+        let mergedDrawCount = runs.reduce(0, { $0 + $1.count })
+        self.passRecord.drawBatchingStatistics = DrawBatchingStatistics(passName: self.passRecord.name, drawCountBeforeBatching: drawCount, drawCountAfterBatching: drawCount - mergedDrawCount + runs.count)
+
+        guard !runs.isEmpty else { return }
+
+        let argumentStride = MemoryLayout<DrawIndexedPrimitivesIndirectArguments>.stride
+        let indirectBuffer = Buffer(length: mergedDrawCount * argumentStride, storageMode: .shared, cacheMode: .writeCombined, usage: .indirectBuffer)
+
+        // Rebuild the command stream. The payloads of the commands that are carried over still live in the recorder's data allocator,
+        // so only the commands themselves need to be copied.
+        var batchedCommands = PackedCommandStream<RenderGraphCommand>()
+        var newIndexForCommand = [Int](repeating: 0, count: commandCount + 1)
+        var indirectCommandIndices = [Int]()
+        indirectCommandIndices.reserveCapacity(runs.count)
+
+        indirectBuffer.withMutableContents { contents, _ in
+            let arguments = contents.bindMemory(to: DrawIndexedPrimitivesIndirectArguments.self)
+
+            var runIndex = 0
+            var argumentIndex = 0
+            for (i, command) in commandRecorder.commands.enumerated() {
+                guard runIndex < runs.count, runs[runIndex].contains(i) else {
+                    newIndexForCommand[i] = batchedCommands.count
+                    batchedCommands.append(command, allocator: .tagThreadView(commandRecorder.dataAllocator))
+                    continue
+                }
+
+                let run = runs[runIndex]
+                guard case .drawIndexedPrimitives(let args) = command else { preconditionFailure() }
+
+                if i == run.lowerBound {
+                    indirectCommandIndices.append(batchedCommands.count)
+                    batchedCommands.append(RenderGraphCommand.drawIndexedPrimitivesIndirect,
+                                           payload: (args.pointee.primitiveType, args.pointee.indexType, args.pointee.indexBuffer, 0, indirectBuffer, UInt32(argumentIndex * argumentStride), UInt32(run.count), UInt32(argumentStride), nil, 0),
+                                           allocator: .tagThreadView(commandRecorder.dataAllocator))
+                }
+                newIndexForCommand[i] = batchedCommands.count - 1
+
+                arguments[argumentIndex] = DrawIndexedPrimitivesIndirectArguments(indexCount: args.pointee.indexCount, instanceCount: args.pointee.instanceCount, indexStart: RenderCommandEncoder.indexStart(of: args)!,
+                                                                                   baseVertex: args.pointee.baseVertex, baseInstance: args.pointee.baseInstance)
+                argumentIndex += 1
+
+                if i + 1 == run.upperBound {
+                    runIndex += 1
+                }
+            }
+        }
+        newIndexForCommand[commandCount] = batchedCommands.count
+
+        let usages = commandRecorder.resourceUsages
+        for i in usages.indices {
+            let usage = usages[pointerTo: i]
+            let oldRange = usage.pointee.1.commandRange
+            let lowerBound = newIndexForCommand[min(oldRange.lowerBound, commandCount)]
+            let upperBound = oldRange.isEmpty ? lowerBound : newIndexForCommand[min(oldRange.upperBound - 1, commandCount)] + 1
+            usage.pointee.1.commandRange = lowerBound..<upperBound
+        }
+
+        // The indirect buffer is generated rather than declared by the pass, so its usages are added directly.
+        commandRecorder.readResources.insert(Resource(indirectBuffer))
+        var argumentIndex = 0
+        for (run, commandIndex) in zip(runs, indirectCommandIndices) {
+            let bufferRange = (argumentIndex * argumentStride)..<((argumentIndex + run.count) * argumentStride)
+            let usage = ResourceUsage(resource: Resource(indirectBuffer), type: .indirectBuffer, stages: .vertex, activeRange: .buffer(bufferRange), inArgumentBuffer: false, firstCommandOffset: commandIndex, renderPass: self.passRecord)
+            commandRecorder.resourceUsages.append((Resource(indirectBuffer), usage), allocator: .tagThreadView(commandRecorder.resourceUsageAllocator))
+            argumentIndex += run.count
+        }
+
+        commandRecorder.commands = batchedCommands
+    }
+}
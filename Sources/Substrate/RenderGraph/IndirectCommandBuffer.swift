@@ -0,0 +1,215 @@
+//
+//  IndirectCommandBuffer.swift
+//  Substrate
+//
+
+import SubstrateUtilities
+
+/// The arguments for a single draw within an indirect draw command.
+/// The layout matches both `MTLDrawPrimitivesIndirectArguments` and `VkDrawIndirectCommand`.
+public struct DrawPrimitivesIndirectArguments {
+    public var vertexCount : UInt32
+    public var instanceCount : UInt32
+    public var vertexStart : UInt32
+    public var baseInstance : UInt32
+
+    @inlinable
+    public init(vertexCount: UInt32, instanceCount: UInt32, vertexStart: UInt32, baseInstance: UInt32) {
+        self.vertexCount = vertexCount
+        self.instanceCount = instanceCount
+        self.vertexStart = vertexStart
+        self.baseInstance = baseInstance
+    }
+}
+
+/// The arguments for an indirect dispatch.
+/// The layout matches both `MTLDispatchThreadgroupsIndirectArguments` and `VkDispatchIndirectCommand`.
+public struct DispatchThreadgroupsIndirectArguments {
+    public var threadgroupsPerGrid : (UInt32, UInt32, UInt32)
+
+    @inlinable
+    public init(threadgroupsPerGrid: Size) {
+        self.threadgroupsPerGrid = (UInt32(threadgroupsPerGrid.width), UInt32(threadgroupsPerGrid.height), UInt32(threadgroupsPerGrid.depth))
+    }
+}
+
+public enum IndirectCommandType {
+    /// Each command is a `DrawPrimitivesIndirectArguments`.
+    case draw
+    /// Each command is a `DrawIndexedPrimitivesIndirectArguments`.
+    case drawIndexed
+    /// Each command is a `DispatchThreadgroupsIndirectArguments`.
+    case dispatch
+
+    @inlinable
+    public var argumentStride : Int {
+        switch self {
+        case .draw:
+            return MemoryLayout<DrawPrimitivesIndirectArguments>.stride
+        case .drawIndexed:
+            return MemoryLayout<DrawIndexedPrimitivesIndirectArguments>.stride
+        case .dispatch:
+            return MemoryLayout<DispatchThreadgroupsIndirectArguments>.stride
+        }
+    }
+}
+
+/// A buffer of GPU-generated commands of a single `IndirectCommandType`, typically written by a compute pass (e.g. for GPU culling)
+/// and consumed by later render or compute passes.
+///
+/// If the buffer has a count, a `UInt32` command count is stored at `countOffset` and the commands follow at `argumentsOffset`;
+/// draws read the number of commands to execute from the count, clamped to `maxCommandCount`. The count must be reset
+/// (e.g. through `BlitCommandEncoder.resetCount(of:)`) before the generating pass increments it.
+///
+/// Within the render graph, the commands are tracked as ordinary reads and writes of `buffer`. Shaders that generate commands
+/// bind `buffer` as with any other buffer, and consuming the commands adds an indirect-buffer usage so that the backends
+/// insert the appropriate barriers between the generating and consuming passes.
+public struct IndirectCommandBuffer {
+    public let buffer : Buffer
+    public let commandType : IndirectCommandType
+    public let maxCommandCount : Int
+    public let hasCount : Bool
+
+    /// Wraps an existing buffer, which must be at least `IndirectCommandBuffer.requiredLength(...)` bytes long.
+    public init(buffer: Buffer, commandType: IndirectCommandType, maxCommandCount: Int, hasCount: Bool) {
+        precondition(buffer.length >= IndirectCommandBuffer.requiredLength(commandType: commandType, maxCommandCount: maxCommandCount, hasCount: hasCount))
+        self.buffer = buffer
+        self.commandType = commandType
+        self.maxCommandCount = maxCommandCount
+        self.hasCount = hasCount
+    }
+
+    /// Creates a new buffer with space for `maxCommandCount` commands.
+    /// Dispatch commands can't be executed with a count, so `hasCount` defaults to `false` for `IndirectCommandType.dispatch`.
+    public init(commandType: IndirectCommandType, maxCommandCount: Int, hasCount: Bool? = nil, storageMode: StorageMode = .private, renderGraph: RenderGraph? = nil, flags: ResourceFlags = []) {
+        let hasCount = hasCount ?? (commandType != .dispatch)
+        precondition(!hasCount || commandType != .dispatch, "Indirect dispatches can't be executed with a count.")
+        let length = IndirectCommandBuffer.requiredLength(commandType: commandType, maxCommandCount: maxCommandCount, hasCount: hasCount)
+        let buffer = Buffer(length: length, storageMode: storageMode, usage: [.shaderRead, .shaderWrite, .indirectBuffer, .blitDestination], renderGraph: renderGraph, flags: flags)
+        self.init(buffer: buffer, commandType: commandType, maxCommandCount: maxCommandCount, hasCount: hasCount)
+    }
+
+    @inlinable
+    public static func requiredLength(commandType: IndirectCommandType, maxCommandCount: Int, hasCount: Bool) -> Int {
+        return (hasCount ? IndirectCommandBuffer.countHeaderLength : 0) + maxCommandCount * commandType.argumentStride
+    }
+
+    /// The space reserved for the count at the start of the buffer, which keeps the commands 16-byte aligned.
+    @inlinable
+    static var countHeaderLength : Int { 16 }
+
+    /// The offset of the `UInt32` command count within `buffer`.
+    @inlinable
+    public var countOffset : Int {
+        precondition(self.hasCount)
+        return 0
+    }
+
+    /// The offset of the first command within `buffer`.
+    @inlinable
+    public var argumentsOffset : Int {
+        return self.hasCount ? IndirectCommandBuffer.countHeaderLength : 0
+    }
+
+    @inlinable
+    public func argumentOffset(commandIndex: Int) -> Int {
+        precondition(commandIndex < self.maxCommandCount)
+        return self.argumentsOffset + commandIndex * self.commandType.argumentStride
+    }
+
+    /// The range of `buffer` that is read when executing the commands.
+    @inlinable
+    public var commandsRange : Range<Int> {
+        return 0..<(self.argumentsOffset + self.maxCommandCount * self.commandType.argumentStride)
+    }
+}
+
+extension RenderCommandEncoder {
+    /// Executes the draws in `indirectCommands`, which must contain `IndirectCommandType.draw` commands.
+    /// If `indirectCommands` has a count, only that many draws are executed on Vulkan devices that support `drawIndirectCount`.
+    ///
+    /// - Important: Metal can't read the count on the GPU, so the Metal backend ignores it and always executes all `maxCommandCount`
+    ///   draws, as do Vulkan devices without `drawIndirectCount`. The generating pass must write a zero `instanceCount` for every
+    ///   command it doesn't use.
+    public func drawPrimitives(type primitiveType: PrimitiveType, indirectCommands: IndirectCommandBuffer) {
+        precondition(indirectCommands.commandType == .draw)
+
+        guard self.currentPipelineReflection != nil else {
+            assert(self.renderPipelineDescriptor != nil, "No render or compute pipeline is set for pass \(renderPass.name).")
+            return
+        }
+
+        self.updateResourceUsages()
+        self.lastGPUCommandIndex = self.nextCommandOffset
+
+        self.gpuCommandsStartIndexColor = self.gpuCommandsStartIndexColor ?? self.nextCommandOffset
+        self.gpuCommandsStartIndexDepthStencil = self.gpuCommandsStartIndexDepthStencil ?? self.nextCommandOffset
+        self.commandRecorder.addResourceUsage(for: indirectCommands.buffer, bufferRange: indirectCommands.commandsRange, commandIndex: self.nextCommandOffset, encoder: self, usageType: .indirectBuffer, stages: .vertex, inArgumentBuffer: false)
+
+        let countBuffer = indirectCommands.hasCount ? indirectCommands.buffer : nil
+        let countBufferOffset = indirectCommands.hasCount ? UInt32(indirectCommands.countOffset) : 0
+        commandRecorder.record(RenderGraphCommand.drawPrimitivesIndirect, (primitiveType, indirectCommands.buffer, UInt32(indirectCommands.argumentsOffset), UInt32(indirectCommands.maxCommandCount), UInt32(indirectCommands.commandType.argumentStride), countBuffer, countBufferOffset))
+    }
+
+    /// Executes the indexed draws in `indirectCommands`, which must contain `IndirectCommandType.drawIndexed` commands.
+    /// If `indirectCommands` has a count, only that many draws are executed on Vulkan devices that support `drawIndirectCount`.
+    ///
+    /// - Important: Metal can't read the count on the GPU, so the Metal backend ignores it and always executes all `maxCommandCount`
+    ///   draws, as do Vulkan devices without `drawIndirectCount`. The generating pass must write a zero `instanceCount` for every
+    ///   command it doesn't use.
+    public func drawIndexedPrimitives(type primitiveType: PrimitiveType, indexType: IndexType, indexBuffer: Buffer, indexBufferOffset: Int = 0, indirectCommands: IndirectCommandBuffer) {
+        precondition(indirectCommands.commandType == .drawIndexed)
+
+        guard self.currentPipelineReflection != nil else {
+            assert(self.renderPipelineDescriptor != nil, "No render or compute pipeline is set for pass \(renderPass.name).")
+            return
+        }
+
+        self.updateResourceUsages()
+        self.lastGPUCommandIndex = self.nextCommandOffset
+
+        self.gpuCommandsStartIndexColor = self.gpuCommandsStartIndexColor ?? self.nextCommandOffset
+        self.gpuCommandsStartIndexDepthStencil = self.gpuCommandsStartIndexDepthStencil ?? self.nextCommandOffset
+        self.commandRecorder.addResourceUsage(for: indexBuffer, bufferRange: indexBufferOffset..<indexBuffer.length, commandIndex: self.nextCommandOffset, encoder: self, usageType: .indexBuffer, stages: .vertex, inArgumentBuffer: false)
+        self.commandRecorder.addResourceUsage(for: indirectCommands.buffer, bufferRange: indirectCommands.commandsRange, commandIndex: self.nextCommandOffset, encoder: self, usageType: .indirectBuffer, stages: .vertex, inArgumentBuffer: false)
+
+        let countBuffer = indirectCommands.hasCount ? indirectCommands.buffer : nil
+        let countBufferOffset = indirectCommands.hasCount ? UInt32(indirectCommands.countOffset) : 0
+        commandRecorder.record(RenderGraphCommand.drawIndexedPrimitivesIndirect, (primitiveType, indexType, indexBuffer, UInt32(indexBufferOffset), indirectCommands.buffer, UInt32(indirectCommands.argumentsOffset), UInt32(indirectCommands.maxCommandCount), UInt32(indirectCommands.commandType.argumentStride), countBuffer, countBufferOffset))
+    }
+}
+
+extension ComputeCommandEncoder {
+    /// Executes the dispatch at `commandIndex` in `indirectCommands`, which must contain `IndirectCommandType.dispatch` commands.
+    public func dispatchThreadgroups(indirectCommands: IndirectCommandBuffer, commandIndex: Int = 0, threadsPerThreadgroup: Size) {
+        precondition(indirectCommands.commandType == .dispatch)
+        self.dispatchThreadgroups(indirectBuffer: indirectCommands.buffer, indirectBufferOffset: indirectCommands.argumentOffset(commandIndex: commandIndex), threadsPerThreadgroup: threadsPerThreadgroup)
+    }
+}
+
+extension BlitCommandEncoder {
+    /// Zeroes the command count of `indirectCommands`, which must have a count.
+    public func resetCount(of indirectCommands: IndirectCommandBuffer) {
+        precondition(indirectCommands.hasCount)
+        self.fill(buffer: indirectCommands.buffer, range: indirectCommands.countOffset..<(indirectCommands.countOffset + MemoryLayout<UInt32>.stride), value: 0)
+    }
+}
+
+extension TypedRenderCommandEncoder {
+    public func drawPrimitives(type primitiveType: PrimitiveType, indirectCommands: IndirectCommandBuffer) {
+        self.updateEncoderState()
+        self.encoder.drawPrimitives(type: primitiveType, indirectCommands: indirectCommands)
+    }
+
+    public func drawIndexedPrimitives(type primitiveType: PrimitiveType, indexType: IndexType, indexBuffer: Buffer, indexBufferOffset: Int = 0, indirectCommands: IndirectCommandBuffer) {
+        self.updateEncoderState()
+        self.encoder.drawIndexedPrimitives(type: primitiveType, indexType: indexType, indexBuffer: indexBuffer, indexBufferOffset: indexBufferOffset, indirectCommands: indirectCommands)
+    }
+}
+
+extension TypedComputeCommandEncoder {
+    public func dispatchThreadgroups(indirectCommands: IndirectCommandBuffer, commandIndex: Int = 0, threadsPerThreadgroup: Size) {
+        self.updateEncoderState()
+        self.encoder.dispatchThreadgroups(indirectCommands: indirectCommands, commandIndex: commandIndex, threadsPerThreadgroup: threadsPerThreadgroup)
+    }
+}
@@ -32,7 +32,7 @@ public final class QueueRegistry {
     public let lastCompletionTimes : UnsafeMutablePointer<UInt64.AtomicRepresentation>
     
     var allocatedQueues : UInt8 = 0
-    var lock = SpinLock()
+    var lock = SpinLock(name: "QueueRegistry")
     
     public init() {
 #if !os(Windows)
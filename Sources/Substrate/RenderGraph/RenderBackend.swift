@@ -26,12 +26,19 @@ protocol PipelineReflection : AnyObject {
     func argumentBufferEncoder(at path: ResourceBindingPath, currentEncoder: UnsafeRawPointer?) -> UnsafeRawPointer?
     
     var threadExecutionWidth: Int { get }
+    
+    /// Whether `argumentReflection(at:)` reports the actual resource type bound at each path.
+    var hasArgumentTypeInformation: Bool { get }
 }
 
 extension PipelineReflection {
     public func bindingIsActive(at path: ResourceBindingPath) -> Bool {
         return self.argumentReflection(at: path)?.isActive ?? false
     }
+    
+    public var hasArgumentTypeInformation: Bool {
+        return true
+    }
 }
 
 public enum RenderAPI {
@@ -41,6 +48,8 @@ public enum RenderAPI {
 #if canImport(Vulkan)
     case vulkan
 #endif
+    /// A backend that performs all CPU-side RenderGraph work without a GPU, recording the backend commands it would have submitted.
+    case headless
 }
 
 
@@ -73,6 +82,8 @@ protocol _RenderBackendProtocol : RenderBackendProtocol {
     
     func updateLabel(on resource: Resource)
     var requiresEmulatedInputAttachments : Bool { get }
+    /// Whether indirect draws can use a non-zero `baseInstance`.
+    var supportsIndirectFirstInstance : Bool { get }
     
     func bufferContents(for buffer: Buffer, range: Range<Int>) -> UnsafeMutableRawPointer
     func buffer(_ buffer: Buffer, didModifyRange range: Range<Int>)
@@ -90,6 +101,10 @@ protocol _RenderBackendProtocol : RenderBackendProtocol {
     // Note: The pipeline reflection functions may return nil if reflection information could not be created for the pipeline.
     func renderPipelineReflection(descriptor: RenderPipelineDescriptor, renderTarget: RenderTargetDescriptor) -> PipelineReflection?
     func computePipelineReflection(descriptor: ComputePipelineDescriptor) -> PipelineReflection?
+    func prewarmPipelines(renderPipelines: [RenderPipelinePrewarmDescriptor], computePipelines: [ComputePipelineDescriptor], completion: (() -> Void)?)
+    func savePipelineCache()
+    var pipelineCompilationMode : PipelineCompilationMode { get set }
+    func notifyWhenPendingPipelinesCompiled(_ handler: @escaping () -> Void)
     
     func dispose(texture: Texture)
     func dispose(buffer: Buffer)
@@ -101,6 +116,25 @@ protocol _RenderBackendProtocol : RenderBackendProtocol {
     func argumentBufferPath(at index: Int, stages: RenderStages) -> ResourceBindingPath
 }
 
+extension _RenderBackendProtocol {
+    func prewarmPipelines(renderPipelines: [RenderPipelinePrewarmDescriptor], computePipelines: [ComputePipelineDescriptor], completion: (() -> Void)?) {
+        completion?()
+    }
+    
+    func savePipelineCache() {}
+    
+    var pipelineCompilationMode : PipelineCompilationMode {
+        get {
+            return .synchronous
+        }
+        set {}
+    }
+    
+    func notifyWhenPendingPipelinesCompiled(_ handler: @escaping () -> Void) {
+        handler()
+    }
+}
+
 public struct RenderBackend {
     @usableFromInline static var _backend : _RenderBackendProtocol! = nil
     
@@ -114,7 +148,9 @@ public struct RenderBackend {
         return _backend.api
     }
     
-    public static func initialise(api: RenderAPI, applicationName: String, device: Any? = nil, libraryPath: String? = nil, enableValidation: Bool = true, enableShaderHotReloading: Bool = true) {
+    /// - Parameter pipelineCachePath: where to persist compiled pipelines between launches on backends that support it.
+    ///   If `nil`, a file within the user's caches directory is used.
+    public static func initialise(api: RenderAPI, applicationName: String, device: Any? = nil, libraryPath: String? = nil, pipelineCachePath: String? = nil, enableValidation: Bool = true, enableShaderHotReloading: Bool = true) {
         switch api {
 #if canImport(Metal)
         case .metal:
@@ -123,8 +159,12 @@ public struct RenderBackend {
 #if canImport(Vulkan)
         case .vulkan:
             let instance = VulkanInstance(applicationName: applicationName, applicationVersion: VulkanVersion(major: 0, minor: 0, patch: 1), engineName: "Substrate", engineVersion: VulkanVersion(major: 3, minor: 0, patch: 1))!
-            _backend = VulkanBackend(instance: instance, shaderLibraryURL: URL(fileURLWithPath: libraryPath!))
+            let pipelineCacheURL = pipelineCachePath.map { URL(fileURLWithPath: $0) } ??
+                FileManager.default.urls(for: .cachesDirectory, in: .userDomainMask).first?.appendingPathComponent(applicationName).appendingPathComponent("VulkanPipelineCache.bin")
+            _backend = VulkanBackend(instance: instance, shaderLibraryURL: URL(fileURLWithPath: libraryPath!), pipelineCacheURL: pipelineCacheURL)
 #endif
+        case .headless:
+            _backend = HeadlessBackend()
         }
     }
     
@@ -185,6 +225,29 @@ public struct RenderBackend {
         return _backend.computePipelineReflection(descriptor: descriptor)
     }
     
+    /// Compiles the given pipelines on background threads so that their first use within a frame doesn't stall.
+    /// `completion` is called on an arbitrary thread once all of the pipelines have been compiled.
+    public static func prewarmPipelines(renderPipelines: [RenderPipelinePrewarmDescriptor], computePipelines: [ComputePipelineDescriptor] = [], completion: (() -> Void)? = nil) {
+        _backend.prewarmPipelines(renderPipelines: renderPipelines, computePipelines: computePipelines, completion: completion)
+    }
+    
+    /// Whether render pipelines are compiled on the encoding thread or in the background when they're first used.
+    /// Backends other than Vulkan always compile synchronously.
+    public static var pipelineCompilationMode : PipelineCompilationMode {
+        get {
+            return _backend.pipelineCompilationMode
+        }
+        set {
+            _backend.pipelineCompilationMode = newValue
+        }
+    }
+    
+    /// Writes any compiled pipelines to the pipeline cache on disk. Pipelines are also saved periodically,
+    /// but this should be called before the application exits.
+    public static func savePipelineCache() {
+        _backend.savePipelineCache()
+    }
+    
     @inlinable
     public static func dispose(texture: Texture) {
         return _backend.dispose(texture: texture)
@@ -235,6 +298,11 @@ public struct RenderBackend {
         return _backend.requiresEmulatedInputAttachments
     }
     
+    @inlinable
+    static var supportsIndirectFirstInstance : Bool {
+        return _backend.supportsIndirectFirstInstance
+    }
+    
     @inlinable
     public static func bufferContents(for buffer: Buffer, range: Range<Int>) -> UnsafeMutableRawPointer {
         return _backend.bufferContents(for: buffer, range: range)
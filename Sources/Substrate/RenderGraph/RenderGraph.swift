@@ -107,6 +107,12 @@ public protocol DrawRenderPass : RenderPass {
     /// The operation to perform on the stencil attachment at the start of the render pass.
     /// Ignored if there is no depth attachment specified in the `renderTargetDescriptor`.
     var stencilClearOperation: StencilClearOperation { get }
+    
+    /// Whether runs of consecutive `drawIndexedPrimitives` calls that differ only in their index range, instance range and base vertex
+    /// should be merged into indirect multi-draw commands once the pass has been recorded.
+    ///
+    /// - SeeAlso: `RenderGraph.lastFrameDrawBatchingStatistics`
+    var batchesIndexedDraws: Bool { get }
 }
 
 extension DrawRenderPass {
@@ -125,6 +131,11 @@ extension DrawRenderPass {
         return .keep
     }
     
+    @inlinable
+    public var batchesIndexedDraws: Bool {
+        return false
+    }
+    
     var renderTargetDescriptorForActiveAttachments: RenderTargetDescriptor {
         // Filter out any unused attachments.
         var descriptor = self.renderTargetDescriptor
@@ -163,6 +174,17 @@ public protocol ComputeRenderPass : RenderPass {
     ///
     /// - SeeAlso: `ComputeCommandEncoder`
     func execute(computeCommandEncoder: ComputeCommandEncoder)
+    
+    /// Whether the pass may execute on an asynchronous compute queue, overlapping with draw and blit work on the main queue.
+    /// Only honoured by backends that expose a separate compute queue; dependencies on other passes are synchronised across queues.
+    var allowsAsyncCompute: Bool { get }
+}
+
+extension ComputeRenderPass {
+    @inlinable
+    public var allowsAsyncCompute: Bool {
+        return false
+    }
 }
 
 /// A `CPURenderPass` is a pass that does not encode any GPU work but may access GPU resources.
@@ -461,7 +483,7 @@ final class RenderPassRecord {
     @usableFromInline let name: String
     @usableFromInline let type: RenderPassType
     @usableFromInline var pass : RenderPass!
-    @usableFromInline var commands : ChunkArray<RenderGraphCommand>! = nil
+    @usableFromInline var commands : PackedCommandStream<RenderGraphCommand>! = nil
     @usableFromInline var readResources : HashSet<Resource>! = nil
     @usableFromInline var writtenResources : HashSet<Resource>! = nil
     @usableFromInline var resourceUsages : ChunkArray<(Resource, ResourceUsage)>! = nil
@@ -470,6 +492,12 @@ final class RenderPassRecord {
     @usableFromInline /* internal(set) */ var isActive : Bool
     @usableFromInline /* internal(set) */ var usesWindowTexture : Bool = false
     @usableFromInline /* internal(set) */ var hasSideEffects : Bool = false
+    /// The number of redundant binding and state commands that were dropped while recording the pass.
+    @usableFromInline /* internal(set) */ var elidedCommandCount : Int = 0
+    /// The draw counts before and after merging indexed draws, if the pass batches its draws.
+    @usableFromInline /* internal(set) */ var drawBatchingStatistics : DrawBatchingStatistics? = nil
+    /// The offsets within the pass' commands of its draw commands, in order. Only computed for passes with emulated input attachments.
+    @usableFromInline /* internal(set) */ var drawCommandOffsets : [Int]? = nil
     
     init(pass: RenderPass, passIndex: Int) {
         self.name = pass.name
@@ -499,7 +527,11 @@ protocol _RenderGraphContext : AnyObject {
     var accessSemaphore : DispatchSemaphore? { get }
     var renderGraphQueue: Queue { get }
     func beginFrameResourceAccess() // Access is ended when a renderGraph is submitted.
-    func executeRenderGraph(passes: [RenderPassRecord], usedResources: Set<Resource>, dependencyTable: DependencyTable<DependencyType>, completion: @escaping (_ gpuTime: Double) -> Void)
+    /// Returns the number of draws in the frame that were deferred because their render pipeline was being compiled.
+    func executeRenderGraph(passes: [RenderPassRecord], usedResources: Set<Resource>, dependencyTable: DependencyTable<DependencyType>, profile: RenderGraphFrameProfile?, completion: @escaping (_ gpuTime: Double) -> Void) -> Int
+    /// Performs the parts of `executeRenderGraph` that depend on the RenderGraph's frontend state, and returns a closure
+    /// that encodes and submits the frame and returns its deferred draw count. The closure must be called on `queue` before the next frame is prepared.
+    func prepareRenderGraph(passes: [RenderPassRecord], usedResources: Set<Resource>, dependencyTable: DependencyTable<DependencyType>, profile: RenderGraphFrameProfile?, completion: @escaping (_ gpuTime: Double) -> Void) -> () -> Int
 }
 
 @usableFromInline enum RenderGraphTagType : UInt64 {
@@ -526,11 +558,62 @@ protocol _RenderGraphContext : AnyObject {
         let tag = (RenderGraphTagType.renderGraphTag << 32) | (self.rawValue << 16)
         return tag
     }
+    
+    /// The tag for allocations that last until the execution in `executionSlot` has been submitted.
+    public func tag(executionSlot: Int) -> TaggedHeap.Tag {
+        assert(self == .renderGraphExecution || self == .resourceUsageNodes)
+        return self.tag | TaggedHeap.Tag(executionSlot)
+    }
+}
+
+public enum RenderGraphExecutionMode {
+    /// `RenderGraph.execute()` returns once the frame has been encoded and submitted to the GPU.
+    case synchronous
+    /// `RenderGraph.execute()` returns once the frame's passes have been executed and its resource commands generated;
+    /// the backend encodes and submits the frame on the RenderGraph's context queue while the application records the next frame.
+    /// Transient resources for consecutive frames are allocated from two alternating transient registries.
+    case pipelined
+}
+
+/// An execution of a pipelined RenderGraph that may not yet have been submitted.
+final class RenderGraphPendingExecution {
+    let submissionGroup = DispatchGroup()
+    private(set) var executionIndex : UInt64 = 0
+    
+    init() {
+        self.submissionGroup.enter()
+    }
+    
+    func markSubmitted(executionIndex: UInt64) {
+        self.executionIndex = executionIndex
+        self.submissionGroup.leave()
+    }
 }
 
 public struct RenderGraphExecutionWaitToken {
     public let queue: Queue
-    public let executionIndex: UInt64
+    private let submittedExecutionIndex: UInt64
+    private let pendingExecution: RenderGraphPendingExecution?
+    
+    init(queue: Queue, executionIndex: UInt64) {
+        self.queue = queue
+        self.submittedExecutionIndex = executionIndex
+        self.pendingExecution = nil
+    }
+    
+    init(queue: Queue, pendingExecution: RenderGraphPendingExecution) {
+        self.queue = queue
+        self.submittedExecutionIndex = 0
+        self.pendingExecution = pendingExecution
+    }
+    
+    /// The command index on `queue` that must complete for the execution to be complete.
+    /// For executions of pipelined RenderGraphs, this waits until the execution has been submitted.
+    public var executionIndex: UInt64 {
+        guard let pendingExecution = self.pendingExecution else { return self.submittedExecutionIndex }
+        pendingExecution.submissionGroup.wait()
+        return pendingExecution.executionIndex
+    }
     
     public func wait() {
         self.queue.waitForCommandCompletion(self.executionIndex)
@@ -542,9 +625,24 @@ public final class RenderGraph {
     
     public static var jobManager : RenderGraphJobManager = DefaultRenderGraphJobManager()
     
+    /// Whether backends that support it may translate the command encoders within a command buffer into backend commands
+    /// concurrently on the `jobManager`. Currently only used by the Vulkan backend.
+    public static var encodesCommandsConcurrently : Bool = true
+    
+    /// Held while an execution is compiled and its resource commands are generated. Pipelined executions release it
+    /// once they've been handed off for encoding, so that other RenderGraphs can compile while they're submitted.
     static let activeRenderGraphSemaphore = DispatchSemaphore(value: 1)
     public private(set) static var activeRenderGraph : RenderGraph? = nil
     
+    /// Allocations that last until an execution has been submitted are made from one of two sets of tags,
+    /// so that one execution can be compiled while the previous one is still being encoded.
+    static let executionSlotCount = 2
+    private static let executionSlotSemaphore = DispatchSemaphore(value: RenderGraph.executionSlotCount)
+    private static let executionSlotLock = SpinLock()
+    private static var executionSlotsInUse = [Bool](repeating: false, count: RenderGraph.executionSlotCount)
+    /// The execution slot of the execution that's currently being compiled.
+    static private(set) var activeExecutionSlot = 0
+    
     /// executionAllocator is used for allocations that last one execution of the RenderGraph.
     static var executionAllocator : TagAllocator! = nil
     
@@ -556,16 +654,99 @@ public final class RenderGraph {
     private var renderPasses : [RenderPassRecord] = []
     private var usedResources : Set<Resource> = []
     
+    let topologyCache = RenderGraphTopologyCache()
+    
+    /// Whether to reuse the culled and ordered pass topology between structurally identical frames.
+    /// Frames are structurally identical if they have the same sequence of pass types, their passes use resources
+    /// created in the same order with the same flags, and their draw passes have matching render target attachments.
+    /// On a cache hit, only pass command recording is performed.
+    public var cachesTopology : Bool = false {
+        didSet {
+            if !self.cachesTopology {
+                self.topologyCache.removeAll()
+            }
+        }
+    }
+    
+    /// The strategy used to order the passes that remain after culling.
+    public var passSchedulingMode : RenderGraphPassSchedulingMode = .dependencyOrder {
+        didSet {
+            self.topologyCache.removeAll()
+        }
+    }
+    
+    /// Whether to record a description of the pass order and its estimated encoder and dependency costs in `lastPassScheduleDescription`
+    /// whenever the pass order is computed. Frames that hit the topology cache don't update the description.
+    public var recordsPassSchedule : Bool = false
+    public private(set) var lastPassScheduleDescription : String? = nil
+    
     public static private(set) var globalSubmissionIndex : UInt64 = 0
     private var previousFrameCompletionTime : UInt64 = 0
     public private(set) var lastGraphCPUTime = 1000.0 / 60.0
     public private(set) var lastGraphGPUTime = 1000.0 / 60.0
     
+    /// The number of draws in the last execution that were skipped or drawn with a fallback pipeline because their render pipeline
+    /// was still being compiled. Always zero unless `RenderBackend.pipelineCompilationMode` is `.asynchronous`.
+    /// For a pipelined RenderGraph, this is updated on the context queue once the execution has been submitted.
+    public var lastFrameDeferredDrawCount : Int {
+        return self.deferredDrawCountLock.withLock { self._lastFrameDeferredDrawCount }
+    }
+    
+    private let deferredDrawCountLock = SpinLock()
+    private var _lastFrameDeferredDrawCount = 0
+    
+    /// For each active pass in the last execution, the number of binding and state commands its encoder dropped because they
+    /// were identical to the state that was already bound.
+    public private(set) var lastFrameElidedCommandCounts : [(passName: String, elidedCommandCount: Int)] = []
+    
+    /// The number of draw calls before and after merging for each active pass in the last execution that batches its indexed draws.
+    ///
+    /// - SeeAlso: `DrawRenderPass.batchesIndexedDraws`
+    public private(set) var lastFrameDrawBatchingStatistics : [DrawBatchingStatistics] = []
+    
+    /// The number of recent executions to keep a `RenderGraphFrameProfile` for in `frameProfiles`.
+    /// Profiling is disabled when this is zero.
+    public var profiledFrameCount : Int = 0 {
+        didSet {
+            self.frameProfileLock.withLock {
+                self._frameProfiles.removeFirst(max(self._frameProfiles.count - self.profiledFrameCount, 0))
+            }
+        }
+    }
+    
+    private let frameProfileLock = SpinLock()
+    private var _frameProfiles = [RenderGraphFrameProfile]()
+    /// The profile for the execution that's currently being compiled.
+    private var currentFrameProfile : RenderGraphFrameProfile? = nil
+    
+    /// The profiles for up to `profiledFrameCount` of the most recent executions, oldest first.
+    /// A profile is added when its execution begins, and is complete once the execution has completed on the GPU.
+    public var frameProfiles : [RenderGraphFrameProfile] {
+        return self.frameProfileLock.withLock { self._frameProfiles }
+    }
+    
+    /// Returns the profiles in `frameProfiles` as Chrome trace event JSON, which can be viewed in `chrome://tracing` or Perfetto.
+    public func frameProfilesChromeTraceJSON() -> String {
+        return RenderGraphTraceExporter.chromeTraceJSON(profiles: self.frameProfiles)
+    }
+    
+    /// Called on an arbitrary thread once the pipelines that caused draws to be deferred in an execution have finished compiling,
+    /// so that the frame can be redrawn if needed.
+    public var onDeferredPipelinesCompiled : (() -> Void)? = nil
+    
     var submissionNotifyQueue = [() -> Void]()
     var completionNotifyQueue = [() -> Void]()
     let context : _RenderGraphContext
     
-    public let transientRegistryIndex : Int
+    public let executionMode : RenderGraphExecutionMode
+    
+    /// The transient registries owned by this RenderGraph; pipelined RenderGraphs alternate between two registries.
+    private let transientRegistryIndices : [Int]
+    /// The transient registry for the frame currently being recorded.
+    public private(set) var transientRegistryIndex : Int
+    
+    /// The most recent execution, if the RenderGraph is pipelined.
+    private var pendingExecution : RenderGraphPendingExecution? = nil
     
     /// Creates a new RenderGraph instance. There may only be up to eight RenderGraph's at any given time.
     ///
@@ -579,12 +760,22 @@ public final class RenderGraph {
     /// - Parameter transientBufferCapacity: The maximum number of transient `Buffer`s that can be used in a single `RenderGraph` submission.
     ///
     /// - Parameter transientArgumentBufferArrayCapacity: The maximum number of transient `ArgumentBufferArray`s that can be used in a single `RenderGraph` submission.
-    public init(inflightFrameCount: Int, transientBufferCapacity: Int = 16384, transientTextureCapacity: Int = 16384, transientArgumentBufferArrayCapacity: Int = 1024) {
-        self.transientRegistryIndex = TransientRegistryManager.allocate()
+    ///
+    /// - Parameter executionMode: Whether `execute()` waits for the frame to be encoded and submitted, or returns early so that
+    /// the next frame can be recorded while the backend encodes the current one. Pipelined RenderGraphs use two transient registries.
+    public init(inflightFrameCount: Int, transientBufferCapacity: Int = 16384, transientTextureCapacity: Int = 16384, transientArgumentBufferArrayCapacity: Int = 1024, executionMode: RenderGraphExecutionMode = .synchronous) {
+        self.executionMode = executionMode
+        self.transientRegistryIndices = (0..<(executionMode == .pipelined ? 2 : 1)).map { _ in TransientRegistryManager.allocate() }
+        self.transientRegistryIndex = self.transientRegistryIndices[0]
         
-        TransientBufferRegistry.instances[self.transientRegistryIndex].initialise(capacity: transientBufferCapacity)
-        TransientTextureRegistry.instances[self.transientRegistryIndex].initialise(capacity: transientTextureCapacity)
-        TransientArgumentBufferArrayRegistry.instances[self.transientRegistryIndex].initialise(capacity: transientArgumentBufferArrayCapacity)
+        for registryIndex in self.transientRegistryIndices {
+            TransientBufferRegistry.instances[registryIndex].initialise(capacity: transientBufferCapacity)
+            TransientTextureRegistry.instances[registryIndex].initialise(capacity: transientTextureCapacity)
+            TransientArgumentBufferArrayRegistry.instances[registryIndex].initialise(capacity: transientArgumentBufferArrayCapacity)
+        }
+        if executionMode == .pipelined {
+            TransientRegistryManager.setAlternateRegistry(self.transientRegistryIndices[1], for: self.transientRegistryIndices[0])
+        }
         
         switch RenderBackend._backend.api {
 #if canImport(Metal)
@@ -595,11 +786,17 @@ public final class RenderGraph {
         case .vulkan:
             self.context = RenderGraphContextImpl<VulkanBackend>(backend: RenderBackend._backend as! VulkanBackend, inflightFrameCount: inflightFrameCount, transientRegistryIndex: transientRegistryIndex)
 #endif
+        case .headless:
+            self.context = RenderGraphContextImpl<HeadlessBackend>(backend: RenderBackend._backend as! HeadlessBackend, inflightFrameCount: inflightFrameCount, transientRegistryIndex: transientRegistryIndex)
         }
     }
     
     deinit {
-        TransientRegistryManager.free(self.transientRegistryIndex)
+        for registryIndex in self.transientRegistryIndices {
+            TransientRegistryManager.free(registryIndex)
+        }
+        self.frameProfileLock.deinit()
+        self.deferredDrawCountLock.deinit()
     }
     
     /// The logical command queue corresponding to this render graph.
@@ -915,6 +1112,7 @@ public final class RenderGraph {
         let unmanagedReferences = RenderGraph.threadUnmanagedReferences[threadIndex]
         
         let renderPassScratchTag = RenderGraphTagType.renderPassExecutionTag(passIndex: passRecord.passIndex)
+        let recordingStartTime = self.currentFrameProfile != nil ? RenderGraphFrameProfile.currentTime : 0
         
         let commandRecorder = RenderGraphCommandRecorder(renderGraphTransientRegistryIndex: self.transientRegistryIndex,
                                                         renderGraphQueue: self.queue,
@@ -958,6 +1156,13 @@ public final class RenderGraph {
         passRecord.readResources = commandRecorder.readResources
         passRecord.writtenResources = commandRecorder.writtenResources
         passRecord.resourceUsages = commandRecorder.resourceUsages
+        passRecord.elidedCommandCount = commandRecorder.elidedCommandCount
+        
+        // Emulated input attachments need a barrier between every draw; find the draws once here rather than walking the command stream for each usage.
+        if passRecord.type == .draw, RenderBackend.requiresEmulatedInputAttachments,
+           commandRecorder.resourceUsages.contains(where: { $0.1.type == .inputAttachmentRenderTarget }) {
+            passRecord.drawCommandOffsets = commandRecorder.commands.enumerated().compactMap { $0.element.isDrawCommand ? $0.offset : nil }
+        }
         
         // Remove our reference to the render pass once we've executed it so it can
         // release any references to member variables.
@@ -968,6 +1173,8 @@ public final class RenderGraph {
         }
         
         TaggedHeap.free(tag: renderPassScratchTag)
+        
+        self.currentFrameProfile?.addCPUInterval(name: passRecord.name, kind: .passRecording, lane: threadIndex, startTime: recordingStartTime, endTime: RenderGraphFrameProfile.currentTime)
     }
     
     func fillUsedResourcesFromPass(passRecord: RenderPassRecord, threadIndex: Int) {
@@ -998,33 +1205,50 @@ public final class RenderGraph {
             }
         }
         
-        for passRecord in renderPasses where passRecord.type != .cpu {
-            jobManager.dispatchPassJob { [unowned(unsafe) jobManager] in
-                let threadIndex = jobManager.threadIndex
-                
-                if passRecord.pass.writtenResources.isEmpty {
-                    self.executePass(passRecord, threadIndex: threadIndex)
-                } else {
-                    let threadIndex = jobManager.threadIndex
-                    self.fillUsedResourcesFromPass(passRecord: passRecord, threadIndex: threadIndex)
-                }
+        let gpuPasses = renderPasses.filter { $0.type != .cpu }
+        jobManager.dispatchPassJobs(count: gpuPasses.count) { [unowned(unsafe) jobManager] i in
+            let passRecord = gpuPasses[i]
+            let threadIndex = jobManager.threadIndex
+            
+            if passRecord.pass.writtenResources.isEmpty {
+                self.executePass(passRecord, threadIndex: threadIndex)
+            } else {
+                self.fillUsedResourcesFromPass(passRecord: passRecord, threadIndex: threadIndex)
             }
         }
         
         jobManager.waitForAllPassJobs()
     }
     
-    func markActive(passIndex i: Int, dependencyTable: DependencyTable<DependencyType>, renderPasses: [RenderPassRecord]) {
+    /// Executes any active passes that were deferred until after culling.
+    /// As in `evaluateResourceUsages`, CPU passes are executed serially on the calling thread
+    /// and all other passes are recorded concurrently across the job manager's threads.
+    func executeDeferredPasses(_ activePasses: [RenderPassRecord]) {
+        let jobManager = RenderGraph.jobManager
+        
+        for passRecord in activePasses where passRecord.type == .cpu && passRecord.commandRange == nil {
+            self.executePass(passRecord, threadIndex: jobManager.threadIndex)
+        }
+        
+        let deferredPasses = activePasses.filter { $0.type != .cpu && $0.commandRange == nil }
+        jobManager.dispatchPassJobs(count: deferredPasses.count) { [unowned(unsafe) jobManager] i in
+            self.executePass(deferredPasses[i], threadIndex: jobManager.threadIndex)
+        }
+        
+        jobManager.waitForAllPassJobs()
+    }
+    
+    func markActive(passIndex i: Int, dependencyTable: SparseDependencyTable<DependencyType>, renderPasses: [RenderPassRecord]) {
         if !renderPasses[i].isActive {
             renderPasses[i].isActive = true
             
-            for j in (0..<i).reversed() where dependencyTable.dependency(from: i, on: j) == .execution {
+            for (j, dependency) in dependencyTable.dependencies(of: i) where dependency == .execution {
                 markActive(passIndex: j, dependencyTable: dependencyTable, renderPasses: renderPasses)
             }
         }
     }
     
-    func computeDependencyOrdering(passIndex i: Int, dependencyTable: DependencyTable<DependencyType>, renderPasses: [RenderPassRecord], addedToList: inout [Bool], activePasses: inout [RenderPassRecord]) {
+    func computeDependencyOrdering(passIndex i: Int, dependencyTable: SparseDependencyTable<DependencyType>, renderPasses: [RenderPassRecord], addedToList: inout [Bool], activePasses: inout [RenderPassRecord]) {
         
         // Ideally, we should reorder the passes into an optimal order according to some heuristics.
         // For example:
@@ -1039,7 +1263,7 @@ public final class RenderGraph {
             
             if let targetPass = renderPasses[i].pass as? DrawRenderPass {
                 // First process all passes that can't share the same render target...
-                for j in (0..<i).reversed() where dependencyTable.dependency(from: i, on: j) != .none {
+                for (j, _) in dependencyTable.dependencies(of: i) {
                     if let otherPass = renderPasses[j].pass as? DrawRenderPass, RenderTargetDescriptor.descriptorsAreMergeable(passA: otherPass, passB: targetPass) {
                     } else {
                         computeDependencyOrdering(passIndex: j, dependencyTable: dependencyTable, renderPasses: renderPasses, addedToList: &addedToList, activePasses: &activePasses)
@@ -1047,14 +1271,14 @@ public final class RenderGraph {
                 }
                 
                 // ... and then process those which can.
-                for j in (0..<i).reversed() where dependencyTable.dependency(from: i, on: j) != .none {
+                for (j, _) in dependencyTable.dependencies(of: i) {
                     if let otherPass = renderPasses[j].pass as? DrawRenderPass, RenderTargetDescriptor.descriptorsAreMergeable(passA: otherPass, passB: targetPass) {
                         computeDependencyOrdering(passIndex: j, dependencyTable: dependencyTable, renderPasses: renderPasses, addedToList: &addedToList, activePasses: &activePasses)
                     }
                 }
                 
             } else {
-                for j in (0..<i).reversed() where dependencyTable.dependency(from: i, on: j) != .none {
+                for (j, _) in dependencyTable.dependencies(of: i) {
                     computeDependencyOrdering(passIndex: j, dependencyTable: dependencyTable, renderPasses: renderPasses, addedToList: &addedToList, activePasses: &activePasses)
                 }
             }
@@ -1063,14 +1287,35 @@ public final class RenderGraph {
         }
     }
     
-    func compile(renderPasses: [RenderPassRecord]) -> ([RenderPassRecord], DependencyTable<DependencyType>) {
+    /// Builds the pass dependency table, marks passes that contribute to the frame's side effects as active, and orders the active passes.
+    func computeTopology(renderPasses: [RenderPassRecord]) -> RenderGraphTopology {
+        // Dependencies are stored sparsely, with each pass's dependencies in descending pass order.
+        // For each resource we only track its last writer and the passes that have read it since that write, so each usage adds
+        // a constant number of edges on average and the table is built in time linear in the number of usages:
+        // - a read depends on the last writer (read-after-write).
+        // - a write depends on the last writer (write-after-write) and on every reader since that write (write-after-read).
+        // Earlier writers are reached transitively through the chain of write-after-write edges. Those edges are execution
+        // dependencies since a write may only partially overwrite the resource, so any pass that keeps the later writer alive
+        // must also keep the earlier writers alive.
+        let compilationAllocator = AllocatorType.threadLocalTag(ThreadLocalTagAllocator(tag: RenderGraphTagType.renderGraphCompilation.tag))
+        var resourceStateIndices = HashMap<Resource, Int>(allocator: compilationAllocator)
+        var resourceStates = [(lastWriter: Int, firstReaderNode: Int)]()
+        var readerNodes = [(passIndex: Int, next: Int)]()
         
-        renderPasses.enumerated().forEach { $1.passIndex = $0 } // We may have inserted early blit passes, so we need to set the pass indices now.
+        var dependencyTable = SparseDependencyTable<DependencyType>(reservingCapacity: renderPasses.count)
+        var passHasSideEffects = [Bool](repeating: false, count: renderPasses.count)
         
-        self.evaluateResourceUsages(renderPasses: renderPasses)
+        var rowDependencies = [DependencyType](repeating: .none, count: renderPasses.count)
+        var rowDependencyIndices = [Int]()
         
-        var dependencyTable = DependencyTable<DependencyType>(capacity: renderPasses.count, defaultValue: .none)
-        var passHasSideEffects = [Bool](repeating: false, count: renderPasses.count)
+        func addDependency(on j: Int, _ dependency: DependencyType) {
+            if rowDependencies[j] == .none {
+                rowDependencyIndices.append(j)
+            }
+            if dependency == .execution || rowDependencies[j] == .none {
+                rowDependencies[j] = dependency
+            }
+        }
         
         for (i, pass) in renderPasses.enumerated() {
             for resource in pass.writtenResources {
@@ -1085,25 +1330,66 @@ public final class RenderGraph {
                     pass.usesWindowTexture = true
                 }
                 
-                for (j, otherPass) in renderPasses.enumerated().dropFirst(i + 1) {
-                    if otherPass.readResources.contains(resource) {
-                        dependencyTable.setDependency(from: j, on: i, to: .execution)
-                    }
-                    if otherPass.writtenResources.contains(resource), dependencyTable.dependency(from: j, on: i) != .execution {
-                        dependencyTable.setDependency(from: j, on: i, to: .ordering) // since the relative ordering of writes matters
-                    }
+                guard let stateIndex = resourceStateIndices[resource] else { continue }
+                let state = resourceStates[stateIndex]
+                if state.lastWriter >= 0 {
+                    addDependency(on: state.lastWriter, .execution)
+                }
+                var node = state.firstReaderNode
+                while node >= 0 {
+                    addDependency(on: readerNodes[node].passIndex, .ordering) // since the write mustn't be moved before the read
+                    node = readerNodes[node].next
                 }
             }
             
             for resource in pass.readResources {
                 assert(resource._usesPersistentRegistry || resource.transientRegistryIndex == self.transientRegistryIndex, "Transient resource \(resource) associated with another RenderGraph is being used in this RenderGraph.")
                 assert(resource.isValid, "Resource \(resource) is invalid but is used in the current frame.")
+                
+                if let stateIndex = resourceStateIndices[resource], resourceStates[stateIndex].lastWriter >= 0 {
+                    addDependency(on: resourceStates[stateIndex].lastWriter, .execution)
+                }
             }
             
+            // Record this pass's usages only after building its row so that it doesn't depend on itself.
+            for resource in pass.readResources {
+                let stateIndex: Int
+                if let index = resourceStateIndices[resource] {
+                    stateIndex = index
+                    let firstReaderNode = resourceStates[index].firstReaderNode
+                    if firstReaderNode >= 0, readerNodes[firstReaderNode].passIndex == i {
+                        continue // The pass lists this resource more than once.
+                    }
+                } else {
+                    stateIndex = resourceStates.count
+                    resourceStateIndices.insertOrAssign(key: resource, value: stateIndex)
+                    resourceStates.append((lastWriter: -1, firstReaderNode: -1))
+                }
+                readerNodes.append((passIndex: i, next: resourceStates[stateIndex].firstReaderNode))
+                resourceStates[stateIndex].firstReaderNode = readerNodes.count - 1
+            }
+            
+            for resource in pass.writtenResources {
+                if let stateIndex = resourceStateIndices[resource] {
+                    resourceStates[stateIndex] = (lastWriter: i, firstReaderNode: -1)
+                } else {
+                    resourceStateIndices.insertOrAssign(key: resource, value: resourceStates.count)
+                    resourceStates.append((lastWriter: i, firstReaderNode: -1))
+                }
+            }
+            
+            rowDependencyIndices.sort(by: >)
+            dependencyTable.appendRow(dependencies: rowDependencyIndices.lazy.map { (index: $0, value: rowDependencies[$0]) })
+            for j in rowDependencyIndices {
+                rowDependencies[j] = .none
+            }
+            rowDependencyIndices.removeAll(keepingCapacity: true)
+            
             if pass.type == .external {
                 passHasSideEffects[i] = true
             }
         }
+        resourceStateIndices.deinit()
         
         for i in (0..<renderPasses.count).reversed() where passHasSideEffects[i] {
             self.markActive(passIndex: i, dependencyTable: dependencyTable, renderPasses: renderPasses)
@@ -1115,36 +1401,85 @@ public final class RenderGraph {
             self.computeDependencyOrdering(passIndex: i, dependencyTable: dependencyTable, renderPasses: renderPasses, addedToList: &addedToList, activePasses: &activePasses)
         }
         
-        var i = 0
-        while i < activePasses.count {
-            let passRecord = activePasses[i]
-            if passRecord.commandRange == nil {
-                self.executePass(passRecord, threadIndex: 0)
+        if self.passSchedulingMode == .costModel || self.recordsPassSchedule {
+            let scheduler = RenderGraphPassScheduler(passes: activePasses, dependencyTable: dependencyTable, totalPassCount: renderPasses.count)
+            
+            let (order, costs) : ([Int], [RenderGraphPassScheduler.Cost])
+            if self.passSchedulingMode == .costModel {
+                (order, costs) = scheduler.schedule()
+                activePasses = order.map { scheduler.passes[$0] }
+            } else {
+                order = Array(activePasses.indices)
+                costs = scheduler.costs(of: order)
             }
-            if passRecord.type == .cpu || passRecord.commandRange!.count == 0 {
-                passRecord.isActive = false // We've definitely executed the pass now, so there's no more work to be done on it by the GPU backends.
-                activePasses.remove(at: i)
+            
+            if self.recordsPassSchedule {
+                self.lastPassScheduleDescription = scheduler.debugDescription(order: order, costs: costs)
+            }
+        }
+        
+        return RenderGraphTopology(dependencyTable: dependencyTable, orderedActivePassIndices: activePasses.map { $0.passIndex })
+    }
+    
+    func compile(renderPasses: [RenderPassRecord]) -> ([RenderPassRecord], DependencyTable<DependencyType>) {
+        
+        renderPasses.enumerated().forEach { $1.passIndex = $0 } // We may have inserted early blit passes, so we need to set the pass indices now.
+        
+        self.evaluateResourceUsages(renderPasses: renderPasses)
+        
+        let topology : RenderGraphTopology
+        if self.cachesTopology {
+            let topologyKey = RenderGraphTopologyCache.key(for: renderPasses)
+            if let cachedTopology = self.topologyCache.topology(for: topologyKey) {
+                topology = cachedTopology
+                
+                for pass in renderPasses where pass.writtenResources.contains(where: { $0.flags.contains(.windowHandle) }) {
+                    pass.usesWindowTexture = true
+                }
+                for i in topology.orderedActivePassIndices {
+                    renderPasses[i].isActive = true
+                }
             } else {
-                i += 1
+                topology = self.computeTopology(renderPasses: renderPasses)
+                self.topologyCache.setTopology(topology, for: topologyKey)
             }
+        } else {
+            topology = self.computeTopology(renderPasses: renderPasses)
         }
         
+        let dependencyTable = topology.dependencyTable
+        var activePasses = topology.orderedActivePassIndices.map { renderPasses[$0] }
+        
+        self.executeDeferredPasses(activePasses)
+        
+        activePasses.removeAll(where: { passRecord in
+            if passRecord.type == .cpu || passRecord.commandRange!.count == 0 {
+                passRecord.isActive = false // We've definitely executed the pass now, so there's no more work to be done on it by the GPU backends.
+                return true
+            }
+            return false
+        })
+        
         var activePassDependencies = DependencyTable<DependencyType>(capacity: activePasses.count, defaultValue: .none)
         
-        for pass in (0..<activePasses.count).reversed() {
-            let passIndexOriginal = activePasses[pass].passIndex
-            
-            for possibleDependency in (0..<pass).reversed() {
-                let possibleDependencyIndexOriginal = activePasses[possibleDependency].passIndex
-                guard possibleDependencyIndexOriginal < passIndexOriginal else { continue }
-                
-                let dependency = dependencyTable.dependency(from: passIndexOriginal, on: possibleDependencyIndexOriginal)
+        var activeIndexForPass = [Int](repeating: -1, count: renderPasses.count)
+        for (activeIndex, passRecord) in activePasses.enumerated() {
+            activeIndexForPass[passRecord.passIndex] = activeIndex
+        }
+        
+        for pass in 0..<activePasses.count {
+            for (dependencyIndexOriginal, dependency) in dependencyTable.dependencies(of: activePasses[pass].passIndex) {
+                let possibleDependency = activeIndexForPass[dependencyIndexOriginal]
+                guard possibleDependency >= 0, possibleDependency < pass else { continue }
                 activePassDependencies.setDependency(from: pass, on: possibleDependency, to: dependency)
             }
         }
         
         let allocator = TagAllocator.ThreadView(allocator: RenderGraph.resourceUsagesAllocator, threadIndex: 0)
         
+        self.lastFrameElidedCommandCounts = activePasses.map { (passName: $0.name, elidedCommandCount: $0.elidedCommandCount) }
+        self.lastFrameDrawBatchingStatistics = activePasses.compactMap { $0.drawBatchingStatistics }
+        
         // Index the commands for each pass in a sequential manner for the entire frame.
         var commandCount = 0
         for (i, passRecord) in activePasses.enumerated() {
@@ -1172,6 +1507,11 @@ public final class RenderGraph {
             passRecord.resourceUsages = nil
         }
         
+        self.currentFrameProfile?.updateCounters {
+            $0.activePassCount = activePasses.count
+            $0.commandCount = commandCount
+        }
+        
         // Compilation is finished, so reset that tag.
         TaggedHeap.free(tag: RenderGraphTagType.renderGraphCompilation.tag)
         
@@ -1219,29 +1559,66 @@ public final class RenderGraph {
             self.completionNotifyQueue.forEach { $0() }
             self.completionNotifyQueue.removeAll(keepingCapacity: true)
             
+            if let pendingExecution = self.pendingExecution {
+                return RenderGraphExecutionWaitToken(queue: self.queue, pendingExecution: pendingExecution)
+            }
             return RenderGraphExecutionWaitToken(queue: self.queue, executionIndex: self.queue.lastSubmittedCommand)
         }
         
         self.context.accessSemaphore?.wait()
         
+        if let pendingExecution = self.pendingExecution {
+            // The backend's transient resources are cycled once an execution has been submitted, so compiling must wait
+            // for this RenderGraph's previous execution. Executions of other RenderGraphs don't need to wait.
+            pendingExecution.submissionGroup.wait()
+        }
+        
+        let executionSlot = RenderGraph.acquireExecutionSlot()
         RenderGraph.activeRenderGraphSemaphore.wait()
         RenderGraph.activeRenderGraph = self
+        
+        if self.executionMode == .pipelined {
+            // The semaphore is signalled once the execution has been handed off for encoding.
+            return self.context.queue.sync {
+                return self._executePipelined(executionSlot: executionSlot)
+            }
+        }
+        
         defer {
-            RenderGraph.activeRenderGraph = nil
             RenderGraph.activeRenderGraphSemaphore.signal()
         }
         
         return self.context.queue.sync {
-            return self._execute()
+            return self._execute(executionSlot: executionSlot)
         }
     }
     
-    private func _execute() -> RenderGraphExecutionWaitToken {
-
+    private static func acquireExecutionSlot() -> Int {
+        RenderGraph.executionSlotSemaphore.wait()
+        return RenderGraph.executionSlotLock.withLock {
+            let executionSlot = RenderGraph.executionSlotsInUse.firstIndex(of: false)!
+            RenderGraph.executionSlotsInUse[executionSlot] = true
+            return executionSlot
+        }
+    }
+    
+    private static func releaseExecutionSlot(_ executionSlot: Int) {
+        TaggedHeap.free(tag: RenderGraphTagType.renderGraphExecution.tag(executionSlot: executionSlot))
+        TaggedHeap.free(tag: RenderGraphTagType.resourceUsageNodes.tag(executionSlot: executionSlot))
+        TaggedHeap.free(tag: .renderGraphResourceCommandArrayTag(executionSlot: executionSlot))
+        
+        RenderGraph.executionSlotLock.withLock {
+            RenderGraph.executionSlotsInUse[executionSlot] = false
+        }
+        RenderGraph.executionSlotSemaphore.signal()
+    }
+    
+    private func beginExecution(executionSlot: Int) -> ([RenderPassRecord], DependencyTable<DependencyType>, RenderGraphFrameProfile?) {
         let jobManager = RenderGraph.jobManager
         
-        RenderGraph.resourceUsagesAllocator = TagAllocator(tag: RenderGraphTagType.resourceUsageNodes.tag, threadCount: jobManager.threadCount)
-        RenderGraph.executionAllocator = TagAllocator(tag: RenderGraphTagType.renderGraphExecution.tag, threadCount: jobManager.threadCount)
+        RenderGraph.activeExecutionSlot = executionSlot
+        RenderGraph.resourceUsagesAllocator = TagAllocator(tag: RenderGraphTagType.resourceUsageNodes.tag(executionSlot: executionSlot), threadCount: jobManager.threadCount)
+        RenderGraph.executionAllocator = TagAllocator(tag: RenderGraphTagType.renderGraphExecution.tag(executionSlot: executionSlot), threadCount: jobManager.threadCount)
         
         let threadCount = jobManager.threadCount
         
@@ -1251,11 +1628,30 @@ public final class RenderGraph {
         
         self.context.beginFrameResourceAccess()
         
-        let (passes, dependencyTable) = self.compile(renderPasses: self.renderPasses)
+        var profile : RenderGraphFrameProfile? = nil
+        if self.profiledFrameCount > 0 {
+            let frameProfile = RenderGraphFrameProfile(renderGraphName: "RenderGraph \(self.queue.index)", frameIndex: RenderGraph.globalSubmissionIndex)
+            self.frameProfileLock.withLock {
+                self._frameProfiles.append(frameProfile)
+                self._frameProfiles.removeFirst(max(self._frameProfiles.count - self.profiledFrameCount, 0))
+            }
+            profile = frameProfile
+        }
+        
+        self.currentFrameProfile = profile
+        defer { self.currentFrameProfile = nil }
         
+        let (passes, dependencyTable) = profile.measure("Compile") {
+            self.compile(renderPasses: self.renderPasses)
+        }
+        return (passes, dependencyTable, profile)
+    }
+    
+    private func makeCompletionHandler(profile: RenderGraphFrameProfile?) -> (Double) -> Void {
         let completionQueue = self.completionNotifyQueue
-        let completion: (Double) -> Void = { gpuTime in
+        return { gpuTime in
             self.lastGraphGPUTime = gpuTime
+            profile?.markComplete()
 //            print("Frame completed in \(gpuTime)")
             
             let completionTime = DispatchTime.now().uptimeNanoseconds
@@ -1266,35 +1662,128 @@ public final class RenderGraph {
             
             completionQueue.forEach { $0() }
         }
-        
-        #if os(macOS) || os(iOS) || os(tvOS) || os(watchOS)
-        autoreleasepool {
-            self.context.executeRenderGraph(passes: passes, usedResources: self.usedResources, dependencyTable: dependencyTable, completion: completion)
+    }
+    
+    private func didExecute(passes: [RenderPassRecord], renderPasses: [RenderPassRecord], deferredDrawCount: Int) {
+        self.deferredDrawCountLock.withLock { self._lastFrameDeferredDrawCount = deferredDrawCount }
+        if deferredDrawCount > 0, let onDeferredPipelinesCompiled = self.onDeferredPipelinesCompiled {
+            RenderBackend._backend.notifyWhenPendingPipelinesCompiled(onDeferredPipelinesCompiled)
         }
-        #else
-        self.context.executeRenderGraph(passes: passes, usedResources: self.usedResources, dependencyTable: dependencyTable, completion: completion)
-        #endif
         
         // Make sure the RenderGraphCommands buffers are deinitialised before the tags are freed.
         passes.forEach {
             $0.commands = nil
         }
         
-        self.renderPasses.forEach {
+        renderPasses.forEach {
             $0.commands = nil
         }
+    }
+    
+    private func _execute(executionSlot: Int) -> RenderGraphExecutionWaitToken {
+        let (passes, dependencyTable, profile) = self.beginExecution(executionSlot: executionSlot)
+        let completion = self.makeCompletionHandler(profile: profile)
+        
+        var deferredDrawCount = 0
+        #if os(macOS) || os(iOS) || os(tvOS) || os(watchOS)
+        autoreleasepool {
+            deferredDrawCount = self.context.executeRenderGraph(passes: passes, usedResources: self.usedResources, dependencyTable: dependencyTable, profile: profile, completion: completion)
+        }
+        #else
+        deferredDrawCount = self.context.executeRenderGraph(passes: passes, usedResources: self.usedResources, dependencyTable: dependencyTable, profile: profile, completion: completion)
+        #endif
+        
+        self.didExecute(passes: passes, renderPasses: self.renderPasses, deferredDrawCount: deferredDrawCount)
         
         self.submissionNotifyQueue.forEach { $0() }
         self.submissionNotifyQueue.removeAll(keepingCapacity: true)
         self.completionNotifyQueue.removeAll(keepingCapacity: true)
         
-        self.reset()
+        self.renderPasses.removeAll(keepingCapacity: true)
+        self.usedResources.removeAll(keepingCapacity: true)
+        let unmanagedReferences = self.endCompilation()
+        self.reset(transientRegistryIndex: self.transientRegistryIndex, executionSlot: executionSlot, unmanagedReferences: unmanagedReferences)
         
         RenderGraph.globalSubmissionIndex += 1
         return RenderGraphExecutionWaitToken(queue: self.queue, executionIndex: self.queue.lastSubmittedCommand)
     }
     
-    private func reset() {
+    /// Executes and culls the passes and generates the frame's resource commands on the calling thread, then encodes
+    /// and submits the frame asynchronously on the context queue. Anything the application may touch while recording
+    /// the next frame is handed off before returning, and `activeRenderGraphSemaphore` is released so that other RenderGraphs
+    /// can compile. The execution's tagged allocations stay owned by it through `executionSlot` until it has been submitted.
+    private func _executePipelined(executionSlot: Int) -> RenderGraphExecutionWaitToken {
+        let (passes, dependencyTable, profile) = self.beginExecution(executionSlot: executionSlot)
+        let completion = self.makeCompletionHandler(profile: profile)
+        
+        var encodeAndSubmit : () -> Int = { 0 }
+        #if os(macOS) || os(iOS) || os(tvOS) || os(watchOS)
+        autoreleasepool {
+            encodeAndSubmit = self.context.prepareRenderGraph(passes: passes, usedResources: self.usedResources, dependencyTable: dependencyTable, profile: profile, completion: completion)
+        }
+        #else
+        encodeAndSubmit = self.context.prepareRenderGraph(passes: passes, usedResources: self.usedResources, dependencyTable: dependencyTable, profile: profile, completion: completion)
+        #endif
+        
+        let renderPasses = self.renderPasses
+        let submissionQueue = self.submissionNotifyQueue
+        let transientRegistryIndex = self.transientRegistryIndex
+        
+        self.renderPasses = []
+        self.usedResources.removeAll(keepingCapacity: true)
+        self.submissionNotifyQueue.removeAll(keepingCapacity: true)
+        self.completionNotifyQueue.removeAll(keepingCapacity: true)
+        self.transientRegistryIndex = self.transientRegistryIndices.first(where: { $0 != transientRegistryIndex })!
+        
+        let pendingExecution = RenderGraphPendingExecution()
+        self.pendingExecution = pendingExecution
+        
+        let unmanagedReferences = self.endCompilation()
+        RenderGraph.globalSubmissionIndex += 1
+        RenderGraph.activeRenderGraphSemaphore.signal()
+        
+        self.context.queue.async {
+            var deferredDrawCount = 0
+            #if os(macOS) || os(iOS) || os(tvOS) || os(watchOS)
+            autoreleasepool {
+                deferredDrawCount = encodeAndSubmit()
+            }
+            #else
+            deferredDrawCount = encodeAndSubmit()
+            #endif
+            
+            self.didExecute(passes: passes, renderPasses: renderPasses, deferredDrawCount: deferredDrawCount)
+            
+            submissionQueue.forEach { $0() }
+            
+            self.reset(transientRegistryIndex: transientRegistryIndex, executionSlot: executionSlot, unmanagedReferences: unmanagedReferences)
+            
+            pendingExecution.markSubmitted(executionIndex: self.queue.lastSubmittedCommand)
+        }
+        
+        return RenderGraphExecutionWaitToken(queue: self.queue, pendingExecution: pendingExecution)
+    }
+    
+    /// Releases the state that's shared between all executions once an execution's resource commands have been generated,
+    /// so that the next execution can be compiled. Returns the references that must be kept alive until the execution has been submitted.
+    private func endCompilation() -> [ExpandingBuffer<Unmanaged<AnyObject>>] {
+        PersistentTextureRegistry.instance.clearUsages()
+        PersistentBufferRegistry.instance.clearUsages()
+        PersistentArgumentBufferRegistry.instance.clearUsages()
+        PersistentArgumentBufferArrayRegistry.instance.clearUsages()
+        HeapRegistry.instance.clearUsages()
+        
+        let unmanagedReferences = RenderGraph.threadUnmanagedReferences!
+        RenderGraph.threadUnmanagedReferences = nil
+        
+        RenderGraph.executionAllocator = nil
+        RenderGraph.resourceUsagesAllocator = nil
+        RenderGraph.activeRenderGraph = nil
+        
+        return unmanagedReferences
+    }
+    
+    private func reset(transientRegistryIndex: Int, executionSlot: Int, unmanagedReferences: [ExpandingBuffer<Unmanaged<AnyObject>>]) {
         if transientRegistryIndex >= 0 {
             TransientBufferRegistry.instances[transientRegistryIndex].clear()
             TransientTextureRegistry.instances[transientRegistryIndex].clear()
@@ -1308,21 +1797,13 @@ public final class RenderGraph {
         PersistentArgumentBufferArrayRegistry.instance.clear(afterRenderGraph: self)
         HeapRegistry.instance.clear(afterRenderGraph: self)
         
-        RenderGraph.threadUnmanagedReferences.forEach { unmanagedReferences in
+        unmanagedReferences.forEach { unmanagedReferences in
             for reference in unmanagedReferences {
                 reference.release()
             }
             unmanagedReferences.removeAll()
         }
-        RenderGraph.threadUnmanagedReferences = nil
-        
-        self.renderPasses.removeAll(keepingCapacity: true)
-        self.usedResources.removeAll(keepingCapacity: true)
-        
-        RenderGraph.executionAllocator = nil
-        RenderGraph.resourceUsagesAllocator = nil
         
-        TaggedHeap.free(tag: RenderGraphTagType.renderGraphExecution.tag)
-        TaggedHeap.free(tag: RenderGraphTagType.resourceUsageNodes.tag)
+        RenderGraph.releaseExecutionSlot(executionSlot)
     }
 }
@@ -4,6 +4,7 @@
 //
 
 import Foundation
+import Atomics
 import SubstrateUtilities
 
 public protocol RenderGraphJobManager : AnyObject {
@@ -11,55 +12,278 @@ public protocol RenderGraphJobManager : AnyObject {
     var threadCount : Int { get }
     
     func dispatchPassJob(_ function: @escaping () -> Void)
+    /// Dispatches `count` jobs, each of which calls `function` with its index in `0..<count`.
+    func dispatchPassJobs(count: Int, _ function: @escaping (_ index: Int) -> Void)
+    /// Waits for all dispatched pass jobs to complete. Must not be called from within a pass job.
     func waitForAllPassJobs()
+    /// Calls `function` for each index in `0..<count`, potentially concurrently, and returns once all calls have completed.
+    /// May be called from within a pass job to split its work into child jobs.
+    func forEachConcurrently(count: Int, _ function: (_ index: Int) -> Void)
     func syncOnMainThread<T>(_ function: () throws -> T) rethrows -> T
     func asyncOnMainThread(_ function: @escaping () -> Void)
 }
 
-final class DefaultRenderGraphJobManager : RenderGraphJobManager {
+extension RenderGraphJobManager {
+    public func dispatchPassJobs(count: Int, _ function: @escaping (_ index: Int) -> Void) {
+        for i in 0..<count {
+            self.dispatchPassJob { function(i) }
+        }
+    }
+    
+    public func forEachConcurrently(count: Int, _ function: (_ index: Int) -> Void) {
+        for i in 0..<count {
+            function(i)
+        }
+    }
+}
+
+/// A group of jobs sharing a single function, so that dispatching a job doesn't require allocating a closure.
+/// Batches are pooled by the job manager and reused once all of their jobs have completed.
+final class RenderGraphJobBatch {
+    enum Function {
+        case indexed((Int) -> Void)
+        case single(() -> Void)
+    }
+    
+    var function : Function? = nil
+    /// Whether a thread is waiting for the batch to complete, in which case that thread returns it to the pool;
+    /// otherwise, the batch's last job to complete does.
+    var hasWaiter = false
+    let remainingJobs = UnsafeMutablePointer<Int.AtomicRepresentation>.allocate(capacity: 1)
+    
+    init() {
+        self.remainingJobs.initialize(to: Int.AtomicRepresentation(0))
+    }
+    
+    deinit {
+        self.remainingJobs.deallocate()
+    }
+    
+    func reset(function: Function, jobCount: Int, hasWaiter: Bool) {
+        self.function = function
+        self.hasWaiter = hasWaiter
+        Int.AtomicRepresentation.atomicStore(jobCount, at: self.remainingJobs, ordering: .relaxed)
+    }
+    
+    @inline(__always)
+    func run(index: Int) {
+        switch self.function! {
+        case .indexed(let function):
+            function(index)
+        case .single(let function):
+            function()
+        }
+    }
+    
+    /// Returns true if this was the last job in the batch to complete.
+    @inline(__always)
+    func markJobCompleted() -> Bool {
+        return Int.AtomicRepresentation.atomicLoadThenWrappingDecrement(at: self.remainingJobs, ordering: .acquiringAndReleasing) == 1
+    }
+    
+    var isComplete : Bool {
+        return Int.AtomicRepresentation.atomicLoad(at: self.remainingJobs, ordering: .acquiring) == 0
+    }
+}
+
+struct RenderGraphJob {
+    /// Retained once for the whole batch, and released when the batch is returned to the pool.
+    let batch : Unmanaged<RenderGraphJobBatch>
+    let index : Int
+}
+
+/// A per-thread Chase-Lev work-stealing deque. Only the owning thread may push and pop jobs, which it does at the bottom
+/// without taking a lock; any other thread may steal jobs from the top, synchronising with the owner and other thieves by
+/// compare-and-swap on the top index.
+final class RenderGraphJobDeque {
+    /// A power-of-two sized circular array of jobs. Each job is stored as two words that are read and written atomically,
+    /// since a thief may read a slot concurrently with the owner writing it when the deque wraps around.
+    struct Storage {
+        let capacity : Int
+        let slots : UnsafeMutablePointer<Int.AtomicRepresentation>
+        
+        init(capacity: Int) {
+            assert(capacity.nonzeroBitCount == 1)
+            self.capacity = capacity
+            self.slots = .allocate(capacity: 2 * capacity)
+            self.slots.initialize(repeating: Int.AtomicRepresentation(0), count: 2 * capacity)
+        }
+        
+        func deallocate() {
+            self.slots.deallocate()
+        }
+        
+        @inline(__always)
+        func job(at index: Int) -> RenderGraphJob {
+            let slot = 2 * (index & (self.capacity - 1))
+            let batch = Int.AtomicRepresentation.atomicLoad(at: self.slots + slot, ordering: .relaxed)
+            let jobIndex = Int.AtomicRepresentation.atomicLoad(at: self.slots + slot + 1, ordering: .relaxed)
+            return RenderGraphJob(batch: Unmanaged.fromOpaque(UnsafeRawPointer(bitPattern: batch)!), index: jobIndex)
+        }
+        
+        @inline(__always)
+        func setJob(_ job: RenderGraphJob, at index: Int) {
+            let slot = 2 * (index & (self.capacity - 1))
+            Int.AtomicRepresentation.atomicStore(Int(bitPattern: job.batch.toOpaque()), at: self.slots + slot, ordering: .relaxed)
+            Int.AtomicRepresentation.atomicStore(job.index, at: self.slots + slot + 1, ordering: .relaxed)
+        }
+    }
+    
+    // top and bottom are kept on separate cache lines, since thieves write to top and the owner to bottom.
+    let indices : UnsafeMutablePointer<Int.AtomicRepresentation>
+    var top : UnsafeMutablePointer<Int.AtomicRepresentation> { return self.indices }
+    var bottom : UnsafeMutablePointer<Int.AtomicRepresentation> { return self.indices + 8 }
+    
+    /// The bit pattern of the current `UnsafeMutablePointer<Storage>`.
+    let storage = UnsafeMutablePointer<Int.AtomicRepresentation>.allocate(capacity: 1)
+    /// Storage replaced by a larger array. Thieves may still be reading from it, so it's only freed with the deque. Owner-only.
+    var retiredStorage = [UnsafeMutablePointer<Storage>]()
+    
+    init(capacity: Int = 256) {
+        self.indices = .allocate(capacity: 16)
+        self.indices.initialize(repeating: Int.AtomicRepresentation(0), count: 16)
+        
+        let storage = UnsafeMutablePointer<Storage>.allocate(capacity: 1)
+        storage.initialize(to: Storage(capacity: capacity))
+        self.storage.initialize(to: Int.AtomicRepresentation(Int(bitPattern: storage)))
+    }
+    
+    deinit {
+        for storage in self.retiredStorage + [self.currentStorage] {
+            storage.pointee.deallocate()
+            storage.deallocate()
+        }
+        self.storage.deallocate()
+        self.indices.deallocate()
+    }
+    
+    var currentStorage : UnsafeMutablePointer<Storage> {
+        return UnsafeMutablePointer(bitPattern: Int.AtomicRepresentation.atomicLoad(at: self.storage, ordering: .acquiring))!
+    }
+    
+    /// Replaces the storage with one of twice the capacity. Must only be called by the owning thread.
+    func grow(from storage: UnsafeMutablePointer<Storage>, top: Int, bottom: Int) -> UnsafeMutablePointer<Storage> {
+        let newStorage = UnsafeMutablePointer<Storage>.allocate(capacity: 1)
+        newStorage.initialize(to: Storage(capacity: 2 * storage.pointee.capacity))
+        for i in top..<bottom {
+            newStorage.pointee.setJob(storage.pointee.job(at: i), at: i)
+        }
+        Int.AtomicRepresentation.atomicStore(Int(bitPattern: newStorage), at: self.storage, ordering: .releasing)
+        self.retiredStorage.append(storage)
+        return newStorage
+    }
+    
+    /// Pushes a job onto the bottom of the deque. Must only be called by the owning thread.
+    func push(_ job: RenderGraphJob) {
+        let bottom = Int.AtomicRepresentation.atomicLoad(at: self.bottom, ordering: .relaxed)
+        let top = Int.AtomicRepresentation.atomicLoad(at: self.top, ordering: .acquiring)
+        var storage = self.currentStorage
+        if bottom - top >= storage.pointee.capacity {
+            storage = self.grow(from: storage, top: top, bottom: bottom)
+        }
+        storage.pointee.setJob(job, at: bottom)
+        Int.AtomicRepresentation.atomicStore(bottom + 1, at: self.bottom, ordering: .releasing)
+    }
+    
+    /// Pops the most recently pushed job. Must only be called by the owning thread.
+    func popLast() -> RenderGraphJob? {
+        let bottom = Int.AtomicRepresentation.atomicLoad(at: self.bottom, ordering: .relaxed) - 1
+        let storage = self.currentStorage
+        // The store to bottom must be ordered before the load of top so that the owner and a thief can't both take the last job.
+        Int.AtomicRepresentation.atomicStore(bottom, at: self.bottom, ordering: .sequentiallyConsistent)
+        let top = Int.AtomicRepresentation.atomicLoad(at: self.top, ordering: .sequentiallyConsistent)
+        
+        if top > bottom {
+            // The deque was empty.
+            Int.AtomicRepresentation.atomicStore(bottom + 1, at: self.bottom, ordering: .relaxed)
+            return nil
+        }
+        
+        let job = storage.pointee.job(at: bottom)
+        if top == bottom {
+            // This is the last job, so race any thieves for it.
+            let (exchanged, _) = Int.AtomicRepresentation.atomicCompareExchange(expected: top, desired: top + 1, at: self.top, ordering: .sequentiallyConsistent)
+            Int.AtomicRepresentation.atomicStore(bottom + 1, at: self.bottom, ordering: .relaxed)
+            return exchanged ? job : nil
+        }
+        return job
+    }
+    
+    /// Takes the least recently pushed job. May be called from any thread.
+    func steal() -> RenderGraphJob? {
+        while true {
+            let top = Int.AtomicRepresentation.atomicLoad(at: self.top, ordering: .sequentiallyConsistent)
+            let bottom = Int.AtomicRepresentation.atomicLoad(at: self.bottom, ordering: .sequentiallyConsistent)
+            guard top < bottom else { return nil }
+            
+            let job = self.currentStorage.pointee.job(at: top)
+            if Int.AtomicRepresentation.atomicCompareExchange(expected: top, desired: top + 1, at: self.top, ordering: .sequentiallyConsistent).exchanged {
+                return job
+            }
+            // Another thief or the owner took the job; try the next one.
+        }
+    }
+}
+
+/// A work-stealing job manager. Each worker thread and the main thread owns a lock-free job deque that it pushes jobs onto;
+/// idle threads steal jobs from the other threads' deques, and threads waiting for jobs to complete help execute them,
+/// blocking when there's nothing left for them to run. Jobs submitted from any other thread go through a shared, locked queue.
+public final class DefaultRenderGraphJobManager : RenderGraphJobManager {
     static let queueIndexKey = DispatchSpecificKey<Int>()
     
     public let threadCount : Int
     var queues: [DispatchQueue]!
+    let deques : [RenderGraphJobDeque]
     let taskAvailableSemaphore: DispatchSemaphore
-    var taskQueue = [() -> Void]()
-    let taskQueueLock = SpinLock()
-    let taskGroup = DispatchGroup()
+    let pendingJobCount = UnsafeMutablePointer<Int.AtomicRepresentation>.allocate(capacity: 1)
+    
+    /// Jobs submitted from threads that don't own a deque.
+    let sharedJobs = RingBuffer<RenderGraphJob>()
+    let sharedJobsLock = SpinLock(name: "RenderGraphJobManager.sharedJobs")
+    let sharedJobCount = UnsafeMutablePointer<Int.AtomicRepresentation>.allocate(capacity: 1)
+    
+    var batchPool = [RenderGraphJobBatch]()
+    let batchPoolLock = SpinLock(name: "RenderGraphJobManager.batchPool")
+    
+    /// Incremented whenever jobs are submitted or a batch completes, so that waiting threads can sleep until there may be more to do.
+    let jobStateEpoch = UnsafeMutablePointer<UInt32.AtomicRepresentation>.allocate(capacity: 1)
+    let sleepingWaiterCount = UnsafeMutablePointer<Int.AtomicRepresentation>.allocate(capacity: 1)
     
     deinit {
-        self.taskQueueLock.deinit()
+        self.pendingJobCount.deallocate()
+        self.sharedJobCount.deallocate()
+        self.jobStateEpoch.deallocate()
+        self.sleepingWaiterCount.deallocate()
+        self.sharedJobsLock.deinit()
+        self.batchPoolLock.deinit()
     }
     
     public var threadIndex : Int {
         return DispatchQueue.getSpecific(key: Self.queueIndexKey) ?? 0
     }
     
-    public func dispatchPassJob(_ function: @escaping () -> Void) {
-        taskGroup.enter()
-        
-        self.taskQueueLock.lock()
-        self.taskQueue.append {
-            function()
-            self.taskGroup.leave()
-        }
-        self.taskQueueLock.unlock()
-        self.taskAvailableSemaphore.signal()
-    }
-    
-    public func waitForAllPassJobs() {
-        self.taskGroup.wait()
+    /// The index of the deque owned by the calling thread, or nil if the calling thread is neither the main thread nor a worker.
+    var ownedDequeIndex : Int? {
+        return DispatchQueue.getSpecific(key: Self.queueIndexKey)
     }
     
-    public init() {
+    /// - Parameter workerCount: the number of worker threads to create in addition to the main thread,
+    ///   defaulting to one fewer than the number of processors.
+    public init(workerCount: Int? = nil) {
         dispatchPrecondition(condition: .onQueue(.main))
         let processorCount = ProcessInfo.processInfo.processorCount
         
         DispatchQueue.main.setSpecific(key: Self.queueIndexKey, value: 0)
         
         self.taskAvailableSemaphore = DispatchSemaphore(value: 0)
+        self.pendingJobCount.initialize(to: Int.AtomicRepresentation(0))
+        self.sharedJobCount.initialize(to: Int.AtomicRepresentation(0))
+        self.jobStateEpoch.initialize(to: UInt32.AtomicRepresentation(0))
+        self.sleepingWaiterCount.initialize(to: Int.AtomicRepresentation(0))
         
-        let queueCount = min(max(processorCount - 1, 1), 8)
+        let queueCount = max(workerCount ?? (processorCount - 1), 1)
         self.threadCount = queueCount + 1
+        self.deques = (0..<self.threadCount).map { _ in RenderGraphJobDeque() }
         
         let queues = (1...queueCount).map { i -> DispatchQueue in
             let queue = DispatchQueue(label: "RenderGraph Job Queue \(i)", qos: .userInteractive, autoreleaseFrequency: .workItem, target: nil)
@@ -67,11 +291,11 @@ final class DefaultRenderGraphJobManager : RenderGraphJobManager {
             
             queue.async { [weak self] in
                 while let self = self {
-                    self.taskAvailableSemaphore.wait()
-                    self.taskQueueLock.lock()
-                    let task = self.taskQueue.removeLast()
-                    self.taskQueueLock.unlock()
-                    task()
+                    if let job = self.findJob(dequeIndex: i) {
+                        self.execute(job)
+                    } else {
+                        self.taskAvailableSemaphore.wait()
+                    }
                 }
             }
             
@@ -83,6 +307,143 @@ final class DefaultRenderGraphJobManager : RenderGraphJobManager {
         TagAllocator.DynamicThreadView.threadIndexRetrievalFunc = { DispatchQueue.getSpecific(key: Self.queueIndexKey) ?? 0 }
     }
     
+    func findJob(dequeIndex: Int?) -> RenderGraphJob? {
+        if let dequeIndex = dequeIndex, let job = self.deques[dequeIndex].popLast() {
+            return job
+        }
+        if Int.AtomicRepresentation.atomicLoad(at: self.sharedJobCount, ordering: .relaxed) > 0 {
+            let job = self.sharedJobsLock.withLock { () -> RenderGraphJob? in
+                guard let job = self.sharedJobs.popFirst() else { return nil }
+                Int.AtomicRepresentation.atomicLoadThenWrappingDecrement(at: self.sharedJobCount, ordering: .relaxed)
+                return job
+            }
+            if let job = job {
+                return job
+            }
+        }
+        let startIndex = dequeIndex ?? 0
+        for offset in (dequeIndex == nil ? 0 : 1)..<self.threadCount {
+            if let job = self.deques[(startIndex + offset) % self.threadCount].steal() {
+                return job
+            }
+        }
+        return nil
+    }
+    
+    func makeBatch(function: RenderGraphJobBatch.Function, jobCount: Int, hasWaiter: Bool) -> RenderGraphJobBatch {
+        let batch = self.batchPoolLock.withLock { self.batchPool.popLast() } ?? RenderGraphJobBatch()
+        batch.reset(function: function, jobCount: jobCount, hasWaiter: hasWaiter)
+        return batch
+    }
+    
+    func recycle(_ batch: Unmanaged<RenderGraphJobBatch>) {
+        let batchValue = batch.takeUnretainedValue()
+        batchValue.function = nil
+        self.batchPoolLock.withLock { self.batchPool.append(batchValue) }
+        batch.release()
+    }
+    
+    func execute(_ job: RenderGraphJob) {
+        let batch = job.batch.takeUnretainedValue()
+        batch.run(index: job.index)
+        
+        // The batch may be reused as soon as it's complete if another thread is waiting on it, so read this first.
+        let hasWaiter = batch.hasWaiter
+        let isBatchComplete = batch.markJobCompleted()
+        Int.AtomicRepresentation.atomicLoadThenWrappingDecrement(at: self.pendingJobCount, ordering: .releasing)
+        
+        if isBatchComplete {
+            if !hasWaiter {
+                self.recycle(job.batch)
+            }
+            self.notifyWaiters()
+        }
+    }
+    
+    func submit(_ batch: RenderGraphJobBatch, indices: Range<Int>) -> Unmanaged<RenderGraphJobBatch> {
+        let unmanagedBatch = Unmanaged.passRetained(batch)
+        guard !indices.isEmpty else { return unmanagedBatch }
+        Int.AtomicRepresentation.atomicLoadThenWrappingIncrement(by: indices.count, at: self.pendingJobCount, ordering: .relaxed)
+        
+        if let dequeIndex = self.ownedDequeIndex {
+            // Other threads take jobs from the other end of the deque by stealing, so push in reverse
+            // to have the owning thread pop the jobs in order.
+            let deque = self.deques[dequeIndex]
+            for index in indices.reversed() {
+                deque.push(RenderGraphJob(batch: unmanagedBatch, index: index))
+            }
+        } else {
+            self.sharedJobsLock.withLock {
+                for index in indices {
+                    self.sharedJobs.append(RenderGraphJob(batch: unmanagedBatch, index: index))
+                }
+                Int.AtomicRepresentation.atomicLoadThenWrappingIncrement(by: indices.count, at: self.sharedJobCount, ordering: .relaxed)
+            }
+        }
+        
+        for _ in 0..<min(indices.count, self.threadCount - 1) {
+            self.taskAvailableSemaphore.signal()
+        }
+        self.notifyWaiters()
+        return unmanagedBatch
+    }
+    
+    func notifyWaiters() {
+        UInt32.AtomicRepresentation.atomicLoadThenWrappingIncrement(at: self.jobStateEpoch, ordering: .sequentiallyConsistent)
+        if Int.AtomicRepresentation.atomicLoad(at: self.sleepingWaiterCount, ordering: .sequentiallyConsistent) > 0 {
+            ParkingLot.wakeAll(on: self.jobStateEpoch)
+        }
+    }
+    
+    /// Executes jobs on the calling thread until `isDone` returns true, sleeping whenever there are no jobs that it can run.
+    func executeJobs(until isDone: () -> Bool) {
+        let dequeIndex = self.ownedDequeIndex
+        while !isDone() {
+            // Read the epoch before looking for work so that any submission or completion after this point prevents the sleep below.
+            let epoch = UInt32.AtomicRepresentation.atomicLoad(at: self.jobStateEpoch, ordering: .sequentiallyConsistent)
+            if let job = self.findJob(dequeIndex: dequeIndex) {
+                self.execute(job)
+                continue
+            }
+            
+            Int.AtomicRepresentation.atomicLoadThenWrappingIncrement(at: self.sleepingWaiterCount, ordering: .sequentiallyConsistent)
+            if !isDone() {
+                ParkingLot.wait(on: self.jobStateEpoch, whileValueIs: epoch)
+            }
+            Int.AtomicRepresentation.atomicLoadThenWrappingDecrement(at: self.sleepingWaiterCount, ordering: .sequentiallyConsistent)
+        }
+    }
+    
+    public func dispatchPassJob(_ function: @escaping () -> Void) {
+        _ = self.submit(self.makeBatch(function: .single(function), jobCount: 1, hasWaiter: false), indices: 0..<1)
+    }
+    
+    public func dispatchPassJobs(count: Int, _ function: @escaping (_ index: Int) -> Void) {
+        guard count > 0 else { return }
+        _ = self.submit(self.makeBatch(function: .indexed(function), jobCount: count, hasWaiter: false), indices: 0..<count)
+    }
+    
+    public func waitForAllPassJobs() {
+        self.executeJobs(until: { Int.AtomicRepresentation.atomicLoad(at: self.pendingJobCount, ordering: .acquiring) == 0 })
+    }
+    
+    public func forEachConcurrently(count: Int, _ function: (_ index: Int) -> Void) {
+        guard count > 1 else {
+            if count == 1 { function(0) }
+            return
+        }
+        
+        withoutActuallyEscaping(function) { function in
+            let batch = self.submit(self.makeBatch(function: .indexed(function), jobCount: count - 1, hasWaiter: true), indices: 1..<count)
+            
+            function(0)
+            
+            let batchValue = batch.takeUnretainedValue()
+            self.executeJobs(until: { batchValue.isComplete })
+            self.recycle(batch)
+        }
+    }
+    
     @inlinable
     public func syncOnMainThread<T>(_ function: () throws -> T) rethrows -> T {
         if !Thread.isMainThread {
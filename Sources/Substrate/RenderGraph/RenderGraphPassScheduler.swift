@@ -0,0 +1,284 @@
+//
+//  RenderGraphPassScheduler.swift
+//  Substrate
+//
+
+import SubstrateUtilities
+
+public enum RenderGraphPassSchedulingMode {
+    /// Passes are ordered by a depth-first traversal of their dependencies, placing passes with mergeable render targets next to each other where possible.
+    case dependencyOrder
+    /// Passes are ordered by a greedy list scheduler that minimises the estimated number of command encoders, barriers,
+    /// and texture layout transitions, and the number of passes that immediately consume the output of the preceding pass,
+    /// falling back to the `dependencyOrder` ordering when costs are equal.
+    case costModel
+}
+
+/// Reorders the active passes of a frame to minimise a cost model while respecting their dependencies.
+struct RenderGraphPassScheduler {
+    static let encoderSwitchCost = 4
+    static let layoutTransitionCost = 2
+    static let adjacentDependencyCost = 2
+    static let barrierCost = 1
+    static let nearDependencyCost = 1
+    
+    struct Cost {
+        var encoderSwitch = false
+        var dependsOnPrevious = false
+        var dependsOnSecondPrevious = false
+        /// The number of resources that need a barrier against their previous use before the pass, including for layout transitions.
+        var barrierCount = 0
+        /// The number of textures whose layout must change from their previous use before the pass.
+        var layoutTransitionCount = 0
+        
+        var total : Int {
+            return (self.encoderSwitch ? RenderGraphPassScheduler.encoderSwitchCost : 0) +
+                (self.dependsOnPrevious ? RenderGraphPassScheduler.adjacentDependencyCost : 0) +
+                (self.dependsOnSecondPrevious ? RenderGraphPassScheduler.nearDependencyCost : 0) +
+                self.barrierCount * RenderGraphPassScheduler.barrierCost +
+                self.layoutTransitionCount * RenderGraphPassScheduler.layoutTransitionCost
+        }
+    }
+    
+    /// The layouts a texture may need to be in, in the manner of Vulkan image layouts.
+    enum TextureLayout {
+        case shaderRead
+        case general
+        case renderTarget
+        case inputAttachment
+        case blitSource
+        case blitDestination
+        
+        init?(_ usageType: ResourceUsageType) {
+            switch usageType {
+            case .read, .sampler:
+                self = .shaderRead
+            case .write, .readWrite, .mipGeneration:
+                self = .general
+            case .unusedRenderTarget, .writeOnlyRenderTarget, .readWriteRenderTarget:
+                self = .renderTarget
+            case .inputAttachment, .inputAttachmentRenderTarget:
+                self = .inputAttachment
+            case .blitSource:
+                self = .blitSource
+            case .blitDestination:
+                self = .blitDestination
+            default:
+                return nil
+            }
+        }
+    }
+    
+    /// How a pass uses a resource. If the pass was recorded before scheduling, the layouts are those of its first and last
+    /// usage of the resource; otherwise, only whether the resource is written is known.
+    struct ResourceAccess {
+        var resource : Resource
+        var isWrite : Bool
+        var firstLayout : TextureLayout?
+        var lastLayout : TextureLayout?
+    }
+    
+    let passes : [RenderPassRecord]
+    /// For each pass, the indices into `passes` that it must be scheduled after.
+    var dependencies : [[Int]]
+    var dependents : [[Int]]
+    /// For each pass, the resources it uses.
+    let resourceAccesses : [[ResourceAccess]]
+    
+    /// - Parameter passes: the active passes, in their fallback (dependency) order.
+    init(passes: [RenderPassRecord], dependencyTable: SparseDependencyTable<DependencyType>, totalPassCount: Int) {
+        self.passes = passes
+        
+        var localIndexForPass = [Int](repeating: -1, count: totalPassCount)
+        for (i, pass) in passes.enumerated() {
+            localIndexForPass[pass.passIndex] = i
+        }
+        
+        var dependencies = [[Int]](repeating: [], count: passes.count)
+        for (i, pass) in passes.enumerated() {
+            for (dependency, _) in dependencyTable.dependencies(of: pass.passIndex) where localIndexForPass[dependency] >= 0 {
+                dependencies[i].append(localIndexForPass[dependency])
+            }
+        }
+        
+        var dependents = [[Int]](repeating: [], count: passes.count)
+        for i in dependencies.indices {
+            let uniqueDependencies = Set(dependencies[i])
+            dependencies[i] = uniqueDependencies.sorted()
+            for dependency in dependencies[i] {
+                dependents[dependency].append(i)
+            }
+        }
+        
+        self.dependencies = dependencies
+        self.dependents = dependents
+        self.resourceAccesses = passes.map { RenderGraphPassScheduler.resourceAccesses(of: $0) }
+    }
+    
+    static func resourceAccesses(of pass: RenderPassRecord) -> [ResourceAccess] {
+        var accesses = [ResourceAccess]()
+        var accessIndices = [Resource: Int]()
+        
+        for resource in pass.readResources {
+            accessIndices[resource] = accesses.count
+            accesses.append(ResourceAccess(resource: resource, isWrite: false))
+        }
+        for resource in pass.writtenResources {
+            if let index = accessIndices[resource] {
+                accesses[index].isWrite = true
+            } else {
+                accessIndices[resource] = accesses.count
+                accesses.append(ResourceAccess(resource: resource, isWrite: true))
+            }
+        }
+        
+        if let resourceUsages = pass.resourceUsages {
+            for (resource, usage) in resourceUsages where resource.type == .texture {
+                guard let index = accessIndices[resource], let layout = TextureLayout(usage.type) else { continue }
+                if accesses[index].firstLayout == nil {
+                    accesses[index].firstLayout = layout
+                }
+                accesses[index].lastLayout = layout
+            }
+        }
+        
+        return accesses
+    }
+    
+    /// The state of each resource after the passes scheduled so far.
+    struct ScheduleState {
+        var lastAccesses = [Resource: ResourceAccess]()
+        
+        mutating func append(_ accesses: [ResourceAccess]) {
+            for access in accesses {
+                if access.lastLayout == nil, let previousLayout = self.lastAccesses[access.resource]?.lastLayout {
+                    // The pass doesn't say what layout it leaves the texture in, so assume it's unchanged.
+                    var access = access
+                    access.lastLayout = previousLayout
+                    self.lastAccesses[access.resource] = access
+                } else {
+                    self.lastAccesses[access.resource] = access
+                }
+            }
+        }
+    }
+    
+    static func startsNewEncoder(_ pass: RenderPassRecord, after previousPass: RenderPassRecord?) -> Bool {
+        guard let previousPass = previousPass else { return true }
+        switch (previousPass.type, pass.type) {
+        case (.draw, .draw):
+            guard let previousDrawPass = previousPass.pass as? DrawRenderPass, let drawPass = pass.pass as? DrawRenderPass else { return true }
+            return !RenderTargetDescriptor.descriptorsAreMergeable(passA: previousDrawPass, passB: drawPass)
+        case (.blit, .blit):
+            return false
+        default:
+            return true
+        }
+    }
+    
+    func cost(of candidate: Int, after schedule: [Int], state: ScheduleState) -> Cost {
+        var cost = Cost()
+        for access in self.resourceAccesses[candidate] {
+            guard let previous = state.lastAccesses[access.resource] else { continue }
+            var needsBarrier = previous.isWrite || access.isWrite
+            if let previousLayout = previous.lastLayout, let layout = access.firstLayout, previousLayout != layout {
+                cost.layoutTransitionCount += 1
+                needsBarrier = true
+            }
+            if needsBarrier {
+                cost.barrierCount += 1
+            }
+        }
+        
+        cost.encoderSwitch = RenderGraphPassScheduler.startsNewEncoder(self.passes[candidate], after: schedule.last.map { self.passes[$0] })
+        if let previous = schedule.last {
+            cost.dependsOnPrevious = self.dependencies[candidate].contains(previous)
+        }
+        if schedule.count >= 2 {
+            cost.dependsOnSecondPrevious = self.dependencies[candidate].contains(schedule[schedule.count - 2])
+        }
+        return cost
+    }
+    
+    /// Returns the scheduled order as indices into `passes`, along with the cost of each pass in that order.
+    func schedule() -> (order: [Int], costs: [Cost]) {
+        var remainingDependencyCounts = self.dependencies.map { $0.count }
+        var ready = remainingDependencyCounts.indices.filter { remainingDependencyCounts[$0] == 0 }
+        
+        var order = [Int]()
+        order.reserveCapacity(self.passes.count)
+        var costs = [Cost]()
+        costs.reserveCapacity(self.passes.count)
+        var state = ScheduleState()
+        
+        while !ready.isEmpty {
+            // Ties are broken by the fallback order, which keeps the scheduler deterministic.
+            var bestReadyIndex = 0
+            var bestCost = self.cost(of: ready[0], after: order, state: state)
+            for readyIndex in ready.indices.dropFirst() {
+                let cost = self.cost(of: ready[readyIndex], after: order, state: state)
+                if cost.total < bestCost.total || (cost.total == bestCost.total && ready[readyIndex] < ready[bestReadyIndex]) {
+                    bestReadyIndex = readyIndex
+                    bestCost = cost
+                }
+            }
+            
+            let pass = ready.remove(at: bestReadyIndex)
+            order.append(pass)
+            costs.append(bestCost)
+            state.append(self.resourceAccesses[pass])
+            
+            for dependent in self.dependents[pass] {
+                remainingDependencyCounts[dependent] -= 1
+                if remainingDependencyCounts[dependent] == 0 {
+                    ready.append(dependent)
+                }
+            }
+        }
+        
+        precondition(order.count == self.passes.count, "Cyclic dependency between render passes.")
+        return (order, costs)
+    }
+    
+    func costs(of order: [Int]) -> [Cost] {
+        var schedule = [Int]()
+        schedule.reserveCapacity(order.count)
+        var state = ScheduleState()
+        return order.map { pass in
+            defer {
+                schedule.append(pass)
+                state.append(self.resourceAccesses[pass])
+            }
+            return self.cost(of: pass, after: schedule, state: state)
+        }
+    }
+    
+    static func summary(of costs: [Cost]) -> String {
+        let encoderCount = costs.lazy.filter { $0.encoderSwitch }.count
+        let adjacentDependencyCount = costs.lazy.filter { $0.dependsOnPrevious }.count
+        let barrierCount = costs.reduce(0, { $0 + $1.barrierCount })
+        let layoutTransitionCount = costs.reduce(0, { $0 + $1.layoutTransitionCount })
+        let totalCost = costs.reduce(0, { $0 + $1.total })
+        return "\(encoderCount) estimated encoders, \(adjacentDependencyCount) adjacent dependencies, \(barrierCount) barriers, \(layoutTransitionCount) layout transitions, total cost \(totalCost)"
+    }
+    
+    func debugDescription(order: [Int], costs: [Cost]) -> String {
+        var description = "Pass schedule (\(self.passes.count) passes)\n"
+        description += "  Fallback order: \(RenderGraphPassScheduler.summary(of: self.costs(of: Array(self.passes.indices))))\n"
+        description += "  Chosen order: \(RenderGraphPassScheduler.summary(of: costs))\n"
+        for (position, (pass, cost)) in zip(order, costs).enumerated() {
+            var flags = [String]()
+            if cost.encoderSwitch { flags.append("new encoder") }
+            if cost.dependsOnPrevious { flags.append("depends on previous") }
+            if cost.dependsOnSecondPrevious { flags.append("depends on second previous") }
+            if cost.barrierCount > 0 { flags.append("\(cost.barrierCount) barriers") }
+            if cost.layoutTransitionCount > 0 { flags.append("\(cost.layoutTransitionCount) layout transitions") }
+            description += "  \(position): \(self.passes[pass].name) (\(self.passes[pass].type), pass \(self.passes[pass].passIndex))"
+            if !flags.isEmpty {
+                description += " [\(flags.joined(separator: ", "))]"
+            }
+            description += "\n"
+        }
+        return description
+    }
+}
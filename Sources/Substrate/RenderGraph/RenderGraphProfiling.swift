@@ -0,0 +1,234 @@
+//
+//  RenderGraphProfiling.swift
+//  Substrate
+//
+
+import SubstrateUtilities
+import Dispatch
+
+/// A span of work within a profiled frame.
+public struct RenderGraphProfileInterval {
+    public enum Kind {
+        /// A phase of the render graph's execution, such as compilation or command encoding.
+        case phase
+        /// The recording of a single pass' commands.
+        case passRecording
+        /// The GPU execution of a command encoder.
+        case gpuEncoder
+    }
+
+    public var name : String
+    public var kind : Kind
+    /// For CPU intervals, the index of the job manager thread that recorded the pass, or -1 for the render graph's own phases.
+    /// For GPU intervals, the index of the queue family the encoder was submitted to.
+    public var lane : Int
+    /// The start time in nanoseconds. CPU intervals are measured in `DispatchTime` uptime, while GPU intervals are measured using the GPU's clock.
+    public var startTime : UInt64
+    /// The end time in nanoseconds, in the same time domain as `startTime`.
+    public var endTime : UInt64
+
+    public var durationMilliseconds : Double {
+        return Double(self.endTime &- self.startTime) * 1e-6
+    }
+}
+
+public struct RenderGraphProfileCounters {
+    /// The number of passes that were executed on the GPU.
+    public var activePassCount = 0
+    /// The number of commands recorded by the active passes.
+    public var commandCount = 0
+    /// The number of barriers, memory aliasing fences and other resource commands generated for the frame.
+    public var resourceCommandCount = 0
+    /// The number of resource commands after they were merged into backend commands.
+    public var compactedResourceCommandCount = 0
+    public var commandEncoderCount = 0
+    public var commandBufferCount = 0
+    /// The memory used by the frame's transient resources, where reported by the backend.
+    public var transientBytes = 0
+    /// The number of transient resource allocations that were satisfied from the backend's resource pools.
+    public var resourcePoolHitCount = 0
+    /// The number of transient resource allocations that required a new allocation from the device.
+    public var resourcePoolMissCount = 0
+}
+
+/// The timings and counters for a single execution of a `RenderGraph`.
+///
+/// GPU intervals are only recorded by backends that support per-encoder timestamps, and are added once the frame
+/// completes on the GPU.
+public final class RenderGraphFrameProfile {
+    public let renderGraphName : String
+    public let frameIndex : UInt64
+
+    private var lock = SpinLock()
+    private var _cpuIntervals = [RenderGraphProfileInterval]()
+    private var _gpuIntervals = [RenderGraphProfileInterval]()
+    private var _counters = RenderGraphProfileCounters()
+    private var _isComplete = false
+    private var _submissionTime : UInt64 = 0
+
+    init(renderGraphName: String, frameIndex: UInt64) {
+        self.renderGraphName = renderGraphName
+        self.frameIndex = frameIndex
+    }
+
+    deinit {
+        self.lock.deinit()
+    }
+
+    public var cpuIntervals : [RenderGraphProfileInterval] {
+        return self.lock.withLock { self._cpuIntervals }
+    }
+
+    public var gpuIntervals : [RenderGraphProfileInterval] {
+        return self.lock.withLock { self._gpuIntervals }
+    }
+
+    public var counters : RenderGraphProfileCounters {
+        return self.lock.withLock { self._counters }
+    }
+
+    /// Whether the frame has completed on the GPU, after which no more intervals will be added.
+    public var isComplete : Bool {
+        return self.lock.withLock { self._isComplete }
+    }
+
+    /// The CPU time at which the frame's first command buffer was submitted, used to place the GPU intervals on the CPU timeline.
+    var submissionTime : UInt64 {
+        get {
+            return self.lock.withLock { self._submissionTime }
+        }
+        set {
+            self.lock.withLock { self._submissionTime = newValue }
+        }
+    }
+
+    static var currentTime : UInt64 {
+        return DispatchTime.now().uptimeNanoseconds
+    }
+
+    func addCPUInterval(name: String, kind: RenderGraphProfileInterval.Kind = .phase, lane: Int = -1, startTime: UInt64, endTime: UInt64) {
+        self.lock.withLock {
+            self._cpuIntervals.append(RenderGraphProfileInterval(name: name, kind: kind, lane: lane, startTime: startTime, endTime: endTime))
+        }
+    }
+
+    func addGPUIntervals(_ intervals: [RenderGraphProfileInterval]) {
+        guard !intervals.isEmpty else { return }
+        self.lock.withLock {
+            self._gpuIntervals.append(contentsOf: intervals)
+        }
+    }
+
+    func updateCounters(_ update: (inout RenderGraphProfileCounters) -> Void) {
+        self.lock.withLock {
+            update(&self._counters)
+        }
+    }
+
+    func markComplete() {
+        self.lock.withLock {
+            self._isComplete = true
+        }
+    }
+
+    /// Records the time taken by `perform` as a phase interval.
+    @discardableResult
+    func measure<T>(_ name: String, _ perform: () throws -> T) rethrows -> T {
+        let startTime = RenderGraphFrameProfile.currentTime
+        defer { self.addCPUInterval(name: name, startTime: startTime, endTime: RenderGraphFrameProfile.currentTime) }
+        return try perform()
+    }
+}
+
+extension Optional where Wrapped == RenderGraphFrameProfile {
+    /// Runs `perform`, recording its duration if profiling is enabled.
+    @discardableResult
+    func measure<T>(_ name: String, _ perform: () throws -> T) rethrows -> T {
+        if let profile = self {
+            return try profile.measure(name, perform)
+        }
+        return try perform()
+    }
+}
+
+enum RenderGraphTraceExporter {
+    static func escape(_ string: String) -> String {
+        var result = ""
+        result.reserveCapacity(string.utf8.count)
+        for scalar in string.unicodeScalars {
+            switch scalar {
+            case "\"":
+                result += "\\\""
+            case "\\":
+                result += "\\\\"
+            case "\n":
+                result += "\\n"
+            case _ where scalar.value < 0x20:
+                result += "\\u00" + (scalar.value < 0x10 ? "0" : "") + String(scalar.value, radix: 16)
+            default:
+                result.unicodeScalars.append(scalar)
+            }
+        }
+        return result
+    }
+
+    static func appendEvent(_ interval: RenderGraphProfileInterval, processID: Int, threadID: Int, timeOffset: Int64, frameIndex: UInt64, to json: inout String) {
+        let category : String
+        switch interval.kind {
+        case .phase:
+            category = "phase"
+        case .passRecording:
+            category = "pass"
+        case .gpuEncoder:
+            category = "gpu"
+        }
+        let startMicroseconds = Double(Int64(bitPattern: interval.startTime) &+ timeOffset) * 1e-3
+        let durationMicroseconds = Double(interval.endTime &- interval.startTime) * 1e-3
+        json += "{\"name\":\"\(escape(interval.name))\",\"cat\":\"\(category)\",\"ph\":\"X\",\"pid\":\(processID),\"tid\":\(threadID),\"ts\":\(startMicroseconds),\"dur\":\(durationMicroseconds),\"args\":{\"frame\":\(frameIndex)}},\n"
+    }
+
+    /// Formats `profiles` as a Chrome trace event JSON document, which can be loaded into `chrome://tracing` or Perfetto.
+    /// CPU work appears in one process with a track per thread, and GPU work in another with a track per queue family.
+    /// Since the GPU's clock isn't synchronised with the CPU's, each frame's GPU intervals are placed so that the first one
+    /// starts at the frame's submission time.
+    static func chromeTraceJSON(profiles: [RenderGraphFrameProfile]) -> String {
+        let cpuProcessID = 1
+        let gpuProcessID = 2
+
+        var json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+        json += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":\(cpuProcessID),\"args\":{\"name\":\"CPU\"}},\n"
+        json += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":\(gpuProcessID),\"args\":{\"name\":\"GPU\"}},\n"
+
+        for profile in profiles {
+            let cpuIntervals = profile.cpuIntervals
+            let gpuIntervals = profile.gpuIntervals
+            let counters = profile.counters
+
+            for interval in cpuIntervals {
+                appendEvent(interval, processID: cpuProcessID, threadID: interval.lane + 1, timeOffset: 0, frameIndex: profile.frameIndex, to: &json)
+            }
+
+            if let gpuStartTime = gpuIntervals.lazy.map({ $0.startTime }).min() {
+                let timeOffset = Int64(bitPattern: profile.submissionTime) &- Int64(bitPattern: gpuStartTime)
+                for interval in gpuIntervals {
+                    appendEvent(interval, processID: gpuProcessID, threadID: interval.lane, timeOffset: timeOffset, frameIndex: profile.frameIndex, to: &json)
+                }
+            }
+
+            if let frameStartTime = cpuIntervals.lazy.map({ $0.startTime }).min() {
+                let timestamp = Double(frameStartTime) * 1e-3
+                json += "{\"name\":\"\(escape(profile.renderGraphName)) Counters\",\"ph\":\"C\",\"pid\":\(cpuProcessID),\"ts\":\(timestamp),\"args\":{"
+                json += "\"activePasses\":\(counters.activePassCount),\"commands\":\(counters.commandCount),\"resourceCommands\":\(counters.resourceCommandCount),"
+                json += "\"compactedResourceCommands\":\(counters.compactedResourceCommandCount),\"encoders\":\(counters.commandEncoderCount),\"commandBuffers\":\(counters.commandBufferCount),"
+                json += "\"transientBytes\":\(counters.transientBytes),\"poolHits\":\(counters.resourcePoolHitCount),\"poolMisses\":\(counters.resourcePoolMissCount)}},\n"
+            }
+        }
+
+        if json.hasSuffix(",\n") {
+            json.removeLast(2)
+            json += "\n"
+        }
+        json += "]}\n"
+        return json
+    }
+}
@@ -0,0 +1,146 @@
+//
+//  RenderGraphTopologyCache.swift
+//  Substrate
+//
+
+import SubstrateUtilities
+
+/// The result of culling and ordering a frame's passes, which only depends on the structure of the frame.
+struct RenderGraphTopology {
+    let dependencyTable : SparseDependencyTable<DependencyType>
+    /// The indices of the passes that survived culling, in execution order.
+    let orderedActivePassIndices : [Int]
+}
+
+/// The exact structure of a frame's passes: each pass's type, its render targets if it's a draw pass, and the sets of resources
+/// it reads and writes. Since a resource's usages are determined by the passes that use it, two frames with equal keys have the same
+/// per-resource usage sequences and therefore the same topology.
+///
+/// The key's hash is precomputed so that lookups only hash the structure once; equality always compares the full structure,
+/// so frames whose hashes collide are never given each other's topology.
+struct RenderGraphTopologyKey : Hashable {
+    let words : [UInt64]
+    let hash : UInt64
+    
+    init(words: [UInt64], hash: UInt64) {
+        self.words = words
+        self.hash = hash
+    }
+    
+    func hash(into hasher: inout Hasher) {
+        hasher.combine(self.hash)
+    }
+    
+    static func ==(lhs: RenderGraphTopologyKey, rhs: RenderGraphTopologyKey) -> Bool {
+        return lhs.hash == rhs.hash && lhs.words == rhs.words
+    }
+}
+
+/// Caches `RenderGraphTopology`s keyed on the structure of the frame's passes and the resources they use,
+/// so that structurally identical frames can skip dependency construction, culling, and ordering.
+final class RenderGraphTopologyCache {
+    static let maxEntryCount = 8
+    
+    private var entries = [RenderGraphTopologyKey: RenderGraphTopology]()
+    private(set) var hitCount = 0
+    private(set) var missCount = 0
+    
+    @inline(__always)
+    static func mix(_ value: UInt64) -> UInt64 {
+        // splitmix64 finaliser
+        var z = value &+ 0x9E3779B97F4A7C15
+        z = (z ^ (z >> 30)) &* 0xBF58476D1CE4E5B9
+        z = (z ^ (z >> 27)) &* 0x94D049BB133111EB
+        return z ^ (z >> 31)
+    }
+    
+    /// A key for the resource that's stable across frames, provided resources are created in the same order each frame.
+    @inline(__always)
+    static func key(for resource: Resource?) -> UInt64 {
+        guard let resource = resource else { return 0 }
+        let generationMask = ((1 << UInt64(Resource.generationBitsRange.count)) - 1) << UInt64(Resource.generationBitsRange.lowerBound)
+        return resource.handle & ~generationMask
+    }
+    
+    static func passTypeKey(_ type: RenderPassType) -> UInt64 {
+        switch type {
+        case .cpu:
+            return 1
+        case .draw:
+            return 2
+        case .compute:
+            return 3
+        case .blit:
+            return 4
+        case .external:
+            return 5
+        }
+    }
+    
+    /// Computes the structural key for `renderPasses`, which is equal between two frames only if they would produce the same topology.
+    /// Each pass's resource sets are sorted since `HashSet` iteration order varies between frames.
+    static func key(for renderPasses: [RenderPassRecord]) -> RenderGraphTopologyKey {
+        var words = [UInt64]()
+        words.reserveCapacity(renderPasses.count * 8)
+        
+        var resourceKeys = [UInt64]()
+        let appendResourceSet = { (resources: HashSet<Resource>, words: inout [UInt64]) in
+            resourceKeys.removeAll(keepingCapacity: true)
+            for resource in resources {
+                resourceKeys.append(self.key(for: resource))
+            }
+            resourceKeys.sort()
+            words.append(UInt64(resourceKeys.count))
+            words.append(contentsOf: resourceKeys)
+        }
+        
+        for pass in renderPasses {
+            words.append(self.passTypeKey(pass.type))
+            
+            if let drawPass = pass.pass as? DrawRenderPass {
+                // Draw passes are reordered based on whether their render targets are mergeable.
+                let descriptor = drawPass.renderTargetDescriptor
+                words.append(UInt64(descriptor.size.width) << 32 | UInt64(descriptor.size.height))
+                words.append(UInt64(descriptor.colorAttachments.count))
+                for (i, attachment) in descriptor.colorAttachments.enumerated() {
+                    words.append(self.key(for: attachment.map { Resource($0.texture) }))
+                    words.append(drawPass.colorClearOperation(attachmentIndex: i).isClear ? 1 : 0)
+                }
+                words.append(self.key(for: descriptor.depthAttachment.map { Resource($0.texture) }))
+                words.append(drawPass.depthClearOperation.isClear ? 1 : 0)
+                words.append(self.key(for: descriptor.stencilAttachment.map { Resource($0.texture) }))
+                words.append(drawPass.stencilClearOperation.isClear ? 1 : 0)
+                words.append(self.key(for: descriptor.visibilityResultBuffer.map { Resource($0) }))
+            }
+            
+            appendResourceSet(pass.readResources, &words)
+            appendResourceSet(pass.writtenResources, &words)
+        }
+        
+        var hash : UInt64 = 0
+        for word in words {
+            hash = self.mix(hash ^ word)
+        }
+        return RenderGraphTopologyKey(words: words, hash: hash)
+    }
+    
+    func topology(for key: RenderGraphTopologyKey) -> RenderGraphTopology? {
+        if let topology = self.entries[key] {
+            self.hitCount += 1
+            return topology
+        }
+        self.missCount += 1
+        return nil
+    }
+    
+    func setTopology(_ topology: RenderGraphTopology, for key: RenderGraphTopologyKey) {
+        if self.entries.count >= RenderGraphTopologyCache.maxEntryCount {
+            self.entries.removeAll(keepingCapacity: true)
+        }
+        self.entries[key] = topology
+    }
+    
+    func removeAll() {
+        self.entries.removeAll()
+    }
+}
@@ -169,6 +169,20 @@ public struct RenderPipelineDescriptor : Hashable {
     public var writeMasks : [ColorWriteMask]
     public var functionConstants : FunctionConstants? = nil
     
+    @usableFromInline var _fallbackDescriptor = [RenderPipelineDescriptor]() // An array since structs can't directly contain themselves.
+    
+    /// The pipeline to draw with while this pipeline is being compiled if `RenderBackend.pipelineCompilationMode` is `.asynchronous`.
+    /// The fallback's shaders must use a compatible resource layout. If `nil`, draws are skipped until this pipeline is ready.
+    @inlinable
+    public var fallbackDescriptor : RenderPipelineDescriptor? {
+        get {
+            return self._fallbackDescriptor.first
+        }
+        set {
+            self._fallbackDescriptor = newValue.map { [$0] } ?? []
+        }
+    }
+    
     @inlinable
     public mutating func setFunctionConstants<FC : FunctionConstantCodable>(_ functionConstants: FC) {
         self.functionConstants = try! FunctionConstants(functionConstants)
@@ -183,6 +197,22 @@ public struct RenderPipelineDescriptor : Hashable {
         hasher.combine(self.fragmentFunction)
         hasher.combine(self.label)
     }
+    
+    // The fallback is a hint for how to draw while the pipeline compiles rather than part of the pipeline's state,
+    // so pipelines that only differ in their fallbacks share a compiled pipeline.
+    @inlinable
+    public static func ==(lhs: RenderPipelineDescriptor, rhs: RenderPipelineDescriptor) -> Bool {
+        return lhs.label == rhs.label &&
+            lhs.vertexDescriptor == rhs.vertexDescriptor &&
+            lhs.vertexFunction == rhs.vertexFunction &&
+            lhs.fragmentFunction == rhs.fragmentFunction &&
+            lhs.isAlphaToCoverageEnabled == rhs.isAlphaToCoverageEnabled &&
+            lhs.isAlphaToOneEnabled == rhs.isAlphaToOneEnabled &&
+            lhs.isRasterizationEnabled == rhs.isRasterizationEnabled &&
+            lhs.blendStates == rhs.blendStates &&
+            lhs.writeMasks == rhs.writeMasks &&
+            lhs.functionConstants == rhs.functionConstants
+    }
 }
 
 public struct TypedComputePipelineDescriptor<R : RenderPassReflection> {
@@ -242,3 +272,29 @@ public struct ComputePipelineDescriptor : Hashable {
         self._functionConstants = functionConstants
     }
 }
+
+public enum PipelineCompilationMode {
+    /// Pipelines are compiled on the encoding thread when they're first used, stalling encoding until they're ready.
+    case synchronous
+    /// Pipelines are compiled in the background when they're first used. Until a pipeline is ready, draws that use it
+    /// are drawn with its `RenderPipelineDescriptor.fallbackDescriptor` or skipped if it has no fallback.
+    case asynchronous
+}
+
+/// A render pipeline to compile ahead of its first use, along with the render target and fixed-function state it will be used with.
+public struct RenderPipelinePrewarmDescriptor {
+    public var descriptor : RenderPipelineDescriptor
+    public var renderTarget : RenderTargetDescriptor
+    
+    public var depthStencil : DepthStencilDescriptor? = nil
+    public var primitiveType : PrimitiveType = .triangle
+    public var cullMode : CullMode = .none
+    public var fillMode : TriangleFillMode = .fill
+    public var depthClipMode : DepthClipMode = .clip
+    public var frontFaceWinding : Winding = .clockwise
+    
+    public init(descriptor: RenderPipelineDescriptor, renderTarget: RenderTargetDescriptor) {
+        self.descriptor = descriptor
+        self.renderTarget = renderTarget
+    }
+}
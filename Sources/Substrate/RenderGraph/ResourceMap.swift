@@ -258,17 +258,21 @@ public struct TransientResourceMap<R : ResourceProtocol, V> {
             return
         }
         
+        // Pipelined RenderGraphs alternate between two registries, so the map needs to cover the indices used in either.
+        let alternateRegistryIndex = TransientRegistryManager.alternateRegistryIndices[self.transientRegistryIndex]
+        let registryIndices = alternateRegistryIndex >= 0 ? [self.transientRegistryIndex, alternateRegistryIndex] : [self.transientRegistryIndex]
+        
         switch R.self {
         case is Buffer.Type:
-            self.count = Int.AtomicRepresentation.atomicLoad(at: TransientBufferRegistry.instances[self.transientRegistryIndex].count, ordering: .relaxed)
+            self.count = registryIndices.map { Int.AtomicRepresentation.atomicLoad(at: TransientBufferRegistry.instances[$0].count, ordering: .relaxed) }.max()!
         case is Texture.Type:
-            self.count = Int.AtomicRepresentation.atomicLoad(at: TransientTextureRegistry.instances[self.transientRegistryIndex].count, ordering: .relaxed)
+            self.count = registryIndices.map { Int.AtomicRepresentation.atomicLoad(at: TransientTextureRegistry.instances[$0].count, ordering: .relaxed) }.max()!
         case is ArgumentBuffer.Type:
-            let count = TransientArgumentBufferRegistry.instances[self.transientRegistryIndex].count
+            let count = registryIndices.map { TransientArgumentBufferRegistry.instances[$0].count }.max()!
             self.reserveCapacity(count)
             self.count = count
         case is ArgumentBufferArray.Type:
-            self.count = TransientArgumentBufferRegistry.instances[self.transientRegistryIndex].count
+            self.count = registryIndices.map { TransientArgumentBufferRegistry.instances[$0].count }.max()!
         case is Heap.Type:
             break
         default:
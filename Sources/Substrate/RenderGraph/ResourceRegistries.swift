@@ -18,7 +18,11 @@ final class TransientRegistryManager {
     public static let maxTransientRegistries = UInt8.bitWidth
     
     static var allocatedRegistries : UInt8 = 0
-    static var lock = SpinLock()
+    static var lock = SpinLock(name: "TransientRegistryManager")
+    
+    /// For each registry belonging to a pipelined RenderGraph, the index of the registry used on alternate frames, or -1.
+    /// Backend resource maps for one registry may also contain resources from its alternate.
+    static var alternateRegistryIndices = [Int](repeating: -1, count: maxTransientRegistries)
     
     public static func allocate() -> Int {
         return self.lock.withLock {
@@ -38,6 +42,13 @@ final class TransientRegistryManager {
         self.lock.withLock {
             assert(self.allocatedRegistries & (1 << index) != 0, "Registry index being disposed is not allocated.")
             self.allocatedRegistries &= ~(1 << index)
+            self.alternateRegistryIndices[index] = -1
+        }
+    }
+    
+    public static func setAlternateRegistry(_ alternateIndex: Int, for index: Int) {
+        self.lock.withLock {
+            self.alternateRegistryIndices[index] = alternateIndex
         }
     }
 }
@@ -367,6 +378,19 @@ class PersistentRegistry<Resource: ResourceProtocolImpl> {
         }
     }
     
+    /// Clears the usages recorded by the last RenderGraph execution, once its resource commands have been generated.
+    func clearUsages() {
+        self.lock.withLock {
+            let chunkCount = self.chunkCount
+            for chunkIndex in 0..<chunkCount {
+                let chunkItemCount = chunkIndex + 1 == chunkCount ? (self.nextFreeIndex % Resource.itemsPerChunk) : Resource.itemsPerChunk
+                self.sharedChunks[chunkIndex].usagesOptional?.assign(repeating: ChunkArray(), count: chunkItemCount)
+            }
+        }
+    }
+    
+    /// Marks the resources as no longer in use by `afterRenderGraph` once its execution has been submitted,
+    /// and disposes of any resources whose disposal was deferred until then.
     func clear(afterRenderGraph: RenderGraph) {
         self.lock.withLock {
             self.processEnqueuedDisposals()
@@ -376,8 +400,6 @@ class PersistentRegistry<Resource: ResourceProtocolImpl> {
             let chunkCount = self.chunkCount
             for chunkIndex in 0..<chunkCount {
                 let chunkItemCount = chunkIndex + 1 == chunkCount ? (self.nextFreeIndex % Resource.itemsPerChunk) : Resource.itemsPerChunk
-                self.sharedChunks[chunkIndex].usagesOptional?.assign(repeating: ChunkArray(), count: chunkItemCount)
-                
                 if let activeRenderGraphs = self.persistentChunks[chunkIndex].activeRenderGraphsOptional {
                     for i in 0..<chunkItemCount {
                         UInt8.AtomicRepresentation.atomicLoadThenBitwiseAnd(with: renderGraphInactiveMask, at: activeRenderGraphs.advanced(by: i), ordering: .relaxed)
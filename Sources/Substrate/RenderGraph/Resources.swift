@@ -583,8 +583,10 @@ extension Resource: CustomStringConvertible {
 }
 
 extension Resource : CustomHashable {
+    @inlinable
     public var customHashValue : Int {
-        return self.hashValue
+        // HashMap and HashSet mix the hash, so the handle can be used directly rather than going through Hasher.
+        return Int(bitPattern: self._handle)
     }
 }
 
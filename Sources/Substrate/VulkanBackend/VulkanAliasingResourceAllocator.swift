@@ -0,0 +1,308 @@
+//
+//  VulkanAliasingResourceAllocator.swift
+//  Substrate
+//
+
+#if canImport(Vulkan)
+import Vulkan
+import SubstrateUtilities
+import SubstrateCExtras
+
+/// A block of device memory that transient resources are bound into at planned offsets.
+final class VulkanAliasingMemoryBlock {
+    let allocator : VmaAllocator
+    let allocation : VmaAllocation
+    let allocationInfo : VmaAllocationInfo
+    let size : Int
+    
+    init(allocator: VmaAllocator, size: Int, alignment: Int, memoryTypeBits: UInt32) {
+        self.allocator = allocator
+        self.size = size
+        
+        var requirements = VkMemoryRequirements(size: VkDeviceSize(size), alignment: VkDeviceSize(alignment), memoryTypeBits: memoryTypeBits)
+        var allocInfo = VmaAllocationCreateInfo(storageMode: .private, cacheMode: .defaultCache)
+        var allocation : VmaAllocation? = nil
+        var allocationInfo = VmaAllocationInfo()
+        vmaAllocateMemory(allocator, &requirements, &allocInfo, &allocation, &allocationInfo).check()
+        
+        self.allocation = allocation!
+        self.allocationInfo = allocationInfo
+    }
+    
+    deinit {
+        vmaFreeMemory(self.allocator, self.allocation)
+    }
+}
+
+/// Places private transient resources into shared memory blocks according to a `TransientAliasingPlan`,
+/// so that resources whose lifetimes within a frame don't overlap can share memory.
+///
+/// Unlike `VulkanPoolResourceAllocator`, resources are made available for reuse within the frame; the hazards between
+/// resources that share memory are tracked through the fences returned from `collectImage(for:)` and `collectBuffer(for:)`.
+final class VulkanAliasingResourceAllocator : VulkanResourceAllocator {
+
+    enum PlannedResource {
+        case image(VulkanImageDescriptor)
+        case buffer(VulkanBufferDescriptor)
+    }
+    
+    struct Statistics {
+        var resourceCount = 0
+        /// The memory that would have been required without aliasing.
+        var unaliasedSize = 0
+        /// The memory actually required by this frame's resources.
+        var aliasedSize = 0
+    }
+    
+    private struct BoundResource {
+        var image : VulkanImage?
+        var buffer : VulkanBuffer?
+        var memoryClass : Int
+        var offset : Int
+        
+        var object : AnyObject {
+            return self.image ?? self.buffer!
+        }
+    }
+    
+    private struct FrameAllocation {
+        var resource : BoundResource
+        var fences : [FenceDependency]
+        /// Whether another resource this frame occupies some of the same memory.
+        var isShared : Bool
+    }
+    
+    static let maxCachedRequirementsCount = 256
+    
+    let device : VulkanDevice
+    let allocator : VmaAllocator
+    let numFrames : Int
+    
+    /// The memory blocks for each in-flight frame, keyed by memory class.
+    private var blocks : [[Int : VulkanAliasingMemoryBlock]]
+    /// The resources bound into each in-flight frame's blocks, which can be reused if the next plan places the same resource at the same offset.
+    private var boundResources : [[BoundResource]]
+    private var waitEvents : [ContextWaitEvent]
+    private var nextFrameWaitEvent = ContextWaitEvent()
+    
+    private var frameAllocations = [Resource : FrameAllocation]()
+    private var frameResources = [BoundResource]()
+    
+    private var imageRequirements = [(VulkanImageDescriptor, VkMemoryRequirements)]()
+    private var bufferRequirements = [(VulkanBufferDescriptor, VkMemoryRequirements)]()
+    
+    private var currentIndex = 0
+    
+    private(set) var lastFrameStatistics = Statistics()
+    
+    init(device: VulkanDevice, allocator: VmaAllocator, numFrames: Int) {
+        self.device = device
+        self.allocator = allocator
+        self.numFrames = numFrames
+        self.blocks = [[Int : VulkanAliasingMemoryBlock]](repeating: [:], count: numFrames)
+        self.boundResources = [[BoundResource]](repeating: [], count: numFrames)
+        self.waitEvents = [ContextWaitEvent](repeating: ContextWaitEvent(), count: numFrames)
+    }
+    
+    /// Releases `object` once all commands submitted so far have completed.
+    private func releaseAfterSubmittedCommands(_ object: AnyObject) {
+        CommandEndActionManager.manager.enqueue(action: .release(Unmanaged.passRetained(object)))
+    }
+    
+    private func memoryRequirements(for descriptor: VulkanImageDescriptor) -> VkMemoryRequirements {
+        if let cached = self.imageRequirements.first(where: { $0.0 == descriptor }) {
+            return cached.1
+        }
+        
+        var image : VkImage? = nil
+        descriptor.withImageCreateInfo(device: self.device) { info in
+            var info = info
+            vkCreateImage(self.device.vkDevice, &info, nil, &image).check()
+        }
+        var requirements = VkMemoryRequirements()
+        vkGetImageMemoryRequirements(self.device.vkDevice, image!, &requirements)
+        vkDestroyImage(self.device.vkDevice, image!, nil)
+        
+        if self.imageRequirements.count >= VulkanAliasingResourceAllocator.maxCachedRequirementsCount {
+            self.imageRequirements.removeAll(keepingCapacity: true)
+        }
+        self.imageRequirements.append((descriptor, requirements))
+        return requirements
+    }
+    
+    private func memoryRequirements(for descriptor: VulkanBufferDescriptor) -> VkMemoryRequirements {
+        if let cached = self.bufferRequirements.first(where: { $0.0 == descriptor }) {
+            return cached.1
+        }
+        
+        var buffer : VkBuffer? = nil
+        descriptor.withBufferCreateInfo(device: self.device) { info in
+            var info = info
+            vkCreateBuffer(self.device.vkDevice, &info, nil, &buffer).check()
+        }
+        var requirements = VkMemoryRequirements()
+        vkGetBufferMemoryRequirements(self.device.vkDevice, buffer!, &requirements)
+        vkDestroyBuffer(self.device.vkDevice, buffer!, nil)
+        
+        if self.bufferRequirements.count >= VulkanAliasingResourceAllocator.maxCachedRequirementsCount {
+            self.bufferRequirements.removeAll(keepingCapacity: true)
+        }
+        self.bufferRequirements.append((descriptor, requirements))
+        return requirements
+    }
+    
+    private func block(memoryClass: Int, size: Int, alignment: Int) -> VulkanAliasingMemoryBlock {
+        if let block = self.blocks[self.currentIndex][memoryClass], block.size >= size {
+            return block
+        }
+        
+        if let block = self.blocks[self.currentIndex].removeValue(forKey: memoryClass) {
+            self.releaseAfterSubmittedCommands(block)
+            
+            // Any resources bound to the old block can't be reused.
+            var i = 0
+            while i < self.boundResources[self.currentIndex].count {
+                if self.boundResources[self.currentIndex][i].memoryClass == memoryClass {
+                    let resource = self.boundResources[self.currentIndex].remove(at: i, preservingOrder: false)
+                    self.releaseAfterSubmittedCommands(resource.object)
+                } else {
+                    i += 1
+                }
+            }
+        }
+        
+        // Buffers and images are kept in separate classes, so the low bit of the memory class doesn't contribute to the memory type bits.
+        let block = VulkanAliasingMemoryBlock(allocator: self.allocator, size: size, alignment: alignment, memoryTypeBits: UInt32(truncatingIfNeeded: memoryClass >> 1))
+        self.blocks[self.currentIndex][memoryClass] = block
+        return block
+    }
+    
+    private func takeBoundResource(memoryClass: Int, offset: Int, where matches: (BoundResource) -> Bool) -> BoundResource? {
+        guard let index = self.boundResources[self.currentIndex].firstIndex(where: { $0.memoryClass == memoryClass && $0.offset == offset && matches($0) }) else {
+            return nil
+        }
+        return self.boundResources[self.currentIndex].remove(at: index, preservingOrder: false)
+    }
+    
+    /// Plans the placement of this frame's aliased resources and binds them to memory.
+    /// - Parameter resources: the resources to place, in the same order as `lifetimes`.
+    /// - Parameter disposalFences: returns the fences that must be waited on before a resource's memory can be reused.
+    func planFrame(resources: [PlannedResource], lifetimes: [TransientResourceLifetime], disposalFences: (Resource) -> [FenceDependency]) {
+        assert(self.frameAllocations.isEmpty)
+        
+        let requirements = resources.map { resource -> TransientMemoryRequirements in
+            switch resource {
+            case .image(let descriptor):
+                let requirements = self.memoryRequirements(for: descriptor)
+                return TransientMemoryRequirements(size: Int(requirements.size), alignment: Int(requirements.alignment), memoryClass: Int(requirements.memoryTypeBits) << 1)
+            case .buffer(let descriptor):
+                // Keeping buffers and images in separate blocks means we don't need to respect bufferImageGranularity.
+                let requirements = self.memoryRequirements(for: descriptor)
+                return TransientMemoryRequirements(size: Int(requirements.size), alignment: Int(requirements.alignment), memoryClass: Int(requirements.memoryTypeBits) << 1 | 1)
+            }
+        }
+        
+        let plan = TransientAliasingPlanner.makePlan(lifetimes: lifetimes, requirements: requirements)
+        
+        let blocks = plan.blocks.map { self.block(memoryClass: $0.memoryClass, size: $0.size, alignment: $0.alignment) }
+        
+        for (i, resource) in resources.enumerated() {
+            let placement = plan.placements[i]
+            let memoryClass = plan.blocks[placement.blockIndex].memoryClass
+            let block = blocks[placement.blockIndex]
+            
+            let boundResource : BoundResource
+            switch resource {
+            case .image(let descriptor):
+                if let cached = self.takeBoundResource(memoryClass: memoryClass, offset: placement.offset, where: { $0.image?.descriptor == descriptor }) {
+                    boundResource = cached
+                } else {
+                    var image : VkImage? = nil
+                    descriptor.withImageCreateInfo(device: self.device) { info in
+                        var info = info
+                        vkCreateImage(self.device.vkDevice, &info, nil, &image).check()
+                    }
+                    vmaBindImageMemory2(self.allocator, block.allocation, VkDeviceSize(placement.offset), image!, nil).check()
+                    
+                    let vulkanImage = VulkanImage(device: self.device, image: image!, allocator: nil, allocation: nil, descriptor: descriptor)
+                    boundResource = BoundResource(image: vulkanImage, buffer: nil, memoryClass: memoryClass, offset: placement.offset)
+                }
+            case .buffer(let descriptor):
+                if let cached = self.takeBoundResource(memoryClass: memoryClass, offset: placement.offset, where: { $0.buffer?.descriptor == descriptor }) {
+                    boundResource = cached
+                } else {
+                    var buffer : VkBuffer? = nil
+                    descriptor.withBufferCreateInfo(device: self.device) { info in
+                        var info = info
+                        vkCreateBuffer(self.device.vkDevice, &info, nil, &buffer).check()
+                    }
+                    vmaBindBufferMemory2(self.allocator, block.allocation, VkDeviceSize(placement.offset), buffer!, nil).check()
+                    
+                    let vulkanBuffer = VulkanBuffer(device: self.device, buffer: buffer!, allocator: self.allocator, allocation: nil, allocationInfo: block.allocationInfo, descriptor: descriptor)
+                    boundResource = BoundResource(image: nil, buffer: vulkanBuffer, memoryClass: memoryClass, offset: placement.offset)
+                }
+            }
+            
+            var fences = [FenceDependency]()
+            for predecessor in plan.predecessors[i] {
+                fences.append(contentsOf: disposalFences(lifetimes[predecessor].resource))
+            }
+            
+            self.frameAllocations[lifetimes[i].resource] = FrameAllocation(resource: boundResource, fences: fences, isShared: plan.isShared[i])
+            self.frameResources.append(boundResource)
+        }
+        
+        // Anything that wasn't reused this frame is no longer needed.
+        for resource in self.boundResources[self.currentIndex] {
+            self.releaseAfterSubmittedCommands(resource.object)
+        }
+        self.boundResources[self.currentIndex].removeAll(keepingCapacity: true)
+        
+        self.lastFrameStatistics = Statistics(resourceCount: resources.count, unaliasedSize: plan.unaliasedSize, aliasedSize: plan.aliasedSize)
+    }
+    
+    func collectImage(for resource: Resource) -> (VkImageReference, [FenceDependency], ContextWaitEvent)? {
+        guard let allocation = self.frameAllocations[resource], let image = allocation.resource.image else { return nil }
+        return (VkImageReference(image: Unmanaged.passUnretained(image)), allocation.fences, self.waitEvents[self.currentIndex])
+    }
+    
+    func collectBuffer(for resource: Resource) -> (VkBufferReference, [FenceDependency], ContextWaitEvent)? {
+        guard let allocation = self.frameAllocations[resource], let buffer = allocation.resource.buffer else { return nil }
+        return (VkBufferReference(buffer: Unmanaged.passUnretained(buffer), offset: 0), allocation.fences, self.waitEvents[self.currentIndex])
+    }
+    
+    /// Whether `resource` was placed in memory that another resource also occupies this frame.
+    func isAliased(_ resource: Resource) -> Bool {
+        return self.frameAllocations[resource]?.isShared ?? false
+    }
+    
+    /// Returns false if `resource` wasn't allocated by this allocator.
+    func deposit(_ resource: Resource, waitEvent: ContextWaitEvent) -> Bool {
+        guard self.frameAllocations.removeValue(forKey: resource) != nil else { return false }
+        
+        if self.nextFrameWaitEvent.waitValue < waitEvent.waitValue {
+            self.nextFrameWaitEvent = waitEvent
+        } else {
+            self.nextFrameWaitEvent.afterStages.formUnion(waitEvent.afterStages)
+        }
+        return true
+    }
+    
+    func cycleFrames() {
+        assert(self.frameAllocations.isEmpty)
+        self.frameAllocations.removeAll(keepingCapacity: true)
+        
+        if !self.frameResources.isEmpty {
+            // planFrame has already released any resources from this frame's previous use that weren't reused.
+            self.boundResources[self.currentIndex].append(contentsOf: self.frameResources)
+            self.frameResources.removeAll(keepingCapacity: true)
+            
+            self.waitEvents[self.currentIndex] = self.nextFrameWaitEvent
+            self.nextFrameWaitEvent = ContextWaitEvent()
+        }
+        
+        self.currentIndex = (self.currentIndex + 1) % self.numFrames
+    }
+}
+
+#endif // canImport(Vulkan)
@@ -45,7 +45,7 @@ final class VulkanBackend : SpecificRenderBackend {
     
     var queueSyncSemaphores = [VkSemaphore?](repeating: nil, count: QueueRegistry.maxQueues)
     
-    public init(instance: VulkanInstance, shaderLibraryURL: URL) {
+    public init(instance: VulkanInstance, shaderLibraryURL: URL, pipelineCacheURL: URL?) {
         self.vulkanInstance = instance
         let physicalDevice = self.vulkanInstance.createSystemDefaultDevice()!
         
@@ -53,7 +53,7 @@ final class VulkanBackend : SpecificRenderBackend {
         
         self.resourceRegistry = VulkanPersistentResourceRegistry(instance: instance, device: self.device)
         self.shaderLibrary = try! VulkanShaderLibrary(device: self.device, url: shaderLibraryURL)
-        self.stateCaches = VulkanStateCaches(device: self.device, shaderLibrary: self.shaderLibrary)
+        self.stateCaches = VulkanStateCaches(device: self.device, shaderLibrary: self.shaderLibrary, pipelineCacheURL: pipelineCacheURL)
         
         RenderBackend._backend = self
     }
@@ -68,6 +68,12 @@ final class VulkanBackend : SpecificRenderBackend {
         self.activeContext = context
     }
     
+    func didCompleteCommand(_ index: UInt64, queue: Queue, context: RenderGraphContextImpl<VulkanBackend>) {
+        // Pipelined frames are encoded after the context is deactivated, so wait until the frame has completed
+        // to make sure that the pipelines it created are included.
+        self.stateCaches.savePipelineCacheIfNeeded()
+    }
+    
     public func materialisePersistentTexture(_ texture: Texture) -> Bool {
         return resourceRegistry.accessLock.withWriteLock {
             return self.resourceRegistry.allocateTexture(texture) != nil
@@ -137,6 +143,10 @@ final class VulkanBackend : SpecificRenderBackend {
     public var requiresEmulatedInputAttachments: Bool {
         return false
     }
+    
+    public var supportsIndirectFirstInstance: Bool {
+        return self.device.supportsDrawIndirectFirstInstance
+    }
 
     public var supportsMemorylessAttachments: Bool {
         return false
@@ -156,6 +166,27 @@ final class VulkanBackend : SpecificRenderBackend {
         return self.stateCaches.reflection(for: descriptor)
     }
     
+    func prewarmPipelines(renderPipelines: [RenderPipelinePrewarmDescriptor], computePipelines: [ComputePipelineDescriptor], completion: (() -> Void)?) {
+        self.stateCaches.prewarmPipelines(renderPipelines: renderPipelines, computePipelines: computePipelines, completion: completion)
+    }
+    
+    func savePipelineCache() {
+        self.stateCaches.savePipelineCache()
+    }
+    
+    var pipelineCompilationMode: PipelineCompilationMode {
+        get {
+            return self.stateCaches.pipelineCompilationMode
+        }
+        set {
+            self.stateCaches.pipelineCompilationMode = newValue
+        }
+    }
+    
+    func notifyWhenPendingPipelinesCompiled(_ handler: @escaping () -> Void) {
+        self.stateCaches.notifyWhenPendingPipelinesCompiled(handler)
+    }
+    
     @usableFromInline
     var pushConstantPath: ResourceBindingPath {
         return ResourceBindingPath.pushConstantPath
@@ -288,21 +319,14 @@ final class VulkanBackend : SpecificRenderBackend {
         return VulkanQueue(backend: self, device: self.device)
     }
     
+    var supportsAsyncCompute: Bool {
+        return self.device.asyncComputeQueue != nil
+    }
+    
     func makeSyncEvent(for queue: Queue) -> Event {
-        var semaphoreTypeCreateInfo = VkSemaphoreTypeCreateInfo()
-        semaphoreTypeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO
-        semaphoreTypeCreateInfo.initialValue = 0
-        semaphoreTypeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE
-        
-        var semaphore: VkSemaphore? = nil
-        withUnsafePointer(to: semaphoreTypeCreateInfo) { semaphoreTypeCreateInfo in
-            var semaphoreCreateInfo = VkSemaphoreCreateInfo()
-            semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO
-            semaphoreCreateInfo.pNext = UnsafeRawPointer(semaphoreTypeCreateInfo)
-            vkCreateSemaphore(self.device.vkDevice, &semaphoreCreateInfo, nil, &semaphore)
-        }
+        let semaphore = self.device.makeTimelineSemaphore()
         self.queueSyncSemaphores[Int(queue.index)] = semaphore
-        return semaphore!
+        return semaphore
     }
     
     func syncEvent(for queue: Queue) -> VkSemaphore? {
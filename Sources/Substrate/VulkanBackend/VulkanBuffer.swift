@@ -59,13 +59,14 @@ class VulkanBuffer {
     let device : VulkanDevice
     let vkBuffer : VkBuffer
     let allocator : VmaAllocator
-    let allocation : VmaAllocation
+    /// nil if the buffer is bound to memory owned by another object, such as an aliasing memory block.
+    let allocation : VmaAllocation?
     let allocationInfo : VmaAllocationInfo
     let descriptor : VulkanBufferDescriptor
     
     var label : String? = nil
 
-    init(device: VulkanDevice, buffer: VkBuffer, allocator: VmaAllocator, allocation: VmaAllocation, allocationInfo: VmaAllocationInfo, descriptor: VulkanBufferDescriptor) {
+    init(device: VulkanDevice, buffer: VkBuffer, allocator: VmaAllocator, allocation: VmaAllocation?, allocationInfo: VmaAllocationInfo, descriptor: VulkanBufferDescriptor) {
         self.device = device
         self.vkBuffer = buffer
         self.allocator = allocator
@@ -101,7 +102,11 @@ class VulkanBuffer {
     }
     
     deinit {
-        vmaDestroyBuffer(self.allocator, self.vkBuffer, self.allocation)
+        if let allocation = self.allocation {
+            vmaDestroyBuffer(self.allocator, self.vkBuffer, allocation)
+        } else {
+            vkDestroyBuffer(self.device.vkDevice, self.vkBuffer, nil)
+        }
     }
 }
 
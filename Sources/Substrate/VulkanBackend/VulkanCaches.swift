@@ -8,28 +8,58 @@
 #if canImport(Vulkan)
 import Vulkan
 import SubstrateCExtras
+import SubstrateUtilities
+import Foundation
 
 final class VulkanStateCaches {
+    /// The minimum number of seconds between periodic saves of the pipeline cache.
+    static let pipelineCacheSaveInterval = 30.0
+    
     let device: VulkanDevice
     let shaderLibrary : VulkanShaderLibrary
+    let pipelineCacheURL : URL?
     
+    /// Guards the cached states, since pipelines may be pre-warmed on background threads while frames are encoded.
+    private let accessLock = SpinLock()
     private var vertexInputStates = [VertexDescriptor : VertexInputStateCreateInfo]()
     private var functionSpecialisationStates = [FunctionConstants : SpecialisationInfo]()
     private var currentPipelineReflection : VulkanPipelineReflection? = nil
     private var renderPipelines = [VulkanRenderPipelineDescriptor : VkPipeline?]()
     private var computePipelines = [VulkanComputePipelineDescriptor : VkPipeline?]()
     
+    var pipelineCompilationMode = PipelineCompilationMode.synchronous
+    private let pipelineCompilationQueue = DispatchQueue(label: "Vulkan Pipeline Compilation Queue", qos: .userInitiated, attributes: .concurrent)
+    private var pendingRenderPipelines = Set<VulkanRenderPipelineDescriptor>()
+    private var pendingPipelinesCompiledHandlers = [() -> Void]()
+    
     public let pipelineCache : VkPipelineCache
+    private let pipelineCacheSaveQueue = DispatchQueue(label: "Vulkan Pipeline Cache Save Queue", qos: .utility)
+    private var pipelinesCreatedSinceSave = 0
+    private var lastPipelineCacheSaveTime = DispatchTime.now()
     
-    public init(device: VulkanDevice, shaderLibrary: VulkanShaderLibrary) {
+    /// - Parameter pipelineCacheURL: the file to load the pipeline cache from and save it to, or `nil` if the pipeline cache shouldn't persist between launches.
+    public init(device: VulkanDevice, shaderLibrary: VulkanShaderLibrary, pipelineCacheURL: URL?) {
         self.device = device
+        self.pipelineCacheURL = pipelineCacheURL
         
         do {
             var cacheCreateInfo = VkPipelineCacheCreateInfo()
             cacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO
             
             var cache : VkPipelineCache? = nil
-            vkCreatePipelineCache(self.device.vkDevice, &cacheCreateInfo, nil, &cache)
+            if let initialData = pipelineCacheURL.flatMap({ VulkanStateCaches.loadPipelineCacheData(from: $0, device: device) }) {
+                initialData.withUnsafeBytes { initialData in
+                    cacheCreateInfo.initialDataSize = initialData.count
+                    cacheCreateInfo.pInitialData = initialData.baseAddress
+                    vkCreatePipelineCache(self.device.vkDevice, &cacheCreateInfo, nil, &cache)
+                }
+                cacheCreateInfo.initialDataSize = 0
+                cacheCreateInfo.pInitialData = nil
+            }
+            
+            if cache == nil {
+                vkCreatePipelineCache(self.device.vkDevice, &cacheCreateInfo, nil, &cache)
+            }
             
             self.pipelineCache = cache!
         }
@@ -38,12 +68,102 @@ final class VulkanStateCaches {
     }
     
     deinit {
+        self.savePipelineCache()
         vkDestroyPipelineCache(self.device.vkDevice, self.pipelineCache, nil)
+        self.accessLock.deinit()
+    }
+    
+    /// Returns the contents of the pipeline cache file at `url` if it was created by the same device and driver.
+    static func loadPipelineCacheData(from url: URL, device: VulkanDevice) -> Data? {
+        guard let data = try? Data(contentsOf: url) else { return nil }
+        
+        var properties = VkPhysicalDeviceProperties()
+        vkGetPhysicalDeviceProperties(device.physicalDevice.vkDevice, &properties)
+        
+        // The data starts with a VkPipelineCacheHeaderVersionOne: the header size, header version, vendor ID, and device ID
+        // as 32-bit integers, followed by the pipeline cache UUID, which identifies the driver build.
+        let isCompatible = data.withUnsafeBytes { bytes -> Bool in
+            return withUnsafeBytes(of: properties.pipelineCacheUUID) { uuid -> Bool in
+                var header : (headerSize: UInt32, headerVersion: UInt32, vendorID: UInt32, deviceID: UInt32) = (0, 0, 0, 0)
+                let uuidOffset = MemoryLayout.size(ofValue: header)
+                guard bytes.count >= uuidOffset + uuid.count else { return false }
+                
+                withUnsafeMutableBytes(of: &header) { $0.copyMemory(from: UnsafeRawBufferPointer(rebasing: bytes[0..<uuidOffset])) }
+                
+                return Int(header.headerSize) >= uuidOffset + uuid.count &&
+                    header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE.rawValue &&
+                    header.vendorID == properties.vendorID &&
+                    header.deviceID == properties.deviceID &&
+                    uuid.elementsEqual(bytes[uuidOffset..<(uuidOffset + uuid.count)])
+            }
+        }
+        
+        guard isCompatible else {
+            print("VulkanStateCaches: ignoring the pipeline cache at \(url.path) since it was created by a different device or driver.")
+            return nil
+        }
+        return data
+    }
+    
+    private func writePipelineCache() {
+        guard let url = self.pipelineCacheURL else { return }
+        
+        let hasNewPipelines = self.accessLock.withLock { () -> Bool in
+            defer {
+                self.pipelinesCreatedSinceSave = 0
+                self.lastPipelineCacheSaveTime = DispatchTime.now()
+            }
+            return self.pipelinesCreatedSinceSave > 0
+        }
+        guard hasNewPipelines else { return }
+        
+        var dataSize = 0
+        guard vkGetPipelineCacheData(self.device.vkDevice, self.pipelineCache, &dataSize, nil) == VK_SUCCESS, dataSize > 0 else { return }
+        
+        var data = Data(count: dataSize)
+        let result = data.withUnsafeMutableBytes { data in
+            return vkGetPipelineCacheData(self.device.vkDevice, self.pipelineCache, &dataSize, data.baseAddress)
+        }
+        guard result == VK_SUCCESS else { return }
+        data.count = dataSize
+        
+        do {
+            try FileManager.default.createDirectory(at: url.deletingLastPathComponent(), withIntermediateDirectories: true, attributes: nil)
+            try data.write(to: url, options: .atomic)
+        } catch {
+            print("VulkanStateCaches: failed to write the pipeline cache to \(url.path): \(error)")
+        }
+    }
+    
+    /// Writes the pipeline cache to disk if any pipelines have been created since it was last saved.
+    func savePipelineCache() {
+        self.pipelineCacheSaveQueue.sync {
+            self.writePipelineCache()
+        }
+    }
+    
+    /// Saves the pipeline cache in the background if pipelines have been created and it hasn't been saved within the last `pipelineCacheSaveInterval` seconds.
+    func savePipelineCacheIfNeeded() {
+        guard self.pipelineCacheURL != nil else { return }
+        
+        let shouldSave = self.accessLock.withLock {
+            return self.pipelinesCreatedSinceSave > 0 &&
+                DispatchTime.now().uptimeNanoseconds - self.lastPipelineCacheSaveTime.uptimeNanoseconds >= UInt64(VulkanStateCaches.pipelineCacheSaveInterval * 1e9)
+        }
+        guard shouldSave else { return }
+        
+        self.pipelineCacheSaveQueue.async {
+            self.writePipelineCache()
+        }
     }
     
     public subscript(pipelineDescriptor: VulkanRenderPipelineDescriptor, 
                      renderPass renderPass: VulkanRenderPass) -> VkPipeline? {
-        if let pipeline = self.renderPipelines[pipelineDescriptor] {
+        return self.renderPipeline(for: pipelineDescriptor, renderPass: renderPass.vkPass)
+    }
+    
+    func renderPipeline(for pipelineDescriptor: VulkanRenderPipelineDescriptor, renderPass: VkRenderPass) -> VkPipeline? {
+        if let pipeline = self.accessLock.withLock({ self.renderPipelines[pipelineDescriptor] }) {
             return pipeline
         }
 
@@ -53,13 +173,86 @@ final class VulkanStateCaches {
         pipelineDescriptor.withVulkanPipelineCreateInfo(renderPass: renderPass, stateCaches: self) { createInfo in
             vkCreateGraphicsPipelines(self.device.vkDevice, self.pipelineCache, 1, &createInfo, nil, &pipeline).check()
         }
-        self.renderPipelines[pipelineDescriptor] = pipeline
+        
+        let existingPipeline = self.accessLock.withLock { () -> VkPipeline?? in
+            if let existingPipeline = self.renderPipelines[pipelineDescriptor] {
+                return existingPipeline
+            }
+            self.renderPipelines[pipelineDescriptor] = pipeline
+            self.pipelinesCreatedSinceSave += 1
+            return nil
+        }
+        
+        if let existingPipeline = existingPipeline {
+            // Another thread created the same pipeline concurrently.
+            vkDestroyPipeline(self.device.vkDevice, pipeline, nil)
+            return existingPipeline
+        }
 
         return pipeline
     }
 
+    /// Returns the pipeline to draw with for `pipelineDescriptor`, and whether the draw has been deferred because the pipeline is being compiled in the background.
+    /// A deferred draw uses the pipeline for the descriptor's `fallbackDescriptor`, or should be skipped if the returned pipeline is `nil`.
+    func renderPipelineForDraw(_ pipelineDescriptor: VulkanRenderPipelineDescriptor, renderPass: VkRenderPass) -> (pipeline: VkPipeline?, isDeferred: Bool) {
+        guard self.pipelineCompilationMode == .asynchronous else {
+            return (self.renderPipeline(for: pipelineDescriptor, renderPass: renderPass), false)
+        }
+        
+        let (existingPipeline, needsCompilation) = self.accessLock.withLock { () -> (VkPipeline??, Bool) in
+            if let pipeline = self.renderPipelines[pipelineDescriptor] {
+                return (pipeline, false)
+            }
+            return (nil, self.pendingRenderPipelines.insert(pipelineDescriptor).inserted)
+        }
+        
+        if let pipeline = existingPipeline {
+            return (pipeline, false)
+        }
+        
+        if needsCompilation {
+            self.pipelineCompilationQueue.async {
+                // The frame's render pass may be destroyed before compilation finishes, so compile against a compatible render pass we own.
+                if let renderPass = pipelineDescriptor.compatibleRenderPass.makeVkRenderPass(device: self.device) {
+                    _ = self.renderPipeline(for: pipelineDescriptor, renderPass: renderPass)
+                    vkDestroyRenderPass(self.device.vkDevice, renderPass, nil)
+                }
+                
+                let handlers = self.accessLock.withLock { () -> [() -> Void] in
+                    self.pendingRenderPipelines.remove(pipelineDescriptor)
+                    guard self.pendingRenderPipelines.isEmpty else { return [] }
+                    defer { self.pendingPipelinesCompiledHandlers.removeAll() }
+                    return self.pendingPipelinesCompiledHandlers
+                }
+                handlers.forEach { $0() }
+            }
+        }
+        
+        guard let fallbackDescriptor = pipelineDescriptor.descriptor.fallbackDescriptor else {
+            return (nil, true)
+        }
+        
+        var fallbackPipelineDescriptor = pipelineDescriptor
+        fallbackPipelineDescriptor.descriptor = fallbackDescriptor
+        return (self.renderPipeline(for: fallbackPipelineDescriptor, renderPass: renderPass), true)
+    }
+    
+    /// Calls `handler` on an arbitrary thread once there are no render pipelines being compiled in the background.
+    func notifyWhenPendingPipelinesCompiled(_ handler: @escaping () -> Void) {
+        let hasPendingPipelines = self.accessLock.withLock { () -> Bool in
+            if self.pendingRenderPipelines.isEmpty {
+                return false
+            }
+            self.pendingPipelinesCompiledHandlers.append(handler)
+            return true
+        }
+        if !hasPendingPipelines {
+            handler()
+        }
+    }
+
     public subscript(pipelineDescriptor: VulkanComputePipelineDescriptor, pipelineReflection pipelineReflection: VulkanPipelineReflection) -> VkPipeline? {
-        if let pipeline = self.computePipelines[pipelineDescriptor] {
+        if let pipeline = self.accessLock.withLock({ self.computePipelines[pipelineDescriptor] }) {
             return pipeline
         }
 
@@ -70,25 +263,86 @@ final class VulkanStateCaches {
             vkCreateComputePipelines(self.device.vkDevice, self.pipelineCache, 1, &createInfo, nil, &pipeline).check()
         }
         
-        self.computePipelines[pipelineDescriptor] = pipeline
+        let existingPipeline = self.accessLock.withLock { () -> VkPipeline?? in
+            if let existingPipeline = self.computePipelines[pipelineDescriptor] {
+                return existingPipeline
+            }
+            self.computePipelines[pipelineDescriptor] = pipeline
+            self.pipelinesCreatedSinceSave += 1
+            return nil
+        }
+        
+        if let existingPipeline = existingPipeline {
+            // Another thread created the same pipeline concurrently.
+            vkDestroyPipeline(self.device.vkDevice, pipeline, nil)
+            return existingPipeline
+        }
 
         return pipeline
     }
-
+    
+    /// Compiles the given pipelines on background threads, calling `completion` once they've all been compiled.
+    ///
+    /// The render passes used within a frame may not exactly match the ones used here,
+    /// in which case the pipelines are created again on first use; however, that creation is then a hit in `pipelineCache`.
+    func prewarmPipelines(renderPipelines: [RenderPipelinePrewarmDescriptor], computePipelines: [ComputePipelineDescriptor], completion: (() -> Void)?) {
+        DispatchQueue.global(qos: .utility).async {
+            DispatchQueue.concurrentPerform(iterations: renderPipelines.count + computePipelines.count) { i in
+                if i < renderPipelines.count {
+                    self.prewarmRenderPipeline(renderPipelines[i])
+                } else {
+                    self.prewarmComputePipeline(computePipelines[i - renderPipelines.count])
+                }
+            }
+            
+            self.savePipelineCache()
+            completion?()
+        }
+    }
+    
+    private func prewarmRenderPipeline(_ prewarmDescriptor: RenderPipelinePrewarmDescriptor) {
+        let compatibleRenderPass = VulkanCompatibleRenderPass(renderTargetDescriptor: prewarmDescriptor.renderTarget)
+        guard let renderPass = compatibleRenderPass.makeVkRenderPass(device: self.device) else { return }
+        defer { vkDestroyRenderPass(self.device.vkDevice, renderPass, nil) }
+        
+        var pipelineDescriptor = VulkanRenderPipelineDescriptor(shaderLibrary: self.shaderLibrary, compatibleRenderPass: compatibleRenderPass)
+        pipelineDescriptor.descriptor = prewarmDescriptor.descriptor
+        pipelineDescriptor.depthStencil = prewarmDescriptor.depthStencil
+        pipelineDescriptor.primitiveType = prewarmDescriptor.primitiveType
+        pipelineDescriptor.cullMode = prewarmDescriptor.cullMode
+        pipelineDescriptor.fillMode = prewarmDescriptor.fillMode
+        pipelineDescriptor.depthClipMode = prewarmDescriptor.depthClipMode
+        pipelineDescriptor.frontFaceWinding = prewarmDescriptor.frontFaceWinding
+        
+        _ = self.renderPipeline(for: pipelineDescriptor, renderPass: renderPass)
+    }
+    
+    private func prewarmComputePipeline(_ descriptor: ComputePipelineDescriptor) {
+        let key = PipelineLayoutKey.compute(descriptor.function)
+        // The thread group size isn't part of the pipeline's identity, so this matches any dispatch size.
+        let pipelineDescriptor = VulkanComputePipelineDescriptor(descriptor: descriptor,
+                                                                 layout: self.shaderLibrary.pipelineLayout(for: key),
+                                                                 threadsPerThreadgroup: Size(width: 0, height: 0, depth: 0))
+        _ = self[pipelineDescriptor, pipelineReflection: self.shaderLibrary.reflection(for: key)]
+    }
 
     public subscript(functionConstants: FunctionConstants?, pipelineReflection pipelineReflection: VulkanPipelineReflection) -> SpecialisationInfo? {
         guard let functionConstants = functionConstants else {
             return nil
         }
         
-        if let state = self.functionSpecialisationStates[functionConstants] {
+        if let state = self.accessLock.withLock({ self.functionSpecialisationStates[functionConstants] }) {
             return state
         }
         
         let info = SpecialisationInfo(functionConstants, constantIndices: pipelineReflection.specialisations)
-        self.functionSpecialisationStates[functionConstants] = info
-        
-        return info
+        return self.accessLock.withLock {
+            if let state = self.functionSpecialisationStates[functionConstants] {
+                return state
+            }
+            self.functionSpecialisationStates[functionConstants] = info
+            return info
+        }
     }
     
     private let defaultVertexInputStateCreateInfo : VertexInputStateCreateInfo = {
@@ -101,13 +355,18 @@ final class VulkanStateCaches {
             return self.defaultVertexInputStateCreateInfo
         }
         
-        if let state = self.vertexInputStates[descriptor] {
+        if let state = self.accessLock.withLock({ self.vertexInputStates[descriptor] }) {
             return state
         }
         
         let info = VertexInputStateCreateInfo(descriptor: descriptor)
-        self.vertexInputStates[descriptor] = info
-        return info
+        return self.accessLock.withLock {
+            if let state = self.vertexInputStates[descriptor] {
+                return state
+            }
+            self.vertexInputStates[descriptor] = info
+            return info
+        }
     }
     
     public func reflection(for descriptor: RenderPipelineDescriptor, renderTarget: RenderTargetDescriptor) -> VulkanPipelineReflection {
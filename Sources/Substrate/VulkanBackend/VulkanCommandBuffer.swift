@@ -25,7 +25,9 @@ final class VulkanCommandBuffer: BackendCommandBuffer {
     
     let backend: VulkanBackend
     let queue: VulkanDeviceQueue
+    let commandPool: VulkanCommandPool
     let commandBuffer: VkCommandBuffer
+    private var isRecording = true
     let commandInfo: FrameCommandInfo<VulkanBackend>
     let resourceMap: FrameResourceMap<VulkanBackend>
     let compactedResourceCommands: [CompactedResourceCommand<VulkanCompactedResourceCommandType>]
@@ -46,14 +48,30 @@ final class VulkanCommandBuffer: BackendCommandBuffer {
     
     var presentSwapchains = [VulkanSwapChain]()
     
+    /// Command buffers that each contain one encoder recorded by `encodeCommands(encoderIndices:)`.
+    /// They're submitted in order after `commandBuffer` and retained until it completes.
+    var encoderCommandBuffers = [VulkanCommandBuffer]()
+    
+    /// If `FrameCommandInfo.recordsGPUTimestamps` is set, the query pool that the start and end timestamps of each encoder are
+    /// written to, with encoder `i` in the frame using queries `2 * i` and `2 * i + 1`.
+    /// The pool is created by the submitted command buffer and shared with its `encoderCommandBuffers`.
+    private var timestampQueryPool : VkQueryPool? = nil
+    private var ownsTimestampQueryPool = false
+    private var timestampedEncoderIndices = [Int]()
+    
+    /// The number of draws recorded into `commandBuffer` itself that were deferred because their pipeline was being compiled.
+    var recordedDeferredDrawCount = 0
+    
     init(backend: VulkanBackend,
          queue: VulkanDeviceQueue,
          commandInfo: FrameCommandInfo<VulkanBackend>,
          resourceMap: FrameResourceMap<VulkanBackend>,
-         compactedResourceCommands: [CompactedResourceCommand<VulkanCompactedResourceCommandType>]) {
+         compactedResourceCommands: [CompactedResourceCommand<VulkanCompactedResourceCommandType>],
+         timestampQueryPool: VkQueryPool? = nil) {
         self.backend = backend
         self.queue = queue
-        self.commandBuffer = queue.allocateCommandBuffer()
+        self.commandPool = queue.acquireCommandPool()
+        self.commandBuffer = self.commandPool.allocateCommandBuffer()
         self.commandInfo = commandInfo
         self.resourceMap = resourceMap
         self.compactedResourceCommands = compactedResourceCommands
@@ -62,10 +80,40 @@ final class VulkanCommandBuffer: BackendCommandBuffer {
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO
         beginInfo.flags = VkCommandBufferUsageFlags(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT)
         vkBeginCommandBuffer(self.commandBuffer, &beginInfo).check()
+        
+        if let timestampQueryPool = timestampQueryPool {
+            self.timestampQueryPool = timestampQueryPool
+        } else if commandInfo.recordsGPUTimestamps, queue.device.physicalDevice.queueFamilies[queue.familyIndex].timestampValidBits > 0 {
+            let queryCount = UInt32(2 * commandInfo.commandEncoders.count)
+            var createInfo = VkQueryPoolCreateInfo()
+            createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO
+            createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP
+            createInfo.queryCount = queryCount
+            var queryPool : VkQueryPool? = nil
+            if vkCreateQueryPool(queue.device.vkDevice, &createInfo, nil, &queryPool).check() {
+                // This command buffer is submitted before its encoderCommandBuffers, so resetting here covers their queries too.
+                vkCmdResetQueryPool(self.commandBuffer, queryPool, 0, queryCount)
+                self.timestampQueryPool = queryPool
+                self.ownsTimestampQueryPool = true
+            }
+        }
     }
 
     deinit {
-        self.queue.depositCommandBuffer(self.commandBuffer)
+        if self.isRecording {
+            self.queue.releaseCommandPool(self.commandPool)
+        }
+        self.commandPool.depositCommandBuffer(self.commandBuffer)
+        if self.ownsTimestampQueryPool {
+            vkDestroyQueryPool(self.queue.device.vkDevice, self.timestampQueryPool, nil)
+        }
+    }
+    
+    /// Ends the command buffer and returns its command pool to the queue for use by other command buffers.
+    private func endRecording() {
+        vkEndCommandBuffer(self.commandBuffer).check()
+        self.queue.releaseCommandPool(self.commandPool)
+        self.isRecording = false
     }
     
     var gpuStartTime: Double {
@@ -76,7 +124,41 @@ final class VulkanCommandBuffer: BackendCommandBuffer {
         return 0.0
     }
     
+    var deferredDrawCount: Int {
+        return self.encoderCommandBuffers.reduce(self.recordedDeferredDrawCount) { $0 + $1.recordedDeferredDrawCount }
+    }
+    
+    var encoderGPUIntervals: [RenderGraphProfileInterval] {
+        guard self.ownsTimestampQueryPool else { return [] }
+        
+        let encoderIndices = self.timestampedEncoderIndices + self.encoderCommandBuffers.flatMap { $0.timestampedEncoderIndices }
+        return encoderIndices.compactMap { encoderIndex in
+            var timestamps : (UInt64, UInt64) = (0, 0)
+            let result = withUnsafeMutableBytes(of: &timestamps) { timestamps in
+                vkGetQueryPoolResults(self.queue.device.vkDevice, self.timestampQueryPool, UInt32(2 * encoderIndex), 2, timestamps.count, timestamps.baseAddress, UInt64(MemoryLayout<UInt64>.stride), VkQueryResultFlags(VK_QUERY_RESULT_64_BIT))
+            }
+            guard result == VK_SUCCESS else { return nil }
+            
+            let encoderInfo = self.commandInfo.commandEncoders[encoderIndex]
+            let timestampPeriod = self.backend.device.timestampPeriod
+            return RenderGraphProfileInterval(name: encoderInfo.name, kind: .gpuEncoder, lane: encoderInfo.queueFamilyIndex,
+                                              startTime: UInt64(Double(timestamps.0) * timestampPeriod), endTime: UInt64(Double(timestamps.1) * timestampPeriod))
+        }
+    }
+    
     func encodeCommands(encoderIndex: Int) {
+        guard let timestampQueryPool = self.timestampQueryPool else {
+            self.encodeEncoderCommands(encoderIndex: encoderIndex)
+            return
+        }
+        
+        vkCmdWriteTimestamp(self.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, UInt32(2 * encoderIndex))
+        self.encodeEncoderCommands(encoderIndex: encoderIndex)
+        vkCmdWriteTimestamp(self.commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, UInt32(2 * encoderIndex + 1))
+        self.timestampedEncoderIndices.append(encoderIndex)
+    }
+    
+    private func encodeEncoderCommands(encoderIndex: Int) {
         let encoderInfo = self.commandInfo.commandEncoders[encoderIndex]
         
         switch encoderInfo.type {
@@ -111,6 +193,50 @@ final class VulkanCommandBuffer: BackendCommandBuffer {
         }
     }
     
+    static var supportsConcurrentEncoding: Bool {
+        return true
+    }
+    
+    /// Records each encoder into its own primary command buffer, with encoders being recorded concurrently on the job manager.
+    /// Since each draw encoder begins its own render pass, the encoders can't be recorded into secondary command buffers;
+    /// instead, the command buffers are submitted in encoder order in a single batch in `commit`, with the resource commands
+    /// for each encoder's passes recorded into that encoder's command buffer.
+    func encodeCommands(encoderIndices: Range<Int>) {
+        let gpuEncoderIndices = encoderIndices.filter {
+            let type = self.commandInfo.commandEncoders[$0].type
+            return type == .draw || type == .compute || type == .blit
+        }
+        
+        guard RenderGraph.encodesCommandsConcurrently, gpuEncoderIndices.count > 1 else {
+            for encoderIndex in encoderIndices {
+                self.encodeCommands(encoderIndex: encoderIndex)
+            }
+            return
+        }
+        
+        assert(self.encoderCommandBuffers.isEmpty)
+        self.encoderCommandBuffers = gpuEncoderIndices.map { _ in
+            VulkanCommandBuffer(backend: self.backend, queue: self.queue, commandInfo: self.commandInfo, resourceMap: self.resourceMap, compactedResourceCommands: self.compactedResourceCommands, timestampQueryPool: self.timestampQueryPool)
+        }
+        
+        var concurrentIndices = [Int]()
+        for (i, encoderIndex) in gpuEncoderIndices.enumerated() {
+            // Encoders that use window textures acquire the drawable on the main thread, so can't be encoded on a job thread.
+            if self.commandInfo.commandEncoders[encoderIndex].usesWindowTexture {
+                self.encoderCommandBuffers[i].encodeCommands(encoderIndex: encoderIndex)
+            } else {
+                concurrentIndices.append(i)
+            }
+        }
+        
+        RenderGraph.jobManager.forEachConcurrently(count: concurrentIndices.count) { i in
+            let index = concurrentIndices[i]
+            let commandBuffer = self.encoderCommandBuffers[index]
+            commandBuffer.encodeCommands(encoderIndex: gpuEncoderIndices[index])
+            commandBuffer.endRecording()
+        }
+    }
+    
     func waitForEvent(_ event: VkSemaphore, value: UInt64) {
         // TODO: wait for more fine-grained pipeline stages.
         self.waitSemaphores.append(ResourceSemaphore(vkSemaphore: event, stages: VK_PIPELINE_STAGE_ALL_COMMANDS_BIT))
@@ -122,6 +248,11 @@ final class VulkanCommandBuffer: BackendCommandBuffer {
         self.signalSemaphoreSignalValues.append(value)
     }
     
+    func waitForCommandBuffer(_ commandBuffer: VulkanCommandBuffer) {
+        // Command buffers on the async compute queue signal their queue's semaphore when they're created.
+        self.waitForEvent(commandBuffer.signalSemaphores[0]!, value: commandBuffer.signalSemaphoreSignalValues[0])
+    }
+    
     func presentSwapchains(resourceRegistry: VulkanTransientResourceRegistry) {
         // Only contains drawables applicable to the render passes in the command buffer...
         self.presentSwapchains.append(contentsOf: resourceRegistry.frameSwapChains)
@@ -130,12 +261,17 @@ final class VulkanCommandBuffer: BackendCommandBuffer {
     }
     
     func commit(onCompletion: @escaping (VulkanCommandBuffer) -> Void) {
-        vkEndCommandBuffer(self.commandBuffer).check()
+        self.endRecording()
+        for commandBuffer in self.encoderCommandBuffers where commandBuffer.isRecording {
+            commandBuffer.endRecording()
+        }
+        
+        let commandBuffers = [self.commandBuffer as VkCommandBuffer?] + self.encoderCommandBuffers.map { $0.commandBuffer as VkCommandBuffer? }
 
         var submitInfo = VkSubmitInfo()
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO
 
-        submitInfo.commandBufferCount = 1
+        submitInfo.commandBufferCount = UInt32(commandBuffers.count)
     
         let waitSemaphores = self.waitSemaphores.map { $0.vkSemaphore as VkSemaphore? } + self.presentSwapchains.map { $0.acquisitionSemaphore }
         self.waitSemaphoreWaitValues.append(repeating: 0, count: self.presentSwapchains.count)
@@ -156,8 +292,8 @@ final class VulkanCommandBuffer: BackendCommandBuffer {
         timelineInfo.signalSemaphoreValueCount = UInt32(self.signalSemaphores.count)
         timelineInfo.pSignalSemaphoreValues = UnsafePointer(self.signalSemaphoreSignalValues.buffer)
         
-        withUnsafePointer(to: self.commandBuffer as VkCommandBuffer?) { commandBufferPtr in
-            submitInfo.pCommandBuffers = commandBufferPtr
+        commandBuffers.withUnsafeBufferPointer { commandBuffers in
+            submitInfo.pCommandBuffers = commandBuffers.baseAddress
             submitInfo.signalSemaphoreCount = UInt32(self.signalSemaphores.count)
             
             waitSemaphores.withUnsafeBufferPointer { waitSemaphores in
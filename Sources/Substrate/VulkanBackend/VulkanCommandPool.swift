@@ -11,27 +11,18 @@ import SubstrateCExtras
 import SubstrateUtilities
 import Dispatch
 
-/// Wraps a Vulkan queue.
-final class VulkanDeviceQueue {
-    let commandBufferManagementQueue = DispatchQueue(label: "Vulkan Command Buffer Management")
-
-    public let device: VulkanDevice
-    public let vkQueue : VkQueue
-    public let familyIndex: Int
-    public let queueIndex: Int
-    
+/// Wraps a Vulkan command pool along with the command buffers allocated from it that are available for reuse.
+/// Since command pools must be externally synchronised, a pool is only used by a single command buffer's recording
+/// at a time; see `VulkanDeviceQueue.acquireCommandPool()`.
+final class VulkanCommandPool {
+    let device: VulkanDevice
     let commandPool: VkCommandPool
     
+    private let commandBufferLock = SpinLock()
     private var commandBuffers : [VkCommandBuffer] = []
     
-    init(device: VulkanDevice, familyIndex: Int, queueIndex: Int) {
+    init(device: VulkanDevice, familyIndex: Int) {
         self.device = device
-        self.familyIndex = familyIndex
-        self.queueIndex = queueIndex
-        
-        var queue : VkQueue? = nil
-        vkGetDeviceQueue(device.vkDevice, UInt32(familyIndex), UInt32(queueIndex), &queue)
-        self.vkQueue = queue!
         
         var commandPoolCreateInfo = VkCommandPoolCreateInfo()
         commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO
@@ -47,10 +38,12 @@ final class VulkanDeviceQueue {
 
     deinit {
         vkDestroyCommandPool(self.device.vkDevice, self.commandPool, nil)
+        self.commandBufferLock.deinit()
     }
     
+    /// Must only be called by the pool's current owner.
     public func allocateCommandBuffer() -> VkCommandBuffer {
-        if let commandBuffer = self.commandBufferManagementQueue.sync(execute: { self.commandBuffers.popLast() }) {
+        if let commandBuffer = self.commandBufferLock.withLock({ self.commandBuffers.popLast() }) {
             vkResetCommandBuffer(commandBuffer, 0)
             return commandBuffer
         }
@@ -67,14 +60,52 @@ final class VulkanDeviceQueue {
         return commandBuffer!
     }
 
+    /// May be called from any thread once the command buffer has finished executing.
     public func depositCommandBuffer(_ commandBuffer: VkCommandBuffer) {
         // TODO: periodically reset all resources to the pool to avoid fragmentation/over-allocation using vkResetCommandPool
-        self.commandBufferManagementQueue.sync {
+        self.commandBufferLock.withLock {
             self.commandBuffers.append(commandBuffer)
         }
     }
 }
 
+/// Wraps a Vulkan queue.
+final class VulkanDeviceQueue {
+    let commandBufferManagementQueue = DispatchQueue(label: "Vulkan Command Buffer Management")
+
+    public let device: VulkanDevice
+    public let vkQueue : VkQueue
+    public let familyIndex: Int
+    public let queueIndex: Int
+    
+    private var commandPools : [VulkanCommandPool] = []
+    
+    init(device: VulkanDevice, familyIndex: Int, queueIndex: Int) {
+        self.device = device
+        self.familyIndex = familyIndex
+        self.queueIndex = queueIndex
+        
+        var queue : VkQueue? = nil
+        vkGetDeviceQueue(device.vkDevice, UInt32(familyIndex), UInt32(queueIndex), &queue)
+        self.vkQueue = queue!
+    }
+    
+    /// Returns a command pool that is exclusively owned by the caller until it's passed to `releaseCommandPool(_:)`,
+    /// creating a new pool if all existing pools are in use (e.g. by command buffers being recorded on other threads).
+    public func acquireCommandPool() -> VulkanCommandPool {
+        if let commandPool = self.commandBufferManagementQueue.sync(execute: { self.commandPools.popLast() }) {
+            return commandPool
+        }
+        return VulkanCommandPool(device: self.device, familyIndex: self.familyIndex)
+    }
+    
+    public func releaseCommandPool(_ commandPool: VulkanCommandPool) {
+        self.commandBufferManagementQueue.sync {
+            self.commandPools.append(commandPool)
+        }
+    }
+}
+
 /// Wraps the RenderGraph abstraction of a queue, which may map to multiple Vulkan queues.
 final class VulkanQueue: BackendQueue {
     typealias Backend = VulkanBackend
@@ -82,15 +113,39 @@ final class VulkanQueue: BackendQueue {
     let backend: VulkanBackend
     let device : VulkanDevice
     
+    /// Signalled by command buffers on the async compute queue. This is separate from the render graph queue's sync event
+    /// since command buffers on different queues may complete out of order, while timeline semaphore values must be increasing.
+    let asyncComputeSemaphore: VkSemaphore?
+    private var asyncComputeSignalValue: UInt64 = 0
+    
     init(backend: VulkanBackend, device: VulkanDevice) {
         self.backend = backend
         self.device = device
+        self.asyncComputeSemaphore = device.asyncComputeQueue != nil ? device.makeTimelineSemaphore() : nil
+    }
+    
+    deinit {
+        if let asyncComputeSemaphore = self.asyncComputeSemaphore {
+            vkDestroySemaphore(self.device.vkDevice, asyncComputeSemaphore, nil)
+        }
     }
     
     func makeCommandBuffer(commandInfo: FrameCommandInfo<Backend>, resourceMap: FrameResourceMap<Backend>, compactedResourceCommands: [CompactedResourceCommand<Backend.CompactedResourceCommandType>]) -> VulkanCommandBuffer {
-        let queue = device.queues[0] // TODO: use queues other than the main queue.
+        let queue = device.queues[0]
         return VulkanCommandBuffer(backend: self.backend, queue: queue, commandInfo: commandInfo, resourceMap: resourceMap, compactedResourceCommands: compactedResourceCommands)
     }
+    
+    func makeCommandBuffer(commandInfo: FrameCommandInfo<Backend>, resourceMap: FrameResourceMap<Backend>, compactedResourceCommands: [CompactedResourceCommand<Backend.CompactedResourceCommandType>], commandBufferIndex: Int) -> VulkanCommandBuffer {
+        guard commandInfo.queueFamilyIndex(commandBufferIndex: commandBufferIndex) == CommandEncoderInfo<VulkanRenderTargetDescriptor>.asyncComputeQueueFamilyIndex,
+              let queue = self.device.asyncComputeQueue, let asyncComputeSemaphore = self.asyncComputeSemaphore else {
+            return self.makeCommandBuffer(commandInfo: commandInfo, resourceMap: resourceMap, compactedResourceCommands: compactedResourceCommands)
+        }
+        
+        let commandBuffer = VulkanCommandBuffer(backend: self.backend, queue: queue, commandInfo: commandInfo, resourceMap: resourceMap, compactedResourceCommands: compactedResourceCommands)
+        self.asyncComputeSignalValue += 1
+        commandBuffer.signalEvent(asyncComputeSemaphore, value: self.asyncComputeSignalValue)
+        return commandBuffer
+    }
 }
 
 #endif // canImport(Vulkan)
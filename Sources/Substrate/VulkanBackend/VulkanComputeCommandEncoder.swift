@@ -40,6 +40,17 @@ struct VulkanComputePipelineDescriptor : Hashable {
             withInfo(&pipelineInfo)
         }
     }
+    
+    // The compute shaders aren't specialised on their thread group size, so it doesn't change the created pipeline
+    // and is left out of the descriptor's identity. This also lets pipelines prewarmed without a dispatch size be found when they're used.
+    static func ==(lhs: VulkanComputePipelineDescriptor, rhs: VulkanComputePipelineDescriptor) -> Bool {
+        return lhs.descriptor == rhs.descriptor && lhs.layout == rhs.layout
+    }
+    
+    func hash(into hasher: inout Hasher) {
+        hasher.combine(self.descriptor)
+        hasher.combine(self.layout)
+    }
 }
 
 class VulkanComputeCommandEncoder : VulkanResourceBindingCommandEncoder {
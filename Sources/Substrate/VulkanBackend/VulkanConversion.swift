@@ -99,6 +99,12 @@ extension VkDependencyFlags {
     }
 }
 
+extension VkQueryResultFlags {
+    init(_ flagBits: VkQueryResultFlagBits) {
+        self.init(flagBits.rawValue)
+    }
+}
+
 extension VkDescriptorPoolCreateFlags {
     init(_ flagBits: VkDescriptorPoolCreateFlagBits) {
         self.init(flagBits.rawValue)
@@ -78,6 +78,14 @@ public final class VulkanDevice {
     
     public let physicalDevice : VulkanPhysicalDevice
     let vkDevice : VkDevice
+    /// Whether a single indirect draw command can issue more than one draw.
+    let supportsMultiDrawIndirect : Bool
+    /// Whether indirect draws can read their draw count from a buffer.
+    let supportsDrawIndirectCount : Bool
+    /// Whether indirect draws can use a non-zero `firstInstance`.
+    let supportsDrawIndirectFirstInstance : Bool
+    /// The number of nanoseconds per increment of a timestamp query.
+    let timestampPeriod : Double
     
     private(set) var queues : [VulkanDeviceQueue] = []
     
@@ -88,6 +96,7 @@ public final class VulkanDevice {
             var properties = VkPhysicalDeviceProperties()
             vkGetPhysicalDeviceProperties(physicalDevice.vkDevice, &properties)
             print("Using VkPhysicalDevice \(String(cStringTuple: properties.deviceName)) with API version \(VulkanVersion(properties.apiVersion)) and driver version \(VulkanVersion(properties.driverVersion))")
+            self.timestampPeriod = Double(properties.limits.timestampPeriod)
         }
         // Strategy: one render queue, as many async compute queues as we can get, and a couple of copy queues.
         
@@ -176,6 +185,9 @@ public final class VulkanDevice {
         
         if device == nil { return nil }
         self.vkDevice = device!
+        self.supportsMultiDrawIndirect = features.features.multiDrawIndirect != VkBool32(VK_FALSE)
+        self.supportsDrawIndirectCount = features12.drawIndirectCount != VkBool32(VK_FALSE)
+        self.supportsDrawIndirectFirstInstance = features.features.drawIndirectFirstInstance != VkBool32(VK_FALSE)
         
         let queues = activeQueues.map { (familyIndex, queueIndex) -> VulkanDeviceQueue in
             return VulkanDeviceQueue(device: self, familyIndex: familyIndex, queueIndex: queueIndex)
@@ -184,10 +196,34 @@ public final class VulkanDevice {
         self.queues = queues
     }
     
+    /// A queue in a compute-only family that compute passes can be run on concurrently with the main render queue, if the device has one.
+    public var asyncComputeQueue: VulkanDeviceQueue? {
+        return self.queues.first(where: { queue in
+            let queueFlags = VkQueueFlagBits(self.physicalDevice.queueFamilies[queue.familyIndex].queueFlags)
+            return queueFlags.contains(VK_QUEUE_COMPUTE_BIT) && !queueFlags.contains(VK_QUEUE_GRAPHICS_BIT)
+        })
+    }
+    
     deinit {
         vkDestroyDevice(self.vkDevice, nil)
     }
     
+    func makeTimelineSemaphore(initialValue: UInt64 = 0) -> VkSemaphore {
+        var semaphoreTypeCreateInfo = VkSemaphoreTypeCreateInfo()
+        semaphoreTypeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO
+        semaphoreTypeCreateInfo.initialValue = initialValue
+        semaphoreTypeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE
+        
+        var semaphore: VkSemaphore? = nil
+        withUnsafePointer(to: semaphoreTypeCreateInfo) { semaphoreTypeCreateInfo in
+            var semaphoreCreateInfo = VkSemaphoreCreateInfo()
+            semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO
+            semaphoreCreateInfo.pNext = UnsafeRawPointer(semaphoreTypeCreateInfo)
+            vkCreateSemaphore(self.vkDevice, &semaphoreCreateInfo, nil, &semaphore)
+        }
+        return semaphore!
+    }
+    
     public func queueFamilyIndices(containingAllOf queueFlags: VkQueueFlagBits) -> [UInt32] {
         return self.physicalDevice.queueFamilies.enumerated().compactMap { (i, queue) in
             if VkQueueFlagBits(queue.queueFlags).contains(queueFlags) {
@@ -13,80 +13,152 @@ final class VulkanPoolResourceAllocator : VulkanImageAllocator, VulkanBufferAllo
  
     struct ResourceReference<R> {
         let resource : R
+        let size : Int
         var waitSemaphore : ContextWaitEvent
         var framesUnused : Int = 0
         
-        init(resource: R, waitSemaphore: ContextWaitEvent) {
+        init(resource: R, size: Int, waitSemaphore: ContextWaitEvent) {
             self.resource = resource
+            self.size = size
             self.waitSemaphore = waitSemaphore
         }
     }
     
+    /// The properties of a VulkanImageDescriptor that must be equal for an image to be reused;
+    /// the remaining properties (usage and create flags) only require the pooled image's to be a superset.
+    struct ImageKey : Hashable {
+        var format : UInt32
+        var width : UInt32
+        var height : UInt32
+        var depth : UInt32
+        var mipLevels : UInt32
+        var arrayLayers : UInt32
+        var samples : UInt32
+        var imageType : UInt32
+        var imageViewType : UInt32
+        var tiling : UInt32
+        var storageMode : StorageMode
+        var cacheMode : CPUCacheMode
+        
+        init(_ descriptor: VulkanImageDescriptor) {
+            self.format = UInt32(descriptor.format.rawValue)
+            self.width = descriptor.extent.width
+            self.height = descriptor.extent.height
+            self.depth = descriptor.extent.depth
+            self.mipLevels = descriptor.mipLevels
+            self.arrayLayers = descriptor.arrayLayers
+            self.samples = UInt32(descriptor.samples.rawValue)
+            self.imageType = UInt32(descriptor.imageType.rawValue)
+            self.imageViewType = UInt32(descriptor.imageViewType.rawValue)
+            self.tiling = UInt32(descriptor.tiling.rawValue)
+            self.storageMode = descriptor.storageMode
+            self.cacheMode = descriptor.cacheMode
+        }
+    }
+    
+    struct Statistics {
+        /// The number of collections satisfied from the pool.
+        var hitCount = 0
+        /// The number of collections that required a new allocation.
+        var missCount = 0
+        /// The number of bytes allocated for resources owned by the pool, whether in use or not.
+        var bytesHeld = 0
+        /// The number of bytes allocated for resources sitting unused in the pool.
+        var bytesPooled = 0
+    }
+    
+    static let bufferSizeClassCount = 64
+    
     let device : VulkanDevice
     let allocator : VmaAllocator
     
-    private var buffers : [[ResourceReference<VkBufferReference>]]
-    private var images : [[ResourceReference<VkImageReference>]]
+    /// Resources are released once they've been unused for more than this many frames.
+    var maxFramesUnused : Int
+    
+    private var buffers : [[[ResourceReference<VkBufferReference>]]] // Indexed by frame, then by size class.
+    private var images : [[ImageKey : [ResourceReference<VkImageReference>]]]
     
     private var buffersUsedThisFrame = [ResourceReference<VkBufferReference>]()
     private var imagesUsedThisFrame = [ResourceReference<VkImageReference>]()
     
+    private(set) var statistics = Statistics()
+    
     let numFrames : Int
     private var currentIndex : Int = 0
     
-    init(device: VulkanDevice, allocator: VmaAllocator, numFrames: Int) {
+    init(device: VulkanDevice, allocator: VmaAllocator, numFrames: Int, maxFramesUnused: Int = 2) {
         self.numFrames = numFrames
         self.device = device
         self.allocator = allocator
-        self.buffers = [[ResourceReference<VkBufferReference>]](repeating: [], count: numFrames)
-        self.images = [[ResourceReference<VkImageReference>]](repeating: [], count: numFrames)
+        self.maxFramesUnused = maxFramesUnused
+        self.buffers = [[[ResourceReference<VkBufferReference>]]](repeating: [[ResourceReference<VkBufferReference>]](repeating: [], count: VulkanPoolResourceAllocator.bufferSizeClassCount), count: numFrames)
+        self.images = [[ImageKey : [ResourceReference<VkImageReference>]]](repeating: [:], count: numFrames)
     }
-  
     
-    private func imageFitting(descriptor: VulkanImageDescriptor) -> (VkImageReference, ContextWaitEvent)? {
-        
-        for (i, imageRef) in self.images[currentIndex].enumerated() {
-            if imageRef.resource.image.matches(descriptor: descriptor) {
-                let resourceRef = self.images[currentIndex].remove(at: i, preservingOrder: false)
-                return (resourceRef.resource, resourceRef.waitSemaphore)
-            }
+    /// Buffers in size class `n` have sizes in the range `(2^(n - 1), 2^n]`.
+    @inline(__always)
+    static func sizeClass(for size: UInt64) -> Int {
+        return size <= 1 ? 0 : (UInt64.bitWidth - (size - 1).leadingZeroBitCount)
+    }
+    
+    func resetStatistics() {
+        self.statistics.hitCount = 0
+        self.statistics.missCount = 0
+    }
+    
+    private func imageFitting(descriptor: VulkanImageDescriptor) -> ResourceReference<VkImageReference>? {
+        let key = ImageKey(descriptor)
+        guard let index = self.images[currentIndex][key]?.firstIndex(where: { $0.resource.image.matches(descriptor: descriptor) }) else {
+            return nil
         }
-        
-        return nil
+        return self.images[currentIndex][key]!.remove(at: index, preservingOrder: false)
     }
     
-    private func bufferFitting(descriptor: VulkanBufferDescriptor) -> (VkBufferReference, ContextWaitEvent)? {
-        var bestIndex = -1
-        var bestLength = UInt64.max
-        
-        for (i, bufferRef) in self.buffers[currentIndex].enumerated() {
-            if bufferRef.resource.buffer.fits(descriptor: descriptor), bufferRef.resource.buffer.descriptor.size < bestLength {
-                bestIndex = i
-                bestLength = bufferRef.resource.buffer.descriptor.size
+    private func bufferFitting(descriptor: VulkanBufferDescriptor) -> ResourceReference<VkBufferReference>? {
+        // Every buffer in a higher size class is larger than every buffer in a lower one, so the first class containing a fitting buffer contains the best fit.
+        for sizeClass in VulkanPoolResourceAllocator.sizeClass(for: descriptor.size)..<VulkanPoolResourceAllocator.bufferSizeClassCount {
+            var bestIndex = -1
+            var bestLength = UInt64.max
+            
+            for (i, bufferRef) in self.buffers[currentIndex][sizeClass].enumerated() {
+                if bufferRef.resource.buffer.fits(descriptor: descriptor), bufferRef.resource.buffer.descriptor.size < bestLength {
+                    bestIndex = i
+                    bestLength = bufferRef.resource.buffer.descriptor.size
+                }
+            }
+            
+            if bestIndex != -1 {
+                return self.buffers[currentIndex][sizeClass].remove(at: bestIndex, preservingOrder: false)
             }
         }
-        
-        if bestIndex != -1 {
-            let resourceRef = self.buffers[currentIndex].remove(at: bestIndex, preservingOrder: false)
-            return (resourceRef.resource, resourceRef.waitSemaphore)
-        } else {
-            return nil
-        }
+        return nil
+    }
+    
+    private func allocationSize(of image: VulkanImage) -> Int {
+        var allocationInfo = VmaAllocationInfo()
+        vmaGetAllocationInfo(self.allocator, image.allocation!, &allocationInfo)
+        return Int(allocationInfo.size)
     }
 
     func collectImage(descriptor: VulkanImageDescriptor) -> (VkImageReference, [FenceDependency], ContextWaitEvent) {
         if let image = self.imageFitting(descriptor: descriptor) {
-            return (image.0, [], image.1)
+            self.statistics.hitCount += 1
+            self.statistics.bytesPooled -= image.size
+            return (image.resource, [], image.waitSemaphore)
         } else {
             var allocInfo = VmaAllocationCreateInfo(storageMode: descriptor.storageMode, cacheMode: descriptor.cacheMode)
             
             var image : VkImage? = nil
             var allocation : VmaAllocation? = nil
+            var allocationInfo = VmaAllocationInfo()
             descriptor.withImageCreateInfo(device: self.device) { (info) in
                 var info = info
-                vmaCreateImage(self.allocator, &info, &allocInfo, &image, &allocation, nil)
+                vmaCreateImage(self.allocator, &info, &allocInfo, &image, &allocation, &allocationInfo)
             }
             
+            self.statistics.missCount += 1
+            self.statistics.bytesHeld += Int(allocationInfo.size)
+            
             let vulkanImage = VulkanImage(device: self.device, image: image!, allocator: self.allocator, allocation: allocation!, descriptor: descriptor)
             return (VkImageReference(image: Unmanaged.passRetained(vulkanImage)),
                     [], ContextWaitEvent())
@@ -98,12 +170,14 @@ final class VulkanPoolResourceAllocator : VulkanImageAllocator, VulkanBufferAllo
         // Delay returning the resource to the pool until the start of the next frame so we don't need to track hazards within the frame.
         // This slightly increases memory usage but greatly simplifies resource tracking, and besides, heaps should be used instead
         // for cases where memory usage is important.
-        self.imagesUsedThisFrame.append(ResourceReference(resource: image, waitSemaphore: waitSemaphore))
+        self.imagesUsedThisFrame.append(ResourceReference(resource: image, size: self.allocationSize(of: image.image), waitSemaphore: waitSemaphore))
     }
     
     func collectBuffer(descriptor: VulkanBufferDescriptor) -> (VkBufferReference, [FenceDependency], ContextWaitEvent) {
         if let buffer = self.bufferFitting(descriptor: descriptor) {
-            return (buffer.0, [], buffer.1)
+            self.statistics.hitCount += 1
+            self.statistics.bytesPooled -= buffer.size
+            return (buffer.resource, [], buffer.waitSemaphore)
         } else {
             var allocInfo = VmaAllocationCreateInfo(storageMode: descriptor.storageMode, cacheMode: descriptor.cacheMode)
             
@@ -115,6 +189,9 @@ final class VulkanPoolResourceAllocator : VulkanImageAllocator, VulkanBufferAllo
                 vmaCreateBuffer(self.allocator, &info, &allocInfo, &buffer, &allocation, &allocationInfo)
             }
             
+            self.statistics.missCount += 1
+            self.statistics.bytesHeld += Int(allocationInfo.size)
+            
             let vulkanBuffer = VulkanBuffer(device: self.device, buffer: buffer!, allocator: self.allocator, allocation: allocation!, allocationInfo: allocationInfo, descriptor: descriptor)
             return (VkBufferReference(buffer: Unmanaged.passRetained(vulkanBuffer), offset: 0),
                     [], ContextWaitEvent())
@@ -126,47 +203,54 @@ final class VulkanPoolResourceAllocator : VulkanImageAllocator, VulkanBufferAllo
         // Delay returning the resource to the pool until the start of the next frame so we don't need to track hazards within the frame.
         // This slightly increases memory usage but greatly simplifies resource tracking, and besides, heaps should be used instead
         // for cases where memory usage is important.
-        self.buffersUsedThisFrame.append(ResourceReference(resource: buffer, waitSemaphore: waitSemaphore))
+        self.buffersUsedThisFrame.append(ResourceReference(resource: buffer, size: Int(buffer.buffer.allocationInfo.size), waitSemaphore: waitSemaphore))
     }
     
-    func cycleFrames() {
-        do {
-            var i = 0
-            while i < self.buffers[self.currentIndex].count {
-                self.buffers[self.currentIndex][i].framesUnused += 1
-                
-                if self.buffers[self.currentIndex][i].framesUnused > 2 {
-                    let buffer = self.buffers[self.currentIndex].remove(at: i, preservingOrder: false)
-                    buffer.resource._buffer.release()
-                } else {
-                    i += 1
-                }
-            }
+    /// Ages every resource in `resources`, releasing those that have been unused for more than `maxFramesUnused` frames.
+    private func evictUnusedResources<R>(_ resources: inout [ResourceReference<R>], release: (R) -> Void) {
+        var i = 0
+        while i < resources.count {
+            resources[i].framesUnused += 1
             
-            self.buffers[self.currentIndex].append(contentsOf: buffersUsedThisFrame)
-            self.buffersUsedThisFrame.removeAll(keepingCapacity: true)
+            if resources[i].framesUnused > self.maxFramesUnused {
+                let resource = resources.remove(at: i, preservingOrder: false)
+                self.statistics.bytesHeld -= resource.size
+                self.statistics.bytesPooled -= resource.size
+                release(resource.resource)
+            } else {
+                i += 1
+            }
+        }
+    }
+    
+    func cycleFrames() {
+        for sizeClass in 0..<VulkanPoolResourceAllocator.bufferSizeClassCount where !self.buffers[self.currentIndex][sizeClass].isEmpty {
+            self.evictUnusedResources(&self.buffers[self.currentIndex][sizeClass], release: { $0._buffer.release() })
         }
         
-        do {
-            var i = 0
-            while i < self.images[self.currentIndex].count {
-                self.images[self.currentIndex][i].framesUnused += 1
-                
-                if self.images[self.currentIndex][i].framesUnused > 2 {
-                    let image = self.images[self.currentIndex].remove(at: i, preservingOrder: false)
-                    image.resource._image.release()
-                } else {
-                    i += 1
-                }
+        for buffer in self.buffersUsedThisFrame {
+            self.buffers[self.currentIndex][VulkanPoolResourceAllocator.sizeClass(for: buffer.resource.buffer.descriptor.size)].append(buffer)
+            self.statistics.bytesPooled += buffer.size
+        }
+        self.buffersUsedThisFrame.removeAll(keepingCapacity: true)
+        
+        var pooledImages = [ImageKey : [ResourceReference<VkImageReference>]]()
+        swap(&pooledImages, &self.images[self.currentIndex])
+        for (key, var imageRefs) in pooledImages {
+            self.evictUnusedResources(&imageRefs, release: { $0._image.release() })
+            if !imageRefs.isEmpty {
+                self.images[self.currentIndex][key] = imageRefs
             }
-            
-            self.images[self.currentIndex].append(contentsOf: imagesUsedThisFrame)
-            self.imagesUsedThisFrame.removeAll(keepingCapacity: true)
         }
         
+        for image in self.imagesUsedThisFrame {
+            self.images[self.currentIndex][ImageKey(image.resource.image.descriptor), default: []].append(image)
+            self.statistics.bytesPooled += image.size
+        }
+        self.imagesUsedThisFrame.removeAll(keepingCapacity: true)
+        
         self.currentIndex = (self.currentIndex + 1) % self.numFrames
     }
 }
 
 #endif // canImport(Vulkan)
-
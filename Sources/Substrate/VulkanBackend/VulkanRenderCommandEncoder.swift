@@ -88,7 +88,7 @@ struct VulkanRenderPipelineDescriptor : Hashable {
         return true
     }
 
-    func withVulkanPipelineCreateInfo(renderPass: VulkanRenderPass, stateCaches: VulkanStateCaches, _ withInfo: (inout VkGraphicsPipelineCreateInfo) -> Void) {
+    func withVulkanPipelineCreateInfo(renderPass: VkRenderPass, stateCaches: VulkanStateCaches, _ withInfo: (inout VkGraphicsPipelineCreateInfo) -> Void) {
         
         var functionNames = [FixedSizeBuffer<CChar>]()
         
@@ -191,7 +191,7 @@ struct VulkanRenderPipelineDescriptor : Hashable {
                 pipelineInfo.pTessellationState = escapingPointer(to: &states.7)
                 pipelineInfo.pViewportState = escapingPointer(to: &states.8)
             
-                pipelineInfo.renderPass = renderPass.vkPass
+                pipelineInfo.renderPass = renderPass
                 pipelineInfo.subpass = UInt32(self.subpassIndex)
                 
                 withInfo(&pipelineInfo)
@@ -213,6 +213,9 @@ class VulkanRenderCommandEncoder : VulkanResourceBindingCommandEncoder {
     var currentDrawRenderPass : DrawRenderPass! = nil
     var pipelineDescriptor : VulkanRenderPipelineDescriptor
     
+    /// Whether the current pipeline is being compiled in the background, in which case it's checked for again on each draw.
+    var pipelineIsDeferred = false
+    
     var boundVertexBuffers = [Buffer?](repeating: nil, count: 8)
     var enqueuedBindings = [RenderGraphCommand]()
 
@@ -249,19 +252,25 @@ class VulkanRenderCommandEncoder : VulkanResourceBindingCommandEncoder {
     }
 
     
-    func prepareToDraw() {
+    /// Returns false if the draw should be skipped because its pipeline is still being compiled.
+    func prepareToDraw() -> Bool {
         assert(self.pipelineDescriptor.descriptor != nil, "No render pipeline descriptor is set.")
 
-        if self.pipelineDescriptor.hasChanged {
-            defer {
-                self.pipelineDescriptor.hasChanged = false
-            }
+        if self.pipelineDescriptor.hasChanged || self.pipelineIsDeferred {
+            self.pipelineDescriptor.hasChanged = false
 
             // Bind the pipeline before binding any resources.
 
-            let pipeline = self.stateCaches[self.pipelineDescriptor, 
-                                            renderPass: self.renderPass!]
-            vkCmdBindPipeline(self.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline)
+            let (pipeline, isDeferred) = self.stateCaches.renderPipelineForDraw(self.pipelineDescriptor, renderPass: self.renderPass!.vkPass)
+            self.pipelineIsDeferred = isDeferred
+            if isDeferred {
+                self.commandBufferResources.recordedDeferredDrawCount += 1
+            }
+            
+            guard let boundPipeline = pipeline else {
+                return false
+            }
+            vkCmdBindPipeline(self.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, boundPipeline)
         }
 
         for binding in self.enqueuedBindings {
@@ -310,6 +319,7 @@ class VulkanRenderCommandEncoder : VulkanResourceBindingCommandEncoder {
             }
         }
         self.enqueuedBindings.removeAll(keepingCapacity: true)
+        return true
     }
     
     private func beginPass(_ pass: RenderPassRecord) throws {
@@ -464,20 +474,58 @@ class VulkanRenderCommandEncoder : VulkanResourceBindingCommandEncoder {
             
         case .drawPrimitives(let args):
             self.pipelineDescriptor.primitiveType = args.pointee.primitiveType
-            self.prepareToDraw()
+            guard self.prepareToDraw() else { return }
             
             vkCmdDraw(self.commandBuffer, args.pointee.vertexCount, args.pointee.instanceCount, args.pointee.vertexStart, args.pointee.baseInstance)
             
+        case .drawPrimitivesIndirect(let args):
+            self.pipelineDescriptor.primitiveType = args.pointee.primitiveType
+            guard self.prepareToDraw() else { return }
+            
+            let indirectBuffer = resourceMap[args.pointee.indirectBuffer]
+            let indirectBufferOffset = VkDeviceSize(args.pointee.indirectBufferOffset) + VkDeviceSize(indirectBuffer.offset)
+            if let countBuffer = args.pointee.countBuffer, self.device.supportsDrawIndirectCount {
+                let countBuffer = resourceMap[countBuffer]
+                vkCmdDrawIndirectCount(self.commandBuffer, indirectBuffer.buffer.vkBuffer, indirectBufferOffset, countBuffer.buffer.vkBuffer, VkDeviceSize(args.pointee.countBufferOffset) + VkDeviceSize(countBuffer.offset), args.pointee.drawCount, args.pointee.stride)
+            } else if self.device.supportsMultiDrawIndirect {
+                vkCmdDrawIndirect(self.commandBuffer, indirectBuffer.buffer.vkBuffer, indirectBufferOffset, args.pointee.drawCount, args.pointee.stride)
+            } else {
+                for i in 0..<args.pointee.drawCount {
+                    vkCmdDrawIndirect(self.commandBuffer, indirectBuffer.buffer.vkBuffer, indirectBufferOffset + VkDeviceSize(i * args.pointee.stride), 1, args.pointee.stride)
+                }
+            }
+            
         case .drawIndexedPrimitives(let args):
             self.pipelineDescriptor.primitiveType = args.pointee.primitiveType
             
             let buffer = resourceMap[args.pointee.indexBuffer]
             vkCmdBindIndexBuffer(self.commandBuffer, buffer.buffer.vkBuffer, VkDeviceSize(args.pointee.indexBufferOffset) + VkDeviceSize(buffer.offset), VkIndexType(args.pointee.indexType))
             
-            self.prepareToDraw()
+            guard self.prepareToDraw() else { return }
             
             vkCmdDrawIndexed(self.commandBuffer, args.pointee.indexCount, args.pointee.instanceCount, 0, args.pointee.baseVertex, args.pointee.baseInstance)
             
+        case .drawIndexedPrimitivesIndirect(let args):
+            self.pipelineDescriptor.primitiveType = args.pointee.primitiveType
+            
+            let buffer = resourceMap[args.pointee.indexBuffer]
+            vkCmdBindIndexBuffer(self.commandBuffer, buffer.buffer.vkBuffer, VkDeviceSize(args.pointee.indexBufferOffset) + VkDeviceSize(buffer.offset), VkIndexType(args.pointee.indexType))
+            
+            guard self.prepareToDraw() else { return }
+            
+            let indirectBuffer = resourceMap[args.pointee.indirectBuffer]
+            let indirectBufferOffset = VkDeviceSize(args.pointee.indirectBufferOffset) + VkDeviceSize(indirectBuffer.offset)
+            if let countBuffer = args.pointee.countBuffer, self.device.supportsDrawIndirectCount {
+                let countBuffer = resourceMap[countBuffer]
+                vkCmdDrawIndexedIndirectCount(self.commandBuffer, indirectBuffer.buffer.vkBuffer, indirectBufferOffset, countBuffer.buffer.vkBuffer, VkDeviceSize(args.pointee.countBufferOffset) + VkDeviceSize(countBuffer.offset), args.pointee.drawCount, args.pointee.stride)
+            } else if self.device.supportsMultiDrawIndirect {
+                vkCmdDrawIndexedIndirect(self.commandBuffer, indirectBuffer.buffer.vkBuffer, indirectBufferOffset, args.pointee.drawCount, args.pointee.stride)
+            } else {
+                for i in 0..<args.pointee.drawCount {
+                    vkCmdDrawIndexedIndirect(self.commandBuffer, indirectBuffer.buffer.vkBuffer, indirectBufferOffset + VkDeviceSize(i * args.pointee.stride), 1, args.pointee.stride)
+                }
+            }
+            
         case .setViewport(let viewportPtr):
             var viewport = VkViewport(viewportPtr.pointee)
             vkCmdSetViewport(self.commandBuffer, 0, 1, &viewport)
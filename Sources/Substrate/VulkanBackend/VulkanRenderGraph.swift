@@ -88,6 +88,16 @@ extension VulkanBackend {
                     signalStages.formUnion(producingUsage.type.shaderStageMask(isDepthOrStencil: isDepthOrStencil, stages: producingUsage.stages))
                 }
                 
+                if dependency.isAliasingDependency {
+                    var aliasingStages: VkPipelineStageFlagBits = []
+                    for (producingUsage, _) in dependency.aliasedUsages {
+                        let pixelFormat = Texture(producingUsage.resource)?.descriptor.pixelFormat ?? .invalid
+                        aliasingStages.formUnion(producingUsage.type.shaderStageMask(isDepthOrStencil: pixelFormat.isDepth || pixelFormat.isStencil, stages: producingUsage.stages))
+                    }
+                    // If we don't know which stages last accessed the aliased memory, wait for all of them.
+                    signalStages.formUnion(aliasingStages.isEmpty ? VK_PIPELINE_STAGE_ALL_COMMANDS_BIT : aliasingStages)
+                }
+                
                 signalIndex = max(signalIndex, dependency.signal.index)
             }
             
@@ -97,9 +107,46 @@ extension VulkanBackend {
                 let dependency = dependencies.dependency(from: dependentIndex, on: sourceIndex)!
                 var destinationStages: VkPipelineStageFlagBits = []
                 
+                var memoryBarriers = [VkMemoryBarrier]()
                 var bufferBarriers = [VkBufferMemoryBarrier]()
                 var imageBarriers = [VkImageMemoryBarrier]()
                 
+                if dependency.isAliasingDependency {
+                    // Resources in the dependent encoder are placed in memory previously used by resources in the source encoder.
+                    // Their contents are discarded by the transition from VK_IMAGE_LAYOUT_UNDEFINED on first use, so we only need to make
+                    // the previous occupants' writes available to the new occupants' first usages.
+                    var srcAccessMask: VkAccessFlagBits = []
+                    var dstAccessMask: VkAccessFlagBits = []
+                    var aliasingStages: VkPipelineStageFlagBits = []
+                    for (producingUsage, consumingUsage) in dependency.aliasedUsages {
+                        if producingUsage.isWrite {
+                            let pixelFormat = Texture(producingUsage.resource)?.descriptor.pixelFormat ?? .invalid
+                            srcAccessMask.formUnion(producingUsage.type.accessMask(isDepthOrStencil: pixelFormat.isDepth || pixelFormat.isStencil))
+                        }
+                        let pixelFormat = Texture(consumingUsage.resource)?.descriptor.pixelFormat ?? .invalid
+                        let isDepthOrStencil = pixelFormat.isDepth || pixelFormat.isStencil
+                        dstAccessMask.formUnion(consumingUsage.type.accessMask(isDepthOrStencil: isDepthOrStencil))
+                        aliasingStages.formUnion(consumingUsage.type.shaderStageMask(isDepthOrStencil: isDepthOrStencil, stages: consumingUsage.stages))
+                    }
+                    
+                    if dependency.aliasedUsages.isEmpty || aliasingStages.isEmpty {
+                        // We don't know how the memory is used on one side, so cover every access.
+                        srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT
+                        dstAccessMask = [VK_ACCESS_MEMORY_READ_BIT, VK_ACCESS_MEMORY_WRITE_BIT]
+                        aliasingStages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT
+                    }
+                    
+                    if !srcAccessMask.isEmpty {
+                        // If the previous occupants only read the memory, the execution dependency is enough.
+                        var barrier = VkMemoryBarrier()
+                        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER
+                        barrier.srcAccessMask = srcAccessMask.rawValue
+                        barrier.dstAccessMask = dstAccessMask.rawValue
+                        memoryBarriers.append(barrier)
+                    }
+                    destinationStages.formUnion(aliasingStages)
+                }
+                
 //                assert(self.device.queueFamilyIndex(queue: queue, encoderType: sourceEncoderType) == self.device.queueFamilyIndex(queue: queue, encoderType: destinationEncoderType), "Queue ownership transfers must be handled with a pipeline barrier rather than an event")
                 
                 for (resource, producingUsage, consumingUsage) in dependency.resources {
@@ -219,8 +266,29 @@ extension VulkanBackend {
                     continue
                 }
 
-                let label = "Encoder \(sourceIndex) Event"
                 let sourceEncoder = frameCommandInfo.commandEncoders[sourceIndex]
+                
+                if sourceEncoder.queueFamilyIndex != frameCommandInfo.commandEncoders[dependentIndex].queueFamilyIndex {
+                    // Events can't be used across queues; the dependent command buffer instead waits on the source command buffer's semaphore,
+                    // which makes all of the source's writes available. We still need to perform any layout transitions on the dependent queue.
+                    if imageBarriers.isEmpty { continue }
+                    
+                    for i in imageBarriers.indices {
+                        imageBarriers[i].srcAccessMask = 0
+                    }
+                    
+                    let imageBarriersPtr: UnsafeMutablePointer<VkImageMemoryBarrier> = allocator.allocate(capacity: imageBarriers.count)
+                    imageBarriersPtr.initialize(from: imageBarriers, count: imageBarriers.count)
+                    
+                    let command: VulkanCompactedResourceCommandType = .pipelineBarrier(sourceStages: VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, destinationStages: destinationStages, dependencyFlags: VkDependencyFlagBits(rawValue: 0),
+                                                                                       memoryBarriers: UnsafeBufferPointer<VkMemoryBarrier>(start: nil, count: 0),
+                                                                                       bufferMemoryBarriers: UnsafeBufferPointer<VkBufferMemoryBarrier>(start: nil, count: 0),
+                                                                                       imageMemoryBarriers: UnsafeBufferPointer<VkImageMemoryBarrier>(start: imageBarriersPtr, count: imageBarriers.count))
+                    compactedResourceCommands.append(CompactedResourceCommand<VulkanCompactedResourceCommandType>(command: command, index: dependency.wait.index, order: .before))
+                    continue
+                }
+                
+                let label = "Encoder \(sourceIndex) Event"
                 let commandBufferSignalValue = frameCommandInfo.signalValue(commandBufferIndex: sourceEncoder.commandBufferIndex)
                 let fence = VulkanEventHandle(label: label, queue: queue, commandBufferIndex: commandBufferSignalValue)
 
@@ -230,6 +298,9 @@ extension VulkanBackend {
                 
                 compactedResourceCommands.append(CompactedResourceCommand<VulkanCompactedResourceCommandType>(command: .signalEvent(fence.event, afterStages: signalStages), index: signalIndex, order: .after))
                 
+                let memoryBarriersPtr: UnsafeMutablePointer<VkMemoryBarrier> = allocator.allocate(capacity: memoryBarriers.count)
+                memoryBarriersPtr.initialize(from: memoryBarriers, count: memoryBarriers.count)
+                
                 let bufferBarriersPtr: UnsafeMutablePointer<VkBufferMemoryBarrier> = allocator.allocate(capacity: bufferBarriers.count)
                 bufferBarriersPtr.initialize(from: bufferBarriers, count: bufferBarriers.count)
                 
@@ -238,7 +309,7 @@ extension VulkanBackend {
                 
                 let command: VulkanCompactedResourceCommandType = .waitForEvents(UnsafeBufferPointer(start: fence.eventPointer, count: 1),
                                                                                  sourceStages: signalStages, destinationStages: destinationStages,
-                                                                                 memoryBarriers: UnsafeBufferPointer<VkMemoryBarrier>(start: nil, count: 0),
+                                                                                 memoryBarriers: UnsafeBufferPointer<VkMemoryBarrier>(start: memoryBarriersPtr, count: memoryBarriers.count),
                                                                                  bufferMemoryBarriers: UnsafeBufferPointer<VkBufferMemoryBarrier>(start: bufferBarriersPtr, count: bufferBarriers.count),
                                                                                  imageMemoryBarriers: UnsafeBufferPointer<VkImageMemoryBarrier>(start: imageBarriersPtr, count: imageBarriers.count))
                 
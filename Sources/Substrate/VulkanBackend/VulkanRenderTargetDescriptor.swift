@@ -8,6 +8,7 @@
 #if canImport(Vulkan)
 import Vulkan
 import SubstrateCExtras
+import SubstrateUtilities
 
 enum MergeResult {
     case incompatible
@@ -580,6 +581,128 @@ struct VulkanCompatibleRenderPass: Hashable {
         }
     }
     
+    /// Creates a single-subpass render pass for `descriptor`, which is used to compile pipelines outside of a frame.
+    init(renderTargetDescriptor descriptor: RenderTargetDescriptor) {
+        self.attachments = [Attachment]()
+        self.attachments.reserveCapacity(descriptor.colorAttachments.count + 1)
+        
+        var depthStencilAttachmentIndex = VK_ATTACHMENT_UNUSED
+        if let depthAttachment = descriptor.depthAttachment {
+            depthStencilAttachmentIndex = UInt32(self.attachments.count)
+            self.attachments.append(Attachment(format: depthAttachment.texture.descriptor.pixelFormat, sampleCount: depthAttachment.texture.descriptor.sampleCount))
+        }
+        if let stencilAttachment = descriptor.stencilAttachment, stencilAttachment.texture != descriptor.depthAttachment?.texture {
+            depthStencilAttachmentIndex = UInt32(self.attachments.count)
+            self.attachments.append(Attachment(format: stencilAttachment.texture.descriptor.pixelFormat, sampleCount: stencilAttachment.texture.descriptor.sampleCount))
+        }
+        
+        var colorAttachmentIndices = [UInt32]()
+        var resolveAttachmentIndices = [UInt32]()
+        for colorAttachment in descriptor.colorAttachments {
+            guard let colorAttachment = colorAttachment else {
+                colorAttachmentIndices.append(VK_ATTACHMENT_UNUSED)
+                resolveAttachmentIndices.append(VK_ATTACHMENT_UNUSED)
+                continue
+            }
+            colorAttachmentIndices.append(UInt32(self.attachments.count))
+            self.attachments.append(Attachment(format: colorAttachment.texture.descriptor.pixelFormat, sampleCount: colorAttachment.texture.descriptor.sampleCount))
+            
+            if let resolveTexture = colorAttachment.resolveTexture {
+                resolveAttachmentIndices.append(UInt32(self.attachments.count))
+                self.attachments.append(Attachment(format: resolveTexture.descriptor.pixelFormat, sampleCount: resolveTexture.descriptor.sampleCount))
+            } else {
+                resolveAttachmentIndices.append(VK_ATTACHMENT_UNUSED)
+            }
+        }
+        
+        self.flags = 0
+        self.dependencies = []
+        self.subpasses = [Subpass(flags: 0,
+                                  bindPoint: VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                  inputAttachmentIndices: [],
+                                  colorAttachmentIndices: colorAttachmentIndices,
+                                  depthStencilAttachmentIndex: depthStencilAttachmentIndex,
+                                  resolveAttachmentIndices: resolveAttachmentIndices)]
+    }
+    
+    /// Creates a render pass that is compatible with this one, for use when creating pipelines.
+    /// The caller is responsible for destroying the returned render pass.
+    func makeVkRenderPass(device: VulkanDevice) -> VkRenderPass? {
+        let attachments = self.attachments.map { attachment -> VkAttachmentDescription in
+            var description = VkAttachmentDescription()
+            description.format = VkFormat(pixelFormat: attachment.format)!
+            description.samples = VkSampleCountFlagBits(rawValue: UInt32(attachment.sampleCount))
+            description.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE
+            description.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE
+            description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE
+            description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE
+            description.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+            description.finalLayout = VK_IMAGE_LAYOUT_GENERAL
+            return description
+        }
+        
+        // Compute the attachment count in advance so we don't resize the attachment reference buffer.
+        let attachmentReferenceCount = self.subpasses.reduce(0, { $0 + $1.inputAttachmentIndices.count + 2 * $1.colorAttachmentIndices.count + 1 })
+        let attachmentReferences = ExpandingBuffer<VkAttachmentReference>(initialCapacity: attachmentReferenceCount)
+        
+        var subpasses = [VkSubpassDescription]()
+        for subpass in self.subpasses {
+            var description = VkSubpassDescription()
+            description.flags = subpass.flags
+            description.pipelineBindPoint = subpass.bindPoint
+            
+            description.pInputAttachments = UnsafePointer(attachmentReferences.buffer.advanced(by: attachmentReferences.count))
+            for index in subpass.inputAttachmentIndices {
+                attachmentReferences.append(VkAttachmentReference(attachment: index, layout: VK_IMAGE_LAYOUT_GENERAL))
+            }
+            description.inputAttachmentCount = UInt32(subpass.inputAttachmentIndices.count)
+            
+            description.pColorAttachments = UnsafePointer(attachmentReferences.buffer.advanced(by: attachmentReferences.count))
+            for index in subpass.colorAttachmentIndices {
+                attachmentReferences.append(VkAttachmentReference(attachment: index, layout: VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL))
+            }
+            description.colorAttachmentCount = UInt32(subpass.colorAttachmentIndices.count)
+            
+            description.pResolveAttachments = UnsafePointer(attachmentReferences.buffer.advanced(by: attachmentReferences.count))
+            for index in subpass.resolveAttachmentIndices {
+                attachmentReferences.append(VkAttachmentReference(attachment: index, layout: VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL))
+            }
+            
+            if subpass.depthStencilAttachmentIndex != VK_ATTACHMENT_UNUSED {
+                description.pDepthStencilAttachment = UnsafePointer(attachmentReferences.buffer.advanced(by: attachmentReferences.count))
+                attachmentReferences.append(VkAttachmentReference(attachment: subpass.depthStencilAttachmentIndex, layout: VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL))
+            }
+            
+            subpasses.append(description)
+        }
+        assert(attachmentReferences.count <= attachmentReferenceCount)
+        
+        var renderPass : VkRenderPass? = nil
+        withExtendedLifetime(attachmentReferences) {
+            var createInfo = VkRenderPassCreateInfo()
+            createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO
+            createInfo.flags = self.flags
+            
+            subpasses.withUnsafeBufferPointer { subpasses in
+                createInfo.pSubpasses = subpasses.baseAddress
+                createInfo.subpassCount = UInt32(subpasses.count)
+                
+                attachments.withUnsafeBufferPointer { attachments in
+                    createInfo.pAttachments = attachments.baseAddress
+                    createInfo.attachmentCount = UInt32(attachments.count)
+                    
+                    self.dependencies.withUnsafeBufferPointer { dependencies in
+                        createInfo.pDependencies = dependencies.baseAddress
+                        createInfo.dependencyCount = UInt32(dependencies.count)
+                        
+                        vkCreateRenderPass(device.vkDevice, &createInfo, nil, &renderPass)
+                    }
+                }
+            }
+        }
+        return renderPass
+    }
+    
     func hash(into hasher: inout Hasher) {
         hasher.combine(self.attachments)
         hasher.combine(self.flags)
@@ -46,6 +46,16 @@ enum VulkanSharingMode : Equatable {
         self.init(queueFlags: queueFlags, device: device)
     }
     
+    /// Transient resources only need to be shared between queue families when the device has an async compute queue;
+    /// they're shared concurrently so that passes on different queues don't need queue family ownership transfers.
+    public init(transientUsage usage: VkBufferUsageFlagBits, device: VulkanDevice) {
+        self = device.asyncComputeQueue != nil ? VulkanSharingMode(usage: usage, device: device) : .exclusive
+    }
+    
+    public init(transientUsage usage: VkImageUsageFlagBits, device: VulkanDevice) {
+        self = device.asyncComputeQueue != nil ? VulkanSharingMode(usage: usage, device: device) : .exclusive
+    }
+    
     public init(queueFlags: VkQueueFlagBits, device: VulkanDevice) {
         self = .concurrent(queueFamilyIndices: device.queueFamilyIndices(matchingAnyOf: queueFlags)) // FIXME: figure out how to manage queue sharing.
     }
@@ -329,6 +329,7 @@ final class VulkanTransientResourceRegistry: BackendTransientResourceRegistry {
     private let stagingTextureAllocator : VulkanPoolResourceAllocator
     private let historyBufferAllocator : VulkanPoolResourceAllocator
     private let privateAllocator : VulkanPoolResourceAllocator
+    private let aliasingAllocator : VulkanAliasingResourceAllocator
     
     private let descriptorPools: [VulkanDescriptorPool]
     
@@ -360,6 +361,7 @@ final class VulkanTransientResourceRegistry: BackendTransientResourceRegistry {
         self.stagingTextureAllocator = VulkanPoolResourceAllocator(device: device, allocator: persistentRegistry.vmaAllocator, numFrames: inflightFrameCount)
         self.historyBufferAllocator = VulkanPoolResourceAllocator(device: device, allocator: persistentRegistry.vmaAllocator, numFrames: 1)
         self.privateAllocator = VulkanPoolResourceAllocator(device: device, allocator: persistentRegistry.vmaAllocator, numFrames: 1)
+        self.aliasingAllocator = VulkanAliasingResourceAllocator(device: device, allocator: persistentRegistry.vmaAllocator, numFrames: inflightFrameCount)
         
         self.descriptorPools = (0..<inflightFrameCount).map { _ in VulkanDescriptorPool(device: device, incrementalRelease: false) }
         
@@ -433,17 +435,36 @@ final class VulkanTransientResourceRegistry: BackendTransientResourceRegistry {
         }
     }
     
-    static func isAliasedHeapResource(resource: Resource) -> Bool {
-        return false
+    static func isAliasingCandidate(resource: Resource) -> Bool {
+        guard resource.type == .texture || resource.type == .buffer else {
+            return false
+        }
+        
+        let flags = resource.flags
+        if flags.intersection([.persistent, .historyBuffer, .windowHandle]) != [] {
+            return false
+        }
+        
+        return resource.storageMode == .private
     }
     
-    @discardableResult
-    public func allocateTexture(_ texture: Texture, forceGPUPrivate: Bool) -> VkImageReference {
-        if texture.flags.contains(.windowHandle) {    
-            self.textureReferences[texture] = VkImageReference(windowTexture: ()) // We retrieve the swapchain image later.
-            return VkImageReference(windowTexture: ())
+    func isAliasedHeapResource(resource: Resource) -> Bool {
+        return self.aliasingAllocator.isAliased(resource)
+    }
+    
+    func planTransientAliasing(lifetimes: [TransientResourceLifetime]) {
+        let resources = lifetimes.map { lifetime -> VulkanAliasingResourceAllocator.PlannedResource in
+            if let texture = Texture(lifetime.resource) {
+                return .image(self.imageDescriptor(for: texture, forceGPUPrivate: true))
+            } else {
+                return .buffer(self.bufferDescriptor(for: Buffer(lifetime.resource)!, forceGPUPrivate: true))
+            }
         }
-
+        
+        self.aliasingAllocator.planFrame(resources: resources, lifetimes: lifetimes, disposalFences: { self.heapResourceDisposalFences[$0] ?? [] })
+    }
+    
+    func imageDescriptor(for texture: Texture, forceGPUPrivate: Bool) -> VulkanImageDescriptor {
         var imageUsage : VkImageUsageFlagBits = []
         
         let canBeTransient = texture.usages.allSatisfy({ $0.type.isRenderTarget })
@@ -452,34 +473,46 @@ final class VulkanTransientResourceRegistry: BackendTransientResourceRegistry {
         }
         let isDepthOrStencil = texture.descriptor.pixelFormat.isDepth || texture.descriptor.pixelFormat.isStencil
         
-        for usage in texture.usages {
-            switch usage.type {
-            case .read:
-                imageUsage.formUnion(VK_IMAGE_USAGE_SAMPLED_BIT)
-            case .write, .readWrite:
-                imageUsage.formUnion(VK_IMAGE_USAGE_STORAGE_BIT)
-            case .readWriteRenderTarget, .writeOnlyRenderTarget:
-                imageUsage.formUnion(isDepthOrStencil ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
-            case .inputAttachment, .inputAttachmentRenderTarget:
-                imageUsage.formUnion(VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT)
-            case .blitSource:
-                imageUsage.formUnion(VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
-            case .blitDestination:
-                imageUsage.formUnion(VK_IMAGE_USAGE_TRANSFER_DST_BIT)
-            default:
-                break
+        texture.usages.withContiguousChunks { usages in
+            for usage in usages {
+                switch usage.type {
+                case .read:
+                    imageUsage.formUnion(VK_IMAGE_USAGE_SAMPLED_BIT)
+                case .write, .readWrite:
+                    imageUsage.formUnion(VK_IMAGE_USAGE_STORAGE_BIT)
+                case .readWriteRenderTarget, .writeOnlyRenderTarget:
+                    imageUsage.formUnion(isDepthOrStencil ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
+                case .inputAttachment, .inputAttachmentRenderTarget:
+                    imageUsage.formUnion(VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT)
+                case .blitSource:
+                    imageUsage.formUnion(VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
+                case .blitDestination:
+                    imageUsage.formUnion(VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+                default:
+                    break
+                }
             }
         }
         
         var descriptor = texture.descriptor
-        let flags = texture.flags
         
         if forceGPUPrivate {
             descriptor.storageMode = .private
         }
+        
+        return VulkanImageDescriptor(descriptor, usage: imageUsage, sharingMode: VulkanSharingMode(transientUsage: imageUsage, device: self.persistentRegistry.device), initialLayout: VK_IMAGE_LAYOUT_UNDEFINED)
+    }
+    
+    @discardableResult
+    public func allocateTexture(_ texture: Texture, forceGPUPrivate: Bool) -> VkImageReference {
+        if texture.flags.contains(.windowHandle) {    
+            self.textureReferences[texture] = VkImageReference(windowTexture: ()) // We retrieve the swapchain image later.
+            return VkImageReference(windowTexture: ())
+        }
 
-        let allocator = self.allocatorForImage(storageMode: descriptor.storageMode, cacheMode: descriptor.cacheMode, flags: flags)
-        let (vkImage, events, waitEvent) = allocator.collectImage(descriptor: VulkanImageDescriptor(descriptor, usage: imageUsage, sharingMode: .exclusive, initialLayout: VK_IMAGE_LAYOUT_UNDEFINED))
+        let imageDescriptor = self.imageDescriptor(for: texture, forceGPUPrivate: forceGPUPrivate)
+        let (vkImage, events, waitEvent) = self.aliasingAllocator.collectImage(for: Resource(texture)) ??
+            self.allocatorForImage(storageMode: imageDescriptor.storageMode, cacheMode: imageDescriptor.cacheMode, flags: texture.flags).collectImage(descriptor: imageDescriptor)
         
         if let label = texture.label {
             vkImage.image.label = label
@@ -513,6 +546,11 @@ final class VulkanTransientResourceRegistry: BackendTransientResourceRegistry {
     public func allocateWindowHandleTexture(_ texture: Texture) throws -> VkImageReference {
         precondition(texture.flags.contains(.windowHandle))
         
+        // The image may have already been acquired before encoding, in which case encoding may be off the main thread.
+        if self.textureReferences[texture]!._image != nil {
+            return self.textureReferences[texture]!
+        }
+        
         RenderGraph.jobManager.syncOnMainThread {
             if self.textureReferences[texture]!._image != nil {
                 return
@@ -528,31 +566,32 @@ final class VulkanTransientResourceRegistry: BackendTransientResourceRegistry {
         return self.textureReferences[texture]!
     }
     
-    @discardableResult
-    public func allocateBuffer(_ buffer: Buffer, forceGPUPrivate: Bool) -> VkBufferReference {
+    func bufferDescriptor(for buffer: Buffer, forceGPUPrivate: Bool) -> VulkanBufferDescriptor {
         // If this is a CPU-visible buffer, include the usage hints passed by the user.
         var bufferUsage: VkBufferUsageFlagBits = forceGPUPrivate ? [] : VkBufferUsageFlagBits(buffer.descriptor.usageHint)
 
-        for usage in buffer.usages {
-            switch usage.type {
-            case .constantBuffer:
-                bufferUsage.formUnion(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
-            case .read:
-                bufferUsage.formUnion([VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT])
-            case .write:
-                bufferUsage.formUnion([VK_BUFFER_USAGE_STORAGE_BUFFER_BIT])
-            case .readWrite:
-                bufferUsage.formUnion([VK_BUFFER_USAGE_STORAGE_BUFFER_BIT])
-            case .vertexBuffer:
-                bufferUsage.formUnion(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT)
-            case .indexBuffer:
-                bufferUsage.formUnion(VK_BUFFER_USAGE_INDEX_BUFFER_BIT)
-            case .blitSource:
-                bufferUsage.formUnion(VK_BUFFER_USAGE_TRANSFER_SRC_BIT)
-            case .blitDestination:
-                bufferUsage.formUnion(VK_BUFFER_USAGE_TRANSFER_DST_BIT)
-            default:
-                break
+        buffer.usages.withContiguousChunks { usages in
+            for usage in usages {
+                switch usage.type {
+                case .constantBuffer:
+                    bufferUsage.formUnion(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+                case .read:
+                    bufferUsage.formUnion([VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT])
+                case .write:
+                    bufferUsage.formUnion([VK_BUFFER_USAGE_STORAGE_BUFFER_BIT])
+                case .readWrite:
+                    bufferUsage.formUnion([VK_BUFFER_USAGE_STORAGE_BUFFER_BIT])
+                case .vertexBuffer:
+                    bufferUsage.formUnion(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT)
+                case .indexBuffer:
+                    bufferUsage.formUnion(VK_BUFFER_USAGE_INDEX_BUFFER_BIT)
+                case .blitSource:
+                    bufferUsage.formUnion(VK_BUFFER_USAGE_TRANSFER_SRC_BIT)
+                case .blitDestination:
+                    bufferUsage.formUnion(VK_BUFFER_USAGE_TRANSFER_DST_BIT)
+                default:
+                    break
+                }
             }
         }
         if bufferUsage.isEmpty, !forceGPUPrivate {
@@ -565,8 +604,14 @@ final class VulkanTransientResourceRegistry: BackendTransientResourceRegistry {
             descriptor.storageMode = .private
         }
         
-        let allocator = self.allocatorForBuffer(storageMode: forceGPUPrivate ? .private : buffer.descriptor.storageMode, cacheMode: buffer.descriptor.cacheMode, flags: buffer.flags)
-        let (vkBuffer, events, waitSemaphore) = allocator.collectBuffer(descriptor: VulkanBufferDescriptor(descriptor, usage: bufferUsage, sharingMode: .exclusive))
+        return VulkanBufferDescriptor(descriptor, usage: bufferUsage, sharingMode: VulkanSharingMode(transientUsage: bufferUsage, device: self.persistentRegistry.device))
+    }
+    
+    @discardableResult
+    public func allocateBuffer(_ buffer: Buffer, forceGPUPrivate: Bool) -> VkBufferReference {
+        let bufferDescriptor = self.bufferDescriptor(for: buffer, forceGPUPrivate: forceGPUPrivate)
+        let (vkBuffer, events, waitSemaphore) = self.aliasingAllocator.collectBuffer(for: Resource(buffer)) ??
+            self.allocatorForBuffer(storageMode: bufferDescriptor.storageMode, cacheMode: bufferDescriptor.cacheMode, flags: buffer.flags).collectBuffer(descriptor: bufferDescriptor)
         
         if let label = buffer.label {
             vkBuffer.buffer.label = label
@@ -668,7 +713,7 @@ final class VulkanTransientResourceRegistry: BackendTransientResourceRegistry {
     }
     
     func setDisposalFences(on resource: Resource, to events: [FenceDependency]) {
-        assert(Self.isAliasedHeapResource(resource: Resource(resource)))
+        assert(Self.isAliasingCandidate(resource: Resource(resource)))
         self.heapResourceDisposalFences[Resource(resource)] = events
     }
     
@@ -692,13 +737,13 @@ final class VulkanTransientResourceRegistry: BackendTransientResourceRegistry {
                 vkTexture._image.release()
             }
             
-            var events : [FenceDependency] = []
-            if Self.isAliasedHeapResource(resource: Resource(texture)) {
-                events = self.heapResourceDisposalFences[Resource(texture)] ?? []
+            if self.aliasingAllocator.deposit(Resource(texture), waitEvent: waitEvent) {
+                return
             }
             
+            // Only resources placed by the aliasing allocator share memory, so nothing else needs to wait on heap aliasing fences.
             let allocator = self.allocatorForImage(storageMode: texture.descriptor.storageMode, cacheMode: texture.descriptor.cacheMode, flags: texture.flags)
-            allocator.depositImage(vkTexture, events: events, waitSemaphore: waitEvent)
+            allocator.depositImage(vkTexture, events: [], waitSemaphore: waitEvent)
         }
     }
     
@@ -715,13 +760,12 @@ final class VulkanTransientResourceRegistry: BackendTransientResourceRegistry {
         }
         
         if let vkBuffer = bufferRef {
-            var events : [FenceDependency] = []
-            if Self.isAliasedHeapResource(resource: Resource(buffer)) {
-                events = self.heapResourceDisposalFences[Resource(buffer)] ?? []
+            if self.aliasingAllocator.deposit(Resource(buffer), waitEvent: waitEvent) {
+                return
             }
             
             let allocator = self.allocatorForBuffer(storageMode: buffer.descriptor.storageMode, cacheMode: buffer.descriptor.cacheMode, flags: buffer.flags)
-            allocator.depositBuffer(vkBuffer, events: events, waitSemaphore: waitEvent)
+            allocator.depositBuffer(vkBuffer, events: [], waitSemaphore: waitEvent)
         }
     }
     
@@ -762,10 +806,22 @@ final class VulkanTransientResourceRegistry: BackendTransientResourceRegistry {
         self.stagingTextureAllocator.cycleFrames()
         self.historyBufferAllocator.cycleFrames()
         self.privateAllocator.cycleFrames()
+        self.aliasingAllocator.cycleFrames()
         
         self.descriptorPoolIndex = (self.descriptorPoolIndex &+ 1) % self.inflightFrameCount
         self.frameIndex += 1
     }
+    
+    func takeAllocationStatistics() -> TransientAllocationStatistics {
+        var statistics = TransientAllocationStatistics()
+        statistics.transientBytes = self.aliasingAllocator.lastFrameStatistics.aliasedSize
+        for allocator in [self.stagingTextureAllocator, self.historyBufferAllocator, self.privateAllocator] {
+            statistics.poolHitCount += allocator.statistics.hitCount
+            statistics.poolMissCount += allocator.statistics.missCount
+            allocator.resetStatistics()
+        }
+        return statistics
+    }
 }
 
 #endif // canImport(Vulkan)
@@ -556,6 +556,8 @@ final class VulkanShaderLibrary {
     private let functionsToModules : [String : VulkanShaderModule]
     
     let spvcContext : spvc_context
+    /// Guards the caches and the SPIRV-Cross compilers, since pipelines may be compiled on background threads.
+    private let accessLock = DispatchSemaphore(value: 1)
     private var reflectionCache = [PipelineLayoutKey : VulkanPipelineReflection]()
     private var pipelineLayoutCache = [PipelineLayoutKey : VkPipelineLayout]()
     
@@ -605,6 +607,9 @@ final class VulkanShaderLibrary {
     }
     
     func pipelineLayout(for key: PipelineLayoutKey) -> VkPipelineLayout {
+        self.accessLock.wait()
+        defer { self.accessLock.signal() }
+        
         if let layout = self.pipelineLayoutCache[key] { // FIXME: we also need to take into account whether the /descriptor set layouts/ are identical.
             return layout
         }
@@ -612,7 +617,7 @@ final class VulkanShaderLibrary {
         var createInfo = VkPipelineLayoutCreateInfo()
         createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO
         
-        let reflection = self.reflection(for: key)
+        let reflection = self.reflectionWithLockHeld(for: key)
         let setLayouts : [VkDescriptorSetLayout?] = reflection.vkDescriptorSetLayouts
 
         var pushConstantRanges = [VkPushConstantRange]()
@@ -637,6 +642,12 @@ final class VulkanShaderLibrary {
     }
     
     func reflection(for key: PipelineLayoutKey) -> VulkanPipelineReflection {
+        self.accessLock.wait()
+        defer { self.accessLock.signal() }
+        return self.reflectionWithLockHeld(for: key)
+    }
+    
+    private func reflectionWithLockHeld(for key: PipelineLayoutKey) -> VulkanPipelineReflection {
         if let reflection = self.reflectionCache[key] {
             return reflection
         }
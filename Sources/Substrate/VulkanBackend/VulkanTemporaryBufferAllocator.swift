@@ -62,8 +62,8 @@ fileprivate class VulkanTemporaryBufferArena {
                 let renderAPIDescriptor = BufferDescriptor(length: allocationSize, storageMode: self.storageMode, cacheMode: self.cacheMode, usage: [.shaderRead, .vertexBuffer, .indexBuffer, .blitSource])
                 
                 var allocInfo = VmaAllocationCreateInfo(storageMode: self.storageMode, cacheMode: self.cacheMode)
-                // FIXME: is it actually valid to have a buffer being used without ownership transfers?
-                let descriptor = VulkanBufferDescriptor(renderAPIDescriptor, usage: [.uniformBuffer, .storageBuffer, .vertexBuffer, .indexBuffer, .transferSource], sharingMode: .exclusive)
+                let bufferUsage: VkBufferUsageFlagBits = [.uniformBuffer, .storageBuffer, .vertexBuffer, .indexBuffer, .transferSource]
+                let descriptor = VulkanBufferDescriptor(renderAPIDescriptor, usage: bufferUsage, sharingMode: VulkanSharingMode(transientUsage: bufferUsage, device: self.device))
                 var buffer : VkBuffer? = nil
                 var allocation : VmaAllocation? = nil
                 var allocationInfo = VmaAllocationInfo()
@@ -159,6 +159,10 @@ public struct AtomicBitSet {
         self.storageCount = storageCount
     }
     
+    public func dispose() {
+        self.storage.deallocate()
+    }
+    
     @inlinable
     public subscript(uintIndex uintIndex: Int, offset offset: Int) -> UInt {
         get {
@@ -258,6 +262,159 @@ public struct AtomicBitSet {
         }
     }
     
+    @inlinable
+    public func clearBits(in range: Range<Int>) {
+        assert(range.upperBound <= self.storageCount * BitSet.bitsPerElement)
+        
+        var (uintIndex, offset) = range.lowerBound.quotientAndRemainder(dividingBy: BitSet.bitsPerElement)
+        
+        var remaining = range.count
+        
+        let bitsInFirstWordCount = min(range.count, BitSet.bitsPerElement - offset)
+        let firstWordBits : UInt = (bitsInFirstWordCount == BitSet.bitsPerElement) ? ~0 : ((1 &<< bitsInFirstWordCount) &- 1)
+        UInt.AtomicRepresentation.atomicLoadThenBitwiseAnd(with: ~(firstWordBits << offset), at: self.storage.advanced(by: uintIndex), ordering: .relaxed)
+        
+        uintIndex += 1
+        remaining -= bitsInFirstWordCount
+        
+        while remaining > 0 {
+            if remaining < BitSet.bitsPerElement {
+                UInt.AtomicRepresentation.atomicLoadThenBitwiseAnd(with: ~((1 &<< remaining) &- 1), at: self.storage.advanced(by: uintIndex), ordering: .relaxed)
+                remaining = 0
+            } else {
+                UInt.AtomicRepresentation.atomicStore(0, at: self.storage.advanced(by: uintIndex), ordering: .relaxed)
+                remaining -= BitSet.bitsPerElement
+            }
+            uintIndex += 1
+        }
+    }
+    
+    /// Atomically sets every bit in `range` if they're all clear, returning whether the bits were set.
+    /// Ranges spanning several words are claimed a word at a time; if a later word conflicts, the earlier words are released again.
+    @inlinable
+    public func trySetBits(in range: Range<Int>) -> Bool {
+        assert(range.upperBound <= self.storageCount * BitSet.bitsPerElement)
+        
+        let (firstIndex, offset) = range.lowerBound.quotientAndRemainder(dividingBy: BitSet.bitsPerElement)
+        
+        var uintIndex = firstIndex
+        var remaining = range.count
+        var bitsInWordCount = min(range.count, BitSet.bitsPerElement - offset)
+        var wordOffset = offset
+        
+        while remaining > 0 {
+            let wordBits : UInt = ((bitsInWordCount == BitSet.bitsPerElement) ? ~0 : ((1 &<< bitsInWordCount) &- 1)) << wordOffset
+            
+            var current = UInt.AtomicRepresentation.atomicLoad(at: self.storage.advanced(by: uintIndex), ordering: .relaxed)
+            while true {
+                if current & wordBits != 0 {
+                    // Release the words we've already claimed.
+                    if uintIndex > firstIndex {
+                        self.clearBits(in: range.lowerBound..<(range.lowerBound + range.count - remaining))
+                    }
+                    return false
+                }
+                let (exchanged, original) = UInt.AtomicRepresentation.atomicWeakCompareExchange(expected: current, desired: current | wordBits, at: self.storage.advanced(by: uintIndex), successOrdering: .acquiring, failureOrdering: .relaxed)
+                if exchanged { break }
+                current = original
+            }
+            
+            remaining -= bitsInWordCount
+            bitsInWordCount = min(remaining, BitSet.bitsPerElement)
+            wordOffset = 0
+            uintIndex += 1
+        }
+        return true
+    }
+    
+    /// Atomically sets up to `maxCount` clear bits within the first non-full word at or after `startWordIndex`,
+    /// returning the index of that word and the bits that were set, or `nil` if every word is full.
+    @inlinable
+    public func setFirstClearBits(maxCount: Int, startingAtWord startWordIndex: Int = 0) -> (uintIndex: Int, bits: UInt)? {
+        assert(maxCount > 0)
+        
+        var uintIndex = startWordIndex
+        while uintIndex < self.storageCount {
+            var current = UInt.AtomicRepresentation.atomicLoad(at: self.storage.advanced(by: uintIndex), ordering: .relaxed)
+            while current != ~0 {
+                var clearBits = ~current
+                var bits = 0 as UInt
+                for _ in 0..<maxCount where clearBits != 0 {
+                    bits |= clearBits & (0 &- clearBits) // Lowest clear bit
+                    clearBits &= clearBits &- 1
+                }
+                
+                let (exchanged, original) = UInt.AtomicRepresentation.atomicWeakCompareExchange(expected: current, desired: current | bits, at: self.storage.advanced(by: uintIndex), successOrdering: .acquiring, failureOrdering: .relaxed)
+                if exchanged {
+                    return (uintIndex, bits)
+                }
+                current = original
+            }
+            uintIndex += 1
+        }
+        return nil
+    }
+    
+    /// Atomically clears `bits` within the word at `uintIndex`.
+    @inlinable
+    public func clearBits(_ bits: UInt, inWordAt uintIndex: Int) {
+        UInt.AtomicRepresentation.atomicLoadThenBitwiseAnd(with: ~bits, at: self.storage.advanced(by: uintIndex), ordering: .releasing)
+    }
+    
+    /// Returns the index of the first word at or after `startIndex` that has at least one clear bit, or `storageCount` if every word is full.
+    @inlinable
+    public func firstNonFullWord(startingAt startIndex: Int = 0) -> Int {
+        var uintIndex = startIndex
+        while uintIndex < self.storageCount, UInt.AtomicRepresentation.atomicLoad(at: self.storage.advanced(by: uintIndex), ordering: .relaxed) == ~0 {
+            uintIndex += 1
+        }
+        return uintIndex
+    }
+    
+    /// Returns the index of the first run of `count` clear bits, scanning a word at a time from the word at `startWordIndex`.
+    /// Full and empty words are skipped whole; within mixed words, runs are found by counting trailing zeros and ones.
+    @inlinable
+    public func firstClearRun(count: Int, startingAtWord startWordIndex: Int = 0) -> Int? {
+        assert(count > 0)
+        
+        var runStart = 0
+        var runLength = 0
+        
+        for uintIndex in startWordIndex..<self.storageCount {
+            let word = UInt.AtomicRepresentation.atomicLoad(at: self.storage.advanced(by: uintIndex), ordering: .relaxed)
+            let wordStart = uintIndex * BitSet.bitsPerElement
+            
+            if word == 0 {
+                if runLength == 0 { runStart = wordStart }
+                runLength += BitSet.bitsPerElement
+                if runLength >= count { return runStart }
+                continue
+            } else if word == ~0 {
+                runLength = 0
+                continue
+            } else if count == 1 {
+                return wordStart + (~word).trailingZeroBitCount
+            }
+            
+            var bit = 0
+            while bit < BitSet.bitsPerElement {
+                let remainingBits = word &>> bit
+                let clearCount = remainingBits == 0 ? BitSet.bitsPerElement - bit : remainingBits.trailingZeroBitCount
+                if clearCount > 0 {
+                    if runLength == 0 { runStart = wordStart + bit }
+                    runLength += clearCount
+                    if runLength >= count { return runStart }
+                    bit += clearCount
+                    if bit == BitSet.bitsPerElement { break } // The run may continue into the next word.
+                }
+                
+                runLength = 0
+                bit += (~remainingBits &>> clearCount).trailingZeroBitCount
+            }
+        }
+        return nil
+    }
+    
     @inlinable
     public func clearBits(in set: BitSet) {
         assert(set.storageCount == self.storageCount)
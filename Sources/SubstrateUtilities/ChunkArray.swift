@@ -5,26 +5,28 @@
 //  Created by Thomas Roughton on 23/08/20.
 //
 
+/// An append-only segmented array whose elements never move once appended.
+///
+/// Elements are stored in chunks whose capacities grow geometrically (8, 16, 32, ...), and a directory of chunk pointers
+/// is kept alongside the elements, so indexing is O(1) and the directory stays small.
+/// Copies share storage; when the directory grows, the previous directory is only freed for allocators that require deallocation.
 public struct ChunkArray<Element>: Collection {
     @inlinable
     public static var elementsPerChunk: Int { 8 }
     
-    @usableFromInline typealias Storage = (Element, Element, Element, Element, Element, Element, Element, Element)
-    
-    @usableFromInline
-    struct Chunk {
-        @usableFromInline var elements: Storage
-        @usableFromInline var next: UnsafeMutablePointer<Chunk>?
-    }
+    @inlinable
+    static var initialDirectoryCapacity: Int { 4 }
     
     public var count: Int
-    @usableFromInline var next: UnsafeMutablePointer<Chunk>?
-    @usableFromInline var tail: UnsafeMutablePointer<Chunk>?
+    @usableFromInline var chunkCount: Int
+    /// The base addresses of the chunks, where chunk `i` has capacity `elementsPerChunk << i`.
+    @usableFromInline var chunks: UnsafeMutablePointer<UnsafeMutablePointer<Element>>?
     
     @inlinable
     public init() {
         precondition(_isPOD(Element.self))
         self.count = 0
+        self.chunkCount = 0
     }
     
     
@@ -40,6 +42,39 @@ public struct ChunkArray<Element>: Collection {
         return i + 1
     }
     
+    @inlinable
+    public func index(_ i: Int, offsetBy distance: Int) -> Int {
+        return i + distance
+    }
+    
+    @inlinable
+    public func distance(from start: Int, to end: Int) -> Int {
+        return end - start
+    }
+    
+    /// The index of the first element in the chunk at `chunkIndex`.
+    @inlinable
+    static func startIndex(ofChunk chunkIndex: Int) -> Int {
+        return ChunkArray.elementsPerChunk * ((1 << chunkIndex) - 1)
+    }
+    
+    @inlinable
+    static func chunkIndex(for index: Int) -> Int {
+        let chunkNumber = UInt(index / ChunkArray.elementsPerChunk + 1)
+        return UInt.bitWidth - 1 - chunkNumber.leadingZeroBitCount
+    }
+    
+    @inlinable
+    var capacity: Int {
+        return ChunkArray.startIndex(ofChunk: self.chunkCount)
+    }
+    
+    @inlinable
+    func pointer(to index: Int) -> UnsafeMutablePointer<Element> {
+        let chunkIndex = ChunkArray.chunkIndex(for: index)
+        return self.chunks.unsafelyUnwrapped[chunkIndex].advanced(by: index - ChunkArray.startIndex(ofChunk: chunkIndex))
+    }
+    
     @inlinable
     public subscript(_ index: Int) -> Element {
         get {
@@ -53,26 +88,13 @@ public struct ChunkArray<Element>: Collection {
     @inlinable
     public subscript(pointerTo index: Int) -> UnsafeMutablePointer<Element> {
         precondition(index >= 0 && index < self.count)
-        let (chunkIndex, indexInChunk) = index.quotientAndRemainder(dividingBy: ChunkArray.elementsPerChunk)
-        
-        var currentChunk = self.next!
-        if chunkIndex == (self.count - 1) / ChunkArray.elementsPerChunk { // precondition: !self.isEmpty
-            currentChunk = self.tail!
-        } else {
-            for _ in 0..<chunkIndex {
-                currentChunk = currentChunk.pointee.next!
-            }
-        }
-            
-        return UnsafeMutableRawPointer(currentChunk).assumingMemoryBound(to: Element.self).advanced(by: indexInChunk)
+        return self.pointer(to: index)
     }
     
     @inlinable
     public var pointerToLast: UnsafeMutablePointer<Element> {
         precondition(self.count > 0)
-        let index = self.count - 1
-        let indexInChunk = index % ChunkArray.elementsPerChunk
-        return UnsafeMutableRawPointer(self.tail!).assumingMemoryBound(to: Element.self).advanced(by: indexInChunk)
+        return self.pointer(to: self.count - 1)
     }
     
     @inlinable
@@ -85,6 +107,24 @@ public struct ChunkArray<Element>: Collection {
         }
     }
     
+    @usableFromInline
+    mutating func appendChunk(allocator: AllocatorType) {
+        if self.chunkCount == 0 || (self.chunkCount >= ChunkArray.initialDirectoryCapacity && self.chunkCount.nonzeroBitCount == 1) {
+            let directoryCapacity = max(2 * self.chunkCount, ChunkArray.initialDirectoryCapacity)
+            let newChunks = Allocator.allocate(type: UnsafeMutablePointer<Element>.self, capacity: directoryCapacity, allocator: allocator)
+            if let oldChunks = self.chunks {
+                newChunks.initialize(from: oldChunks, count: self.chunkCount)
+                Allocator.deallocate(oldChunks, allocator: allocator)
+            }
+            self.chunks = newChunks
+        }
+        
+        let chunkCapacity = ChunkArray.elementsPerChunk << self.chunkCount
+        let chunk = Allocator.allocate(byteCount: chunkCapacity * MemoryLayout<Element>.stride, alignment: MemoryLayout<Element>.alignment, allocator: allocator)
+        self.chunks.unsafelyUnwrapped.advanced(by: self.chunkCount).initialize(to: chunk.bindMemory(to: Element.self, capacity: chunkCapacity))
+        self.chunkCount += 1
+    }
+    
     @inlinable
     public mutating func append(_ element: Element, allocator: AllocatorType) {
         if case .system = allocator {
@@ -92,24 +132,14 @@ public struct ChunkArray<Element>: Collection {
             precondition(_isPOD(Element.self))
         }
         
-        let insertionIndex = self.count
-        let indexInChunk = insertionIndex % ChunkArray.elementsPerChunk
-        if indexInChunk == 0 {
-            let newChunkBytes = Allocator.allocate(byteCount: MemoryLayout<Chunk>.size, alignment: MemoryLayout<Chunk>.alignment, allocator: allocator)
-            newChunkBytes.initializeMemory(as: UInt8.self, repeating: 0, count: MemoryLayout<Chunk>.size)
-            let newChunk = newChunkBytes.bindMemory(to: Chunk.self, capacity: 1)
-            
-            if let currentTail = self.tail {
-                currentTail.pointee.next = newChunk
-            } else {
-                self.next = newChunk
-            }
-            self.tail = newChunk
+        if self.count == self.capacity {
+            self.appendChunk(allocator: allocator)
         }
-        UnsafeMutableRawPointer(self.tail.unsafelyUnwrapped).assumingMemoryBound(to: Element.self).advanced(by: indexInChunk).initialize(to: element)
+        self.pointer(to: self.count).initialize(to: element)
         self.count += 1
     }
     
+    /// Removing elements keeps the chunks allocated, so that they can be reused by later appends.
     @inlinable
     @discardableResult
     public mutating func removeBySwappingWithBack(index: Int, allocator: AllocatorType) -> Element {
@@ -120,48 +150,37 @@ public struct ChunkArray<Element>: Collection {
         
         let elementPointer = self[pointerTo: index]
         let element = elementPointer.move()
-        elementPointer.moveAssign(from: self.pointerToLast, count: 1)
-        
-        let (_, indexInChunk) = self.count.quotientAndRemainder(dividingBy: ChunkArray.elementsPerChunk)
-        if indexInChunk == 0 {
-            self.removeTailChunk(allocator: allocator)
-        }
+        elementPointer.moveInitialize(from: self.pointerToLast, count: 1)
         
         self.count -= 1
         return element
     }
     
-    @usableFromInline
-    mutating func removeTailChunk(allocator: AllocatorType) {
-        var currentChunk = self.next
-        var previousChunk = currentChunk
-        while currentChunk != self.tail {
-            previousChunk = currentChunk
-            currentChunk = currentChunk?.pointee.next!
-        }
-        previousChunk?.pointee.next = nil
-        self.tail = previousChunk
-        if let currentChunk = currentChunk {
-            Allocator.deallocate(currentChunk, allocator: allocator)
-        }
-    }
-    
     @inlinable
     @discardableResult
     public mutating func removeLast(allocator: AllocatorType) -> Element {
         precondition(self.count > 0)
         
         let value = self.pointerToLast.move()
-        
-        let (_, indexInChunk) = self.count.quotientAndRemainder(dividingBy: ChunkArray.elementsPerChunk)
-        if indexInChunk == 0 {
-            self.removeTailChunk(allocator: allocator)
-        }
-        
         self.count -= 1
         return value
     }
     
+    /// Calls `body` with each run of contiguous elements in order, which avoids the per-element chunk boundary check
+    /// that iterating through the array element by element requires.
+    @inlinable
+    public func withContiguousChunks(_ body: (UnsafeMutableBufferPointer<Element>) throws -> Void) rethrows {
+        var chunkIndex = 0
+        var chunkStart = 0
+        while chunkStart < self.count {
+            let chunkCapacity = ChunkArray.elementsPerChunk << chunkIndex
+            let chunkCount = min(chunkCapacity, self.count - chunkStart)
+            try body(UnsafeMutableBufferPointer(start: self.chunks.unsafelyUnwrapped[chunkIndex], count: chunkCount))
+            chunkStart += chunkCapacity
+            chunkIndex += 1
+        }
+    }
+    
     
     public struct Iterator : IteratorProtocol {
         public typealias Element = ChunkArray.Element
@@ -169,28 +188,34 @@ public struct ChunkArray<Element>: Collection {
         @usableFromInline
         let elementCount: Int
         @usableFromInline
-        var chunk: UnsafeMutablePointer<Chunk>?
+        let chunks: UnsafeMutablePointer<UnsafeMutablePointer<Element>>?
         @usableFromInline
         var index = 0
+        @usableFromInline
+        var chunkIndex = -1
+        @usableFromInline
+        var chunkEndIndex = 0
+        @usableFromInline
+        var element: UnsafeMutablePointer<Element>? = nil
         
         @inlinable
-        init(currentChunk: UnsafeMutablePointer<Chunk>?, elementCount: Int) {
-            self.chunk = currentChunk
+        init(chunks: UnsafeMutablePointer<UnsafeMutablePointer<Element>>?, elementCount: Int) {
+            self.chunks = chunks
             self.elementCount = elementCount
         }
         
         @inlinable
         public mutating func next() -> Element? {
             if self.index < self.elementCount {
-                let indexInChunk = self.index % ChunkArray.elementsPerChunk
-                let currentChunk = self.chunk.unsafelyUnwrapped
-                let element = UnsafeMutableRawPointer(currentChunk).assumingMemoryBound(to: Element.self)[indexInChunk]
-                self.index += 1
-                
-                if indexInChunk + 1 == ChunkArray.elementsPerChunk {
-                    self.chunk = currentChunk.pointee.next
+                if self.index == self.chunkEndIndex {
+                    self.chunkIndex += 1
+                    self.element = self.chunks.unsafelyUnwrapped[self.chunkIndex]
+                    self.chunkEndIndex = ChunkArray.startIndex(ofChunk: self.chunkIndex + 1)
                 }
-                return element
+                let element = self.element.unsafelyUnwrapped
+                self.element = element + 1
+                self.index += 1
+                return element.pointee
             }
             return nil
         }
@@ -198,75 +223,18 @@ public struct ChunkArray<Element>: Collection {
     
     @inlinable
     public func makeIterator() -> Iterator {
-        return Iterator(currentChunk: self.next, elementCount: self.count)
+        return Iterator(chunks: self.chunks, elementCount: self.count)
     }
-    
+
 }
 
 extension ChunkArray {
-    /// A view enabling random access into a ChunkArray. Does not allow appending or removing.
-    public struct RandomAccessView: RandomAccessCollection {
-        public let array: ChunkArray
-        @usableFromInline let chunks: UnsafePointer<UnsafeMutablePointer<Chunk>>?
-        
-        public init(array: ChunkArray, allocator: AllocatorType) {
-            precondition(!allocator.requiresDeallocation)
-            
-            self.array = array
-            
-            if array.count > 2 * ChunkArray.elementsPerChunk {
-                let chunkCount = (array.count + ChunkArray.elementsPerChunk - 1) / ChunkArray.elementsPerChunk
-                let chunks = Allocator.allocate(type: UnsafeMutablePointer<Chunk>.self, capacity: chunkCount, allocator: allocator)
-                
-                var i = 0
-                var currentChunk = array.next
-                while let chunk = currentChunk {
-                    chunks[i] = chunk
-                    currentChunk = currentChunk?.pointee.next
-                    i += 1
-                }
-                self.chunks = UnsafePointer(chunks)
-            } else {
-                self.chunks = nil
-            }
-        }
-        
-        @inlinable
-        public var startIndex: Int {
-            return 0
-        }
-        
-        @inlinable
-        public var endIndex: Int {
-            return array.count
-        }
-        
-        @inlinable
-        func chunk(at chunkIndex: Int) -> UnsafeMutablePointer<Chunk> {
-            return self.chunks?[chunkIndex] ?? (chunkIndex == 0 ? array.next! : array.tail!)
-        }
-        
-        @inlinable
-        public subscript(pointerTo index: Int) -> UnsafeMutablePointer<ChunkArray.Element> {
-            precondition(index >= 0 && index < array.count)
-            
-            let (chunkIndex, indexInChunk) = index.quotientAndRemainder(dividingBy: ChunkArray.elementsPerChunk)
-            return UnsafeMutableRawPointer(self.chunk(at: chunkIndex)).assumingMemoryBound(to: Element.self).advanced(by: indexInChunk)
-        }
-        
-        @inlinable
-        public subscript(index: Int) -> ChunkArray.Element {
-            get {
-                return self[pointerTo: index].pointee
-            }
-            set {
-                self[pointerTo: index].pointee = newValue
-            }
-        }
-    }
+    @available(*, deprecated, message: "ChunkArray supports O(1) random access directly.")
+    public typealias RandomAccessView = ChunkArray
     
+    @available(*, deprecated, message: "ChunkArray supports O(1) random access directly.")
     @inlinable
-    public func makeRandomAccessView(allocator: AllocatorType) -> RandomAccessView {
-        return RandomAccessView(array: self, allocator: allocator)
+    public func makeRandomAccessView(allocator: AllocatorType) -> ChunkArray {
+        return self
     }
 }
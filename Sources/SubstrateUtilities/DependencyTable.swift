@@ -217,3 +217,44 @@ public struct DependencyBitset {
         return copy
     }
 }
+
+/// A dependency table that only stores the dependencies that are present, with each row's dependencies stored contiguously.
+/// Rows must be appended in increasing order, and each row may only depend on earlier rows.
+public struct SparseDependencyTable<T> {
+    @usableFromInline var rowStarts : [Int]
+    @usableFromInline var entries : [(index: Int, value: T)]
+    
+    @inlinable
+    public init(reservingCapacity capacity: Int = 0) {
+        self.rowStarts = [0]
+        self.rowStarts.reserveCapacity(capacity + 1)
+        self.entries = []
+    }
+    
+    @inlinable
+    public var capacity : Int {
+        return self.rowStarts.count - 1
+    }
+    
+    /// Appends a new row whose dependencies are `dependencies`, preserving their order.
+    @inlinable
+    public mutating func appendRow<S : Sequence>(dependencies: S) where S.Element == (index: Int, value: T) {
+        let row = self.capacity
+        for dependency in dependencies {
+            assert(dependency.index < row, "Indices can only depend on earlier indices.")
+            self.entries.append(dependency)
+        }
+        self.rowStarts.append(self.entries.count)
+    }
+    
+    @inlinable
+    public func dependencies(of row: Int) -> ArraySlice<(index: Int, value: T)> {
+        return self.entries[self.rowStarts[row]..<self.rowStarts[row + 1]]
+    }
+    
+    @inlinable
+    public func dependency(from: Int, on: Int) -> T? {
+        assert(on < from, "Indices can only depend on earlier indices.")
+        return self.dependencies(of: from).first(where: { $0.index == on })?.value
+    }
+}
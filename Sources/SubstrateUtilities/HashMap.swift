@@ -1,4 +1,4 @@
-// https://github.com/emilk/emilib/blob/master/emilib/hash_map.hpp
+// https://abseil.io/about/design/swisstables
 
 
 public protocol CustomHashable : Equatable {
@@ -12,26 +12,24 @@ extension ObjectIdentifier : CustomHashable {
     }
 }
 
-/// A cache-friendly hash table with open addressing, linear probing and power-of-two capacity
+/// A cache-friendly hash table with open addressing, group probing and power-of-two capacity
 /// HashMap is a struct to avoid retains/releases, but that means that any user must manually
 /// call `deinit` once they're finished.
-/// Based off https://github.com/emilk/emilib/blob/master/emilib/hash_map.hpp 
+/// The layout follows Swiss tables (see `HashTableControl`); `customHashValue` is mixed before use, so it doesn't need to be well-distributed.
 public struct HashMap<K : CustomHashable, V> {
     
     public let allocator : AllocatorType
     
     public typealias Index = Int
     
-    public typealias State = UInt8
-    
-    @usableFromInline var states : UnsafeMutablePointer<State>! = nil
+    @usableFromInline var controlBytes : UnsafeMutablePointer<UInt8>! = nil
     @usableFromInline var keys : UnsafeMutablePointer<K>! = nil
     @usableFromInline var values : UnsafeMutablePointer<V>! = nil
     
     @usableFromInline var bucketCount = 0
     @usableFromInline var filledCount = 0
-    // Our longest bucket-brigade is this long. ONLY when we have zero elements is this ever negative (-1).
-    @usableFromInline var maxProbeLength = -1
+    // The number of empty buckets that can be filled before the table must grow. Deleted buckets don't count towards this.
+    @usableFromInline var growthLeft = 0
     // bucketCount minus one
     @usableFromInline var mask = 0
     
@@ -43,14 +41,14 @@ public struct HashMap<K : CustomHashable, V> {
     @inlinable
     public func `deinit`() {
         for bucket in 0..<self.bucketCount {
-            if self.states[bucket] == .filled {
+            if HashTableControl.isFull(self.controlBytes[bucket]) {
                 self.keys.advanced(by: bucket).deinitialize(count: 1)
                 self.values.advanced(by: bucket).deinitialize(count: 1)
             }
         }
         
         if self.bucketCount > 0 {
-            Allocator.deallocate(self.states, allocator: self.allocator)
+            Allocator.deallocate(self.controlBytes, allocator: self.allocator)
             Allocator.deallocate(self.keys, allocator: self.allocator)
             Allocator.deallocate(self.values, allocator: self.allocator)
         }
@@ -139,15 +137,13 @@ public struct HashMap<K : CustomHashable, V> {
     public mutating func insert(key: K, value: @autoclosure () -> V) -> (index: Index, inserted: Bool) {
         self.checkIfNeedsExpand()
         
-        let bucket = self.findOrAllocate(key: key)
+        let hash = HashTableControl.hash(key)
+        let bucket = self.findOrAllocate(key: key, hash: hash)
         
-        if self.states[bucket] == .filled {
+        if HashTableControl.isFull(self.controlBytes[bucket]) {
             return (bucket, inserted: false)
         } else {
-            self.states[bucket] = .filled
-            self.keys.advanced(by: bucket).initialize(to: key)
-            self.values.advanced(by: bucket).initialize(to: value())
-            self.filledCount += 1
+            self.fill(bucket: bucket, hash: hash, key: key, value: value())
             return (bucket, inserted: true)
         }
     }
@@ -159,40 +155,32 @@ public struct HashMap<K : CustomHashable, V> {
         
         self.checkIfNeedsExpand()
         
-        let bucket = self.findEmptyBucket(key: key)
-        self.states[bucket] = .filled
-        
-        self.keys.advanced(by: bucket).initialize(to: key)
-        self.values.advanced(by: bucket).initialize(to: value)
-        self.filledCount += 1
+        let hash = HashTableControl.hash(key)
+        let bucket = HashTableControl.findInsertSlot(hash: hash, controlBytes: self.controlBytes, mask: self.mask)
+        self.fill(bucket: bucket, hash: hash, key: key, value: value)
     }
     
-    /// bucket must be a valid, empty bucket that was previously allocated with e.g. findOrAllocate
+    /// bucket must be a valid, empty bucket that was previously allocated with e.g. findOrAllocate,
+    /// or the bucket `key` was removed from.
     @inlinable
     public mutating func insertAtIndex(_ bucket: Index, key: K, value: V) {
         assert(!self.contains(key: key))
         
-        self.states[bucket] = .filled
-        
-        self.keys.advanced(by: bucket).initialize(to: key)
-        self.values.advanced(by: bucket).initialize(to: value)
-        self.filledCount += 1
+        self.fill(bucket: bucket, hash: HashTableControl.hash(key), key: key, value: value)
     }
     
     @inlinable
     public mutating func insertOrAssign(key: K, value: V) {
         self.checkIfNeedsExpand()
         
-        let bucket = self.findOrAllocate(key: key)
+        let hash = HashTableControl.hash(key)
+        let bucket = self.findOrAllocate(key: key, hash: hash)
         
         // Check if inserting a new value rather than overwriting an old entry
-        if self.states[bucket] == .filled {
+        if HashTableControl.isFull(self.controlBytes[bucket]) {
             self.values[bucket] = value
         } else {
-            self.states[bucket] = .filled
-            self.keys.advanced(by: bucket).initialize(to: key)
-            self.values.advanced(by: bucket).initialize(to: value)
-            self.filledCount += 1
+            self.fill(bucket: bucket, hash: hash, key: key, value: value)
         }
     }
     
@@ -201,17 +189,15 @@ public struct HashMap<K : CustomHashable, V> {
     public mutating func replaceIfPresent(key: K, newValue: V) -> V? {
         self.checkIfNeedsExpand()
         
-        let bucket = self.findOrAllocate(key: key)
+        let hash = HashTableControl.hash(key)
+        let bucket = self.findOrAllocate(key: key, hash: hash)
         
-        if self.states[bucket] == .filled {
+        if HashTableControl.isFull(self.controlBytes[bucket]) {
             let oldValue = self.values[bucket]
             self.values[bucket] = newValue
             return oldValue
         } else {
-            self.states[bucket] = .filled
-            self.keys.advanced(by: bucket).initialize(to: key)
-            self.values.advanced(by: bucket).initialize(to: newValue)
-            self.filledCount += 1
+            self.fill(bucket: bucket, hash: hash, key: key, value: newValue)
             return nil
         }
     }
@@ -226,7 +212,11 @@ public struct HashMap<K : CustomHashable, V> {
     @inlinable
     public mutating func removeValue(at bucket: Index) -> V? {
         if bucket != -1 {
-            self.states[bucket] = .active
+            let control = HashTableControl.controlForRemoval(at: bucket, controlBytes: self.controlBytes, mask: self.mask)
+            if control == HashTableControl.empty {
+                self.growthLeft += 1
+            }
+            HashTableControl.setControl(control, at: bucket, in: self.controlBytes, mask: self.mask)
             self.keys.advanced(by: bucket).deinitialize(count: 1)
             let oldValue = self.values.advanced(by: bucket).move()
             self.filledCount -= 1
@@ -239,30 +229,26 @@ public struct HashMap<K : CustomHashable, V> {
     @inlinable
     public mutating func removeAll() {
         for bucket in 0..<self.bucketCount {
-            if self.states[bucket] == .filled {
-                self.states[bucket] = .inactive
+            if HashTableControl.isFull(self.controlBytes[bucket]) {
                 self.keys.advanced(by: bucket).deinitialize(count: 1)
                 self.values.advanced(by: bucket).deinitialize(count: 1)
             }
         }
         
-        self.filledCount = 0
-        self.maxProbeLength = -1
+        self.clearControlBytes()
     }
     
     @inlinable
     public mutating func removeAll(iterating iterator: (K, V) -> Void) {
         for bucket in 0..<self.bucketCount {
-            if self.states[bucket] == .filled {
+            if HashTableControl.isFull(self.controlBytes[bucket]) {
                 iterator(self.keys[bucket], self.values[bucket])
-                self.states[bucket] = .inactive
                 self.keys.advanced(by: bucket).deinitialize(count: 1)
                 self.values.advanced(by: bucket).deinitialize(count: 1)
             }
         }
         
-        self.filledCount = 0
-        self.maxProbeLength = -1
+        self.clearControlBytes()
     }
     
     @inlinable
@@ -271,16 +257,25 @@ public struct HashMap<K : CustomHashable, V> {
         self.removeAll()
     }
     
+    @inlinable
+    mutating func clearControlBytes() {
+        if self.bucketCount > 0 {
+            self.controlBytes.assign(repeating: HashTableControl.empty, count: self.bucketCount + HashTableGroup.width)
+        }
+        self.filledCount = 0
+        self.growthLeft = HashTableControl.capacity(forBucketCount: self.bucketCount)
+    }
+    
     @inlinable
     public func forEach(_ body: ((K, V)) throws -> Void) rethrows {
-        for bucket in 0..<bucketCount where self.states[bucket] == .filled {
+        for bucket in 0..<bucketCount where HashTableControl.isFull(self.controlBytes[bucket]) {
             try body((self.keys[bucket], self.values[bucket]))
         }
     }
     
     @inlinable
     public mutating func forEachMutating(_ body: (K, inout V, _ deleteEntry: inout Bool) throws -> Void) rethrows {
-        for bucket in 0..<bucketCount where self.states[bucket] == .filled {
+        for bucket in 0..<bucketCount where HashTableControl.isFull(self.controlBytes[bucket]) {
             var deleteEntry = false
             try body(self.keys[bucket], &self.values[bucket], &deleteEntry)
             if deleteEntry {
@@ -290,51 +285,64 @@ public struct HashMap<K : CustomHashable, V> {
     }
     
     /// Passes back a pointer to the address where the value should go for a given key.
-    /// The bool argument indicates whether the pointer is currently initialised.
+    /// The bool argument indicates whether the pointer is currently initialised; if it isn't, `perform` must initialise it.
     @inlinable
     public mutating func withValue<T>(forKey key: K, perform: (UnsafeMutablePointer<V>, Bool) -> T) -> T {
         self.checkIfNeedsExpand()
         
-        let bucket = self.findOrAllocate(key: key)
-        return perform(self.values.advanced(by: bucket), self.states[bucket] == .filled)
+        let hash = HashTableControl.hash(key)
+        let bucket = self.findOrAllocate(key: key, hash: hash)
+        if HashTableControl.isFull(self.controlBytes[bucket]) {
+            return perform(self.values.advanced(by: bucket), true)
+        }
+        
+        let result = perform(self.values.advanced(by: bucket), false)
+        self.markFilled(bucket: bucket, hash: hash)
+        self.keys.advanced(by: bucket).initialize(to: key)
+        return result
     }
     
-    @usableFromInline
-    mutating func _reserveCapacity(_ capacity: Int) {
-        let requiredBucketCount = capacity + capacity/2 + 1
-        
-        var bucketCount = 4
-        while bucketCount < requiredBucketCount {
-            bucketCount <<= 1
+    @inlinable
+    mutating func markFilled(bucket: Int, hash: UInt64) {
+        if self.controlBytes[bucket] == HashTableControl.empty {
+            self.growthLeft -= 1
         }
-        
-        let newStates : UnsafeMutablePointer<State> = Allocator.allocate(capacity: bucketCount, allocator: self.allocator)
-        newStates.initialize(repeating: .inactive, count: bucketCount)
-        
+        HashTableControl.setControl(HashTableControl.h2(hash), at: bucket, in: self.controlBytes, mask: self.mask)
+        self.filledCount += 1
+    }
+    
+    @inlinable
+    mutating func fill(bucket: Int, hash: UInt64, key: K, value: V) {
+        self.markFilled(bucket: bucket, hash: hash)
+        self.keys.advanced(by: bucket).initialize(to: key)
+        self.values.advanced(by: bucket).initialize(to: value)
+    }
+    
+    @usableFromInline
+    mutating func resize(bucketCount: Int) {
+        let newControlBytes = HashTableControl.allocateControlBytes(bucketCount: bucketCount, allocator: self.allocator)
         let newKeys : UnsafeMutablePointer<K> = Allocator.allocate(capacity: bucketCount, allocator: self.allocator)
         let newValues : UnsafeMutablePointer<V> = Allocator.allocate(capacity: bucketCount, allocator: self.allocator)
         
         let oldBucketCount = self.bucketCount
-        let oldStates = self.states
+        let oldControlBytes = self.controlBytes
         let oldKeys = self.keys
         let oldValues = self.values
         
         self.bucketCount = bucketCount
         self.mask = self.bucketCount - 1
-        self.states = newStates
+        self.controlBytes = newControlBytes
         self.keys = newKeys
         self.values = newValues
-        
-        self.maxProbeLength = -1
+        self.growthLeft = HashTableControl.capacity(forBucketCount: bucketCount) - self.filledCount
         
         for sourceBucket in 0..<oldBucketCount {
-            if oldStates![sourceBucket] == .filled {
+            if HashTableControl.isFull(oldControlBytes![sourceBucket]) {
                 let sourceKey = oldKeys!.advanced(by: sourceBucket).move()
-                let destinationBucket = self.findEmptyBucket(key: sourceKey)
+                let hash = HashTableControl.hash(sourceKey)
+                let destinationBucket = HashTableControl.findInsertSlot(hash: hash, controlBytes: self.controlBytes, mask: self.mask)
                 
-                assert(destinationBucket != -1)
-                assert(self.states[destinationBucket] != .filled)
-                self.states[destinationBucket] = .filled
+                HashTableControl.setControl(HashTableControl.h2(hash), at: destinationBucket, in: self.controlBytes, mask: self.mask)
                 
                 self.keys.advanced(by: destinationBucket).initialize(to: sourceKey)
                 self.values.advanced(by: destinationBucket).moveInitialize(from: oldValues!.advanced(by: sourceBucket), count: 1)
@@ -342,7 +350,7 @@ public struct HashMap<K : CustomHashable, V> {
         }
         
         if oldBucketCount > 0 {
-            Allocator.deallocate(oldStates!, allocator: self.allocator)
+            Allocator.deallocate(oldControlBytes!, allocator: self.allocator)
             Allocator.deallocate(oldKeys!, allocator: self.allocator)
             Allocator.deallocate(oldValues!, allocator: self.allocator)
         }
@@ -350,19 +358,31 @@ public struct HashMap<K : CustomHashable, V> {
     
     @inlinable
     public mutating func reserveCapacity(_ newCapacity: Int) {
-        
-        let requiredBuckets = newCapacity + newCapacity/2 + 1;
-        if requiredBuckets <= self.bucketCount {
+        if newCapacity <= self.filledCount + self.growthLeft {
             return
         }
         
-        self._reserveCapacity(newCapacity)
+        self.resize(bucketCount: max(HashTableControl.bucketCount(forCapacity: newCapacity), self.bucketCount))
     }
     
     // Can we fit another element?
     @inlinable
     mutating func checkIfNeedsExpand() {
-        self.reserveCapacity(self.filledCount + 1)
+        if self.growthLeft == 0 {
+            self.growForInsertion()
+        }
+    }
+    
+    /// If the table is mostly deleted buckets, rehashes into a new table with the same bucket count to clear them;
+    /// otherwise, doubles the capacity.
+    @usableFromInline
+    mutating func growForInsertion() {
+        let capacity = HashTableControl.capacity(forBucketCount: self.bucketCount)
+        if self.filledCount + 1 <= capacity / 2 {
+            self.resize(bucketCount: self.bucketCount)
+        } else {
+            self.resize(bucketCount: HashTableControl.bucketCount(forCapacity: max(self.filledCount + 1, capacity + 1)))
+        }
     }
     
     // Find the bucket with this key, or return -1
@@ -370,83 +390,58 @@ public struct HashMap<K : CustomHashable, V> {
     public func findFilledBucket(key: K) -> Int {
         if self.isEmpty { return -1 }
         
-        let hashValue = key.customHashValue
-        for offset in 0...self.maxProbeLength {
-            let bucket = (hashValue &+ offset) & self.mask
-            if self.states[bucket] == .filled {
+        let hash = HashTableControl.hash(key)
+        let h2 = HashTableControl.h2(hash)
+        var probe = HashTableProbeSequence(hash: hash, mask: self.mask)
+        while true {
+            let group = HashTableGroup(self.controlBytes + probe.position)
+            for bit in group.match(h2) {
+                let bucket = (probe.position &+ bit) & self.mask
                 if self.keys[bucket] == key {
                     return bucket
                 }
-            } else if self.states[bucket] == .inactive {
+            }
+            if group.matchEmpty().bits != 0 {
                 return -1 // End of the chain
             }
+            probe.moveNext()
         }
-        
-        return -1
     }
     
     // Find the bucket with this key, or return a good empty bucket to place the key in.
     // In the latter case, the bucket is expected to be filled.
     @inlinable
     public mutating func findOrAllocate(key: K) -> Int {
-        let hashValue = key.customHashValue
-        
-        var hole = -1
-        var offset = 0
-        while offset <= self.maxProbeLength {
-            defer { offset += 1 }
-            let bucket = (hashValue &+ offset) & self.mask
-            
-            if self.states[bucket] == .filled {
+        return self.findOrAllocate(key: key, hash: HashTableControl.hash(key))
+    }
+    
+    @inlinable
+    mutating func findOrAllocate(key: K, hash: UInt64) -> Int {
+        let h2 = HashTableControl.h2(hash)
+        var insertBucket = -1
+        var probe = HashTableProbeSequence(hash: hash, mask: self.mask)
+        while true {
+            let group = HashTableGroup(self.controlBytes + probe.position)
+            for bit in group.match(h2) {
+                let bucket = (probe.position &+ bit) & self.mask
                 if self.keys[bucket] == key {
                     return bucket
                 }
-            } else if self.states[bucket] == .inactive {
-                return bucket
-            } else {
-                // ACTIVE: keep searching
-                if hole == -1 {
-                    hole = bucket
-                }
             }
-        }
-        
-        // No key found, but there may be a hole for it
-        
-        assert(offset == self.maxProbeLength + 1)
-        
-        if hole != -1 {
-            return hole
-        }
-        
-        // No hole found within _max_probe_length
-        while true {
-            defer { offset += 1 }
-            let bucket = (hashValue &+ offset) & self.mask
-            
-            if self.states[bucket] != .filled {
-                self.maxProbeLength = offset
-                return bucket
+            if insertBucket == -1, let bit = group.matchEmptyOrDeleted().lowestSetBit {
+                insertBucket = (probe.position &+ bit) & self.mask
+            }
+            if group.matchEmpty().bits != 0 {
+                return insertBucket
             }
+            probe.moveNext()
         }
     }
     
     // key is not in this map. Find a place to put it.
     @inlinable
     public mutating func findEmptyBucket(key: K) -> Int {
-        let hashValue = key.customHashValue
-        
-        var offset = 0
-        while true {
-            let bucket = (hashValue &+ offset) & self.mask
-            if self.states[bucket] != .filled {
-                if offset > self.maxProbeLength {
-                    self.maxProbeLength = offset
-                }
-                return bucket
-            }
-            offset += 1
-        }
+        return HashTableControl.findInsertSlot(hash: HashTableControl.hash(key), controlBytes: self.controlBytes, mask: self.mask)
     }
 }
 
@@ -471,7 +466,7 @@ extension HashMap : Sequence {
             while self.bucket < hashMap.bucketCount {
                 defer { self.bucket += 1 }
                 
-                if hashMap.states[bucket] == .filled {
+                if HashTableControl.isFull(hashMap.controlBytes[bucket]) {
                     return (hashMap.keys[bucket], hashMap.values[bucket])
                 }
             }
@@ -503,7 +498,7 @@ extension HashMap {
             while self.bucket < hashMap.bucketCount {
                 defer { self.bucket += 1 }
                 
-                if hashMap.states[bucket] == .filled {
+                if HashTableControl.isFull(hashMap.controlBytes[bucket]) {
                     return hashMap.values[bucket]
                 }
             }
@@ -530,15 +525,3 @@ extension HashMap {
         return ValuesSequence(hashMap: self)
     }
 }
-
-extension HashMap.State {
-    /// Never been touched
-    @inlinable
-    public static var inactive : UInt8 { return 0 }
-    /// Is inside a search-chain, but is empty
-    @inlinable
-    public static var active : UInt8 { return 1 }
-    /// Is set with key/value
-    @inlinable
-    public static var filled : UInt8 { return 2 }
-}
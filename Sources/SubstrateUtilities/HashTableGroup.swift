@@ -0,0 +1,204 @@
+//
+//  HashTableGroup.swift
+//  SubstrateUtilities
+//
+
+/// Shared probing logic for `HashMap` and `HashSet`, which are Swiss tables: each bucket has a one-byte control value,
+/// and lookups compare a group of control bytes against a 7-bit fragment of the key's hash at once,
+/// only comparing keys for the buckets that match.
+///
+/// The group is a word of control bytes matched with SWAR bit tricks, which works on all platforms without needing
+/// a vector movemask. The control array is followed by a copy of its first `HashTableGroup.width` bytes so that a group
+/// can be loaded starting at any bucket without wrapping.
+@usableFromInline
+enum HashTableControl {
+    /// The bucket has never been filled. Probing stops at a group containing an empty bucket.
+    @inlinable
+    static var empty : UInt8 { 0b1111_1111 }
+
+    /// The bucket's entry has been removed, but other keys may have probed past it.
+    @inlinable
+    static var deleted : UInt8 { 0b1000_0000 }
+
+    /// Filled buckets store the top seven bits of their key's hash, so the high bit is clear.
+    @inlinable
+    static func isFull(_ control: UInt8) -> Bool {
+        return control & 0x80 == 0
+    }
+
+    /// Applies a finaliser to `customHashValue` so that keys with poorly-distributed hashes (e.g. aligned pointers or
+    /// sequential indices) still spread across buckets and produce distinct control bytes.
+    /// This is the 64-bit finaliser from MurmurHash3.
+    @inlinable
+    static func hash<K : CustomHashable>(_ key: K) -> UInt64 {
+        var x = UInt64(UInt(bitPattern: key.customHashValue))
+        x ^= x &>> 33
+        x &*= 0xff51afd7ed558ccd
+        x ^= x &>> 33
+        x &*= 0xc4ceb9fe1a85ec53
+        x ^= x &>> 33
+        return x
+    }
+
+    /// The hash bits stored in the control byte of a filled bucket.
+    @inlinable
+    static func h2(_ hash: UInt64) -> UInt8 {
+        return UInt8(truncatingIfNeeded: hash &>> 57)
+    }
+
+    /// The smallest bucket count that can hold `capacity` entries without exceeding the maximum load factor of 7/8.
+    @inlinable
+    static func bucketCount(forCapacity capacity: Int) -> Int {
+        let requiredBucketCount = (capacity * 8 + 6) / 7
+        var bucketCount = HashTableGroup.width
+        while bucketCount < requiredBucketCount {
+            bucketCount <<= 1
+        }
+        return bucketCount
+    }
+
+    /// The number of entries that can be stored in a table with `bucketCount` buckets.
+    @inlinable
+    static func capacity(forBucketCount bucketCount: Int) -> Int {
+        return bucketCount / 8 * 7
+    }
+
+    @inlinable
+    static func allocateControlBytes(bucketCount: Int, allocator: AllocatorType) -> UnsafeMutablePointer<UInt8> {
+        let controlBytes : UnsafeMutablePointer<UInt8> = Allocator.allocate(capacity: bucketCount + HashTableGroup.width, allocator: allocator)
+        controlBytes.initialize(repeating: HashTableControl.empty, count: bucketCount + HashTableGroup.width)
+        return controlBytes
+    }
+
+    /// Sets the control byte for `bucket`, keeping the trailing copy of the first group in sync.
+    @inlinable
+    static func setControl(_ control: UInt8, at bucket: Int, in controlBytes: UnsafeMutablePointer<UInt8>, mask: Int) {
+        controlBytes[bucket] = control
+        controlBytes[((bucket &- HashTableGroup.width) & mask) &+ HashTableGroup.width] = control
+    }
+
+    /// Returns the first empty or deleted bucket in `hash`'s probe sequence.
+    @inlinable
+    static func findInsertSlot(hash: UInt64, controlBytes: UnsafeMutablePointer<UInt8>, mask: Int) -> Int {
+        var probe = HashTableProbeSequence(hash: hash, mask: mask)
+        while true {
+            let group = HashTableGroup(controlBytes + probe.position)
+            if let bit = group.matchEmptyOrDeleted().lowestSetBit {
+                return (probe.position &+ bit) & mask
+            }
+            probe.moveNext()
+        }
+    }
+
+    /// Determines the control byte for a bucket whose entry is being removed. If no probe sequence can have passed over
+    /// the bucket without seeing an empty bucket, it can be marked as empty rather than deleted.
+    @inlinable
+    static func controlForRemoval(at bucket: Int, controlBytes: UnsafeMutablePointer<UInt8>, mask: Int) -> UInt8 {
+        let groupBefore = HashTableGroup(controlBytes + ((bucket &- HashTableGroup.width) & mask))
+        let groupAfter = HashTableGroup(controlBytes + bucket)
+        let nonEmptyBefore = groupBefore.matchEmpty().leadingNonEmptyCount
+        let nonEmptyAfter = groupAfter.matchEmpty().trailingNonEmptyCount
+        return nonEmptyBefore + nonEmptyAfter >= HashTableGroup.width ? HashTableControl.deleted : HashTableControl.empty
+    }
+}
+
+/// Triangular probing over groups, which visits every group exactly once when the bucket count is a power of two.
+@usableFromInline
+struct HashTableProbeSequence {
+    @usableFromInline var position : Int
+    @usableFromInline var stride : Int
+    @usableFromInline let mask : Int
+
+    @inlinable
+    init(hash: UInt64, mask: Int) {
+        self.position = Int(truncatingIfNeeded: hash) & mask
+        self.stride = 0
+        self.mask = mask
+    }
+
+    @inlinable
+    mutating func moveNext() {
+        self.stride &+= HashTableGroup.width
+        self.position = (self.position &+ self.stride) & self.mask
+    }
+}
+
+@usableFromInline
+struct HashTableGroup {
+    @inlinable
+    static var width : Int { MemoryLayout<UInt64>.size }
+
+    @inlinable
+    static var lowBits : UInt64 { 0x0101_0101_0101_0101 }
+
+    @inlinable
+    static var highBits : UInt64 { 0x8080_8080_8080_8080 }
+
+    @usableFromInline var bits : UInt64
+
+    @inlinable
+    init(_ controlBytes: UnsafePointer<UInt8>) {
+        var bits : UInt64 = 0
+        withUnsafeMutableBytes(of: &bits) { $0.copyMemory(from: UnsafeRawBufferPointer(start: controlBytes, count: HashTableGroup.width)) }
+        self.bits = UInt64(littleEndian: bits)
+    }
+
+    @inlinable
+    init(_ controlBytes: UnsafeMutablePointer<UInt8>) {
+        self.init(UnsafePointer(controlBytes))
+    }
+
+    /// Returns the buckets whose control byte may equal `h2`. There may be false positives, which are rejected by comparing keys.
+    @inlinable
+    func match(_ h2: UInt8) -> HashTableBitMask {
+        let x = self.bits ^ (HashTableGroup.lowBits &* UInt64(h2))
+        return HashTableBitMask(bits: (x &- HashTableGroup.lowBits) & ~x & HashTableGroup.highBits)
+    }
+
+    /// Empty is the only control value with both of its top two bits set.
+    @inlinable
+    func matchEmpty() -> HashTableBitMask {
+        return HashTableBitMask(bits: self.bits & (self.bits &<< 1) & HashTableGroup.highBits)
+    }
+
+    @inlinable
+    func matchEmptyOrDeleted() -> HashTableBitMask {
+        return HashTableBitMask(bits: self.bits & HashTableGroup.highBits)
+    }
+}
+
+/// A set of buckets within a group, with one bit set in the high bit of each matching bucket's byte.
+@usableFromInline
+struct HashTableBitMask : Sequence, IteratorProtocol {
+    @usableFromInline var bits : UInt64
+
+    @inlinable
+    init(bits: UInt64) {
+        self.bits = bits
+    }
+
+    @inlinable
+    var lowestSetBit : Int? {
+        if self.bits == 0 { return nil }
+        return self.bits.trailingZeroBitCount / 8
+    }
+
+    /// For a mask from `matchEmpty()`, the number of consecutive non-empty buckets at the end of the group.
+    @inlinable
+    var leadingNonEmptyCount : Int {
+        return self.bits.leadingZeroBitCount / 8
+    }
+
+    /// For a mask from `matchEmpty()`, the number of consecutive non-empty buckets at the start of the group.
+    @inlinable
+    var trailingNonEmptyCount : Int {
+        return self.bits.trailingZeroBitCount / 8
+    }
+
+    @inlinable
+    mutating func next() -> Int? {
+        guard let bit = self.lowestSetBit else { return nil }
+        self.bits &= self.bits &- 1
+        return bit
+    }
+}
@@ -0,0 +1,175 @@
+//
+//  PackedCommandStream.swift
+//  SubstrateUtilities
+//
+
+/// An append-only sequence of commands, where each command is stored inline in a byte stream immediately followed
+/// by its payload. Entries are written sequentially into blocks from the stream's allocator, and an entry is never split
+/// across blocks, so pointers to payloads remain valid for the lifetime of the allocation and replaying the commands is a linear walk.
+///
+/// `Command` must be a POD type; it typically holds a pointer to its payload.
+public struct PackedCommandStream<Command>: Sequence {
+    @usableFromInline
+    struct EntryHeader {
+        @usableFromInline var command: Command
+        /// The distance in bytes from this header to the next entry's header.
+        @usableFromInline var stride: UInt32
+    }
+
+    @usableFromInline
+    struct BlockHeader {
+        @usableFromInline var next: UnsafeMutableRawPointer?
+        /// The address one past the last entry in the block.
+        @usableFromInline var end: UnsafeMutableRawPointer
+    }
+
+    @inlinable
+    public static var initialBlockSize: Int { 1024 }
+
+    @inlinable
+    public static var maxBlockSize: Int { 16 * 1024 }
+
+    @inlinable
+    static var entryAlignment: Int { max(MemoryLayout<EntryHeader>.alignment, 8) }
+
+    @usableFromInline var _count: Int
+    @usableFromInline var head: UnsafeMutableRawPointer?
+    @usableFromInline var tail: UnsafeMutableRawPointer?
+    @usableFromInline var tailCapacityEnd: UnsafeMutableRawPointer?
+    @usableFromInline var nextBlockSize: Int
+
+    @inlinable
+    public init() {
+        precondition(_isPOD(Command.self))
+        self._count = 0
+        self.nextBlockSize = PackedCommandStream.initialBlockSize
+    }
+
+    @inlinable
+    public var count: Int {
+        return self._count
+    }
+
+    @inlinable
+    public var isEmpty: Bool {
+        return self.count == 0
+    }
+
+    @inlinable
+    public var underestimatedCount: Int {
+        return self.count
+    }
+
+    /// Reserves space for an entry whose payload has the given size and alignment, returning a pointer to the entry's header.
+    @inlinable
+    mutating func reserveEntry(payloadByteCount: Int, payloadAlignment: Int, allocator: AllocatorType) -> (header: UnsafeMutableRawPointer, payload: UnsafeMutableRawPointer) {
+        let headerSize = MemoryLayout<EntryHeader>.size
+
+        if let tail = self.tail {
+            let header = tail.assumingMemoryBound(to: BlockHeader.self).pointee.end
+            let payload = (header + headerSize).alignedUp(toMultipleOf: payloadAlignment)
+            let entryEnd = (payload + payloadByteCount).alignedUp(toMultipleOf: PackedCommandStream.entryAlignment)
+            if entryEnd <= self.tailCapacityEnd.unsafelyUnwrapped {
+                tail.assumingMemoryBound(to: BlockHeader.self).pointee.end = entryEnd
+                return (header, payload)
+            }
+        }
+
+        let blockHeaderSize = MemoryLayout<BlockHeader>.stride.roundedUpToMultiple(of: 16)
+        let requiredSize = blockHeaderSize + (headerSize.roundedUpToMultiple(of: payloadAlignment) + payloadByteCount).roundedUpToMultiple(of: 16)
+        let blockSize = max(self.nextBlockSize, requiredSize)
+        self.nextBlockSize = min(blockSize * 2, PackedCommandStream.maxBlockSize)
+
+        let block = Allocator.allocate(byteCount: blockSize, alignment: max(16, payloadAlignment), allocator: allocator)
+        let header = block + blockHeaderSize
+        let payload = (header + headerSize).alignedUp(toMultipleOf: payloadAlignment)
+        let entryEnd = (payload + payloadByteCount).alignedUp(toMultipleOf: PackedCommandStream.entryAlignment)
+        block.initializeMemory(as: BlockHeader.self, repeating: BlockHeader(next: nil, end: entryEnd), count: 1)
+
+        if let tail = self.tail {
+            tail.assumingMemoryBound(to: BlockHeader.self).pointee.next = block
+        } else {
+            self.head = block
+        }
+        self.tail = block
+        self.tailCapacityEnd = block + blockSize
+
+        return (header, payload)
+    }
+
+    @inlinable
+    mutating func initializeEntry(header: UnsafeMutableRawPointer, command: Command) {
+        let entryEnd = self.tail.unsafelyUnwrapped.assumingMemoryBound(to: BlockHeader.self).pointee.end
+        header.initializeMemory(as: EntryHeader.self, repeating: EntryHeader(command: command, stride: UInt32(entryEnd - header)), count: 1)
+        self._count += 1
+    }
+
+    /// Appends a command with no inline payload.
+    @inlinable
+    public mutating func append(_ command: Command, allocator: AllocatorType) {
+        let (header, _) = self.reserveEntry(payloadByteCount: 0, payloadAlignment: 1, allocator: allocator)
+        self.initializeEntry(header: header, command: command)
+    }
+
+    /// Appends a command whose payload is stored inline directly after it.
+    @inlinable
+    public mutating func append<T>(_ makeCommand: (UnsafePointer<T>) -> Command, payload: T, allocator: AllocatorType) {
+        let (header, payloadPointer) = self.reserveEntry(payloadByteCount: MemoryLayout<T>.size, payloadAlignment: MemoryLayout<T>.alignment, allocator: allocator)
+        let typedPayload = payloadPointer.initializeMemory(as: T.self, repeating: payload, count: 1)
+        self.initializeEntry(header: header, command: makeCommand(UnsafePointer(typedPayload)))
+    }
+
+    /// Appends a command with an untyped inline payload of `byteCount` bytes, which `makeCommand` must initialise.
+    @inlinable
+    public mutating func append(payloadByteCount: Int, alignment: Int, allocator: AllocatorType, _ makeCommand: (UnsafeMutableRawPointer) -> Command) {
+        let (header, payloadPointer) = self.reserveEntry(payloadByteCount: payloadByteCount, payloadAlignment: alignment, allocator: allocator)
+        self.initializeEntry(header: header, command: makeCommand(payloadPointer))
+    }
+
+    public struct Iterator: IteratorProtocol {
+        @usableFromInline var block: UnsafeMutableRawPointer?
+        @usableFromInline var entry: UnsafeMutableRawPointer?
+        @usableFromInline var blockEnd: UnsafeMutableRawPointer?
+
+        @inlinable
+        init(head: UnsafeMutableRawPointer?) {
+            self.block = head
+            if let head = head {
+                self.entry = head + MemoryLayout<BlockHeader>.stride.roundedUpToMultiple(of: 16)
+                self.blockEnd = head.assumingMemoryBound(to: BlockHeader.self).pointee.end
+            }
+        }
+
+        @inlinable
+        public mutating func next() -> Command? {
+            guard var entry = self.entry else { return nil }
+            if entry == self.blockEnd {
+                guard let nextBlock = self.block.unsafelyUnwrapped.assumingMemoryBound(to: BlockHeader.self).pointee.next else {
+                    self.entry = nil
+                    return nil
+                }
+                self.block = nextBlock
+                entry = nextBlock + MemoryLayout<BlockHeader>.stride.roundedUpToMultiple(of: 16)
+                self.blockEnd = nextBlock.assumingMemoryBound(to: BlockHeader.self).pointee.end
+            }
+
+            let header = entry.assumingMemoryBound(to: EntryHeader.self)
+            self.entry = entry + Int(header.pointee.stride)
+            return header.pointee.command
+        }
+    }
+
+    @inlinable
+    public func makeIterator() -> Iterator {
+        return Iterator(head: self.head)
+    }
+}
+
+extension UnsafeMutableRawPointer {
+    @inlinable
+    func alignedUp(toMultipleOf alignment: Int) -> UnsafeMutableRawPointer {
+        let address = UInt(bitPattern: self)
+        let alignedAddress = (address + UInt(alignment) - 1) & ~(UInt(alignment) - 1)
+        return self + Int(alignedAddress - address)
+    }
+}
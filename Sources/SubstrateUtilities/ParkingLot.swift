@@ -0,0 +1,79 @@
+//
+//  ParkingLot.swift
+//
+//
+
+import Atomics
+import Foundation
+#if os(macOS) || os(iOS) || os(tvOS) || os(watchOS)
+import Darwin
+#elseif os(Linux)
+import Glibc
+#endif
+
+/// Lets threads sleep until the value at an address changes, in the manner of a futex.
+/// The futex syscall isn't callable from Swift, so threads are instead parked on one of a fixed table of condition variables
+/// chosen by hashing the address. Wakes are broadcast to the whole bucket and waiters re-check their value, so addresses
+/// sharing a bucket only cause spurious wake-ups.
+public enum ParkingLot {
+    #if !os(Windows)
+    struct Buckets {
+        static let count = 64
+        
+        let mutexes : UnsafeMutablePointer<pthread_mutex_t>
+        let conditions : UnsafeMutablePointer<pthread_cond_t>
+        // Guarded by the bucket's mutex.
+        let waiterCounts : UnsafeMutablePointer<Int>
+        
+        init() {
+            self.mutexes = .allocate(capacity: Buckets.count)
+            self.conditions = .allocate(capacity: Buckets.count)
+            self.waiterCounts = .allocate(capacity: Buckets.count)
+            self.waiterCounts.initialize(repeating: 0, count: Buckets.count)
+            for i in 0..<Buckets.count {
+                pthread_mutex_init(self.mutexes.advanced(by: i), nil)
+                pthread_cond_init(self.conditions.advanced(by: i), nil)
+            }
+        }
+        
+        static func index(for address: UnsafeRawPointer) -> Int {
+            // Locks are allocated on their own cache lines, so the low bits carry no information.
+            let bits = UInt(bitPattern: address) >> 6
+            return Int(truncatingIfNeeded: bits ^ (bits >> 6) ^ (bits >> 12)) & (Buckets.count - 1)
+        }
+    }
+    
+    static let buckets = Buckets()
+    
+    /// Sleeps the calling thread while the value at `address` is `expectedValue`. May return spuriously.
+    public static func wait(on address: UnsafeMutablePointer<UInt32.AtomicRepresentation>, whileValueIs expectedValue: UInt32) {
+        let bucket = Buckets.index(for: address)
+        pthread_mutex_lock(self.buckets.mutexes.advanced(by: bucket))
+        // Checking the value under the bucket's mutex means a wake can't be lost between the check and the wait.
+        if UInt32.AtomicRepresentation.atomicLoad(at: address, ordering: .relaxed) == expectedValue {
+            self.buckets.waiterCounts[bucket] += 1
+            pthread_cond_wait(self.buckets.conditions.advanced(by: bucket), self.buckets.mutexes.advanced(by: bucket))
+            self.buckets.waiterCounts[bucket] -= 1
+        }
+        pthread_mutex_unlock(self.buckets.mutexes.advanced(by: bucket))
+    }
+    
+    /// Wakes all threads waiting on `address`. The value at `address` must be changed before calling this.
+    public static func wakeAll(on address: UnsafeRawPointer) {
+        let bucket = Buckets.index(for: address)
+        pthread_mutex_lock(self.buckets.mutexes.advanced(by: bucket))
+        if self.buckets.waiterCounts[bucket] > 0 {
+            pthread_cond_broadcast(self.buckets.conditions.advanced(by: bucket))
+        }
+        pthread_mutex_unlock(self.buckets.mutexes.advanced(by: bucket))
+    }
+    #else
+    // Parking isn't supported on Windows yet, so waiting threads keep spinning.
+    public static func wait(on address: UnsafeMutablePointer<UInt32.AtomicRepresentation>, whileValueIs expectedValue: UInt32) {
+        yieldCPU()
+    }
+    
+    public static func wakeAll(on address: UnsafeRawPointer) {
+    }
+    #endif
+}
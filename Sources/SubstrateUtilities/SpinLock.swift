@@ -12,6 +12,8 @@ import Foundation
 enum LockState : UInt32 {
     case free
     case taken
+    /// Taken, and there may be threads parked waiting for the lock to be released.
+    case contended
 }
 
 #if canImport(SX)
@@ -21,21 +23,56 @@ import SX.Atomic
 func yieldCPU() {
     sx_yield_cpu()
 }
+#elseif canImport(_Builtin_intrinsics) && (arch(x86_64) || arch(i386))
+import _Builtin_intrinsics.intel
+@_transparent
+@inlinable
+func yieldCPU() {
+    _mm_pause()
+}
+#elseif canImport(_Builtin_intrinsics) && arch(arm64)
+import _Builtin_intrinsics.arm.acle
+@_transparent
+@inlinable
+func yieldCPU() {
+    __yield()
+}
 #else
+// Without a spin-loop hint, give up the rest of the time slice so that the thread holding the lock can make progress.
 @_transparent
 @inlinable
 func yieldCPU() {
+    sched_yield()
 }
 #endif
 
-/// An implementation of a spin-lock using test-and-swap
+/// An adaptive lock: contended acquires spin with exponential backoff for a short while, then park the thread until the lock is released.
+///
+/// Building with `-DSUBSTRATE_LOCK_INSTRUMENTATION` records acquire counts, contended acquires, parks and wait times for locks
+/// created with `init(name:)`; see `SpinLock.statistics`.
 public struct SpinLock {
     @usableFromInline let value : UnsafeMutablePointer<UInt32.AtomicRepresentation>
+    #if SUBSTRATE_LOCK_INSTRUMENTATION
+    @usableFromInline let counters : UnsafeMutablePointer<Int.AtomicRepresentation>?
+    #endif
 
     @inlinable
     public init() {
         self.value = UnsafeMutableRawPointer.allocate(byteCount: MemoryLayout<UInt32.AtomicRepresentation>.size, alignment: 64).assumingMemoryBound(to: UInt32.AtomicRepresentation.self)
         UInt32.AtomicRepresentation.atomicStore(LockState.free.rawValue, at: self.value, ordering: .relaxed)
+        #if SUBSTRATE_LOCK_INSTRUMENTATION
+        self.counters = nil
+        #endif
+    }
+    
+    /// Creates a lock whose contention is recorded under `name` when lock instrumentation is enabled.
+    /// Locks with the same name share statistics.
+    public init(name: String) {
+        self.value = UnsafeMutableRawPointer.allocate(byteCount: MemoryLayout<UInt32.AtomicRepresentation>.size, alignment: 64).assumingMemoryBound(to: UInt32.AtomicRepresentation.self)
+        UInt32.AtomicRepresentation.atomicStore(LockState.free.rawValue, at: self.value, ordering: .relaxed)
+        #if SUBSTRATE_LOCK_INSTRUMENTATION
+        self.counters = LockStatistics.counters(named: name)
+        #endif
     }
     
     @inlinable
@@ -46,21 +83,75 @@ public struct SpinLock {
     @inlinable
     public var isLocked : Bool {
         get {
-            return UInt32.AtomicRepresentation.atomicLoad(at: self.value, ordering: .relaxed) == LockState.taken.rawValue
+            return UInt32.AtomicRepresentation.atomicLoad(at: self.value, ordering: .relaxed) != LockState.free.rawValue
         }
     }
     
+    /// The number of backoff rounds to spin for before parking; each round spins twice as long as the last.
+    @inlinable
+    static var spinRoundCount : Int { 10 }
+    
     @inlinable
     public func lock() {
-        while UInt32.AtomicRepresentation.atomicLoad(at: self.value, ordering: .relaxed) == LockState.taken.rawValue ||
-                UInt32.AtomicRepresentation.atomicExchange(LockState.taken.rawValue, at: self.value, ordering: .acquiring) == LockState.taken.rawValue {
-            yieldCPU()
+        if UInt32.AtomicRepresentation.atomicCompareExchange(expected: LockState.free.rawValue, desired: LockState.taken.rawValue, at: self.value, ordering: .acquiring).exchanged {
+            #if SUBSTRATE_LOCK_INSTRUMENTATION
+            if let counters = self.counters {
+                Int.AtomicRepresentation.atomicLoadThenWrappingIncrement(at: counters + LockStatistics.acquireCountIndex, ordering: .relaxed)
+            }
+            #endif
+            return
+        }
+        self.lockContended()
+    }
+    
+    @usableFromInline
+    func lockContended() {
+        #if SUBSTRATE_LOCK_INSTRUMENTATION
+        let waitStart = DispatchTime.now().uptimeNanoseconds
+        defer {
+            if let counters = self.counters {
+                Int.AtomicRepresentation.atomicLoadThenWrappingIncrement(at: counters + LockStatistics.acquireCountIndex, ordering: .relaxed)
+                Int.AtomicRepresentation.atomicLoadThenWrappingIncrement(at: counters + LockStatistics.contendedAcquireCountIndex, ordering: .relaxed)
+                Int.AtomicRepresentation.atomicLoadThenWrappingIncrement(by: Int(DispatchTime.now().uptimeNanoseconds - waitStart), at: counters + LockStatistics.waitNanosecondsIndex, ordering: .relaxed)
+            }
+        }
+        #endif
+        
+        var backoff = 1
+        for _ in 0..<SpinLock.spinRoundCount {
+            for _ in 0..<backoff {
+                yieldCPU()
+            }
+            backoff *= 2
+            
+            if UInt32.AtomicRepresentation.atomicLoad(at: self.value, ordering: .relaxed) == LockState.free.rawValue,
+               UInt32.AtomicRepresentation.atomicCompareExchange(expected: LockState.free.rawValue, desired: LockState.taken.rawValue, at: self.value, ordering: .acquiring).exchanged {
+                return
+            }
+        }
+        
+        // Mark the lock as contended so that the thread releasing it knows to wake us.
+        // Since we can't tell whether other threads are still parked, we keep it marked as contended once we acquire it.
+        while UInt32.AtomicRepresentation.atomicExchange(LockState.contended.rawValue, at: self.value, ordering: .acquiring) != LockState.free.rawValue {
+            #if SUBSTRATE_LOCK_INSTRUMENTATION
+            if let counters = self.counters {
+                Int.AtomicRepresentation.atomicLoadThenWrappingIncrement(at: counters + LockStatistics.parkCountIndex, ordering: .relaxed)
+            }
+            #endif
+            ParkingLot.wait(on: self.value, whileValueIs: LockState.contended.rawValue)
         }
     }
     
     @inlinable
     public func unlock() {
-        _ = UInt32.AtomicRepresentation.atomicExchange(LockState.free.rawValue, at: self.value, ordering: .releasing)
+        if UInt32.AtomicRepresentation.atomicExchange(LockState.free.rawValue, at: self.value, ordering: .releasing) == LockState.contended.rawValue {
+            self.wakeWaiters()
+        }
+    }
+    
+    @usableFromInline
+    func wakeWaiters() {
+        ParkingLot.wakeAll(on: self.value)
     }
     
     @inlinable
@@ -72,6 +163,72 @@ public struct SpinLock {
     }
 }
 
+/// Contention statistics for the locks created with a given name.
+public struct LockStatistics {
+    public var name : String
+    public var acquireCount : Int
+    /// The number of acquires that found the lock already taken.
+    public var contendedAcquireCount : Int
+    /// The total time, in seconds, that threads spent waiting to acquire the lock.
+    public var totalWaitTime : Double
+    /// The number of times a thread gave up spinning and parked until the lock was released.
+    public var parkCount : Int
+    
+    #if SUBSTRATE_LOCK_INSTRUMENTATION
+    @usableFromInline static var acquireCountIndex : Int { 0 }
+    @usableFromInline static var contendedAcquireCountIndex : Int { 1 }
+    @usableFromInline static var waitNanosecondsIndex : Int { 2 }
+    @usableFromInline static var parkCountIndex : Int { 3 }
+    static var counterCount : Int { 4 }
+    
+    static var countersByName : [String : UnsafeMutablePointer<Int.AtomicRepresentation>] = [:]
+    static let registryLock = SpinLock()
+    
+    static func counters(named name: String) -> UnsafeMutablePointer<Int.AtomicRepresentation> {
+        return self.registryLock.withLock {
+            if let counters = self.countersByName[name] {
+                return counters
+            }
+            let counters = UnsafeMutablePointer<Int.AtomicRepresentation>.allocate(capacity: LockStatistics.counterCount)
+            counters.initialize(repeating: Int.AtomicRepresentation(0), count: LockStatistics.counterCount)
+            self.countersByName[name] = counters
+            return counters
+        }
+    }
+    #endif
+}
+
+extension SpinLock {
+    /// The contention statistics for each named lock, or an empty array if lock instrumentation isn't enabled.
+    public static var statistics : [LockStatistics] {
+        #if SUBSTRATE_LOCK_INSTRUMENTATION
+        return LockStatistics.registryLock.withLock {
+            return LockStatistics.countersByName.map { name, counters in
+                LockStatistics(name: name,
+                               acquireCount: Int.AtomicRepresentation.atomicLoad(at: counters + LockStatistics.acquireCountIndex, ordering: .relaxed),
+                               contendedAcquireCount: Int.AtomicRepresentation.atomicLoad(at: counters + LockStatistics.contendedAcquireCountIndex, ordering: .relaxed),
+                               totalWaitTime: Double(Int.AtomicRepresentation.atomicLoad(at: counters + LockStatistics.waitNanosecondsIndex, ordering: .relaxed)) * 1e-9,
+                               parkCount: Int.AtomicRepresentation.atomicLoad(at: counters + LockStatistics.parkCountIndex, ordering: .relaxed))
+            }.sorted(by: { $0.totalWaitTime > $1.totalWaitTime })
+        }
+        #else
+        return []
+        #endif
+    }
+    
+    public static func resetStatistics() {
+        #if SUBSTRATE_LOCK_INSTRUMENTATION
+        LockStatistics.registryLock.withLock {
+            for counters in LockStatistics.countersByName.values {
+                for i in 0..<LockStatistics.counterCount {
+                    Int.AtomicRepresentation.atomicStore(0, at: counters + i, ordering: .relaxed)
+                }
+            }
+        }
+        #endif
+    }
+}
+
 public struct Semaphore {
     @usableFromInline let value : UnsafeMutablePointer<Int32.AtomicRepresentation>
     
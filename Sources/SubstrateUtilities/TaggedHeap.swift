@@ -7,6 +7,7 @@
 //
 
 import Foundation
+import Atomics
 
 extension UnsafeMutableRawBufferPointer {
     fileprivate func contains(_ pointer: UnsafeRawPointer) -> Bool {
@@ -20,10 +21,12 @@ public enum TaggedHeap {
     // Each block is 2MiB
     // Each block is owned by a UInt64 tag (e.g. hashed allocator name + frame number).
     
-    // Everything is stored in bitsets.
-    // We need: a list of allocated blocks (bitset)
-    // A per-tag list of blocks assigned to that tag. Could use a dictionary of [Tag : BitSet] and a pool of free [BitSet]s? Means data is malloc'ed instead, but does that really matter?
-    // Also need a spin-lock.
+    // The heap is made up of one or more regions, each with a bitset of filled blocks that's searched a word at a time.
+    // When every region is full, another region is added; existing regions never move, so outstanding allocations remain valid.
+    // Blocks are claimed with atomic operations on the filled-block bitsets, and each block records its owning tag
+    // alongside the bitset, so single blocks can be claimed without taking the heap's spin-lock.
+    // Multi-block runs are found under the lock. Freed runs are cached by size, since tags tend to allocate
+    // the same sizes each frame and can then reuse their previous blocks without searching.
     
     public enum Strategy {
         case suballocate(capacity: Int, blockSize: Int = 2 * 1024 * 1024)
@@ -33,30 +36,127 @@ public enum TaggedHeap {
     public typealias Tag = UInt64
     public static var blockSize = 64 * 1024
     
+    /// Marks blocks that aren't owned by any tag; it can't be used as a tag.
+    static let unownedTag = Tag.max
+    
+    public struct Statistics {
+        /// The number of blocks currently allocated.
+        public var allocatedBlockCount : Int = 0
+        /// The largest number of blocks allocated at any one time since the heap was initialised or `resetHighWaterMarks` was called.
+        public var highWaterBlockCount : Int = 0
+    }
+    
+    /// A contiguous run of blocks within a region.
+    struct BlockRun {
+        var region : Int
+        var start : Int
+        var count : Int
+        
+        var range : Range<Int> {
+            return self.start..<(self.start + self.count)
+        }
+    }
+    
+    struct Region {
+        let memory : UnsafeMutableRawPointer
+        let blockCount : Int
+        let filledBlocks : AtomicBitSet
+        /// The tag that owns each filled block. A block's tag is reset to `unownedTag` before the block is freed,
+        /// so a block that has been claimed but not yet tagged never appears to belong to a stale tag.
+        let blockTags : UnsafeMutablePointer<Tag.AtomicRepresentation>
+        /// Where to start searching `filledBlocks`; every word before it was full when it was last updated.
+        let firstFreeWordHint : UnsafeMutablePointer<Int.AtomicRepresentation>
+        
+        init(blockCount: Int) {
+            self.memory = UnsafeMutableRawPointer.allocate(byteCount: TaggedHeap.blockSize * blockCount, alignment: TaggedHeap.blockSize)
+            self.blockCount = blockCount
+            
+            let storageCount = (blockCount + AtomicBitSet.bitsPerElement - 1) / AtomicBitSet.bitsPerElement
+            self.filledBlocks = AtomicBitSet(storageCount: storageCount)
+            // Mark the bits past the end of the region as filled so that searches never return them.
+            if storageCount * AtomicBitSet.bitsPerElement > blockCount {
+                self.filledBlocks.setBits(in: blockCount..<(storageCount * AtomicBitSet.bitsPerElement))
+            }
+            
+            self.blockTags = .allocate(capacity: blockCount)
+            self.blockTags.initialize(repeating: Tag.AtomicRepresentation(TaggedHeap.unownedTag), count: blockCount)
+            self.firstFreeWordHint = .allocate(capacity: 1)
+            self.firstFreeWordHint.initialize(to: Int.AtomicRepresentation(0))
+        }
+        
+        func dispose() {
+            self.memory.deallocate()
+            self.filledBlocks.dispose()
+            self.blockTags.deallocate()
+            self.firstFreeWordHint.deallocate()
+        }
+        
+        var firstFreeWord : Int {
+            get {
+                return Int.AtomicRepresentation.atomicLoad(at: self.firstFreeWordHint, ordering: .relaxed)
+            }
+            nonmutating set {
+                Int.AtomicRepresentation.atomicStore(newValue, at: self.firstFreeWordHint, ordering: .relaxed)
+            }
+        }
+        
+        func tag(ofBlock block: Int) -> Tag {
+            return Tag.AtomicRepresentation.atomicLoad(at: self.blockTags.advanced(by: block), ordering: .relaxed)
+        }
+        
+        func setTag(_ tag: Tag, forBlocks blocks: Range<Int>) {
+            for block in blocks {
+                Tag.AtomicRepresentation.atomicStore(tag, at: self.blockTags.advanced(by: block), ordering: .relaxed)
+            }
+        }
+        
+        func blockIndex(for pointer: UnsafeRawPointer) -> Int? {
+            let offset = pointer - UnsafeRawPointer(self.memory)
+            guard offset >= 0, offset < self.blockCount * TaggedHeap.blockSize else { return nil }
+            return offset / TaggedHeap.blockSize
+        }
+    }
+    
     static var strategy: Strategy = .allocatePerBlock()
     
-    static var blockCount : Int = 0
-    static var bitSetStorageCount : Int = 0
-    @usableFromInline static var heapMemory : UnsafeMutableRawPointer? = nil
-    static var spinLock = SpinLock()
-    static var filledBlocks : AtomicBitSet! = nil
+    static let maxRegionCount = 32
+    static var regions : UnsafeMutablePointer<Region>? = nil
+    /// Regions are fully initialised before the count is incremented, so lock-free readers only need to load the count.
+    static let regionCountStorage = TaggedHeap.makeAtomicCounter()
+    static var spinLock = SpinLock(name: "TaggedHeap")
     
-    static var blocksByTag : [Tag : BitSet]! = nil
-    static var freeBitsets : [BitSet]! = nil
+    /// Recently freed runs, indexed by block count.
+    static var freeRunCache : [[BlockRun]] = []
+    static let maxCachedRunBlockCount = 16
+    static let maxCachedRunsPerSize = 64
     
     static var allocationsByTag : [Tag : [UnsafeMutableRawBufferPointer]] = [:]
     
+    static let allocatedBlockCountStorage = TaggedHeap.makeAtomicCounter()
+    static let highWaterBlockCountStorage = TaggedHeap.makeAtomicCounter()
+    /// The number of blocks each tag had when it was last freed. A tag's block count only grows until it's freed, so this is its high-water mark.
+    static var highWaterBlockCountsByTag : [Tag : Int] = [:]
+    
     #if os(macOS) || targetEnvironment(macCatalyst)
     public static let defaultHeapCapacity = 512 * 1024 * 1024 // 2 * 1024 * 1024 * 1024
     #else
     public static let defaultHeapCapacity = 256 * 1024 * 1024
     #endif
     
+    static func makeAtomicCounter() -> UnsafeMutablePointer<Int.AtomicRepresentation> {
+        let counter = UnsafeMutablePointer<Int.AtomicRepresentation>.allocate(capacity: 1)
+        counter.initialize(to: Int.AtomicRepresentation(0))
+        return counter
+    }
+    
     public static func initialise(capacity: Int = TaggedHeap.defaultHeapCapacity) {
         self.initialise(strategy: .suballocate(capacity: capacity))
     }
     
+    /// Initialises the heap with `strategy`. Any memory from a previous initialisation is released.
     public static func initialise(strategy: Strategy = .suballocate(capacity: TaggedHeap.defaultHeapCapacity)) {
+        self.releaseRegions()
+        
         self.strategy = strategy
         switch strategy {
         case .allocatePerBlock(let blockSize):
@@ -64,71 +164,201 @@ public enum TaggedHeap {
             self.allocationsByTag = [:]
         case .suballocate(let capacity, let blockSize):
             self.blockSize = blockSize
-            self.blockCount = (capacity + TaggedHeap.blockSize - 1) / TaggedHeap.blockSize
-            self.bitSetStorageCount = (self.blockCount + BitSet.bitsPerElement) / BitSet.bitsPerElement
+            self.regions = .allocate(capacity: self.maxRegionCount)
+            self.addRegion(blockCount: (capacity + TaggedHeap.blockSize - 1) / TaggedHeap.blockSize)
             
-            self.heapMemory = UnsafeMutableRawPointer.allocate(byteCount: TaggedHeap.blockSize * blockCount, alignment: TaggedHeap.blockSize)
-            self.filledBlocks = AtomicBitSet(storageCount: bitSetStorageCount)
-            self.blocksByTag = [:]
-            self.freeBitsets = []
+            self.freeRunCache = .init(repeating: [], count: self.maxCachedRunBlockCount + 1)
         }
+        
+        Int.AtomicRepresentation.atomicStore(0, at: self.allocatedBlockCountStorage, ordering: .relaxed)
+        Int.AtomicRepresentation.atomicStore(0, at: self.highWaterBlockCountStorage, ordering: .relaxed)
+        self.highWaterBlockCountsByTag = [:]
+    }
+    
+    static func releaseRegions() {
+        guard let regions = self.regions else { return }
+        let regionCount = self.regionCount
+        for i in 0..<regionCount {
+            regions[i].dispose()
+        }
+        regions.deinitialize(count: regionCount)
+        regions.deallocate()
+        self.regions = nil
+        Int.AtomicRepresentation.atomicStore(0, at: self.regionCountStorage, ordering: .releasing)
+    }
+    
+    static var regionCount : Int {
+        return Int.AtomicRepresentation.atomicLoad(at: self.regionCountStorage, ordering: .acquiring)
     }
     
-    static func findContiguousBlock(count: Int) -> Int {
-        for i in 0..<(self.blockCount - count) {
-            if self.filledBlocks.testBitsAreClear(in: i..<(i + count)) {
-                return i
+    static func addRegion(blockCount: Int) {
+        let regionCount = self.regionCount
+        precondition(regionCount < self.maxRegionCount, "TaggedHeap error: exceeded the maximum of \(self.maxRegionCount) heap regions.")
+        self.regions.unsafelyUnwrapped.advanced(by: regionCount).initialize(to: Region(blockCount: blockCount))
+        Int.AtomicRepresentation.atomicStore(regionCount + 1, at: self.regionCountStorage, ordering: .releasing)
+    }
+    
+    /// The total number of blocks across all regions of the heap.
+    static var capacityBlockCount : Int {
+        var blockCount = 0
+        for i in 0..<self.regionCount {
+            blockCount += self.regions.unsafelyUnwrapped[i].blockCount
+        }
+        return blockCount
+    }
+    
+    static func takeCachedRun(count: Int) -> BlockRun? {
+        guard count < self.freeRunCache.count else { return nil }
+        
+        // A cached run may since have been partially reused by a run of a different size, so it needs to be validated.
+        while let run = self.freeRunCache[count].popLast() {
+            if self.regions.unsafelyUnwrapped[run.region].filledBlocks.testBitsAreClear(in: run.range) {
+                return run
+            }
+        }
+        return nil
+    }
+    
+    static func findContiguousBlocks(count: Int, useHints: Bool) -> BlockRun? {
+        for regionIndex in 0..<self.regionCount {
+            let region = self.regions.unsafelyUnwrapped[regionIndex]
+            if let start = region.filledBlocks.firstClearRun(count: count, startingAtWord: useHints ? region.firstFreeWord : 0) {
+                return BlockRun(region: regionIndex, start: start, count: count)
             }
         }
+        return nil
+    }
+    
+    static func growHeap(count: Int) -> BlockRun {
+        // Double the total capacity, rather than replacing the existing region and leaking its allocations.
+        let blockCount = max(self.capacityBlockCount, count)
+        self.addRegion(blockCount: blockCount)
+        return BlockRun(region: self.regionCount - 1, start: 0, count: count)
+    }
+    
+    static func recordAllocation(blockCount: Int) {
+        let allocatedBlockCount = Int.AtomicRepresentation.atomicLoadThenWrappingIncrement(by: blockCount, at: self.allocatedBlockCountStorage, ordering: .relaxed) + blockCount
         
-        return .max
+        var highWaterBlockCount = Int.AtomicRepresentation.atomicLoad(at: self.highWaterBlockCountStorage, ordering: .relaxed)
+        while allocatedBlockCount > highWaterBlockCount {
+            let (exchanged, original) = Int.AtomicRepresentation.atomicWeakCompareExchange(expected: highWaterBlockCount, desired: allocatedBlockCount, at: self.highWaterBlockCountStorage, successOrdering: .relaxed, failureOrdering: .relaxed)
+            if exchanged { break }
+            highWaterBlockCount = original
+        }
+    }
+    
+    /// Must be called with the spin-lock held.
+    static func recordFree(tag: Tag, blockCount: Int) {
+        Int.AtomicRepresentation.atomicLoadThenWrappingDecrement(by: blockCount, at: self.allocatedBlockCountStorage, ordering: .relaxed)
+        self.highWaterBlockCountsByTag[tag] = max(self.highWaterBlockCountsByTag[tag] ?? 0, blockCount)
     }
     
-    static func taggedBlockList(tag: Tag) -> BitSet {
-        if let tagList = self.blocksByTag[tag] {
-            return tagList
+    /// Claims up to `maxCount` single blocks for `tag` without taking the heap's lock, writing their base addresses to `blocks`.
+    static func claimBlocks(tag: Tag, maxCount: Int, into blocks: UnsafeMutablePointer<UnsafeMutableRawPointer>) -> Int {
+        var claimedCount = 0
+        
+        for regionIndex in 0..<self.regionCount {
+            let region = self.regions.unsafelyUnwrapped[regionIndex]
+            var wordIndex = region.firstFreeWord
+            
+            while claimedCount < maxCount, let claimed = region.filledBlocks.setFirstClearBits(maxCount: maxCount - claimedCount, startingAtWord: wordIndex) {
+                var remainingBits = claimed.bits
+                while remainingBits != 0 {
+                    let block = claimed.uintIndex * AtomicBitSet.bitsPerElement + remainingBits.trailingZeroBitCount
+                    remainingBits &= remainingBits &- 1
+                    
+                    region.setTag(tag, forBlocks: block..<(block + 1))
+                    blocks[claimedCount] = region.memory + block * TaggedHeap.blockSize
+                    claimedCount += 1
+                }
+                wordIndex = claimed.uintIndex
+            }
+            
+            if wordIndex > region.firstFreeWord {
+                region.firstFreeWord = wordIndex
+            }
+            if claimedCount == maxCount {
+                break
+            }
         }
         
-        let list = self.freeBitsets.popLast() ?? BitSet(storageCount: self.bitSetStorageCount)
-        self.blocksByTag[tag] = list
-        return list
+        if claimedCount > 0 {
+            self.recordAllocation(blockCount: claimedCount)
+        }
+        return claimedCount
     }
     
+    /// Allocates `count` contiguous blocks for `tag`. Single blocks are claimed without taking the heap's lock where possible.
     public static func allocateBlocks(tag: Tag, count: Int) -> UnsafeMutableRawPointer {
+        precondition(tag != self.unownedTag, "TaggedHeap: Tag.max is reserved.")
+        
         if case .allocatePerBlock = self.strategy {
             let pointer = UnsafeMutableRawBufferPointer.allocate(byteCount: TaggedHeap.blockSize * count, alignment: TaggedHeap.blockSize)
             self.spinLock.withLock {
                 self.allocationsByTag[tag, default: []].append(pointer)
             }
+            self.recordAllocation(blockCount: count)
             return pointer.baseAddress!
         }
         
-        var blockIndex = self.findContiguousBlock(count: count)
-        if blockIndex == .max {
-            print("TaggedHeap error: no free blocks available! Reallocating a heap with double the capacity; all previous allocations will be leaked.")
-            self.spinLock.withLock {
-                self.initialise(strategy: .suballocate(capacity: 2 * self.blockCount * self.blockSize))
+        if count == 1 {
+            var block = UnsafeMutableRawPointer(bitPattern: 0x1)!
+            if self.claimBlocks(tag: tag, maxCount: 1, into: &block) == 1 {
+                return block
             }
-            return self.allocateBlocks(tag: tag, count: count)
         }
         
         return self.spinLock.withLock {
-            while !self.filledBlocks.testBitsAreClear(in: blockIndex..<(blockIndex + count)) {
-                blockIndex = self.findContiguousBlock(count: count)
+            while true {
+                // Threads claiming single blocks may race us for the run we found, in which case we search again.
+                // The hints are only updated on a best-effort basis, so do a full search before growing the heap.
+                let run = self.takeCachedRun(count: count) ??
+                    self.findContiguousBlocks(count: count, useHints: true) ??
+                    self.findContiguousBlocks(count: count, useHints: false) ??
+                    self.growHeap(count: count)
+                
+                let region = self.regions.unsafelyUnwrapped[run.region]
+                if region.filledBlocks.trySetBits(in: run.range) {
+                    region.setTag(tag, forBlocks: run.range)
+                    self.recordAllocation(blockCount: count)
+                    return region.memory + run.start * TaggedHeap.blockSize
+                }
+            }
+        }
+    }
+    
+    /// Allocates between one and `maxCount` single blocks for `tag`, writing their base addresses to `blocks` and returning the number allocated.
+    /// Blocks are claimed with atomic operations on the heap's bitsets, so threads refilling their block caches don't contend on a lock
+    /// unless the heap needs to grow.
+    public static func allocateBlocks(tag: Tag, maxCount: Int, into blocks: UnsafeMutablePointer<UnsafeMutableRawPointer>) -> Int {
+        precondition(maxCount > 0)
+        
+        if case .suballocate = self.strategy {
+            precondition(tag != self.unownedTag, "TaggedHeap: Tag.max is reserved.")
+            let claimedCount = self.claimBlocks(tag: tag, maxCount: maxCount, into: blocks)
+            if claimedCount > 0 {
+                return claimedCount
+            }
+        }
+        
+        blocks.initialize(to: self.allocateBlocks(tag: tag, count: 1))
+        return 1
+    }
+    
+    static func blockLocation(for pointer: UnsafeRawPointer) -> (region: Region, block: Int)? {
+        for regionIndex in 0..<self.regionCount {
+            let region = self.regions.unsafelyUnwrapped[regionIndex]
+            if let block = region.blockIndex(for: pointer) {
+                return (region, block)
             }
-            
-            let tagBitset = self.taggedBlockList(tag: tag)
-            self.filledBlocks.unsafelyUnwrapped.setBits(in: blockIndex..<(blockIndex + count))
-            tagBitset.setBits(in: blockIndex..<(blockIndex + count))
-            
-            return self.heapMemory.unsafelyUnwrapped + blockIndex * TaggedHeap.blockSize
         }
+        return nil
     }
     
     /// For debugging only; not efficient.
     public static func tag(for pointer: UnsafeRawPointer) -> Tag? {
-        return self.spinLock.withLock {
-            if case .allocatePerBlock = self.strategy {
+        if case .allocatePerBlock = self.strategy {
+            return self.spinLock.withLock {
                 for (tag, allocationList) in self.allocationsByTag {
                     for allocation in allocationList {
                         if allocation.contains(pointer) {
@@ -138,54 +368,158 @@ public enum TaggedHeap {
                 }
                 return nil
             }
-    
-            let block = (pointer - UnsafeRawPointer(self.heapMemory!)) / self.blockSize
-            assert(block >= 0 && block < self.blockCount)
-            for (tag, blocks) in self.blocksByTag {
-                if blocks[block] {
-                    return tag
-                }
-            }
+        }
+        
+        guard let location = self.blockLocation(for: pointer) else {
+            assertionFailure("Pointer \(pointer) is not within the TaggedHeap.")
             return nil
         }
+        let tag = location.region.tag(ofBlock: location.block)
+        return tag == self.unownedTag ? nil : tag
     }
     
     /// For debugging only; not efficient.
     public static func tagMatches(_ tag: Tag, pointer: UnsafeRawPointer) -> Bool {
-        return self.spinLock.withLock {
-            if case .allocatePerBlock = self.strategy {
-                return self.allocationsByTag[tag]?.contains(where: {
-                    $0.contains(pointer)
-                }) ?? false
-            }
-            
-            let block = (pointer - UnsafeRawPointer(self.heapMemory!)) / self.blockSize
-            assert(block >= 0 && block < self.blockCount)
-            
-            guard let blocks = self.blocksByTag[tag] else {
-                return false
-            }
-            return blocks[block]
-        }
+        return self.tag(for: pointer) == tag
     }
     
+    /// Frees all blocks owned by `tag`, clearing each word of the filled-block bitsets with a single atomic operation.
     public static func free(tag: Tag) {
         if case .allocatePerBlock = self.strategy {
             self.spinLock.withLock {
                 guard let allocations = self.allocationsByTag.removeValue(forKey: tag) else { return }
                 allocations.forEach { $0.deallocate() }
+                self.recordFree(tag: tag, blockCount: allocations.reduce(0, { $0 + $1.count / TaggedHeap.blockSize }))
             }
             return
         }
         
-        // Should use a bit-list to track all blocks associated with a specific tag.
         self.spinLock.withLock {
-            guard let blocks = self.blocksByTag.removeValue(forKey: tag) else { return }
+            var freedBlockCount = 0
             
-            self.filledBlocks.clearBits(in: blocks)
+            for regionIndex in 0..<self.regionCount {
+                let region = self.regions.unsafelyUnwrapped[regionIndex]
+                var firstFreedWord = -1
+                var run = BlockRun(region: regionIndex, start: 0, count: 0)
+                
+                for wordIndex in 0..<region.filledBlocks.storageCount {
+                    var filledBits = region.filledBlocks[uintIndex: wordIndex, offset: 0]
+                    var freedBits = 0 as UInt
+                    
+                    while filledBits != 0 {
+                        let bit = filledBits.trailingZeroBitCount
+                        filledBits &= filledBits &- 1
+                        
+                        let block = wordIndex * AtomicBitSet.bitsPerElement + bit
+                        guard block < region.blockCount, region.tag(ofBlock: block) == tag else { continue }
+                        
+                        region.setTag(self.unownedTag, forBlocks: block..<(block + 1))
+                        freedBits |= 1 << bit
+                        
+                        if run.count > 0, run.range.upperBound == block {
+                            run.count += 1
+                        } else {
+                            self.cacheFreedRun(run)
+                            run.start = block
+                            run.count = 1
+                        }
+                    }
+                    
+                    if freedBits != 0 {
+                        region.filledBlocks.clearBits(freedBits, inWordAt: wordIndex)
+                        freedBlockCount += freedBits.nonzeroBitCount
+                        if firstFreedWord < 0 {
+                            firstFreedWord = wordIndex
+                        }
+                    }
+                }
+                
+                self.cacheFreedRun(run)
+                if firstFreedWord >= 0, firstFreedWord < region.firstFreeWord {
+                    region.firstFreeWord = firstFreedWord
+                }
+            }
+            
+            if freedBlockCount > 0 {
+                self.recordFree(tag: tag, blockCount: freedBlockCount)
+            }
+        }
+    }
+    
+    /// Returns single blocks that `tag` claimed but never used to the heap, leaving the tag's other blocks allocated.
+    /// Blocks that `tag` no longer owns are skipped. Has no effect when the heap allocates per block, since those blocks are never claimed ahead of use.
+    public static func releaseBlocks(tag: Tag, _ blocks: UnsafeBufferPointer<UnsafeMutableRawPointer>) {
+        guard case .suballocate = self.strategy, !blocks.isEmpty else { return }
+        
+        self.spinLock.withLock {
+            var releasedBlockCount = 0
             
-            blocks.clear()
-            self.freeBitsets.append(blocks)
+            for pointer in blocks {
+                guard let location = self.blockLocation(for: pointer), location.region.tag(ofBlock: location.block) == tag else { continue }
+                let (region, block) = location
+                
+                region.setTag(self.unownedTag, forBlocks: block..<(block + 1))
+                let (wordIndex, bit) = block.quotientAndRemainder(dividingBy: AtomicBitSet.bitsPerElement)
+                region.filledBlocks.clearBits((1 as UInt) << bit, inWordAt: wordIndex)
+                if wordIndex < region.firstFreeWord {
+                    region.firstFreeWord = wordIndex
+                }
+                releasedBlockCount += 1
+            }
+            
+            // The blocks were never part of the tag's working set, so its high-water mark is left unchanged.
+            if releasedBlockCount > 0 {
+                Int.AtomicRepresentation.atomicLoadThenWrappingDecrement(by: releasedBlockCount, at: self.allocatedBlockCountStorage, ordering: .relaxed)
+            }
+        }
+    }
+    
+    static func cacheFreedRun(_ run: BlockRun) {
+        if run.count > 0, run.count < self.freeRunCache.count, self.freeRunCache[run.count].count < self.maxCachedRunsPerSize {
+            self.freeRunCache[run.count].append(run)
+        }
+    }
+    
+    /// The total number of blocks currently allocated, and the high-water mark of that count.
+    public static var statistics : Statistics {
+        return Statistics(allocatedBlockCount: Int.AtomicRepresentation.atomicLoad(at: self.allocatedBlockCountStorage, ordering: .relaxed),
+                          highWaterBlockCount: Int.AtomicRepresentation.atomicLoad(at: self.highWaterBlockCountStorage, ordering: .relaxed))
+    }
+    
+    /// The number of blocks currently allocated to `tag`, and the high-water mark of that count.
+    /// High-water marks are kept after a tag is freed so that they can be used to size the heap. Not efficient.
+    public static func statistics(for tag: Tag) -> Statistics? {
+        return self.spinLock.withLock {
+            var allocatedBlockCount = 0
+            if case .allocatePerBlock = self.strategy {
+                allocatedBlockCount = self.allocationsByTag[tag]?.reduce(0, { $0 + $1.count / TaggedHeap.blockSize }) ?? 0
+            } else {
+                for regionIndex in 0..<self.regionCount {
+                    let region = self.regions.unsafelyUnwrapped[regionIndex]
+                    for block in 0..<region.blockCount where region.tag(ofBlock: block) == tag {
+                        allocatedBlockCount += 1
+                    }
+                }
+            }
+            
+            let highWaterBlockCount = self.highWaterBlockCountsByTag[tag]
+            if allocatedBlockCount == 0 && highWaterBlockCount == nil {
+                return nil
+            }
+            return Statistics(allocatedBlockCount: allocatedBlockCount, highWaterBlockCount: max(allocatedBlockCount, highWaterBlockCount ?? 0))
+        }
+    }
+    
+    /// The total capacity in bytes across all regions of the heap, or `nil` if the heap doesn't suballocate.
+    public static var capacity : Int? {
+        guard case .suballocate = self.strategy else { return nil }
+        return self.capacityBlockCount * TaggedHeap.blockSize
+    }
+    
+    public static func resetHighWaterMarks() {
+        self.spinLock.withLock {
+            Int.AtomicRepresentation.atomicStore(Int.AtomicRepresentation.atomicLoad(at: self.allocatedBlockCountStorage, ordering: .relaxed), at: self.highWaterBlockCountStorage, ordering: .relaxed)
+            self.highWaterBlockCountsByTag.removeAll()
         }
     }
 }
@@ -290,6 +624,9 @@ public struct TagAllocator {
         public var memory : UnsafeMutableRawPointer? = nil
         public var size : Int = 0
         public var offset = 0
+        // The number of blocks left in this thread's cache, and how many to claim the next time the cache is refilled.
+        public var cachedBlockCount = 0
+        public var nextBatchSize = 1
         
         @inlinable
         init() {
@@ -297,6 +634,10 @@ public struct TagAllocator {
         }
     }
     
+    /// The most blocks a thread claims from the heap at once.
+    @inlinable
+    static var maxBlockBatchSize : Int { 8 }
+    
     @usableFromInline let memory : UnsafeMutableRawPointer
     
     @usableFromInline var header : UnsafeMutablePointer<Header> {
@@ -307,6 +648,11 @@ public struct TagAllocator {
         return self.memory.advanced(by: MemoryLayout<Header>.stride).assumingMemoryBound(to: AllocationBlock.self)
     }
     
+    /// Each thread's cache of claimed blocks, `maxBlockBatchSize` entries per thread.
+    @usableFromInline var cachedBlocks : UnsafeMutablePointer<UnsafeMutableRawPointer> {
+        return UnsafeMutableRawPointer(self.blocks + self.header.pointee.threadCount).assumingMemoryBound(to: UnsafeMutableRawPointer.self)
+    }
+    
     @inlinable
     public init(tag: TaggedHeap.Tag, threadCount: Int) {
         let firstBlock = TaggedHeap.allocateBlocks(tag: tag, count: 1)
@@ -317,8 +663,13 @@ public struct TagAllocator {
         
         firstBlock.advanced(by: MemoryLayout<Header>.stride).bindMemory(to: AllocationBlock.self, capacity: threadCount)
         self.blocks.initialize(repeating: AllocationBlock(), count: threadCount)
+        UnsafeMutableRawPointer(self.blocks + threadCount).bindMemory(to: UnsafeMutableRawPointer.self, capacity: threadCount * TagAllocator.maxBlockBatchSize)
+        
+        let headerSize = MemoryLayout<Header>.stride + MemoryLayout<AllocationBlock>.stride * threadCount + MemoryLayout<UnsafeMutableRawPointer>.stride * threadCount * TagAllocator.maxBlockBatchSize
+        assert(headerSize <= TaggedHeap.blockSize)
         self.blocks[0].memory = firstBlock
-        self.blocks[0].offset = MemoryLayout<Header>.stride + MemoryLayout<AllocationBlock>.stride * threadCount
+        self.blocks[0].size = TaggedHeap.blockSize
+        self.blocks[0].offset = headerSize
     }
     
     @inlinable
@@ -329,6 +680,14 @@ public struct TagAllocator {
     @inlinable
     public mutating func reset() {
         let header = self.header.pointee
+        // The new allocator starts with empty block caches, so return the blocks each thread claimed but didn't use.
+        // If the tag has already been freed, so have the cached blocks.
+        if self.isValid {
+            for threadIndex in 0..<header.threadCount {
+                let cache = self.cachedBlocks.advanced(by: threadIndex * TagAllocator.maxBlockBatchSize)
+                TaggedHeap.releaseBlocks(tag: header.tag, UnsafeBufferPointer(start: cache, count: self.blocks[threadIndex].cachedBlockCount))
+            }
+        }
         self = TagAllocator(tag: header.tag, threadCount: header.threadCount)
     }
     
@@ -342,7 +701,7 @@ public struct TagAllocator {
         }
         
         let requiredBlocks = (bytes + TaggedHeap.blockSize - 1) / TaggedHeap.blockSize
-        let memory = TaggedHeap.allocateBlocks(tag: self.header.pointee.tag, count: requiredBlocks)
+        let memory = requiredBlocks == 1 ? self.nextCachedBlock(threadIndex: threadIndex) : TaggedHeap.allocateBlocks(tag: self.header.pointee.tag, count: requiredBlocks)
         blockPtr.pointee.memory = memory
         blockPtr.pointee.size = requiredBlocks * TaggedHeap.blockSize
         blockPtr.pointee.offset = bytes
@@ -350,6 +709,23 @@ public struct TagAllocator {
         return memory
     }
     
+    /// Takes a block from the thread's cache, refilling the cache from the heap if it's empty.
+    /// Each refill claims twice as many blocks as the last (up to `maxBlockBatchSize`), so threads that allocate heavily
+    /// go to the heap less often while threads that allocate little don't hold on to unused blocks.
+    @usableFromInline
+    func nextCachedBlock(threadIndex: Int) -> UnsafeMutableRawPointer {
+        let blockPtr = self.blocks.advanced(by: threadIndex)
+        let cache = self.cachedBlocks.advanced(by: threadIndex * TagAllocator.maxBlockBatchSize)
+        
+        if blockPtr.pointee.cachedBlockCount == 0 {
+            blockPtr.pointee.cachedBlockCount = TaggedHeap.allocateBlocks(tag: self.header.pointee.tag, maxCount: blockPtr.pointee.nextBatchSize, into: cache)
+            blockPtr.pointee.nextBatchSize = min(2 * blockPtr.pointee.nextBatchSize, TagAllocator.maxBlockBatchSize)
+        }
+        
+        blockPtr.pointee.cachedBlockCount -= 1
+        return cache[blockPtr.pointee.cachedBlockCount]
+    }
+    
     @inlinable
     public func allocate<T>(type: T.Type = T.self, capacity: Int, threadIndex: Int) -> UnsafeMutablePointer<T> {
         return self.allocate(bytes: capacity * MemoryLayout<T>.stride, alignment: MemoryLayout<T>.alignment, threadIndex: threadIndex).bindMemory(to: T.self, capacity: capacity)
@@ -1,6 +1,22 @@
 import XCTest
 @testable import SubstrateMathTests
+@testable import SubstrateTests
 
 XCTMain([
      testCase(SubstrateMathTests.allTests),
+     testCase(HeadlessBackendTests.allTests),
+     testCase(HeadlessAsyncComputeTests.allTests),
+     testCase(RenderGraphTopologyTests.allTests),
+     testCase(RenderGraphJobManagerTests.allTests),
+     testCase(RenderGraphPassSchedulerTests.allTests),
+     testCase(TransientAliasingPlannerTests.allTests),
+     testCase(RenderGraphPipelinedExecutionTests.allTests),
+     testCase(ResourceCommandGeneratorBenchmarks.allTests),
+     testCase(ResourceCommandGeneratorTests.allTests),
+     testCase(BindingShadowStateTests.allTests),
+     testCase(DrawBatchingTests.allTests),
+     testCase(IndirectCommandBufferTests.allTests),
+     testCase(AsyncPipelineCompilationTests.allTests),
+     testCase(RenderGraphTraceExporterTests.allTests),
+     testCase(VulkanPipelineCacheTests.allTests),
 ])
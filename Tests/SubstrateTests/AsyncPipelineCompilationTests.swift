@@ -0,0 +1,125 @@
+//
+//  AsyncPipelineCompilationTests.swift
+//
+//
+
+import XCTest
+@testable import Substrate
+
+class AsyncPipelineCompilationTests: XCTestCase {
+    var renderTarget : Texture! = nil
+
+    override func setUp() {
+        super.setUp()
+        RenderBackend.initialise(api: .headless, applicationName: "AsyncPipelineCompilationTests")
+        self.renderTarget = Texture(descriptor: TextureDescriptor(texture2DWithFormat: .rgba8Unorm, width: 16, height: 16, mipmapped: false, storageMode: .private, usageHint: .renderTarget), flags: .persistent)
+    }
+
+    override func tearDown() {
+        self.renderTarget.dispose()
+        RenderBackend.pipelineCompilationMode = .synchronous
+        super.tearDown()
+    }
+
+    func pipelineDescriptor(vertexFunction: String, fallback: RenderPipelineDescriptor? = nil) -> RenderPipelineDescriptor {
+        var descriptor = RenderPipelineDescriptor(attachmentCount: 1)
+        descriptor.vertexFunction = vertexFunction
+        descriptor.fragmentFunction = "fragment"
+        descriptor.fallbackDescriptor = fallback
+        return descriptor
+    }
+
+    /// Draws once with a pipeline that has a fallback and once with a pipeline that doesn't.
+    func addFrame(to renderGraph: RenderGraph) {
+        let withFallback = self.pipelineDescriptor(vertexFunction: "detailed", fallback: self.pipelineDescriptor(vertexFunction: "simple"))
+        let withoutFallback = self.pipelineDescriptor(vertexFunction: "optional")
+
+        renderGraph.addDrawCallbackPass(name: "Draw", renderTarget: RenderTargetDescriptor(colorAttachments: [ColorAttachmentDescriptor(texture: self.renderTarget)])) { encoder in
+            encoder.setRenderPipelineDescriptor(withFallback)
+            encoder.drawPrimitives(type: .triangle, vertexStart: 0, vertexCount: 3)
+            encoder.setRenderPipelineDescriptor(withoutFallback)
+            encoder.drawPrimitives(type: .triangle, vertexStart: 0, vertexCount: 3)
+        }
+    }
+
+    /// For each draw in the last execution, whether it was drawn normally, drawn with a fallback, or skipped.
+    func recordedDraws(executing renderGraph: RenderGraph) -> [String] {
+        RenderBackend.clearHeadlessRecordedCommandBuffers()
+        renderGraph.execute().wait()
+
+        return RenderBackend.headlessRecordedCommandBuffers.flatMap { $0.commands }.compactMap { command in
+            switch command {
+            case .command(_, let name) where name.description == "drawPrimitives":
+                return "draw"
+            case .deferredDraw(_, let usesFallback):
+                return usesFallback ? "fallback" : "skipped"
+            default:
+                return nil
+            }
+        }
+    }
+
+    func testDrawsAreDeferredWhilePipelinesCompile() {
+        RenderBackend.pipelineCompilationMode = .asynchronous
+        let renderGraph = RenderGraph(inflightFrameCount: 1)
+
+        self.addFrame(to: renderGraph)
+        XCTAssertEqual(self.recordedDraws(executing: renderGraph), ["fallback", "skipped"])
+
+        // The pipelines finished compiling when the first frame was submitted.
+        self.addFrame(to: renderGraph)
+        XCTAssertEqual(self.recordedDraws(executing: renderGraph), ["draw", "draw"])
+    }
+
+    func testPipelinedFramesReportTheirOwnDeferredDrawCounts() {
+        RenderBackend.pipelineCompilationMode = .asynchronous
+        let renderGraph = RenderGraph(inflightFrameCount: 2, executionMode: .pipelined)
+        let renderTarget = self.renderTarget!
+
+        var reportedCounts = [Int]()
+        var waitTokens = [RenderGraphExecutionWaitToken]()
+        for (vertexFunction, drawCount) in [("pipelinedFirst", 2), ("pipelinedSecond", 3)] {
+            let descriptor = self.pipelineDescriptor(vertexFunction: vertexFunction)
+            renderGraph.addDrawCallbackPass(name: "Draw", renderTarget: RenderTargetDescriptor(colorAttachments: [ColorAttachmentDescriptor(texture: renderTarget)])) { encoder in
+                encoder.setRenderPipelineDescriptor(descriptor)
+                for _ in 0..<drawCount {
+                    encoder.drawPrimitives(type: .triangle, vertexStart: 0, vertexCount: 3)
+                }
+            }
+            // Submission callbacks run on the context queue once the execution's count has been published.
+            renderGraph.onSubmission {
+                reportedCounts.append(renderGraph.lastFrameDeferredDrawCount)
+            }
+            waitTokens.append(renderGraph.execute())
+        }
+
+        for waitToken in waitTokens {
+            waitToken.wait()
+        }
+        XCTAssertEqual(reportedCounts, [2, 3])
+        XCTAssertEqual(renderGraph.lastFrameDeferredDrawCount, 3)
+    }
+
+    func testSynchronousCompilationNeverDefersDraws() {
+        let renderGraph = RenderGraph(inflightFrameCount: 1)
+
+        self.addFrame(to: renderGraph)
+        XCTAssertEqual(self.recordedDraws(executing: renderGraph), ["draw", "draw"])
+    }
+
+    func testFallbackIsNotPartOfPipelineIdentity() {
+        let withoutFallback = self.pipelineDescriptor(vertexFunction: "detailed")
+        let withFallback = self.pipelineDescriptor(vertexFunction: "detailed", fallback: self.pipelineDescriptor(vertexFunction: "simple"))
+
+        XCTAssertEqual(withoutFallback, withFallback)
+        XCTAssertEqual(withoutFallback.hashValue, withFallback.hashValue)
+        XCTAssertNotEqual(withoutFallback, self.pipelineDescriptor(vertexFunction: "simple"))
+    }
+
+    static var allTests = [
+        ("testDrawsAreDeferredWhilePipelinesCompile", testDrawsAreDeferredWhilePipelinesCompile),
+        ("testPipelinedFramesReportTheirOwnDeferredDrawCounts", testPipelinedFramesReportTheirOwnDeferredDrawCounts),
+        ("testSynchronousCompilationNeverDefersDraws", testSynchronousCompilationNeverDefersDraws),
+        ("testFallbackIsNotPartOfPipelineIdentity", testFallbackIsNotPartOfPipelineIdentity),
+    ]
+}
@@ -0,0 +1,111 @@
+//
+//  BindingShadowStateTests.swift
+//
+//
+
+import XCTest
+@testable import Substrate
+
+class BindingShadowStateTests: XCTestCase {
+    var buffer : Buffer! = nil
+
+    override func setUp() {
+        super.setUp()
+        RenderBackend.initialise(api: .headless, applicationName: "BindingShadowStateTests")
+        self.buffer = Buffer(length: 256, storageMode: .private, usage: [.shaderRead, .shaderWrite], flags: .persistent)
+    }
+
+    override func tearDown() {
+        self.buffer.dispose()
+        super.tearDown()
+    }
+
+    /// The names of the binding commands recorded between each dispatch in the frame.
+    func bindingCommandsByDispatch(executing renderGraph: RenderGraph) -> [[String]] {
+        RenderBackend.clearHeadlessRecordedCommandBuffers()
+        renderGraph.execute().wait()
+
+        var commandsByDispatch = [[String]()]
+        for command in RenderBackend.headlessRecordedCommandBuffers.flatMap({ $0.commands }) {
+            guard case .command(_, let name) = command else { continue }
+            switch name.description {
+            case "dispatchThreadgroups":
+                commandsByDispatch.append([])
+            case "setBuffer", "setBytes":
+                commandsByDispatch[commandsByDispatch.count - 1].append(name.description)
+            default:
+                break
+            }
+        }
+        return commandsByDispatch
+    }
+
+    func testRedundantBindingsAreElided() {
+        let renderGraph = RenderGraph(inflightFrameCount: 1)
+        let buffer = self.buffer!
+
+        renderGraph.addComputeCallbackPass(name: "Rebind") { encoder in
+            encoder.setComputePipelineDescriptor(ComputePipelineDescriptor(function: "update"))
+            for _ in 0..<2 {
+                encoder.setBuffer(buffer, offset: 0, key: "buffer")
+                encoder.setValue(UInt32(7), key: "constants")
+                encoder.dispatchThreadgroups(Size(width: 1, height: 1, depth: 1), threadsPerThreadgroup: Size(width: 32, height: 1, depth: 1))
+            }
+        }
+
+        let commandsByDispatch = self.bindingCommandsByDispatch(executing: renderGraph)
+        XCTAssertEqual(commandsByDispatch.count, 3)
+        guard commandsByDispatch.count == 3 else { return }
+        XCTAssertEqual(commandsByDispatch[0].sorted(), ["setBuffer", "setBytes"])
+        XCTAssertEqual(commandsByDispatch[1], [])
+        XCTAssertEqual(renderGraph.lastFrameElidedCommandCounts.map { $0.elidedCommandCount }, [2])
+    }
+
+    func testChangedBytesAreNotElided() {
+        let renderGraph = RenderGraph(inflightFrameCount: 1)
+        let buffer = self.buffer!
+
+        renderGraph.addComputeCallbackPass(name: "Rebind") { encoder in
+            encoder.setComputePipelineDescriptor(ComputePipelineDescriptor(function: "update"))
+            for value in 0..<2 {
+                encoder.setBuffer(buffer, offset: 0, key: "buffer")
+                encoder.setValue(UInt32(value), key: "constants")
+                encoder.dispatchThreadgroups(Size(width: 1, height: 1, depth: 1), threadsPerThreadgroup: Size(width: 32, height: 1, depth: 1))
+            }
+        }
+
+        let commandsByDispatch = self.bindingCommandsByDispatch(executing: renderGraph)
+        XCTAssertEqual(commandsByDispatch.count, 3)
+        guard commandsByDispatch.count == 3 else { return }
+        XCTAssertEqual(commandsByDispatch[1], ["setBytes"])
+        XCTAssertEqual(renderGraph.lastFrameElidedCommandCounts.map { $0.elidedCommandCount }, [1])
+    }
+
+    func testBindingsAfterPipelineChangeAreNotElided() {
+        let renderGraph = RenderGraph(inflightFrameCount: 1)
+        let buffer = self.buffer!
+
+        renderGraph.addComputeCallbackPass(name: "Rebind") { encoder in
+            for function in ["first", "second"] {
+                // The new pipeline may have a different layout, which invalidates the existing bindings.
+                encoder.setComputePipelineDescriptor(ComputePipelineDescriptor(function: function))
+                encoder.setBuffer(buffer, offset: 0, key: "buffer")
+                encoder.setValue(UInt32(7), key: "constants")
+                encoder.dispatchThreadgroups(Size(width: 1, height: 1, depth: 1), threadsPerThreadgroup: Size(width: 32, height: 1, depth: 1))
+            }
+        }
+
+        let commandsByDispatch = self.bindingCommandsByDispatch(executing: renderGraph)
+        XCTAssertEqual(commandsByDispatch.count, 3)
+        guard commandsByDispatch.count == 3 else { return }
+        XCTAssertEqual(commandsByDispatch[0].sorted(), ["setBuffer", "setBytes"])
+        XCTAssertTrue(commandsByDispatch[1].contains("setBuffer"))
+        XCTAssertTrue(commandsByDispatch[1].contains("setBytes"))
+    }
+
+    static var allTests = [
+        ("testRedundantBindingsAreElided", testRedundantBindingsAreElided),
+        ("testChangedBytesAreNotElided", testChangedBytesAreNotElided),
+        ("testBindingsAfterPipelineChangeAreNotElided", testBindingsAfterPipelineChangeAreNotElided),
+    ]
+}
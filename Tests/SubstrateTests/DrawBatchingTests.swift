@@ -0,0 +1,189 @@
+//
+//  DrawBatchingTests.swift
+//
+//
+
+import XCTest
+@testable import Substrate
+
+final class BatchedDrawCallbackPass: DrawRenderPass {
+    let name: String
+    let renderTargetDescriptor: RenderTargetDescriptor
+    let executeFunc: (RenderCommandEncoder) -> Void
+
+    init(name: String, renderTarget: RenderTargetDescriptor, execute: @escaping (RenderCommandEncoder) -> Void) {
+        self.name = name
+        self.renderTargetDescriptor = renderTarget
+        self.executeFunc = execute
+    }
+
+    var batchesIndexedDraws: Bool {
+        return true
+    }
+
+    func execute(renderCommandEncoder: RenderCommandEncoder) {
+        self.executeFunc(renderCommandEncoder)
+    }
+}
+
+class DrawBatchingTests: XCTestCase {
+    var renderTarget : Texture! = nil
+    var firstIndexBuffer : Buffer! = nil
+    var secondIndexBuffer : Buffer! = nil
+
+    override func setUp() {
+        super.setUp()
+        RenderBackend.initialise(api: .headless, applicationName: "DrawBatchingTests")
+        self.makeResources()
+    }
+
+    override func tearDown() {
+        self.disposeResources()
+        RenderBackend.initialise(api: .headless, applicationName: "DrawBatchingTests")
+        super.tearDown()
+    }
+
+    func makeResources() {
+        self.renderTarget = Texture(descriptor: TextureDescriptor(texture2DWithFormat: .rgba8Unorm, width: 16, height: 16, mipmapped: false, storageMode: .private, usageHint: .renderTarget), flags: .persistent)
+        self.firstIndexBuffer = Buffer(length: 1024, storageMode: .private, usage: .indexBuffer, flags: .persistent)
+        self.secondIndexBuffer = Buffer(length: 1024, storageMode: .private, usage: .indexBuffer, flags: .persistent)
+    }
+
+    func disposeResources() {
+        self.renderTarget.dispose()
+        self.firstIndexBuffer.dispose()
+        self.secondIndexBuffer.dispose()
+    }
+
+    /// Draws 16 indices from `indexBuffer` for each of `baseInstances`.
+    func draw(_ encoder: RenderCommandEncoder, indexBuffer: Buffer, baseInstances: [Int]) {
+        for (i, baseInstance) in baseInstances.enumerated() {
+            encoder.drawIndexedPrimitives(type: .triangle, indexCount: 16, indexType: .uint16, indexBuffer: indexBuffer, indexBufferOffset: 32 * i, baseInstance: baseInstance)
+        }
+    }
+
+    /// Adds a pass with three draws from the first index buffer, a cull mode change, then one draw from the first index buffer
+    /// and two from the second.
+    func addBatchedPass(to renderGraph: RenderGraph) {
+        let firstIndexBuffer = self.firstIndexBuffer!
+        let secondIndexBuffer = self.secondIndexBuffer!
+
+        renderGraph.addPass(BatchedDrawCallbackPass(name: "Batched", renderTarget: RenderTargetDescriptor(colorAttachments: [ColorAttachmentDescriptor(texture: self.renderTarget)])) { encoder in
+            var descriptor = RenderPipelineDescriptor(attachmentCount: 1)
+            descriptor.vertexFunction = "vertex"
+            descriptor.fragmentFunction = "fragment"
+            encoder.setRenderPipelineDescriptor(descriptor)
+
+            self.draw(encoder, indexBuffer: firstIndexBuffer, baseInstances: [0, 0, 0])
+            encoder.setCullMode(.back)
+            self.draw(encoder, indexBuffer: firstIndexBuffer, baseInstances: [0])
+            self.draw(encoder, indexBuffer: secondIndexBuffer, baseInstances: [0, 0])
+        })
+    }
+
+    /// The indices and names of the recorded draw commands.
+    func recordedDraws() -> [(index: Int, name: String)] {
+        return RenderBackend.headlessRecordedCommandBuffers.flatMap { $0.commands }.compactMap { command in
+            guard case .command(let index, let name) = command, name.description.hasPrefix("draw") else { return nil }
+            return (index, name.description)
+        }
+    }
+
+    func testAdjacentDrawsAreMergedUntilStateOrIndexBufferChanges() {
+        let renderGraph = RenderGraph(inflightFrameCount: 1)
+        self.addBatchedPass(to: renderGraph)
+
+        RenderBackend.clearHeadlessRecordedCommandBuffers()
+        renderGraph.execute().wait()
+
+        // The cull mode change splits the draws from the first index buffer.
+        XCTAssertEqual(self.recordedDraws().map { $0.name }, ["drawIndexedPrimitivesIndirect", "drawIndexedPrimitives", "drawIndexedPrimitivesIndirect"])
+        XCTAssertEqual(renderGraph.lastFrameDrawBatchingStatistics.map { $0.drawCountBeforeBatching }, [6])
+        XCTAssertEqual(renderGraph.lastFrameDrawBatchingStatistics.map { $0.drawCountAfterBatching }, [3])
+    }
+
+    func testUsagesAreRemappedToBatchedCommands() {
+        let renderGraph = RenderGraph(inflightFrameCount: 1)
+        self.addBatchedPass(to: renderGraph)
+
+        let firstIndexBuffer = self.firstIndexBuffer!
+        let secondIndexBuffer = self.secondIndexBuffer!
+        var firstIndexBufferRanges = [Range<Int>]()
+        var secondIndexBufferRanges = [Range<Int>]()
+        var indirectBufferUsages = [(commandRange: Range<Int>, stages: RenderStages, bufferRange: Range<Int>?)]()
+
+        // The usages are only valid until the execution has been submitted.
+        renderGraph.onSubmission {
+            firstIndexBufferRanges = firstIndexBuffer.usages.filter { $0.type == .indexBuffer }.map { $0.commandRange }
+            secondIndexBufferRanges = secondIndexBuffer.usages.filter { $0.type == .indexBuffer }.map { $0.commandRange }
+
+            let indirectBuffers = RenderBackend.headlessRecordedCommandBuffers.flatMap { $0.commands }.flatMap { command -> [Resource] in
+                guard case .useResources(let resources, let usage, _) = command, usage == .indirectBuffer else { return [] }
+                return resources
+            }
+            XCTAssertEqual(indirectBuffers.count, 1)
+            guard let indirectBuffer = indirectBuffers.first else { return }
+
+            indirectBufferUsages = indirectBuffer.usages.map { usage in
+                var bufferRange : Range<Int>? = nil
+                if case .buffer(let range) = usage.activeRange {
+                    bufferRange = range
+                }
+                return (usage.commandRange, usage.stages, bufferRange)
+            }
+        }
+
+        RenderBackend.clearHeadlessRecordedCommandBuffers()
+        renderGraph.execute().wait()
+
+        let draws = self.recordedDraws()
+        XCTAssertEqual(draws.count, 3)
+        guard draws.count == 3 else { return }
+        let firstIndirectDraw = draws[0].index
+        let singleDraw = draws[1].index
+        let secondIndirectDraw = draws[2].index
+
+        // Each usage should cover only the batched commands that replaced the draws it was recorded for.
+        XCTAssertFalse(firstIndexBufferRanges.isEmpty)
+        for range in firstIndexBufferRanges {
+            XCTAssertTrue([firstIndirectDraw, singleDraw].contains(range.lowerBound), "\(range)")
+            XCTAssertTrue([firstIndirectDraw, singleDraw].contains(range.upperBound - 1), "\(range)")
+        }
+        XCTAssertEqual(secondIndexBufferRanges, [secondIndirectDraw..<(secondIndirectDraw + 1)])
+
+        // The three merged draws come first in the indirect buffer, followed by the two merged draws from the second index buffer.
+        let argumentStride = MemoryLayout<DrawIndexedPrimitivesIndirectArguments>.stride
+        XCTAssertEqual(indirectBufferUsages.map { $0.commandRange.lowerBound }, [firstIndirectDraw, secondIndirectDraw])
+        XCTAssertEqual(indirectBufferUsages.map { $0.bufferRange }, [0..<(3 * argumentStride), (3 * argumentStride)..<(5 * argumentStride)])
+        XCTAssertEqual(indirectBufferUsages.map { $0.stages }, [.vertex, .vertex])
+    }
+
+    func testDrawsWithBaseInstanceAreNotMergedWithoutIndirectFirstInstance() {
+        self.disposeResources()
+        RenderBackend._backend = HeadlessBackend(supportsIndirectFirstInstance: false)
+        self.makeResources()
+        let renderGraph = RenderGraph(inflightFrameCount: 1)
+        let firstIndexBuffer = self.firstIndexBuffer!
+
+        renderGraph.addPass(BatchedDrawCallbackPass(name: "Batched", renderTarget: RenderTargetDescriptor(colorAttachments: [ColorAttachmentDescriptor(texture: self.renderTarget)])) { encoder in
+            var descriptor = RenderPipelineDescriptor(attachmentCount: 1)
+            descriptor.vertexFunction = "vertex"
+            descriptor.fragmentFunction = "fragment"
+            encoder.setRenderPipelineDescriptor(descriptor)
+
+            self.draw(encoder, indexBuffer: firstIndexBuffer, baseInstances: [0, 1, 0, 0])
+        })
+
+        RenderBackend.clearHeadlessRecordedCommandBuffers()
+        renderGraph.execute().wait()
+
+        XCTAssertEqual(self.recordedDraws().map { $0.name }, ["drawIndexedPrimitives", "drawIndexedPrimitives", "drawIndexedPrimitivesIndirect"])
+        XCTAssertEqual(renderGraph.lastFrameDrawBatchingStatistics.map { $0.drawCountAfterBatching }, [3])
+    }
+
+    static var allTests = [
+        ("testAdjacentDrawsAreMergedUntilStateOrIndexBufferChanges", testAdjacentDrawsAreMergedUntilStateOrIndexBufferChanges),
+        ("testUsagesAreRemappedToBatchedCommands", testUsagesAreRemappedToBatchedCommands),
+        ("testDrawsWithBaseInstanceAreNotMergedWithoutIndirectFirstInstance", testDrawsWithBaseInstanceAreNotMergedWithoutIndirectFirstInstance),
+    ]
+}
@@ -0,0 +1,202 @@
+//
+//  HeadlessAsyncComputeTests.swift
+//
+//
+
+import XCTest
+@testable import Substrate
+
+final class AsyncComputeCallbackPass: ComputeRenderPass {
+    let name: String
+    let executeFunc: (ComputeCommandEncoder) -> Void
+
+    init(name: String, execute: @escaping (ComputeCommandEncoder) -> Void) {
+        self.name = name
+        self.executeFunc = execute
+    }
+
+    var allowsAsyncCompute: Bool {
+        return true
+    }
+
+    func execute(computeCommandEncoder: ComputeCommandEncoder) {
+        self.executeFunc(computeCommandEncoder)
+    }
+}
+
+class HeadlessAsyncComputeTests: XCTestCase {
+    var texture : Texture! = nil
+    var staging : Buffer! = nil
+    var output : Buffer! = nil
+    var readback : Buffer! = nil
+
+    override func setUp() {
+        super.setUp()
+        RenderBackend.initialise(api: .headless, applicationName: "HeadlessAsyncComputeTests")
+        RenderBackend._backend = HeadlessBackend(supportsAsyncCompute: true)
+
+        self.texture = Texture(descriptor: TextureDescriptor(texture2DWithFormat: .rgba8Unorm, width: 16, height: 16, mipmapped: false, storageMode: .private, usageHint: [.blitDestination, .shaderRead, .shaderWrite]), flags: .persistent)
+        self.staging = Buffer(length: 16 * 16 * 4, storageMode: .private, usage: .blitSource, flags: .persistent)
+        self.output = Buffer(length: 256, storageMode: .private, usage: [.shaderWrite, .blitSource], flags: .persistent)
+        self.readback = Buffer(length: 256, storageMode: .private, usage: .blitDestination, flags: .persistent)
+    }
+
+    override func tearDown() {
+        self.texture.dispose()
+        self.staging.dispose()
+        self.output.dispose()
+        self.readback.dispose()
+        RenderBackend.initialise(api: .headless, applicationName: "HeadlessAsyncComputeTests")
+        super.tearDown()
+    }
+
+    /// Uploads a texture on the main queue, processes it into a buffer on the async compute queue, then reads the buffer back on the main queue.
+    func addChain(to renderGraph: RenderGraph) {
+        let texture = self.texture!
+        let staging = self.staging!
+        let output = self.output!
+        let readback = self.readback!
+
+        renderGraph.addBlitCallbackPass(name: "Upload") { encoder in
+            encoder.copy(from: staging, sourceOffset: 0, sourceBytesPerRow: 16 * 4, sourceBytesPerImage: 16 * 16 * 4, sourceSize: Size(width: 16, height: 16, depth: 1),
+                         to: texture, destinationSlice: 0, destinationLevel: 0, destinationOrigin: Origin())
+        }
+        renderGraph.addPass(AsyncComputeCallbackPass(name: "Process") { encoder in
+            encoder.setComputePipelineDescriptor(ComputePipelineDescriptor(function: "process"))
+            encoder.setTexture(texture, key: "input")
+            encoder.setBuffer(output, offset: 0, key: "output")
+            encoder.dispatchThreadgroups(Size(width: 1, height: 1, depth: 1), threadsPerThreadgroup: Size(width: 32, height: 1, depth: 1))
+        })
+        renderGraph.addBlitCallbackPass(name: "Readback") { encoder in
+            encoder.copy(from: output, sourceOffset: 0, to: readback, destinationOffset: 0, size: 256)
+        }
+    }
+
+    func signalledQueueValues(_ recording: HeadlessCommandBufferRecording) -> [(index: Int, value: UInt64)] {
+        return recording.commands.compactMap {
+            if case .signalQueue(let index, let value) = $0 { return (index, value) }
+            return nil
+        }
+    }
+
+    func signalledAsyncComputeValues(_ recording: HeadlessCommandBufferRecording) -> [UInt64] {
+        return recording.commands.compactMap {
+            if case .signalAsyncComputeQueue(let value) = $0 { return value }
+            return nil
+        }
+    }
+
+    func waitedCommandBuffers(_ recording: HeadlessCommandBufferRecording) -> [(commandBufferIndex: Int, queueFamilyIndex: Int, value: UInt64)] {
+        return recording.commands.compactMap {
+            if case .waitForCommandBuffer(let commandBufferIndex, let queueFamilyIndex, let value) = $0 { return (commandBufferIndex, queueFamilyIndex, value) }
+            return nil
+        }
+    }
+
+    func testGraphicsComputeGraphicsChain() {
+        let renderGraph = RenderGraph(inflightFrameCount: 1)
+        self.addChain(to: renderGraph)
+
+        RenderBackend.clearHeadlessRecordedCommandBuffers()
+        let waitToken = renderGraph.execute()
+        waitToken.wait()
+
+        let recordings = RenderBackend.headlessRecordedCommandBuffers
+        XCTAssertEqual(recordings.map { $0.commandBufferIndex }, [0, 1, 2])
+        XCTAssertEqual(recordings.map { $0.queueFamilyIndex }, [0, 1, 0])
+        guard recordings.count == 3 else { return }
+        let (upload, process, readback) = (recordings[0], recordings[1], recordings[2])
+
+        // The main queue's command buffers signal consecutive values on the render graph queue's timeline.
+        let queueIndex = Int(renderGraph.queue.index)
+        let uploadSignals = self.signalledQueueValues(upload)
+        XCTAssertEqual(uploadSignals.map { $0.index }, [queueIndex])
+        XCTAssertEqual(self.signalledQueueValues(readback).map { $0.index }, [queueIndex])
+        XCTAssertEqual(self.signalledQueueValues(readback).map { $0.value }, uploadSignals.map { $0.value + 1 })
+        XCTAssertEqual(waitToken.executionIndex, uploadSignals.first.map { $0.value + 1 })
+
+        // The async compute command buffer signals its own timeline rather than the render graph queue's.
+        XCTAssertTrue(self.signalledQueueValues(process).isEmpty)
+        let processSignals = self.signalledAsyncComputeValues(process)
+        XCTAssertEqual(processSignals.count, 1)
+
+        // Each side of a cross-queue dependency waits for the value the other queue's command buffer signals.
+        let processWaits = self.waitedCommandBuffers(process)
+        XCTAssertEqual(processWaits.map { $0.commandBufferIndex }, [0])
+        XCTAssertEqual(processWaits.map { $0.queueFamilyIndex }, [0])
+        XCTAssertEqual(processWaits.map { $0.value }, uploadSignals.map { $0.value })
+
+        let readbackWaits = self.waitedCommandBuffers(readback)
+        XCTAssertEqual(readbackWaits.map { $0.commandBufferIndex }, [1])
+        XCTAssertEqual(readbackWaits.map { $0.queueFamilyIndex }, [1])
+        XCTAssertEqual(readbackWaits.map { $0.value }, processSignals)
+        XCTAssertTrue(self.waitedCommandBuffers(upload).isEmpty)
+
+        // Fences can't be used across queues.
+        for recording in recordings {
+            XCTAssertFalse(recording.commands.contains(where: {
+                switch $0 {
+                case .updateFence, .waitForFence:
+                    return true
+                default:
+                    return false
+                }
+            }))
+        }
+
+        // The texture's layout transition happens on the compute queue, before the dispatch, and only waits for the top of the pipe.
+        var topOfPipeBarrierIndex : Int? = nil
+        var dispatchIndex : Int? = nil
+        for (i, command) in process.commands.enumerated() {
+            switch command {
+            case .memoryBarrier(let resources, let afterStages, let beforeStages) where afterStages.isEmpty:
+                XCTAssertEqual(resources, [Resource(self.texture)])
+                XCTAssertEqual(beforeStages, .compute)
+                XCTAssertNil(topOfPipeBarrierIndex)
+                topOfPipeBarrierIndex = i
+            case .command(_, let name) where name.description == "dispatchThreadgroups":
+                dispatchIndex = i
+            default:
+                break
+            }
+        }
+        XCTAssertNotNil(topOfPipeBarrierIndex)
+        XCTAssertNotNil(dispatchIndex)
+        if let topOfPipeBarrierIndex = topOfPipeBarrierIndex, let dispatchIndex = dispatchIndex {
+            XCTAssertLessThan(topOfPipeBarrierIndex, dispatchIndex)
+        }
+
+        // The buffer that's read back doesn't need a layout transition.
+        XCTAssertFalse(readback.commands.contains(where: {
+            if case .memoryBarrier(_, let afterStages, _) = $0 { return afterStages.isEmpty }
+            return false
+        }))
+    }
+
+    func testAsyncComputeTimelineAdvancesEachFrame() {
+        let renderGraph = RenderGraph(inflightFrameCount: 1)
+
+        var processSignals = [UInt64]()
+        var readbackWaits = [UInt64]()
+        for _ in 0..<2 {
+            self.addChain(to: renderGraph)
+            RenderBackend.clearHeadlessRecordedCommandBuffers()
+            renderGraph.execute().wait()
+
+            let recordings = RenderBackend.headlessRecordedCommandBuffers
+            XCTAssertEqual(recordings.map { $0.queueFamilyIndex }, [0, 1, 0])
+            guard recordings.count == 3 else { return }
+            processSignals.append(contentsOf: self.signalledAsyncComputeValues(recordings[1]))
+            readbackWaits.append(contentsOf: self.waitedCommandBuffers(recordings[2]).map { $0.value })
+        }
+
+        XCTAssertEqual(processSignals.count, 2)
+        XCTAssertEqual(processSignals.last, processSignals.first.map { $0 + 1 })
+        XCTAssertEqual(readbackWaits, processSignals)
+    }
+
+    static var allTests = [
+        ("testGraphicsComputeGraphicsChain", testGraphicsComputeGraphicsChain),
+        ("testAsyncComputeTimelineAdvancesEachFrame", testAsyncComputeTimelineAdvancesEachFrame),
+    ]
+}
@@ -0,0 +1,55 @@
+//
+//  HeadlessBackendTests.swift
+//
+//
+
+import XCTest
+@testable import Substrate
+
+class HeadlessBackendTests: XCTestCase {
+    override func setUp() {
+        super.setUp()
+        RenderBackend.initialise(api: .headless, applicationName: "HeadlessBackendTests")
+    }
+
+    func testBlitPassesAreRecordedAndComplete() {
+        let renderGraph = RenderGraph(inflightFrameCount: 1)
+        let source = Buffer(length: 256, usage: [.blitSource, .blitDestination], renderGraph: renderGraph)
+        let destination = Buffer(length: 256, storageMode: .private, usage: .blitDestination, flags: .persistent)
+        defer { destination.dispose() }
+
+        renderGraph.addBlitCallbackPass(name: "Fill") { encoder in
+            encoder.fill(buffer: source, range: 0..<256, value: 1)
+        }
+        renderGraph.addBlitCallbackPass(name: "Copy") { encoder in
+            encoder.copy(from: source, sourceOffset: 0, to: destination, destinationOffset: 0, size: 256)
+        }
+
+        RenderBackend.clearHeadlessRecordedCommandBuffers()
+        let waitToken = renderGraph.execute()
+        waitToken.wait()
+        XCTAssertGreaterThanOrEqual(renderGraph.queue.lastCompletedCommand, waitToken.executionIndex)
+
+        let recordings = RenderBackend.headlessRecordedCommandBuffers
+        XCTAssertEqual(recordings.count, 1)
+
+        var passNames = [String]()
+        var commandNames = [String]()
+        for command in recordings.flatMap({ $0.commands }) {
+            switch command {
+            case .beginPass(let name):
+                passNames.append(name)
+            case .command(_, let name):
+                commandNames.append(name.description)
+            default:
+                break
+            }
+        }
+        XCTAssertEqual(passNames, ["Fill", "Copy"])
+        XCTAssertEqual(commandNames, ["fillBuffer", "copyBufferToBuffer"])
+    }
+
+    static var allTests = [
+        ("testBlitPassesAreRecordedAndComplete", testBlitPassesAreRecordedAndComplete),
+    ]
+}
@@ -0,0 +1,140 @@
+//
+//  IndirectCommandBufferTests.swift
+//
+//
+
+import XCTest
+@testable import Substrate
+
+class IndirectCommandBufferTests: XCTestCase {
+    var renderTarget : Texture! = nil
+    var indexBuffer : Buffer! = nil
+
+    override func setUp() {
+        super.setUp()
+        RenderBackend.initialise(api: .headless, applicationName: "IndirectCommandBufferTests")
+        self.renderTarget = Texture(descriptor: TextureDescriptor(texture2DWithFormat: .rgba8Unorm, width: 16, height: 16, mipmapped: false, storageMode: .private, usageHint: .renderTarget), flags: .persistent)
+        self.indexBuffer = Buffer(length: 1024, storageMode: .private, usage: .indexBuffer, flags: .persistent)
+    }
+
+    override func tearDown() {
+        self.renderTarget.dispose()
+        self.indexBuffer.dispose()
+        super.tearDown()
+    }
+
+    /// The type, active buffer range and first command index of each of `buffer`'s usages in the execution.
+    /// Usages are only valid until the execution has been submitted, so this must be called from `onSubmission`.
+    static func usages(of buffer: Buffer) -> [(type: ResourceUsageType, bufferRange: Range<Int>?, commandIndex: Int)] {
+        return buffer.usages.map { usage in
+            var bufferRange : Range<Int>? = nil
+            if case .buffer(let range) = usage.activeRange {
+                bufferRange = range
+            }
+            return (usage.type, bufferRange, usage.commandRange.lowerBound)
+        }
+    }
+
+    /// The indices of the recorded commands named `name`.
+    func recordedCommandIndices(named name: String) -> [Int] {
+        return RenderBackend.headlessRecordedCommandBuffers.flatMap { $0.commands }.compactMap { command in
+            guard case .command(let index, let commandName) = command, commandName.description == name else { return nil }
+            return index
+        }
+    }
+
+    func testLayoutWithCount() {
+        let indirectCommands = IndirectCommandBuffer(commandType: .drawIndexed, maxCommandCount: 4, flags: .persistent)
+        defer { indirectCommands.buffer.dispose() }
+
+        let stride = MemoryLayout<DrawIndexedPrimitivesIndirectArguments>.stride
+        XCTAssertEqual(stride, 20)
+        XCTAssertTrue(indirectCommands.hasCount)
+        XCTAssertEqual(indirectCommands.countOffset, 0)
+        // The count header keeps the commands 16-byte aligned.
+        XCTAssertEqual(indirectCommands.argumentsOffset, 16)
+        XCTAssertEqual(indirectCommands.argumentOffset(commandIndex: 0), 16)
+        XCTAssertEqual(indirectCommands.argumentOffset(commandIndex: 3), 16 + 3 * stride)
+        XCTAssertEqual(indirectCommands.commandsRange, 0..<(16 + 4 * stride))
+        XCTAssertEqual(indirectCommands.buffer.length, 16 + 4 * stride)
+    }
+
+    func testLayoutWithoutCount() {
+        let draws = IndirectCommandBuffer(commandType: .draw, maxCommandCount: 3, hasCount: false, flags: .persistent)
+        let dispatches = IndirectCommandBuffer(commandType: .dispatch, maxCommandCount: 2, flags: .persistent)
+        defer {
+            draws.buffer.dispose()
+            dispatches.buffer.dispose()
+        }
+
+        XCTAssertEqual(draws.argumentsOffset, 0)
+        XCTAssertEqual(draws.argumentOffset(commandIndex: 2), 2 * 16)
+        XCTAssertEqual(draws.commandsRange, 0..<(3 * 16))
+
+        // Dispatches can't be executed with a count, so they don't have one by default.
+        XCTAssertFalse(dispatches.hasCount)
+        XCTAssertEqual(dispatches.argumentOffset(commandIndex: 1), 12)
+        XCTAssertEqual(dispatches.commandsRange, 0..<(2 * 12))
+        XCTAssertEqual(IndirectCommandBuffer.requiredLength(commandType: .dispatch, maxCommandCount: 2, hasCount: false), 24)
+    }
+
+    func testIndirectDrawUsesCountAndCommands() {
+        let renderGraph = RenderGraph(inflightFrameCount: 1)
+        let indirectCommands = IndirectCommandBuffer(commandType: .drawIndexed, maxCommandCount: 4, flags: .persistent)
+        defer { indirectCommands.buffer.dispose() }
+        let indexBuffer = self.indexBuffer!
+
+        renderGraph.addDrawCallbackPass(name: "Draw", renderTarget: RenderTargetDescriptor(colorAttachments: [ColorAttachmentDescriptor(texture: self.renderTarget)])) { encoder in
+            var descriptor = RenderPipelineDescriptor(attachmentCount: 1)
+            descriptor.vertexFunction = "vertex"
+            descriptor.fragmentFunction = "fragment"
+            encoder.setRenderPipelineDescriptor(descriptor)
+            encoder.drawIndexedPrimitives(type: .triangle, indexType: .uint16, indexBuffer: indexBuffer, indirectCommands: indirectCommands)
+        }
+
+        var usages = [(type: ResourceUsageType, bufferRange: Range<Int>?, commandIndex: Int)]()
+        renderGraph.onSubmission {
+            usages = IndirectCommandBufferTests.usages(of: indirectCommands.buffer)
+        }
+
+        RenderBackend.clearHeadlessRecordedCommandBuffers()
+        renderGraph.execute().wait()
+
+        let drawIndices = self.recordedCommandIndices(named: "drawIndexedPrimitivesIndirect")
+        XCTAssertEqual(drawIndices.count, 1)
+        // The draw reads the count header as well as the commands.
+        XCTAssertEqual(usages.map { $0.type }, [.indirectBuffer])
+        XCTAssertEqual(usages.map { $0.bufferRange }, [indirectCommands.commandsRange])
+        XCTAssertEqual(usages.map { $0.commandIndex }, drawIndices)
+    }
+
+    func testResetCount() {
+        let renderGraph = RenderGraph(inflightFrameCount: 1)
+        let indirectCommands = IndirectCommandBuffer(commandType: .draw, maxCommandCount: 4, flags: .persistent)
+        defer { indirectCommands.buffer.dispose() }
+
+        renderGraph.addBlitCallbackPass(name: "Reset") { encoder in
+            encoder.resetCount(of: indirectCommands)
+        }
+
+        var usages = [(type: ResourceUsageType, bufferRange: Range<Int>?, commandIndex: Int)]()
+        renderGraph.onSubmission {
+            usages = IndirectCommandBufferTests.usages(of: indirectCommands.buffer)
+        }
+
+        RenderBackend.clearHeadlessRecordedCommandBuffers()
+        renderGraph.execute().wait()
+
+        // Only the count is cleared; the commands are left untouched.
+        XCTAssertEqual(self.recordedCommandIndices(named: "fillBuffer").count, 1)
+        XCTAssertEqual(usages.map { $0.type }, [.blitDestination])
+        XCTAssertEqual(usages.map { $0.bufferRange }, [0..<MemoryLayout<UInt32>.stride])
+    }
+
+    static var allTests = [
+        ("testLayoutWithCount", testLayoutWithCount),
+        ("testLayoutWithoutCount", testLayoutWithoutCount),
+        ("testIndirectDrawUsesCountAndCommands", testIndirectDrawUsesCountAndCommands),
+        ("testResetCount", testResetCount),
+    ]
+}
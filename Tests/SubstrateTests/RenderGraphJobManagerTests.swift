@@ -0,0 +1,76 @@
+//
+//  RenderGraphJobManagerTests.swift
+//
+//
+
+import XCTest
+import Foundation
+@testable import Substrate
+
+class RenderGraphJobManagerTests: XCTestCase {
+    // Worker threads live for the lifetime of the process, so the tests share a single job manager.
+    static let jobManager = DefaultRenderGraphJobManager(workerCount: 3)
+
+    func testNestedForEachConcurrently() {
+        let jobManager = RenderGraphJobManagerTests.jobManager
+        let outerCount = 8
+        let innerCount = 64
+        var results = [Int](repeating: 0, count: outerCount * innerCount)
+
+        results.withUnsafeMutableBufferPointer { results in
+            jobManager.forEachConcurrently(count: outerCount) { i in
+                jobManager.forEachConcurrently(count: innerCount) { j in
+                    results[i * innerCount + j] += i * innerCount + j
+                }
+            }
+        }
+
+        XCTAssertEqual(results, Array(0..<(outerCount * innerCount)))
+    }
+
+    func testNestedJobsWithinPassJobs() {
+        let jobManager = RenderGraphJobManagerTests.jobManager
+        let passCount = 16
+        let innerCount = 16
+        var sums = [Int](repeating: 0, count: passCount)
+
+        sums.withUnsafeMutableBufferPointer { sums in
+            jobManager.dispatchPassJobs(count: passCount) { i in
+                var values = [Int](repeating: 0, count: innerCount)
+                values.withUnsafeMutableBufferPointer { values in
+                    jobManager.forEachConcurrently(count: innerCount) { j in
+                        values[j] = j
+                    }
+                }
+                sums[i] = values.reduce(0, +)
+            }
+            jobManager.waitForAllPassJobs()
+        }
+
+        XCTAssertEqual(sums, [Int](repeating: (0..<innerCount).reduce(0, +), count: passCount))
+    }
+
+    func testIdleWorkersStealJobs() {
+        let jobManager = RenderGraphJobManagerTests.jobManager
+        let jobCount = 64
+        var threadIndices = [Int](repeating: -1, count: jobCount)
+
+        // Every job is pushed onto the main thread's deque, so any job that runs on a worker was stolen.
+        threadIndices.withUnsafeMutableBufferPointer { threadIndices in
+            jobManager.dispatchPassJobs(count: jobCount) { i in
+                usleep(1000)
+                threadIndices[i] = jobManager.threadIndex
+            }
+            jobManager.waitForAllPassJobs()
+        }
+
+        XCTAssertFalse(threadIndices.contains(-1))
+        XCTAssertTrue(threadIndices.contains(where: { $0 != 0 }))
+    }
+
+    static var allTests = [
+        ("testNestedForEachConcurrently", testNestedForEachConcurrently),
+        ("testNestedJobsWithinPassJobs", testNestedJobsWithinPassJobs),
+        ("testIdleWorkersStealJobs", testIdleWorkersStealJobs),
+    ]
+}
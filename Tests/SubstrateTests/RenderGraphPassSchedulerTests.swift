@@ -0,0 +1,141 @@
+//
+//  RenderGraphPassSchedulerTests.swift
+//
+//
+
+import XCTest
+import SubstrateUtilities
+@testable import Substrate
+
+class RenderGraphPassSchedulerTests: XCTestCase {
+    var persistentResources = [Resource]()
+
+    override func setUp() {
+        super.setUp()
+        RenderBackend.initialise(api: .headless, applicationName: "RenderGraphPassSchedulerTests")
+    }
+
+    override func tearDown() {
+        for resource in self.persistentResources {
+            resource.dispose()
+        }
+        self.persistentResources.removeAll()
+        super.tearDown()
+    }
+
+    func makeTexture() -> Texture {
+        let texture = Texture(descriptor: TextureDescriptor(texture2DWithFormat: .rgba8Unorm, width: 16, height: 16, mipmapped: false, storageMode: .private, usageHint: [.shaderRead, .blitSource]), flags: .persistent)
+        self.persistentResources.append(Resource(texture))
+        return texture
+    }
+
+    func makeBuffer() -> Buffer {
+        let buffer = Buffer(length: 256, storageMode: .private, usage: [.shaderWrite, .blitDestination], flags: .persistent)
+        self.persistentResources.append(Resource(buffer))
+        return buffer
+    }
+
+    /// Makes a pass record that reads `texture` with `usageType` and writes to its own output buffer, as if it had already been recorded.
+    func makePass(_ pass: RenderPass, index: Int, reading texture: Texture, as usageType: ResourceUsageType) -> RenderPassRecord {
+        let record = RenderPassRecord(pass: pass, passIndex: index)
+        record.readResources = HashSet()
+        record.writtenResources = HashSet()
+        record.resourceUsages = ChunkArray()
+
+        record.readResources.insert(Resource(texture))
+        record.writtenResources.insert(Resource(self.makeBuffer()))
+
+        let usage = ResourceUsage(resource: Resource(texture), type: usageType, stages: pass is ComputeRenderPass ? .compute : .blit, activeRange: .fullResource, inArgumentBuffer: false, firstCommandOffset: 0, renderPass: record)
+        record.resourceUsages.append((Resource(texture), usage), allocator: .system)
+        return record
+    }
+
+    func testSchedulerGroupsUsagesToAvoidLayoutTransitions() {
+        let texture = self.makeTexture()
+
+        // All three passes only read the texture, so they're independent, but the blit needs a different layout from the samples.
+        let passes = [
+            self.makePass(CallbackComputeRenderPass(name: "Sample A", execute: { _ in }), index: 0, reading: texture, as: .read),
+            self.makePass(CallbackBlitRenderPass(name: "Copy", execute: { _ in }), index: 1, reading: texture, as: .blitSource),
+            self.makePass(CallbackComputeRenderPass(name: "Sample B", execute: { _ in }), index: 2, reading: texture, as: .read),
+        ]
+
+        var dependencyTable = SparseDependencyTable<DependencyType>(reservingCapacity: passes.count)
+        for _ in passes {
+            dependencyTable.appendRow(dependencies: EmptyCollection())
+        }
+
+        let scheduler = RenderGraphPassScheduler(passes: passes, dependencyTable: dependencyTable, totalPassCount: passes.count)
+        let declaredCosts = scheduler.costs(of: [0, 1, 2])
+        let (order, costs) = scheduler.schedule()
+
+        XCTAssertEqual(order, [0, 2, 1])
+        XCTAssertEqual(declaredCosts.reduce(0, { $0 + $1.layoutTransitionCount }), 2)
+        XCTAssertEqual(costs.reduce(0, { $0 + $1.layoutTransitionCount }), 1)
+        XCTAssertLessThan(costs.reduce(0, { $0 + $1.barrierCount }), declaredCosts.reduce(0, { $0 + $1.barrierCount }))
+        XCTAssertLessThan(costs.reduce(0, { $0 + $1.total }), declaredCosts.reduce(0, { $0 + $1.total }))
+    }
+
+    func testSchedulerRespectsDependenciesOverLayoutCosts() {
+        let texture = self.makeTexture()
+
+        let passes = [
+            self.makePass(CallbackComputeRenderPass(name: "Sample A", execute: { _ in }), index: 0, reading: texture, as: .read),
+            self.makePass(CallbackBlitRenderPass(name: "Copy", execute: { _ in }), index: 1, reading: texture, as: .blitSource),
+            self.makePass(CallbackComputeRenderPass(name: "Sample B", execute: { _ in }), index: 2, reading: texture, as: .read),
+        ]
+
+        // Sample B must follow the copy, so the scheduler can't group the samples together.
+        var dependencyTable = SparseDependencyTable<DependencyType>(reservingCapacity: passes.count)
+        dependencyTable.appendRow(dependencies: EmptyCollection())
+        dependencyTable.appendRow(dependencies: EmptyCollection())
+        dependencyTable.appendRow(dependencies: CollectionOfOne((index: 1, value: DependencyType.ordering)))
+
+        let scheduler = RenderGraphPassScheduler(passes: passes, dependencyTable: dependencyTable, totalPassCount: passes.count)
+        XCTAssertEqual(scheduler.schedule().order, [0, 1, 2])
+    }
+
+    func testScheduleIsTopologicalOrder() {
+        let sampledTexture = self.makeTexture()
+        let copiedTexture = self.makeTexture()
+
+        // Alternate the usages of each texture so that the declared order is expensive and the scheduler has reason to reorder it.
+        let passes = [
+            self.makePass(CallbackComputeRenderPass(name: "Sample A", execute: { _ in }), index: 0, reading: sampledTexture, as: .read),
+            self.makePass(CallbackBlitRenderPass(name: "Copy A", execute: { _ in }), index: 1, reading: sampledTexture, as: .blitSource),
+            self.makePass(CallbackComputeRenderPass(name: "Sample B", execute: { _ in }), index: 2, reading: copiedTexture, as: .read),
+            self.makePass(CallbackBlitRenderPass(name: "Copy B", execute: { _ in }), index: 3, reading: copiedTexture, as: .blitSource),
+            self.makePass(CallbackComputeRenderPass(name: "Sample C", execute: { _ in }), index: 4, reading: sampledTexture, as: .read),
+            self.makePass(CallbackBlitRenderPass(name: "Copy C", execute: { _ in }), index: 5, reading: copiedTexture, as: .blitSource),
+        ]
+
+        // For each pass, the passes it depends on.
+        let dependencies : [[Int]] = [[], [], [0], [1], [2, 3], [1]]
+        var dependencyTable = SparseDependencyTable<DependencyType>(reservingCapacity: passes.count)
+        for passDependencies in dependencies {
+            dependencyTable.appendRow(dependencies: passDependencies.map { (index: $0, value: DependencyType.execution) })
+        }
+
+        let scheduler = RenderGraphPassScheduler(passes: passes, dependencyTable: dependencyTable, totalPassCount: passes.count)
+        let order = scheduler.schedule().order
+
+        XCTAssertEqual(order.sorted(), Array(passes.indices))
+        guard order.sorted() == Array(passes.indices) else { return }
+
+        var positions = [Int](repeating: 0, count: passes.count)
+        for (position, pass) in order.enumerated() {
+            positions[pass] = position
+        }
+        for (pass, passDependencies) in dependencies.enumerated() {
+            for dependency in passDependencies {
+                XCTAssertLessThan(positions[dependency], positions[pass], "Pass \(pass) was scheduled before its dependency \(dependency) in \(order)")
+            }
+        }
+    }
+
+    static var allTests = [
+        ("testSchedulerGroupsUsagesToAvoidLayoutTransitions", testSchedulerGroupsUsagesToAvoidLayoutTransitions),
+        ("testSchedulerRespectsDependenciesOverLayoutCosts", testSchedulerRespectsDependenciesOverLayoutCosts),
+        ("testScheduleIsTopologicalOrder", testScheduleIsTopologicalOrder),
+    ]
+}
@@ -0,0 +1,80 @@
+//
+//  RenderGraphPipelinedExecutionTests.swift
+//
+//
+
+import XCTest
+import Dispatch
+@testable import Substrate
+
+class RenderGraphPipelinedExecutionTests: XCTestCase {
+    override func setUp() {
+        super.setUp()
+        RenderBackend.initialise(api: .headless, applicationName: "RenderGraphPipelinedExecutionTests")
+    }
+
+    func testCompilesInterleaveWithPreviousSubmission() {
+        let firstRenderGraph = RenderGraph(inflightFrameCount: 2, executionMode: .pipelined)
+        let secondRenderGraph = RenderGraph(inflightFrameCount: 2, executionMode: .pipelined)
+
+        let firstDestination = Buffer(length: 256, storageMode: .private, usage: .blitDestination, flags: .persistent)
+        let secondDestination = Buffer(length: 256, storageMode: .private, usage: .blitDestination, flags: .persistent)
+        defer {
+            firstDestination.dispose()
+            secondDestination.dispose()
+        }
+
+        let secondPassExecuted = DispatchSemaphore(value: 0)
+        var secondCompiledBeforeFirstSubmitted = false
+
+        firstRenderGraph.addBlitCallbackPass(name: "First") { encoder in
+            encoder.fill(buffer: firstDestination, range: 0..<256, value: 1)
+        }
+        // The first execution can't finish submitting until the second RenderGraph has executed its passes,
+        // which would time out if compiling the second RenderGraph waited for the first to be submitted.
+        firstRenderGraph.onSubmission {
+            secondCompiledBeforeFirstSubmitted = secondPassExecuted.wait(timeout: .now() + .seconds(5)) == .success
+        }
+
+        secondRenderGraph.addBlitCallbackPass(name: "Second") { encoder in
+            secondPassExecuted.signal()
+            encoder.fill(buffer: secondDestination, range: 0..<256, value: 2)
+        }
+
+        let firstWaitToken = firstRenderGraph.execute()
+        let secondWaitToken = secondRenderGraph.execute()
+        firstWaitToken.wait()
+        secondWaitToken.wait()
+
+        XCTAssertTrue(secondCompiledBeforeFirstSubmitted)
+    }
+
+    func testConsecutiveFramesOfOneRenderGraphAreSubmittedInOrder() {
+        let renderGraph = RenderGraph(inflightFrameCount: 2, executionMode: .pipelined)
+        let destination = Buffer(length: 256, storageMode: .private, usage: .blitDestination, flags: .persistent)
+        defer { destination.dispose() }
+
+        var submittedFrames = [Int]()
+        var waitTokens = [RenderGraphExecutionWaitToken]()
+        for frame in 0..<4 {
+            renderGraph.addBlitCallbackPass(name: "Frame \(frame)") { encoder in
+                encoder.fill(buffer: destination, range: 0..<256, value: UInt8(frame))
+            }
+            renderGraph.onSubmission {
+                submittedFrames.append(frame)
+            }
+            waitTokens.append(renderGraph.execute())
+        }
+
+        for waitToken in waitTokens {
+            waitToken.wait()
+        }
+        XCTAssertEqual(submittedFrames, [0, 1, 2, 3])
+        XCTAssertEqual(waitTokens.map { $0.executionIndex }, waitTokens.map { $0.executionIndex }.sorted())
+    }
+
+    static var allTests = [
+        ("testCompilesInterleaveWithPreviousSubmission", testCompilesInterleaveWithPreviousSubmission),
+        ("testConsecutiveFramesOfOneRenderGraphAreSubmittedInOrder", testConsecutiveFramesOfOneRenderGraphAreSubmittedInOrder),
+    ]
+}
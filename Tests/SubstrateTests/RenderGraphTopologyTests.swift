@@ -0,0 +1,135 @@
+//
+//  RenderGraphTopologyTests.swift
+//
+//
+
+import XCTest
+import SubstrateUtilities
+@testable import Substrate
+
+class RenderGraphTopologyTests: XCTestCase {
+    override func setUp() {
+        super.setUp()
+        RenderBackend.initialise(api: .headless, applicationName: "RenderGraphTopologyTests")
+        RenderBackend.clearHeadlessRecordedCommandBuffers()
+    }
+
+    func executedPassNames(_ renderGraph: RenderGraph) -> [String] {
+        renderGraph.execute().wait()
+        return RenderBackend.headlessRecordedCommandBuffers.flatMap { $0.commands }.compactMap { command -> String? in
+            if case .beginPass(let name) = command { return name }
+            return nil
+        }
+    }
+
+    func testReadersKeepAllEarlierWritersActive() {
+        let renderGraph = RenderGraph(inflightFrameCount: 1)
+        let transient = Buffer(length: 256, usage: [.blitSource, .blitDestination], renderGraph: renderGraph)
+        let output = Buffer(length: 256, storageMode: .private, usage: .blitDestination, flags: .persistent)
+        defer { output.dispose() }
+
+        renderGraph.addBlitCallbackPass(name: "Write Low") { encoder in
+            encoder.fill(buffer: transient, range: 0..<128, value: 1)
+        }
+        renderGraph.addBlitCallbackPass(name: "Write High") { encoder in
+            encoder.fill(buffer: transient, range: 128..<256, value: 2)
+        }
+        renderGraph.addBlitCallbackPass(name: "Read") { encoder in
+            encoder.copy(from: transient, sourceOffset: 0, to: output, destinationOffset: 0, size: 256)
+        }
+        renderGraph.addBlitCallbackPass(name: "Unread Write") { encoder in
+            encoder.fill(buffer: transient, range: 0..<256, value: 3)
+        }
+
+        // The reader only has an edge to the most recent writer, so the first writer must be reached through the write-after-write edge.
+        XCTAssertEqual(self.executedPassNames(renderGraph), ["Write Low", "Write High", "Read"])
+    }
+
+    func testWritesAreOrderedAfterEarlierReads() {
+        let renderGraph = RenderGraph(inflightFrameCount: 1)
+        let input = Buffer(length: 256, storageMode: .private, usage: [.blitSource, .blitDestination], flags: .persistent)
+        let output = Buffer(length: 256, storageMode: .private, usage: .blitDestination, flags: .persistent)
+        defer {
+            input.dispose()
+            output.dispose()
+        }
+
+        renderGraph.addBlitCallbackPass(name: "Read") { encoder in
+            encoder.copy(from: input, sourceOffset: 0, to: output, destinationOffset: 0, size: 256)
+        }
+        renderGraph.addBlitCallbackPass(name: "Overwrite") { encoder in
+            encoder.fill(buffer: input, range: 0..<256, value: 0)
+        }
+
+        // Both passes have side effects; without the write-after-read edge nothing would stop the overwrite being ordered first.
+        XCTAssertEqual(self.executedPassNames(renderGraph), ["Read", "Overwrite"])
+    }
+
+    func addCopyFrame(to renderGraph: RenderGraph, output: Buffer, includeExtraPass: Bool) {
+        let transient = Buffer(length: 256, usage: [.blitSource, .blitDestination], renderGraph: renderGraph)
+        renderGraph.addBlitCallbackPass(name: "Fill") { encoder in
+            encoder.fill(buffer: transient, range: 0..<256, value: 1)
+        }
+        if includeExtraPass {
+            renderGraph.addBlitCallbackPass(name: "Fill Again") { encoder in
+                encoder.fill(buffer: transient, range: 0..<128, value: 2)
+            }
+        }
+        renderGraph.addBlitCallbackPass(name: "Copy") { encoder in
+            encoder.copy(from: transient, sourceOffset: 0, to: output, destinationOffset: 0, size: 256)
+        }
+    }
+
+    func testTopologyCacheHitsForIdenticalFrames() {
+        let renderGraph = RenderGraph(inflightFrameCount: 1)
+        renderGraph.cachesTopology = true
+        let output = Buffer(length: 256, storageMode: .private, usage: .blitDestination, flags: .persistent)
+        defer { output.dispose() }
+
+        self.addCopyFrame(to: renderGraph, output: output, includeExtraPass: false)
+        XCTAssertEqual(self.executedPassNames(renderGraph), ["Fill", "Copy"])
+        RenderBackend.clearHeadlessRecordedCommandBuffers()
+
+        self.addCopyFrame(to: renderGraph, output: output, includeExtraPass: false)
+        XCTAssertEqual(self.executedPassNames(renderGraph), ["Fill", "Copy"])
+
+        XCTAssertEqual(renderGraph.topologyCache.missCount, 1)
+        XCTAssertEqual(renderGraph.topologyCache.hitCount, 1)
+    }
+
+    func testTopologyCacheMissesWhenStructureChanges() {
+        let renderGraph = RenderGraph(inflightFrameCount: 1)
+        renderGraph.cachesTopology = true
+        let output = Buffer(length: 256, storageMode: .private, usage: .blitDestination, flags: .persistent)
+        defer { output.dispose() }
+
+        self.addCopyFrame(to: renderGraph, output: output, includeExtraPass: false)
+        XCTAssertEqual(self.executedPassNames(renderGraph), ["Fill", "Copy"])
+        RenderBackend.clearHeadlessRecordedCommandBuffers()
+
+        self.addCopyFrame(to: renderGraph, output: output, includeExtraPass: true)
+        XCTAssertEqual(self.executedPassNames(renderGraph), ["Fill", "Fill Again", "Copy"])
+
+        XCTAssertEqual(renderGraph.topologyCache.missCount, 2)
+        XCTAssertEqual(renderGraph.topologyCache.hitCount, 0)
+    }
+
+    func testTopologyCacheComparesFullKeysOnHashCollision() {
+        let cache = RenderGraphTopologyCache()
+        let topology = RenderGraphTopology(dependencyTable: SparseDependencyTable(), orderedActivePassIndices: [0])
+        cache.setTopology(topology, for: RenderGraphTopologyKey(words: [4, 1, 7, 0], hash: 42))
+
+        XCTAssertNil(cache.topology(for: RenderGraphTopologyKey(words: [4, 1, 8, 0], hash: 42)))
+        XCTAssertEqual(cache.topology(for: RenderGraphTopologyKey(words: [4, 1, 7, 0], hash: 42))?.orderedActivePassIndices, [0])
+        XCTAssertEqual(cache.missCount, 1)
+        XCTAssertEqual(cache.hitCount, 1)
+    }
+
+    static var allTests = [
+        ("testReadersKeepAllEarlierWritersActive", testReadersKeepAllEarlierWritersActive),
+        ("testWritesAreOrderedAfterEarlierReads", testWritesAreOrderedAfterEarlierReads),
+        ("testTopologyCacheHitsForIdenticalFrames", testTopologyCacheHitsForIdenticalFrames),
+        ("testTopologyCacheMissesWhenStructureChanges", testTopologyCacheMissesWhenStructureChanges),
+        ("testTopologyCacheComparesFullKeysOnHashCollision", testTopologyCacheComparesFullKeysOnHashCollision),
+    ]
+}
@@ -0,0 +1,69 @@
+//
+//  RenderGraphTraceExporterTests.swift
+//
+//
+
+import XCTest
+import Foundation
+@testable import Substrate
+
+class RenderGraphTraceExporterTests: XCTestCase {
+    /// A profile with one CPU phase, one pass recorded on the first job thread, and one GPU encoder.
+    /// All times are in nanoseconds; the GPU times are on the GPU's own clock.
+    func makeProfile() -> RenderGraphFrameProfile {
+        let profile = RenderGraphFrameProfile(renderGraphName: "Main \"Graph\"", frameIndex: 7)
+        profile.addCPUInterval(name: "Compile", startTime: 2_000_000, endTime: 3_500_000)
+        profile.addCPUInterval(name: "Shadows", kind: .passRecording, lane: 0, startTime: 2_250_000, endTime: 2_750_000)
+        profile.addGPUIntervals([RenderGraphProfileInterval(name: "Shadows", kind: .gpuEncoder, lane: 0, startTime: 10_000, endTime: 510_000)])
+        profile.submissionTime = 5_000_000
+        profile.updateCounters {
+            $0.activePassCount = 1
+            $0.commandCount = 12
+        }
+        return profile
+    }
+
+    func parseEvents(_ json: String) -> [[String: Any]]? {
+        guard let data = json.data(using: .utf8),
+              let document = try? JSONSerialization.jsonObject(with: data) as? [String: Any] else {
+            return nil
+        }
+        return document["traceEvents"] as? [[String: Any]]
+    }
+
+    func testChromeTraceIsValidJSON() {
+        let json = RenderGraphTraceExporter.chromeTraceJSON(profiles: [self.makeProfile()])
+        XCTAssertNotNil(self.parseEvents(json), json)
+        XCTAssertNotNil(self.parseEvents(RenderGraphTraceExporter.chromeTraceJSON(profiles: [])))
+    }
+
+    func testChromeTraceEvents() {
+        guard let events = self.parseEvents(RenderGraphTraceExporter.chromeTraceJSON(profiles: [self.makeProfile()])) else {
+            XCTFail("The trace isn't valid JSON.")
+            return
+        }
+
+        XCTAssertEqual(events.compactMap { $0["name"] as? String }, ["process_name", "process_name", "Compile", "Shadows", "Shadows", "Main \"Graph\" Counters"])
+        XCTAssertEqual(events.compactMap { $0["ph"] as? String }, ["M", "M", "X", "X", "X", "C"])
+        XCTAssertEqual(events.compactMap { $0["pid"] as? Int }, [1, 2, 1, 1, 2, 1])
+
+        // Durations are in microseconds. CPU intervals keep their uptime timestamps, while GPU intervals are
+        // moved so that the first one starts at the frame's submission time.
+        let durationEvents = events.filter { $0["ph"] as? String == "X" }
+        XCTAssertEqual(durationEvents.compactMap { $0["ts"] as? Double }, [2000.0, 2250.0, 5000.0])
+        XCTAssertEqual(durationEvents.compactMap { $0["dur"] as? Double }, [1500.0, 500.0, 500.0])
+        XCTAssertEqual(durationEvents.compactMap { $0["tid"] as? Int }, [0, 1, 0])
+        XCTAssertEqual(durationEvents.compactMap { $0["cat"] as? String }, ["phase", "pass", "gpu"])
+        XCTAssertEqual(durationEvents.compactMap { ($0["args"] as? [String: Any])?["frame"] as? Int }, [7, 7, 7])
+
+        let counterEvent = events.last
+        XCTAssertEqual(counterEvent?["ts"] as? Double, 2000.0)
+        XCTAssertEqual((counterEvent?["args"] as? [String: Any])?["activePasses"] as? Int, 1)
+        XCTAssertEqual((counterEvent?["args"] as? [String: Any])?["commands"] as? Int, 12)
+    }
+
+    static var allTests = [
+        ("testChromeTraceIsValidJSON", testChromeTraceIsValidJSON),
+        ("testChromeTraceEvents", testChromeTraceEvents),
+    ]
+}
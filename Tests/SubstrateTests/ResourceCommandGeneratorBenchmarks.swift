@@ -0,0 +1,95 @@
+//
+//  ResourceCommandGeneratorBenchmarks.swift
+//
+//
+
+import XCTest
+@testable import Substrate
+
+/// Synthetic frames where a few resources are used many times per frame, in the manner of a global constants buffer
+/// or a shadow map atlas. Resource command generation should scale linearly with the number of usages.
+class ResourceCommandGeneratorBenchmarks: XCTestCase {
+    static let passCount = 512
+    static let regionSize = 256
+
+    var constants : Buffer! = nil
+    var atlas : Buffer! = nil
+    var readback : Buffer! = nil
+
+    override func setUp() {
+        super.setUp()
+        RenderBackend.initialise(api: .headless, applicationName: "ResourceCommandGeneratorBenchmarks")
+
+        let atlasLength = ResourceCommandGeneratorBenchmarks.passCount * ResourceCommandGeneratorBenchmarks.regionSize
+        self.constants = Buffer(length: ResourceCommandGeneratorBenchmarks.regionSize, storageMode: .private, usage: .blitSource, flags: .persistent)
+        self.atlas = Buffer(length: atlasLength, storageMode: .private, usage: [.blitSource, .blitDestination], flags: .persistent)
+        self.readback = Buffer(length: atlasLength, storageMode: .private, usage: .blitDestination, flags: .persistent)
+    }
+
+    override func tearDown() {
+        self.constants.dispose()
+        self.atlas.dispose()
+        self.readback.dispose()
+        super.tearDown()
+    }
+
+    /// Every pass reads the constants buffer and writes its own region of the atlas.
+    /// Every sixteenth pass also reads back the whole atlas, which depends on all of the region writes before it.
+    func addSyntheticFrame(to renderGraph: RenderGraph) {
+        let constants = self.constants!
+        let atlas = self.atlas!
+        let readback = self.readback!
+        let regionSize = ResourceCommandGeneratorBenchmarks.regionSize
+
+        for i in 0..<ResourceCommandGeneratorBenchmarks.passCount {
+            renderGraph.addBlitCallbackPass(name: "Region \(i)") { encoder in
+                encoder.copy(from: constants, sourceOffset: 0, to: atlas, destinationOffset: i * regionSize, size: regionSize)
+                if i % 16 == 15 {
+                    encoder.copy(from: atlas, sourceOffset: 0, to: readback, destinationOffset: 0, size: atlas.length)
+                }
+            }
+        }
+    }
+
+    func testSyntheticFrameIsRecorded() {
+        let renderGraph = RenderGraph(inflightFrameCount: 1)
+        self.addSyntheticFrame(to: renderGraph)
+
+        RenderBackend.clearHeadlessRecordedCommandBuffers()
+        renderGraph.execute().wait()
+
+        var passCount = 0
+        var barrierCount = 0
+        for command in RenderBackend.headlessRecordedCommandBuffers.flatMap({ $0.commands }) {
+            switch command {
+            case .beginPass:
+                passCount += 1
+            case .memoryBarrier:
+                barrierCount += 1
+            default:
+                break
+            }
+        }
+        XCTAssertEqual(passCount, ResourceCommandGeneratorBenchmarks.passCount)
+        // At least one barrier is needed before each read-back of the atlas.
+        XCTAssertGreaterThanOrEqual(barrierCount, ResourceCommandGeneratorBenchmarks.passCount / 16)
+    }
+
+    func testManyUsagesPerResourcePerformance() {
+        let renderGraph = RenderGraph(inflightFrameCount: 2)
+
+        measure {
+            var waitToken : RenderGraphExecutionWaitToken? = nil
+            for _ in 0..<4 {
+                self.addSyntheticFrame(to: renderGraph)
+                waitToken = renderGraph.execute()
+            }
+            waitToken?.wait()
+        }
+    }
+
+    static var allTests = [
+        ("testSyntheticFrameIsRecorded", testSyntheticFrameIsRecorded),
+        ("testManyUsagesPerResourcePerformance", testManyUsagesPerResourcePerformance),
+    ]
+}
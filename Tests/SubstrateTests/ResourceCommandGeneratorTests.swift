@@ -0,0 +1,104 @@
+//
+//  ResourceCommandGeneratorTests.swift
+//
+//
+
+import XCTest
+@testable import Substrate
+
+class ResourceCommandGeneratorTests: XCTestCase {
+    static let bufferCount = 48
+
+    var buffers = [Buffer]()
+
+    override func setUp() {
+        super.setUp()
+        RenderBackend.initialise(api: .headless, applicationName: "ResourceCommandGeneratorTests")
+
+        self.buffers = (0..<ResourceCommandGeneratorTests.bufferCount).map { _ in
+            Buffer(length: 256, storageMode: .private, usage: [.shaderRead, .shaderWrite, .blitDestination], flags: .persistent)
+        }
+    }
+
+    override func tearDown() {
+        for buffer in self.buffers {
+            buffer.dispose()
+        }
+        self.buffers.removeAll()
+        super.tearDown()
+    }
+
+    /// Alternates blit and compute passes over overlapping sets of buffers, so that the frame has many encoders
+    /// with dependencies between them.
+    func addFrame(to renderGraph: RenderGraph) {
+        let buffers = self.buffers
+        for i in 0..<16 {
+            renderGraph.addBlitCallbackPass(name: "Fill \(i)") { encoder in
+                for j in stride(from: i % 3, to: buffers.count, by: 3) {
+                    encoder.fill(buffer: buffers[j], range: 0..<256, value: UInt8(i))
+                }
+            }
+            renderGraph.addComputeCallbackPass(name: "Update \(i)") { encoder in
+                encoder.setComputePipelineDescriptor(ComputePipelineDescriptor(function: "update"))
+                for j in stride(from: i % 4, to: buffers.count, by: 4) {
+                    encoder.setBuffer(buffers[j], offset: 0, key: "buffer\(j)")
+                }
+                encoder.dispatchThreadgroups(Size(width: 1, height: 1, depth: 1), threadsPerThreadgroup: Size(width: 32, height: 1, depth: 1))
+            }
+        }
+    }
+
+    /// The recorded commands for the last execution, with commands that share a position sorted
+    /// since their relative order doesn't affect the frame.
+    func recordedCommands(executing renderGraph: RenderGraph) -> [String] {
+        RenderBackend.clearHeadlessRecordedCommandBuffers()
+        renderGraph.execute().wait()
+
+        let handles = { (resources: [Resource]) -> [UInt64] in
+            return resources.map { $0.handle }.sorted()
+        }
+
+        var commands = [String]()
+        var resourceCommands = [String]()
+        for command in RenderBackend.headlessRecordedCommandBuffers.flatMap({ $0.commands }) {
+            switch command {
+            case .memoryBarrier(let resources, let afterStages, let beforeStages):
+                resourceCommands.append("memoryBarrier(\(handles(resources)), \(afterStages.rawValue), \(beforeStages.rawValue))")
+            case .useResources(let resources, let usage, let stages):
+                resourceCommands.append("useResources(\(handles(resources)), \(usage), \(stages.rawValue))")
+            default:
+                commands.append(contentsOf: resourceCommands.sorted())
+                resourceCommands.removeAll()
+                commands.append("\(command)")
+            }
+        }
+        commands.append(contentsOf: resourceCommands.sorted())
+        return commands
+    }
+
+    func testConcurrentPartitionsMatchSerialGeneration() {
+        let renderGraph = RenderGraph(inflightFrameCount: 1)
+        let commandGenerator = (renderGraph.context as! RenderGraphContextImpl<HeadlessBackend>).commandGenerator
+
+        // The first frame initialises the persistent buffers, so only the frames after it are comparable.
+        self.addFrame(to: renderGraph)
+        renderGraph.execute().wait()
+
+        commandGenerator.minimumResourcesPerPartition = .max / 2
+        self.addFrame(to: renderGraph)
+        let serialCommands = self.recordedCommands(executing: renderGraph)
+
+        // With one resource per partition, the resources are split across every thread of the job manager.
+        commandGenerator.minimumResourcesPerPartition = 1
+        self.addFrame(to: renderGraph)
+        let concurrentCommands = self.recordedCommands(executing: renderGraph)
+
+        XCTAssertGreaterThan(RenderGraph.jobManager.threadCount, 1)
+        XCTAssertTrue(serialCommands.contains(where: { $0.hasPrefix("waitForFence") }))
+        XCTAssertEqual(concurrentCommands, serialCommands)
+    }
+
+    static var allTests = [
+        ("testConcurrentPartitionsMatchSerialGeneration", testConcurrentPartitionsMatchSerialGeneration),
+    ]
+}
@@ -0,0 +1,93 @@
+//
+//  TransientAliasingPlannerTests.swift
+//
+//
+
+import XCTest
+@testable import Substrate
+
+class TransientAliasingPlannerTests: XCTestCase {
+    var resources = [Resource]()
+
+    override func setUp() {
+        super.setUp()
+        RenderBackend.initialise(api: .headless, applicationName: "TransientAliasingPlannerTests")
+    }
+
+    override func tearDown() {
+        for resource in self.resources {
+            resource.dispose()
+        }
+        self.resources.removeAll()
+        super.tearDown()
+    }
+
+    /// The planner only uses the resource to identify the lifetime, so any resource will do.
+    func makeLifetime(_ commands: ClosedRange<Int>) -> TransientResourceLifetime {
+        let resource = Resource(Buffer(length: 256, storageMode: .private, usage: .shaderWrite, flags: .persistent))
+        self.resources.append(resource)
+        return TransientResourceLifetime(resource: resource, firstCommandIndex: commands.lowerBound, lastCommandIndex: commands.upperBound)
+    }
+
+    func testOverlappingLifetimesGetDisjointMemory() {
+        let lifetimes = [self.makeLifetime(0...10), self.makeLifetime(5...15)]
+        let requirements = [TransientMemoryRequirements](repeating: TransientMemoryRequirements(size: 256, alignment: 256, memoryClass: 0), count: 2)
+
+        let plan = TransientAliasingPlanner.makePlan(lifetimes: lifetimes, requirements: requirements)
+
+        XCTAssertEqual(plan.blocks.count, 1)
+        XCTAssertFalse(plan.placements[0].overlapsMemory(of: plan.placements[1]))
+        XCTAssertEqual(plan.aliasedSize, 512)
+        XCTAssertEqual(plan.predecessors, [[], []])
+        XCTAssertEqual(plan.isShared, [false, false])
+    }
+
+    func testNonOverlappingLifetimesShareMemory() {
+        let lifetimes = [self.makeLifetime(0...4), self.makeLifetime(5...9), self.makeLifetime(10...14)]
+        let requirements = [TransientMemoryRequirements](repeating: TransientMemoryRequirements(size: 256, alignment: 256, memoryClass: 0), count: 3)
+
+        let plan = TransientAliasingPlanner.makePlan(lifetimes: lifetimes, requirements: requirements)
+
+        XCTAssertEqual(plan.placements.map { $0.offset }, [0, 0, 0])
+        XCTAssertEqual(plan.aliasedSize, 256)
+        XCTAssertEqual(plan.unaliasedSize, 768)
+        XCTAssertEqual(plan.predecessors[0], [])
+        XCTAssertEqual(plan.predecessors[1], [0])
+        XCTAssertEqual(Set(plan.predecessors[2]), [0, 1])
+        XCTAssertEqual(plan.isShared, [true, true, true])
+    }
+
+    func testPlacementRespectsSizeAndAlignment() {
+        let lifetimes = [self.makeLifetime(0...10), self.makeLifetime(0...10), self.makeLifetime(11...20), self.makeLifetime(0...20)]
+        let requirements = [
+            TransientMemoryRequirements(size: 100, alignment: 16, memoryClass: 0),
+            TransientMemoryRequirements(size: 64, alignment: 256, memoryClass: 0),
+            TransientMemoryRequirements(size: 300, alignment: 4, memoryClass: 0),
+            // A different memory class never shares a block, even though it's live at the same time as everything else.
+            TransientMemoryRequirements(size: 128, alignment: 128, memoryClass: 1),
+        ]
+
+        let plan = TransientAliasingPlanner.makePlan(lifetimes: lifetimes, requirements: requirements)
+
+        XCTAssertEqual(plan.blocks.count, 2)
+        XCTAssertEqual(plan.placements[2].offset, 0)
+        XCTAssertEqual(plan.placements[0].offset, 0)
+        // The second resource can't fit before the first, so it goes at the next offset that meets its alignment.
+        XCTAssertEqual(plan.placements[1].offset, 256)
+        XCTAssertEqual(plan.blocks[plan.placements[0].blockIndex].size, 320)
+        XCTAssertEqual(plan.blocks[plan.placements[0].blockIndex].alignment, 256)
+
+        XCTAssertNotEqual(plan.placements[3].blockIndex, plan.placements[0].blockIndex)
+        XCTAssertEqual(plan.placements[3].offset, 0)
+        XCTAssertEqual(plan.blocks[plan.placements[3].blockIndex].size, 128)
+
+        XCTAssertEqual(Set(plan.predecessors[2]), [0, 1])
+        XCTAssertEqual(plan.isShared, [true, true, true, false])
+    }
+
+    static var allTests = [
+        ("testOverlappingLifetimesGetDisjointMemory", testOverlappingLifetimesGetDisjointMemory),
+        ("testNonOverlappingLifetimesShareMemory", testNonOverlappingLifetimesShareMemory),
+        ("testPlacementRespectsSizeAndAlignment", testPlacementRespectsSizeAndAlignment),
+    ]
+}
@@ -0,0 +1,30 @@
+//
+//  VulkanPipelineCacheTests.swift
+//
+//
+
+import XCTest
+#if canImport(Vulkan)
+import Vulkan
+#endif
+@testable import Substrate
+
+class VulkanPipelineCacheTests: XCTestCase {
+    func testPrewarmedComputePipelineIsFoundForDispatch() {
+        #if canImport(Vulkan)
+        // The layout is only compared, never used, so any non-null handle will do.
+        let layout = VkPipelineLayout(bitPattern: 0x10)!
+        let prewarmed = VulkanComputePipelineDescriptor(descriptor: ComputePipelineDescriptor(function: "update"), layout: layout, threadsPerThreadgroup: Size(width: 0, height: 0, depth: 0))
+        let dispatched = VulkanComputePipelineDescriptor(descriptor: ComputePipelineDescriptor(function: "update"), layout: layout, threadsPerThreadgroup: Size(width: 32, height: 1, depth: 1))
+        let otherFunction = VulkanComputePipelineDescriptor(descriptor: ComputePipelineDescriptor(function: "resolve"), layout: layout, threadsPerThreadgroup: Size(width: 32, height: 1, depth: 1))
+
+        let pipelines = [prewarmed : 1]
+        XCTAssertEqual(pipelines[dispatched], 1)
+        XCTAssertNil(pipelines[otherFunction])
+        #endif
+    }
+
+    static var allTests = [
+        ("testPrewarmedComputePipelineIsFoundForDispatch", testPrewarmedComputePipelineIsFoundForDispatch),
+    ]
+}
@@ -0,0 +1,65 @@
+//
+//  ChunkArrayTests.swift
+//
+//
+
+import XCTest
+@testable import SubstrateUtilities
+
+class ChunkArrayTests: XCTestCase {
+    static let tag : TaggedHeap.Tag = 0x43484B41 // "CHKA"
+
+    override func tearDown() {
+        TaggedHeap.free(tag: ChunkArrayTests.tag)
+        super.tearDown()
+    }
+
+    func testAppendAndIndex() {
+        let allocator = AllocatorType.tagThreadView(TagAllocator.ThreadView(allocator: TagAllocator(tag: ChunkArrayTests.tag, threadCount: 1), threadIndex: 0))
+
+        var array = ChunkArray<Int>()
+        for i in 0..<10_000 {
+            array.append(i, allocator: allocator)
+            XCTAssertEqual(array.last, i)
+        }
+        XCTAssertEqual(array.count, 10_000)
+
+        for i in stride(from: 9_999, through: 0, by: -7) {
+            XCTAssertEqual(array[i], i)
+        }
+        XCTAssertEqual(Array(array), Array(0..<10_000))
+
+        var chunkElements = [Int]()
+        var chunkCount = 0
+        array.withContiguousChunks { chunk in
+            chunkElements.append(contentsOf: chunk)
+            chunkCount += 1
+        }
+        XCTAssertEqual(chunkElements, Array(0..<10_000))
+        XCTAssertEqual(chunkCount, ChunkArray<Int>.chunkIndex(for: 9_999) + 1)
+    }
+
+    func testRemoveAndReuse() {
+        let allocator = AllocatorType.tagThreadView(TagAllocator.ThreadView(allocator: TagAllocator(tag: ChunkArrayTests.tag, threadCount: 1), threadIndex: 0))
+
+        var array = ChunkArray<Int>()
+        for i in 0..<100 {
+            array.append(i, allocator: allocator)
+        }
+
+        XCTAssertEqual(array.removeBySwappingWithBack(index: 10, allocator: allocator), 10)
+        XCTAssertEqual(array[10], 99)
+        for _ in 0..<50 {
+            array.removeLast(allocator: allocator)
+        }
+        XCTAssertEqual(array.count, 49)
+
+        for i in 0..<60 {
+            array.append(1_000 + i, allocator: allocator)
+        }
+        XCTAssertEqual(array.count, 109)
+        XCTAssertEqual(array[49], 1_000)
+        XCTAssertEqual(array.last, 1_059)
+        XCTAssertEqual(Array(array).count, 109)
+    }
+}
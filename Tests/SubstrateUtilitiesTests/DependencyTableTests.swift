@@ -22,4 +22,19 @@ class MatrixTests: XCTestCase {
         XCTAssertTrue(matrix.dependency(from: 3, on: 2))
         XCTAssertFalse(matrix.dependency(from: 3, on: 0))
     }
+    
+    func testSparseDependencyTable() {
+        var table = SparseDependencyTable<Int>()
+        table.appendRow(dependencies: EmptyCollection())
+        table.appendRow(dependencies: [(index: 0, value: 1)])
+        table.appendRow(dependencies: [(index: 1, value: 2), (index: 0, value: 3)])
+        table.appendRow(dependencies: [(index: 2, value: 4)])
+        
+        XCTAssertEqual(table.capacity, 4)
+        XCTAssertTrue(table.dependencies(of: 0).isEmpty)
+        XCTAssertEqual(table.dependency(from: 1, on: 0), 1)
+        XCTAssertEqual(table.dependencies(of: 2).map { $0.index }, [1, 0])
+        XCTAssertEqual(table.dependency(from: 2, on: 0), 3)
+        XCTAssertNil(table.dependency(from: 3, on: 0))
+    }
 }
@@ -0,0 +1,382 @@
+//
+//  HashTableTests.swift
+//
+//
+
+import XCTest
+@testable import SubstrateUtilities
+
+class HashTableTests: XCTestCase {
+    /// Mirrors the layout of render graph resource handles: the resource type in the top bits and a sequential index in the low bits.
+    struct ResourceHandleKey : CustomHashable, Hashable {
+        var handle : UInt64
+
+        init(index: Int) {
+            self.handle = (UInt64(1 + index % 4) << 56) | UInt64(index)
+        }
+
+        var customHashValue : Int {
+            return Int(truncatingIfNeeded: self.handle)
+        }
+    }
+
+    final class Object {}
+
+    static let keyCount = 50_000
+
+    func testHashSetMatchesSet() {
+        var hashSet = HashSet<ResourceHandleKey>()
+        defer { hashSet.deinit() }
+        var reference = Set<ResourceHandleKey>()
+
+        // Interleave insertions and removals so that the table accumulates deleted buckets and has to rehash in place.
+        var generator = SystemRandomNumberGenerator()
+        for _ in 0..<100_000 {
+            let key = ResourceHandleKey(index: Int.random(in: 0..<2_000, using: &generator))
+            if Bool.random(using: &generator) {
+                XCTAssertEqual(hashSet.insert(key).inserted, reference.insert(key).inserted)
+            } else {
+                XCTAssertEqual(hashSet.remove(key), reference.remove(key) != nil)
+            }
+            XCTAssertEqual(hashSet.count, reference.count)
+        }
+
+        for i in 0..<2_000 {
+            let key = ResourceHandleKey(index: i)
+            XCTAssertEqual(hashSet.contains(key: key), reference.contains(key))
+        }
+        XCTAssertEqual(Set(hashSet), reference)
+    }
+
+    func testHashMapOperations() {
+        var hashMap = HashMap<ResourceHandleKey, Int>()
+        defer { hashMap.deinit() }
+
+        for i in 0..<1_000 {
+            hashMap[ResourceHandleKey(index: i)] = i
+        }
+        XCTAssertEqual(hashMap.count, 1_000)
+
+        for i in stride(from: 0, to: 1_000, by: 2) {
+            XCTAssertEqual(hashMap.removeValue(forKey: ResourceHandleKey(index: i)), i)
+        }
+        XCTAssertEqual(hashMap.count, 500)
+
+        for i in 0..<1_000 {
+            XCTAssertEqual(hashMap[ResourceHandleKey(index: i)], i % 2 == 0 ? nil : i)
+        }
+
+        // Reinserting at the index a key was removed from, as ResourceBindingEncoder does when rebinding.
+        let key = ResourceHandleKey(index: 1)
+        let index = hashMap.find(key: key)!
+        XCTAssertEqual(hashMap.removeValue(at: index), 1)
+        hashMap.insertAtIndex(index, key: key, value: 10)
+        XCTAssertEqual(hashMap[key], 10)
+
+        let added = hashMap.withValue(forKey: ResourceHandleKey(index: 2_000), perform: { value, isInitialised -> Bool in
+            if !isInitialised { value.initialize(to: 2_000) }
+            return !isInitialised
+        })
+        XCTAssertTrue(added)
+        XCTAssertEqual(hashMap[ResourceHandleKey(index: 2_000)], 2_000)
+        XCTAssertEqual(hashMap.count, 501)
+
+        hashMap.forEachMutating { key, value, deleteEntry in
+            deleteEntry = key.handle & 0b10 != 0
+        }
+        XCTAssertFalse(hashMap.contains(where: { $0.0.handle & 0b10 != 0 }))
+
+        hashMap.removeAll()
+        XCTAssertTrue(hashMap.isEmpty)
+        XCTAssertNil(hashMap[ResourceHandleKey(index: 3)])
+        hashMap[ResourceHandleKey(index: 3)] = 3
+        XCTAssertEqual(hashMap[ResourceHandleKey(index: 3)], 3)
+    }
+
+    // MARK: - Benchmarks
+    // These compare HashSet against the previous linear-probing table with unmixed hashes, for pointer keys and resource handle keys.
+
+    static func makeObjectKeys() -> (objects: [Object], keys: [ObjectIdentifier], missingKeys: [ObjectIdentifier]) {
+        let objects = (0..<(2 * HashTableTests.keyCount)).map { _ in Object() }
+        let keys = objects.prefix(HashTableTests.keyCount).map { ObjectIdentifier($0) }
+        let missingKeys = objects.suffix(HashTableTests.keyCount).map { ObjectIdentifier($0) }
+        return (objects, keys, missingKeys)
+    }
+
+    static func makeHandleKeys() -> (keys: [ResourceHandleKey], missingKeys: [ResourceHandleKey]) {
+        let keys = (0..<HashTableTests.keyCount).map { ResourceHandleKey(index: $0) }
+        let missingKeys = (HashTableTests.keyCount..<(2 * HashTableTests.keyCount)).map { ResourceHandleKey(index: $0) }
+        return (keys, missingKeys)
+    }
+
+    func measureInsert<T: BenchmarkHashSet>(_: T.Type, keys: [T.Key]) {
+        measure {
+            var set = T()
+            for key in keys {
+                set.benchmarkInsert(key)
+            }
+            XCTAssertEqual(set.count, keys.count)
+            set.deinit()
+        }
+    }
+
+    func measureFind<T: BenchmarkHashSet>(_: T.Type, keys: [T.Key], lookupKeys: [T.Key], expectFound: Bool) {
+        var set = T()
+        defer { set.deinit() }
+        for key in keys {
+            set.benchmarkInsert(key)
+        }
+        measure {
+            var foundCount = 0
+            for _ in 0..<4 {
+                for key in lookupKeys where set.benchmarkContains(key) {
+                    foundCount += 1
+                }
+            }
+            XCTAssertEqual(foundCount, expectFound ? 4 * lookupKeys.count : 0)
+        }
+    }
+
+    func measureErase<T: BenchmarkHashSet>(_: T.Type, keys: [T.Key]) {
+        measure {
+            var set = T()
+            for key in keys {
+                set.benchmarkInsert(key)
+            }
+            for key in keys {
+                set.benchmarkRemove(key)
+            }
+            XCTAssertEqual(set.count, 0)
+            set.deinit()
+        }
+    }
+
+    func testInsertPointerKeysPerformance() {
+        let (objects, keys, _) = HashTableTests.makeObjectKeys()
+        withExtendedLifetime(objects) { self.measureInsert(HashSet<ObjectIdentifier>.self, keys: keys) }
+    }
+
+    func testInsertPointerKeysLinearProbingPerformance() {
+        let (objects, keys, _) = HashTableTests.makeObjectKeys()
+        withExtendedLifetime(objects) { self.measureInsert(LinearProbingHashSet<ObjectIdentifier>.self, keys: keys) }
+    }
+
+    func testInsertHandleKeysPerformance() {
+        self.measureInsert(HashSet<ResourceHandleKey>.self, keys: HashTableTests.makeHandleKeys().keys)
+    }
+
+    func testInsertHandleKeysLinearProbingPerformance() {
+        self.measureInsert(LinearProbingHashSet<ResourceHandleKey>.self, keys: HashTableTests.makeHandleKeys().keys)
+    }
+
+    func testFindHitPointerKeysPerformance() {
+        let (objects, keys, _) = HashTableTests.makeObjectKeys()
+        withExtendedLifetime(objects) { self.measureFind(HashSet<ObjectIdentifier>.self, keys: keys, lookupKeys: keys, expectFound: true) }
+    }
+
+    func testFindHitPointerKeysLinearProbingPerformance() {
+        let (objects, keys, _) = HashTableTests.makeObjectKeys()
+        withExtendedLifetime(objects) { self.measureFind(LinearProbingHashSet<ObjectIdentifier>.self, keys: keys, lookupKeys: keys, expectFound: true) }
+    }
+
+    func testFindMissPointerKeysPerformance() {
+        let (objects, keys, missingKeys) = HashTableTests.makeObjectKeys()
+        withExtendedLifetime(objects) { self.measureFind(HashSet<ObjectIdentifier>.self, keys: keys, lookupKeys: missingKeys, expectFound: false) }
+    }
+
+    func testFindMissPointerKeysLinearProbingPerformance() {
+        let (objects, keys, missingKeys) = HashTableTests.makeObjectKeys()
+        withExtendedLifetime(objects) { self.measureFind(LinearProbingHashSet<ObjectIdentifier>.self, keys: keys, lookupKeys: missingKeys, expectFound: false) }
+    }
+
+    func testFindHitHandleKeysPerformance() {
+        let keys = HashTableTests.makeHandleKeys().keys
+        self.measureFind(HashSet<ResourceHandleKey>.self, keys: keys, lookupKeys: keys, expectFound: true)
+    }
+
+    func testFindHitHandleKeysLinearProbingPerformance() {
+        let keys = HashTableTests.makeHandleKeys().keys
+        self.measureFind(LinearProbingHashSet<ResourceHandleKey>.self, keys: keys, lookupKeys: keys, expectFound: true)
+    }
+
+    func testFindMissHandleKeysPerformance() {
+        let (keys, missingKeys) = HashTableTests.makeHandleKeys()
+        self.measureFind(HashSet<ResourceHandleKey>.self, keys: keys, lookupKeys: missingKeys, expectFound: false)
+    }
+
+    func testFindMissHandleKeysLinearProbingPerformance() {
+        let (keys, missingKeys) = HashTableTests.makeHandleKeys()
+        self.measureFind(LinearProbingHashSet<ResourceHandleKey>.self, keys: keys, lookupKeys: missingKeys, expectFound: false)
+    }
+
+    func testErasePointerKeysPerformance() {
+        let (objects, keys, _) = HashTableTests.makeObjectKeys()
+        withExtendedLifetime(objects) { self.measureErase(HashSet<ObjectIdentifier>.self, keys: keys) }
+    }
+
+    func testErasePointerKeysLinearProbingPerformance() {
+        let (objects, keys, _) = HashTableTests.makeObjectKeys()
+        withExtendedLifetime(objects) { self.measureErase(LinearProbingHashSet<ObjectIdentifier>.self, keys: keys) }
+    }
+
+    func testEraseHandleKeysPerformance() {
+        self.measureErase(HashSet<ResourceHandleKey>.self, keys: HashTableTests.makeHandleKeys().keys)
+    }
+
+    func testEraseHandleKeysLinearProbingPerformance() {
+        self.measureErase(LinearProbingHashSet<ResourceHandleKey>.self, keys: HashTableTests.makeHandleKeys().keys)
+    }
+}
+
+protocol BenchmarkHashSet {
+    associatedtype Key : CustomHashable
+    init()
+    var count : Int { get }
+    func benchmarkContains(_ key: Key) -> Bool
+    mutating func benchmarkInsert(_ key: Key)
+    mutating func benchmarkRemove(_ key: Key)
+    func `deinit`()
+}
+
+extension HashSet : BenchmarkHashSet {
+    init() {
+        self.init(allocator: .system)
+    }
+
+    func benchmarkContains(_ key: K) -> Bool {
+        return self.contains(key: key)
+    }
+
+    mutating func benchmarkInsert(_ key: K) {
+        self.insert(key)
+    }
+
+    mutating func benchmarkRemove(_ key: K) {
+        self.remove(key)
+    }
+}
+
+/// The linear-probing table HashSet used before it became a Swiss table, kept as a benchmark baseline.
+struct LinearProbingHashSet<K : CustomHashable> : BenchmarkHashSet {
+    static var inactive : UInt8 { 0 }
+    static var active : UInt8 { 1 }
+    static var filled : UInt8 { 2 }
+
+    var states : UnsafeMutablePointer<UInt8>! = nil
+    var keys : UnsafeMutablePointer<K>! = nil
+    var bucketCount = 0
+    var count = 0
+    var maxProbeLength = -1
+    var mask = 0
+
+    init() {}
+
+    func `deinit`() {
+        for bucket in 0..<self.bucketCount where self.states[bucket] == Self.filled {
+            self.keys.advanced(by: bucket).deinitialize(count: 1)
+        }
+        if self.bucketCount > 0 {
+            self.states.deallocate()
+            self.keys.deallocate()
+        }
+    }
+
+    func findFilledBucket(_ key: K) -> Int {
+        if self.count == 0 { return -1 }
+        let hashValue = key.customHashValue
+        for offset in 0...self.maxProbeLength {
+            let bucket = (hashValue &+ offset) & self.mask
+            if self.states[bucket] == Self.filled {
+                if self.keys[bucket] == key {
+                    return bucket
+                }
+            } else if self.states[bucket] == Self.inactive {
+                return -1
+            }
+        }
+        return -1
+    }
+
+    func benchmarkContains(_ key: K) -> Bool {
+        return self.findFilledBucket(key) != -1
+    }
+
+    mutating func findEmptyBucket(_ key: K) -> Int {
+        let hashValue = key.customHashValue
+        var offset = 0
+        while true {
+            let bucket = (hashValue &+ offset) & self.mask
+            if self.states[bucket] != Self.filled {
+                self.maxProbeLength = max(self.maxProbeLength, offset)
+                return bucket
+            }
+            offset += 1
+        }
+    }
+
+    mutating func reserveCapacity(_ capacity: Int) {
+        let requiredBucketCount = capacity + capacity/2 + 1
+        if requiredBucketCount <= self.bucketCount { return }
+
+        var bucketCount = 4
+        while bucketCount < requiredBucketCount {
+            bucketCount <<= 1
+        }
+
+        let oldBucketCount = self.bucketCount
+        let oldStates = self.states
+        let oldKeys = self.keys
+
+        self.bucketCount = bucketCount
+        self.mask = bucketCount - 1
+        self.states = .allocate(capacity: bucketCount)
+        self.states.initialize(repeating: Self.inactive, count: bucketCount)
+        self.keys = .allocate(capacity: bucketCount)
+        self.maxProbeLength = -1
+
+        for sourceBucket in 0..<oldBucketCount where oldStates![sourceBucket] == Self.filled {
+            let key = oldKeys!.advanced(by: sourceBucket).move()
+            let bucket = self.findEmptyBucket(key)
+            self.states[bucket] = Self.filled
+            self.keys.advanced(by: bucket).initialize(to: key)
+        }
+
+        if oldBucketCount > 0 {
+            oldStates!.deallocate()
+            oldKeys!.deallocate()
+        }
+    }
+
+    mutating func benchmarkInsert(_ key: K) {
+        self.reserveCapacity(self.count + 1)
+
+        let hashValue = key.customHashValue
+        var hole = -1
+        var offset = 0
+        while offset <= self.maxProbeLength {
+            defer { offset += 1 }
+            let bucket = (hashValue &+ offset) & self.mask
+            if self.states[bucket] == Self.filled {
+                if self.keys[bucket] == key { return }
+            } else if self.states[bucket] == Self.inactive {
+                hole = hole == -1 ? bucket : hole
+                break
+            } else if hole == -1 {
+                hole = bucket
+            }
+        }
+        let bucket = hole != -1 ? hole : self.findEmptyBucket(key)
+        self.states[bucket] = Self.filled
+        self.keys.advanced(by: bucket).initialize(to: key)
+        self.count += 1
+    }
+
+    mutating func benchmarkRemove(_ key: K) {
+        let bucket = self.findFilledBucket(key)
+        if bucket != -1 {
+            self.states[bucket] = Self.active
+            self.keys.advanced(by: bucket).deinitialize(count: 1)
+            self.count -= 1
+        }
+    }
+}
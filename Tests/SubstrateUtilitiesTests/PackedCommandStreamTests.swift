@@ -0,0 +1,171 @@
+//
+//  PackedCommandStreamTests.swift
+//
+//
+
+import XCTest
+import Foundation
+@testable import SubstrateUtilities
+
+class PackedCommandStreamTests: XCTestCase {
+    typealias DrawArgs = (vertexStart: UInt32, vertexCount: UInt32, instanceCount: UInt32, baseInstance: UInt32)
+    typealias CopyArgs = (source: UInt64, sourceOffset: UInt32, destination: UInt64, destinationOffset: UInt32, size: UInt32)
+
+    enum TestCommand {
+        case draw(UnsafePointer<DrawArgs>)
+        case copy(UnsafePointer<CopyArgs>)
+        case setValue(UInt32)
+        case label(UnsafePointer<CChar>)
+    }
+
+    static let tag : TaggedHeap.Tag = 0x50434D53 // "PCMS"
+    static let commandCount = 100_000
+
+    override func tearDown() {
+        TaggedHeap.free(tag: PackedCommandStreamTests.tag)
+        super.tearDown()
+    }
+
+    func testRoundTrip() {
+        let allocator = AllocatorType.tagThreadView(TagAllocator.ThreadView(allocator: TagAllocator(tag: PackedCommandStreamTests.tag, threadCount: 1), threadIndex: 0))
+
+        var stream = PackedCommandStream<TestCommand>()
+        for i in 0..<10_000 {
+            switch i % 4 {
+            case 0:
+                stream.append(TestCommand.draw, payload: (UInt32(i), 3, 1, 0), allocator: allocator)
+            case 1:
+                stream.append(TestCommand.copy, payload: (UInt64(i), 0, UInt64(i + 1), 16, 256), allocator: allocator)
+            case 2:
+                stream.append(.setValue(UInt32(i)), allocator: allocator)
+            default:
+                let label = "Command \(i)"
+                label.withCString { cString in
+                    let length = strlen(cString) + 1
+                    stream.append(payloadByteCount: length, alignment: 1, allocator: allocator) { payload in
+                        payload.copyMemory(from: cString, byteCount: length)
+                        return .label(UnsafePointer(payload.assumingMemoryBound(to: CChar.self)))
+                    }
+                }
+            }
+        }
+
+        XCTAssertEqual(stream.count, 10_000)
+
+        var index = 0
+        for command in stream {
+            switch command {
+            case .draw(let args):
+                XCTAssertEqual(index % 4, 0)
+                XCTAssertEqual(args.pointee.vertexStart, UInt32(index))
+                XCTAssertEqual(args.pointee.vertexCount, 3)
+            case .copy(let args):
+                XCTAssertEqual(index % 4, 1)
+                XCTAssertEqual(args.pointee.source, UInt64(index))
+                XCTAssertEqual(args.pointee.destination, UInt64(index + 1))
+                XCTAssertEqual(args.pointee.size, 256)
+            case .setValue(let value):
+                XCTAssertEqual(index % 4, 2)
+                XCTAssertEqual(value, UInt32(index))
+            case .label(let label):
+                XCTAssertEqual(index % 4, 3)
+                XCTAssertEqual(String(cString: label), "Command \(index)")
+            }
+            index += 1
+        }
+        XCTAssertEqual(index, 10_000)
+    }
+
+    func testEmptyStream() {
+        let stream = PackedCommandStream<TestCommand>()
+        XCTAssertTrue(stream.isEmpty)
+        var iterator = stream.makeIterator()
+        XCTAssertNil(iterator.next())
+    }
+
+    // MARK: - Benchmarks
+    // These compare the packed stream against recording into a ChunkArray with each payload copied into a separate allocation.
+
+    static func copyData<T>(_ data: T, allocator: AllocatorType) -> UnsafePointer<T> {
+        let result = Allocator.allocate(type: T.self, capacity: 1, allocator: allocator)
+        result.initialize(to: data)
+        return UnsafePointer(result)
+    }
+
+    static func recordPackedStream(allocator: AllocatorType) -> PackedCommandStream<TestCommand> {
+        var stream = PackedCommandStream<TestCommand>()
+        for i in 0..<PackedCommandStreamTests.commandCount {
+            if i & 1 == 0 {
+                stream.append(TestCommand.draw, payload: (UInt32(i), 3, 1, 0), allocator: allocator)
+            } else {
+                stream.append(TestCommand.copy, payload: (UInt64(i), 0, UInt64(i + 1), 16, 256), allocator: allocator)
+            }
+        }
+        return stream
+    }
+
+    static func recordChunkArray(allocator: AllocatorType) -> ChunkArray<TestCommand> {
+        var commands = ChunkArray<TestCommand>()
+        for i in 0..<PackedCommandStreamTests.commandCount {
+            if i & 1 == 0 {
+                commands.append(.draw(copyData((UInt32(i), 3, 1, 0) as DrawArgs, allocator: allocator)), allocator: allocator)
+            } else {
+                commands.append(.copy(copyData((UInt64(i), 0, UInt64(i + 1), 16, 256) as CopyArgs, allocator: allocator)), allocator: allocator)
+            }
+        }
+        return commands
+    }
+
+    static func replay<S: Sequence>(_ commands: S) -> UInt64 where S.Element == TestCommand {
+        var checksum : UInt64 = 0
+        for command in commands {
+            switch command {
+            case .draw(let args):
+                checksum &+= UInt64(args.pointee.vertexStart) &+ UInt64(args.pointee.vertexCount)
+            case .copy(let args):
+                checksum &+= args.pointee.source &+ UInt64(args.pointee.size)
+            case .setValue(let value):
+                checksum &+= UInt64(value)
+            case .label:
+                break
+            }
+        }
+        return checksum
+    }
+
+    func testRecordPackedStreamPerformance() {
+        measure {
+            let allocator = AllocatorType.tagThreadView(TagAllocator.ThreadView(allocator: TagAllocator(tag: PackedCommandStreamTests.tag, threadCount: 1), threadIndex: 0))
+            let stream = PackedCommandStreamTests.recordPackedStream(allocator: allocator)
+            XCTAssertEqual(stream.count, PackedCommandStreamTests.commandCount)
+            TaggedHeap.free(tag: PackedCommandStreamTests.tag)
+        }
+    }
+
+    func testRecordChunkArrayPerformance() {
+        measure {
+            let allocator = AllocatorType.tagThreadView(TagAllocator.ThreadView(allocator: TagAllocator(tag: PackedCommandStreamTests.tag, threadCount: 1), threadIndex: 0))
+            let commands = PackedCommandStreamTests.recordChunkArray(allocator: allocator)
+            XCTAssertEqual(commands.count, PackedCommandStreamTests.commandCount)
+            TaggedHeap.free(tag: PackedCommandStreamTests.tag)
+        }
+    }
+
+    func testReplayPackedStreamPerformance() {
+        let allocator = AllocatorType.tagThreadView(TagAllocator.ThreadView(allocator: TagAllocator(tag: PackedCommandStreamTests.tag, threadCount: 1), threadIndex: 0))
+        let stream = PackedCommandStreamTests.recordPackedStream(allocator: allocator)
+        let expected = PackedCommandStreamTests.replay(stream)
+        measure {
+            XCTAssertEqual(PackedCommandStreamTests.replay(stream), expected)
+        }
+    }
+
+    func testReplayChunkArrayPerformance() {
+        let allocator = AllocatorType.tagThreadView(TagAllocator.ThreadView(allocator: TagAllocator(tag: PackedCommandStreamTests.tag, threadCount: 1), threadIndex: 0))
+        let commands = PackedCommandStreamTests.recordChunkArray(allocator: allocator)
+        let expected = PackedCommandStreamTests.replay(commands)
+        measure {
+            XCTAssertEqual(PackedCommandStreamTests.replay(commands), expected)
+        }
+    }
+}
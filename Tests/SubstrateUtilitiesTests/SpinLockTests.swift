@@ -0,0 +1,86 @@
+//
+//  SpinLockTests.swift
+//
+//
+
+import XCTest
+import Foundation
+@testable import SubstrateUtilities
+
+class SpinLockTests: XCTestCase {
+    func testMutualExclusionUnderContention() {
+        let lock = SpinLock(name: "SpinLockTests")
+        defer { lock.deinit() }
+
+        let threadCount = ProcessInfo.processInfo.activeProcessorCount
+        let incrementsPerThread = 10_000
+        var counter = 0
+
+        withUnsafeMutablePointer(to: &counter) { counter in
+            DispatchQueue.concurrentPerform(iterations: threadCount) { _ in
+                for _ in 0..<incrementsPerThread {
+                    lock.withLock {
+                        counter.pointee += 1
+                    }
+                }
+            }
+        }
+
+        XCTAssertEqual(counter, threadCount * incrementsPerThread)
+        XCTAssertFalse(lock.isLocked)
+    }
+
+    func testStatisticsAreRecordedForNamedLocks() {
+        let lock = SpinLock(name: "SpinLockTests.Statistics")
+        defer { lock.deinit() }
+        SpinLock.resetStatistics()
+
+        for _ in 0..<10 {
+            lock.lock()
+            lock.unlock()
+        }
+
+        #if SUBSTRATE_LOCK_INSTRUMENTATION
+        let statistics = SpinLock.statistics.first(where: { $0.name == "SpinLockTests.Statistics" })
+        XCTAssertEqual(statistics?.acquireCount, 10)
+        XCTAssertEqual(statistics?.contendedAcquireCount, 0)
+        XCTAssertEqual(statistics?.parkCount, 0)
+        #else
+        XCTAssertTrue(SpinLock.statistics.isEmpty)
+        #endif
+    }
+
+    func testShortCriticalSectionsRarelyPark() {
+        let lock = SpinLock(name: "SpinLockTests.ShortCriticalSections")
+        defer { lock.deinit() }
+        SpinLock.resetStatistics()
+
+        // Keep to one thread per core so that the lock holder is rarely preempted.
+        let threadCount = min(4, ProcessInfo.processInfo.activeProcessorCount)
+        let incrementsPerThread = 100_000
+        var counter = 0
+
+        measure {
+            withUnsafeMutablePointer(to: &counter) { counter in
+                DispatchQueue.concurrentPerform(iterations: threadCount) { _ in
+                    for _ in 0..<incrementsPerThread {
+                        lock.withLock {
+                            counter.pointee &+= 1
+                        }
+                    }
+                }
+            }
+        }
+
+        #if SUBSTRATE_LOCK_INSTRUMENTATION
+        // The lock is held for much less time than the spin phase lasts, so contended acquires should almost always
+        // succeed while spinning rather than parking.
+        let statistics = SpinLock.statistics.first(where: { $0.name == "SpinLockTests.ShortCriticalSections" })
+        XCTAssertNotNil(statistics)
+        if let statistics = statistics {
+            XCTAssertLessThanOrEqual(statistics.parkCount * 100, statistics.contendedAcquireCount, "\(statistics)")
+        }
+        #endif
+        XCTAssertFalse(lock.isLocked)
+    }
+}
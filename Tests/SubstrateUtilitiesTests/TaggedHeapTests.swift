@@ -0,0 +1,149 @@
+//
+//  TaggedHeapTests.swift
+//
+//
+
+import XCTest
+import Foundation
+@testable import SubstrateUtilities
+
+class TaggedHeapTests: XCTestCase {
+    static let tagA : TaggedHeap.Tag = 0x54484541 // "THEA"
+    static let tagB : TaggedHeap.Tag = 0x54484542 // "THEB"
+    static let blockSize = 64 * 1024
+
+    override func setUp() {
+        super.setUp()
+        TaggedHeap.initialise(strategy: .suballocate(capacity: 200 * TaggedHeapTests.blockSize, blockSize: TaggedHeapTests.blockSize))
+    }
+
+    override func tearDown() {
+        TaggedHeap.initialise(strategy: .allocatePerBlock())
+        super.tearDown()
+    }
+
+    func testFreedRunsAreReused() {
+        let first = TaggedHeap.allocateBlocks(tag: TaggedHeapTests.tagA, count: 3)
+        let second = TaggedHeap.allocateBlocks(tag: TaggedHeapTests.tagB, count: 1)
+        XCTAssertEqual(second - first, 3 * TaggedHeapTests.blockSize)
+
+        TaggedHeap.free(tag: TaggedHeapTests.tagA)
+        XCTAssertEqual(TaggedHeap.allocateBlocks(tag: TaggedHeapTests.tagA, count: 1), first)
+        // The cached three-block run is no longer entirely free, so the search should skip past it.
+        XCTAssertEqual(TaggedHeap.allocateBlocks(tag: TaggedHeapTests.tagA, count: 3), second + TaggedHeapTests.blockSize)
+        XCTAssertEqual(TaggedHeap.allocateBlocks(tag: TaggedHeapTests.tagA, count: 2), first + TaggedHeapTests.blockSize)
+
+        XCTAssertEqual(TaggedHeap.tag(for: first), TaggedHeapTests.tagA)
+        XCTAssertEqual(TaggedHeap.tag(for: second), TaggedHeapTests.tagB)
+    }
+
+    func testRunsSpanningWords() {
+        var pointers = [UnsafeMutableRawPointer]()
+        for _ in 0..<60 {
+            pointers.append(TaggedHeap.allocateBlocks(tag: TaggedHeapTests.tagA, count: 1))
+        }
+        let run = TaggedHeap.allocateBlocks(tag: TaggedHeapTests.tagB, count: 10)
+        XCTAssertEqual(run - pointers[0], 60 * TaggedHeapTests.blockSize)
+        XCTAssertTrue(TaggedHeap.tagMatches(TaggedHeapTests.tagB, pointer: run + 9 * TaggedHeapTests.blockSize))
+        XCTAssertFalse(TaggedHeap.tagMatches(TaggedHeapTests.tagA, pointer: run))
+    }
+
+    func testGrowthKeepsExistingAllocations() {
+        let first = TaggedHeap.allocateBlocks(tag: TaggedHeapTests.tagA, count: 150)
+        first.storeBytes(of: 0xDEADBEEF, as: UInt32.self)
+
+        let second = TaggedHeap.allocateBlocks(tag: TaggedHeapTests.tagB, count: 100)
+        XCTAssertEqual(TaggedHeap.capacity, 400 * TaggedHeapTests.blockSize)
+        XCTAssertEqual(first.load(as: UInt32.self), 0xDEADBEEF)
+        XCTAssertEqual(TaggedHeap.tag(for: first), TaggedHeapTests.tagA)
+        XCTAssertEqual(TaggedHeap.tag(for: second), TaggedHeapTests.tagB)
+
+        TaggedHeap.free(tag: TaggedHeapTests.tagA)
+        XCTAssertEqual(TaggedHeap.allocateBlocks(tag: TaggedHeapTests.tagA, count: 150), first)
+    }
+
+    func testConcurrentClaims() {
+        let threadCount = 8
+        let allocationsPerThread = 40
+        var allocations = [[(pointer: UnsafeMutableRawPointer, count: Int)]](repeating: [], count: threadCount)
+
+        allocations.withUnsafeMutableBufferPointer { allocations in
+            DispatchQueue.concurrentPerform(iterations: threadCount) { i in
+                let tag = i % 2 == 0 ? TaggedHeapTests.tagA : TaggedHeapTests.tagB
+                for j in 0..<allocationsPerThread {
+                    let count = j % 5 == 4 ? 3 : 1
+                    allocations[i].append((TaggedHeap.allocateBlocks(tag: tag, count: count), count))
+                }
+            }
+        }
+
+        var blocks = Set<UnsafeMutableRawPointer>()
+        for (i, threadAllocations) in allocations.enumerated() {
+            let tag = i % 2 == 0 ? TaggedHeapTests.tagA : TaggedHeapTests.tagB
+            for allocation in threadAllocations {
+                for block in 0..<allocation.count {
+                    let pointer = allocation.pointer + block * TaggedHeapTests.blockSize
+                    XCTAssertTrue(blocks.insert(pointer).inserted)
+                    XCTAssertEqual(TaggedHeap.tag(for: pointer), tag)
+                }
+            }
+        }
+        XCTAssertEqual(TaggedHeap.statistics.allocatedBlockCount, blocks.count)
+
+        TaggedHeap.free(tag: TaggedHeapTests.tagA)
+        TaggedHeap.free(tag: TaggedHeapTests.tagB)
+        XCTAssertEqual(TaggedHeap.statistics.allocatedBlockCount, 0)
+    }
+
+    func testTagAllocatorClaimsBlocksInBatches() {
+        let allocator = TagAllocator(tag: TaggedHeapTests.tagA, threadCount: 2)
+        for _ in 0..<20 {
+            _ = allocator.allocate(bytes: TaggedHeapTests.blockSize / 2, alignment: 16, threadIndex: 1)
+        }
+        XCTAssertTrue(allocator.isValid)
+        // The header block, then ten blocks used from batches of 1, 2, 4 and 8.
+        XCTAssertEqual(TaggedHeap.statistics(for: TaggedHeapTests.tagA)?.allocatedBlockCount, 16)
+
+        TaggedHeap.free(tag: TaggedHeapTests.tagA)
+        XCTAssertNil(TaggedHeap.tag(for: allocator.memory))
+    }
+
+    func testTagAllocatorResetReleasesCachedBlocks() {
+        var allocator = TagAllocator(tag: TaggedHeapTests.tagA, threadCount: 2)
+        for _ in 0..<20 {
+            _ = allocator.allocate(bytes: TaggedHeapTests.blockSize / 2, alignment: 16, threadIndex: 1)
+        }
+        // The header block, then ten used and five cached blocks from batches of 1, 2, 4 and 8.
+        XCTAssertEqual(TaggedHeap.statistics(for: TaggedHeapTests.tagA)?.allocatedBlockCount, 16)
+
+        allocator.reset()
+        // The five cached blocks are returned to the heap, and the new allocator claims a header block.
+        XCTAssertTrue(allocator.isValid)
+        XCTAssertEqual(TaggedHeap.statistics(for: TaggedHeapTests.tagA)?.allocatedBlockCount, 12)
+        XCTAssertEqual(TaggedHeap.statistics.allocatedBlockCount, 12)
+
+        // Once the tag has been freed, resetting the allocator doesn't release anything twice.
+        TaggedHeap.free(tag: TaggedHeapTests.tagA)
+        _ = TaggedHeap.allocateBlocks(tag: TaggedHeapTests.tagB, count: 4)
+        allocator.reset()
+        XCTAssertEqual(TaggedHeap.statistics(for: TaggedHeapTests.tagB)?.allocatedBlockCount, 4)
+        XCTAssertEqual(TaggedHeap.statistics.allocatedBlockCount, 5)
+    }
+
+    func testHighWaterMarks() {
+        _ = TaggedHeap.allocateBlocks(tag: TaggedHeapTests.tagA, count: 4)
+        _ = TaggedHeap.allocateBlocks(tag: TaggedHeapTests.tagA, count: 2)
+        _ = TaggedHeap.allocateBlocks(tag: TaggedHeapTests.tagB, count: 1)
+        TaggedHeap.free(tag: TaggedHeapTests.tagA)
+        _ = TaggedHeap.allocateBlocks(tag: TaggedHeapTests.tagA, count: 1)
+
+        XCTAssertEqual(TaggedHeap.statistics(for: TaggedHeapTests.tagA)?.allocatedBlockCount, 1)
+        XCTAssertEqual(TaggedHeap.statistics(for: TaggedHeapTests.tagA)?.highWaterBlockCount, 6)
+        XCTAssertEqual(TaggedHeap.statistics.allocatedBlockCount, 2)
+        XCTAssertEqual(TaggedHeap.statistics.highWaterBlockCount, 7)
+
+        TaggedHeap.resetHighWaterMarks()
+        XCTAssertEqual(TaggedHeap.statistics(for: TaggedHeapTests.tagA)?.highWaterBlockCount, 1)
+        XCTAssertEqual(TaggedHeap.statistics.highWaterBlockCount, 2)
+    }
+}